@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include "DS-MandatoryExercise/utils.h"
+#include "DS-MandatoryExercise/keys.h"
+
+/* load generator: runs a workload against the server given by IP_TUPLES & PORT_TUPLES (or SERVERS_TUPLES)
+ * for one value1 size after another, and reports the throughput and the CPU time spent per GB of value1 moved.
+ * server CPU time is read from /proc, so the server must run on the same machine */
+
+#define MAX_SIZES 16
+#define MAX_THREADS 64
+#define MAX_FAILED 16                /* failed operations after which a thread gives up */
+#define BENCH_KEY_BASE 1000000      /* keys used by the benchmark: one per thread from here on */
+#define DEFAULT_SIZES "1024,16384,65536,262144,1048576"
+
+typedef struct {
+    char workload;                  /* GET_VALUE or MODIFY_VALUE */
+    int key;                        /* key the thread works on */
+    size_t size;                    /* value1 bytes */
+    long num_ops;
+    char *value1;                   /* size + 1 bytes */
+    long failed;                    /* failed operations */
+} worker_t;
+
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+
+static double process_cpu(void) {
+    /* CPU time used by this process so far, all threads included */
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (double) (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+           (double) (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+
+static double server_cpu(const int pid) {
+    /* CPU time used by process pid so far; utime & stime are the 12th & 13th fields after the command name */
+    char path[MAX_STR_SIZE], stat[1024];
+    snprintf(path, MAX_STR_SIZE, "/proc/%d/stat", pid);
+
+    FILE *file = fopen(path, "r");
+    if (!file) return -1;
+    size_t len = fread(stat, 1, sizeof(stat) - 1, file);
+    fclose(file);
+    stat[len] = '\0';
+
+    char *fields = strrchr(stat, ')');
+    unsigned long utime, stime;
+    if (!fields || sscanf(fields + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime) != 2)
+        return -1;
+    return (double) (utime + stime) / (double) sysconf(_SC_CLK_TCK);
+}
+
+
+static void *worker(void *args) {
+    worker_t *w = (worker_t *) args;
+    int value2;
+    float value3;
+
+    for (long i = 0; i < w->num_ops; i++) {
+        int result = w->workload == GET_VALUE ? get_value_sized(w->key, w->value1, w->size + 1, &value2, &value3)
+                                              : modify_value(w->key, w->value1, (int) i, 0);
+        /* a server that keeps failing is gone, not busy */
+        if (result == -1 && ++w->failed == MAX_FAILED) break;
+    }
+    return NULL;
+}
+
+
+static int run_size(const char workload, const size_t size, const long total_mb, const int num_threads,
+                    const int server_pid) {
+    worker_t workers[MAX_THREADS];
+    pthread_t threads[MAX_THREADS];
+
+    long num_ops = (long) ((total_mb << 20) / size / num_threads);
+    if (num_ops < 1) num_ops = 1;
+
+    /* every thread gets its own key, holding a value1 of the given size */
+    for (int i = 0; i < num_threads; i++) {
+        workers[i] = (worker_t) {.workload = workload, .key = BENCH_KEY_BASE + i, .size = size, .num_ops = num_ops};
+        workers[i].value1 = malloc(size + 1);
+        if (!workers[i].value1) {
+            perror("Could not allocate value1");
+            for (int j = 0; j < i; j++) free(workers[j].value1);
+            return -1;
+        }
+        for (size_t j = 0; j < size; j++) workers[i].value1[j] = (char) ('a' + (j + i) % 26);
+        workers[i].value1[size] = '\0';
+        if (upsert_value(workers[i].key, workers[i].value1, 0, 0, NULL) == -1) {
+            fprintf(stderr, "Could not store value1 of %zu bytes\n", size);
+            for (int j = 0; j <= i; j++) free(workers[j].value1);
+            return -1;
+        }
+    }
+
+    double server_start = server_pid ? server_cpu(server_pid) : -1;
+    double client_start = process_cpu();
+    double start = now();
+
+    for (int i = 0; i < num_threads; i++) pthread_create(&threads[i], NULL, worker, &workers[i]);
+    for (int i = 0; i < num_threads; i++) pthread_join(threads[i], NULL);
+
+    double seconds = now() - start;
+    double client = process_cpu() - client_start;
+    double server = server_start >= 0 ? server_cpu(server_pid) - server_start : -1;
+
+    long ops = num_ops * num_threads, failed = 0;
+    for (int i = 0; i < num_threads; i++) {
+        failed += workers[i].failed;
+        delete_key(workers[i].key);
+        free(workers[i].value1);
+    }
+    double gb = (double) (ops - failed) * (double) size / (double) (1 << 30);
+
+    printf("%10zu %10ld %8ld %9.3f %10.1f %10.0f", size, ops, failed, seconds, gb * 1024 / seconds, ops / seconds);
+    if (server >= 0) printf(" %14.3f", server / gb);
+    else printf(" %14s", "-");
+    printf(" %14.3f\n", client / gb);
+    return 0;
+}
+
+
+int main(int argc, char **argv) {
+    char workload = GET_VALUE;
+    char sizes_str[MAX_STR_SIZE] = DEFAULT_SIZES;
+    long total_mb = 256;
+    int num_threads = 1, server_pid = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "w:s:n:t:p:")) != -1) {
+        switch (opt) {
+            case 'w':   /* workload */
+                if (!strcmp(optarg, "get")) workload = GET_VALUE;
+                else if (!strcmp(optarg, "set")) workload = MODIFY_VALUE;
+                else {
+                    fprintf(stderr, "Invalid workload: %s\n", optarg); return -1;
+                }
+                break;
+            case 's':   /* value1 sizes */
+                snprintf(sizes_str, MAX_STR_SIZE, "%s", optarg); break;
+            case 'n':   /* MB of value1 moved per size */
+                total_mb = strtol(optarg, NULL, 10); break;
+            case 't':   /* client threads */
+                num_threads = (int) strtol(optarg, NULL, 10); break;
+            case 'p':   /* server PID */
+                server_pid = (int) strtol(optarg, NULL, 10); break;
+            default:
+                fprintf(stderr, "Usage: kvbench [-w get|set] [-s <SIZE,SIZE...>] [-n <MB_PER_SIZE>] [-t <THREADS>] "
+                                "[-p <SERVER_PID>]\n"); return -1;
+        }
+    }
+    if (total_mb < 1 || num_threads < 1 || num_threads > MAX_THREADS) {
+        fprintf(stderr, "Invalid MB per size or number of threads\n"); return -1;
+    }
+
+    size_t sizes[MAX_SIZES];
+    int num_sizes = 0;
+    for (char *size = strtok(sizes_str, ","); size && num_sizes < MAX_SIZES; size = strtok(NULL, ",")) {
+        if ((sizes[num_sizes++] = strtoul(size, NULL, 10)) == 0) {
+            fprintf(stderr, "Invalid value1 size: %s\n", size); return -1;
+        }
+    }
+
+    printf("%10s %10s %8s %9s %10s %10s %14s %14s\n", "size", "ops", "failed", "seconds", "MB/s", "ops/s",
+           "server CPU s/GB", "client CPU s/GB");
+    for (int i = 0; i < num_sizes; i++) {
+        if (run_size(workload, sizes[i], total_mb, num_threads, server_pid) == -1) return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,738 @@
+/* benchmark.h declares the benchmarking framework */
+#include "benchmark/benchmark.h"
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include <string>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+
+extern "C" {
+#include "DS-MandatoryExercise/utils.h"
+#include "DS-MandatoryExercise/netUtils.h"
+#include "DS-MandatoryExercise/dbms/columnTable.h"
+#include "DS-MandatoryExercise/dbms/dbms.h"
+#include "DS-MandatoryExercise/dbms/stringSearch.h"
+}
+
+/* microbenchmarks of the protocol, parsing & DB primitives, run in a temp directory the DB is created in;
+ * results are printed as JSON unless other --benchmark_format is given */
+
+const int VALUE1_LEN = 64;                  /* value1 bytes of every item, except the first one */
+const int TXN_OPS = 4;                      /* sub-operations per transaction */
+const int SCAN_ITEMS = 64;                  /* items read per scan or query page */
+const int CHANGES = 64;                     /* changes read per change feed read */
+
+
+/* protocol & parsing */
+
+static void echo_values(const int socket) {
+    /* sends back every item received, until the socket is closed */
+    arena_t arena;
+    arena_init(&arena);
+    item_t item;
+    while (recv_values(socket, &item, &arena) == 0 && send_values(socket, &item) == 0) arena_reset(&arena);
+    arena_free(&arena);
+}
+
+
+static void BM_send_recv_values(benchmark::State &state) {
+    /* round trip of an item with a value1 of the given length over a socketpair, through an echo thread */
+    int sockets[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == -1) {
+        state.SkipWithError("socketpair failed"); return;
+    }
+    std::thread echo(echo_values, sockets[1]);
+
+    std::string value1((size_t) state.range(0), 'v');
+    item_t item = {};
+    item.value1 = &value1[0];
+    item.value2 = 2;
+    item.value3 = 3.0f;
+    arena_t arena;
+    arena_init(&arena);
+
+    for (auto _ : state) {
+        item_t received;
+        if (send_values(sockets[0], &item) == -1 || recv_values(sockets[0], &received, &arena) == -1) {
+            state.SkipWithError("send_values or recv_values failed"); break;
+        }
+        arena_reset(&arena);
+    }
+    state.SetBytesProcessed(2 * state.iterations() * state.range(0));
+
+    /* the echo thread stops, closing its end, once it can't receive anymore */
+    shutdown(sockets[0], SHUT_RDWR);
+    echo.join();
+    close(sockets[0]);
+    arena_free(&arena);
+}
+BENCHMARK(BM_send_recv_values)->RangeMultiplier(16)->Range(16, VALUE1_DEFAULT_MAX_LEN);
+
+
+static void BM_read_line(benchmark::State &state) {
+    /* reads lines of the given length from a file, starting over at its end */
+    const int num_lines = 1024;
+    char path[] = "lines.XXXXXX";
+    int fd = mkstemp(path);
+    if (fd == -1) {
+        state.SkipWithError("mkstemp failed"); return;
+    }
+    unlink(path);
+
+    std::string line((size_t) state.range(0), 'l');
+    line += '\n';
+    for (int i = 0; i < num_lines; i++) send_msg(fd, &line[0], (int) line.size());
+    lseek(fd, 0, SEEK_SET);
+
+    char buffer[MAX_STR_SIZE];
+    for (auto _ : state) {
+        ssize_t len = read_line(fd, buffer, MAX_STR_SIZE);
+        if (len <= 0) {
+            lseek(fd, 0, SEEK_SET);
+            len = read_line(fd, buffer, MAX_STR_SIZE);
+        }
+        benchmark::DoNotOptimize(len);
+    }
+    state.SetBytesProcessed(state.iterations() * (int64_t) line.size());
+    close(fd);
+}
+BENCHMARK(BM_read_line)->Arg(16)->Arg(128)->Arg(MAX_STR_SIZE - 2);
+
+
+static void BM_str_to_num(benchmark::State &state) {
+    const char type = (char) state.range(0);
+    const char *str = type == INT ? "-1234567" : "-1234.567";
+    int int_value;
+    float float_value;
+    void *value = type == INT ? (void *) &int_value : (void *) &float_value;
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(str_to_num(str, value, type));
+    }
+    state.SetLabel(type == INT ? "int" : "float");
+}
+BENCHMARK(BM_str_to_num)->Arg(INT)->Arg(FLOAT);
+
+
+/* DB: every benchmark runs against a DB of state.range(1) items stored by engine state.range(0);
+ * items have keys 0...num_items - 1, and value2 & value3 equal to their key */
+
+static char db_engine = 0;                  /* engine of the open DB; 0 if none is open */
+static int db_size = 0;                     /* items of the open DB */
+
+
+static int fill_db(const int num_items) {
+    /* item 0 gets a value1 long enough to be left in storage by db_read_item_stored */
+    std::string value1(VALUE1_LEN, 'v'), long_value1(ZERO_COPY_MIN_LEN, 'v');
+    for (int key = 0; key < num_items; key++) {
+        int value2 = key;
+        float value3 = (float) key;
+        if (db_write_item(key, key ? value1.c_str() : long_value1.c_str(), &value2, &value3, CREATE) == -1)
+            return -1;
+    }
+    return 0;
+}
+
+
+static bool prepare_db(benchmark::State &state) {
+    /* opens the DB the benchmark needs, unless it's already open; false if that failed */
+    const char engine = (char) state.range(0);
+    const int num_items = (int) state.range(1);
+    state.SetLabel(std::string(engine == FILE_ENGINE ? "file" : "page") + " engine");
+    if (engine == db_engine && num_items == db_size) return true;
+
+    if (db_engine) {
+        db_empty_db();
+        db_close();
+    }
+    db_engine = 0;
+    if (db_open(NULL, engine, FALSE) == -1 || db_empty_db() == -1 || fill_db(num_items) == -1) {
+        state.SkipWithError("could not prepare DB"); return false;
+    }
+    db_engine = engine;
+    db_size = num_items;
+    return true;
+}
+
+
+static void db_args(benchmark::internal::Benchmark *benchmark) {
+    for (char engine : {FILE_ENGINE, PAGE_ENGINE}) {
+        for (int num_items : {100, 1000, 10000}) benchmark->Args({engine, num_items});
+    }
+}
+
+
+static void db_index_args(benchmark::internal::Benchmark *benchmark) {
+    /* db_args, without & with the value2 index */
+    for (char engine : {FILE_ENGINE, PAGE_ENGINE}) {
+        for (int num_items : {100, 1000, 10000}) {
+            for (int indexed : {FALSE, TRUE}) benchmark->Args({engine, num_items, indexed});
+        }
+    }
+}
+
+
+static void set_index_label(benchmark::State &state) {
+    state.SetLabel(std::string(state.range(0) == FILE_ENGINE ? "file" : "page") + " engine, " +
+                   (state.range(2) ? "indexed" : "not indexed"));
+}
+
+
+static void BM_db_open(benchmark::State &state) {
+    /* closing & opening the DB again, which loads every item */
+    if (!prepare_db(state)) return;
+    for (auto _ : state) {
+        db_close();
+        if (db_open(NULL, db_engine, FALSE) == -1) {
+            db_engine = 0;
+            state.SkipWithError("db_open failed"); break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * db_size);
+}
+BENCHMARK(BM_db_open)->Apply(db_args);
+
+
+static void BM_db_checkpoint(benchmark::State &state) {
+    if (!prepare_db(state)) return;
+    int value2 = 0;
+    float value3 = 0;
+    for (auto _ : state) {
+        /* something to make durable */
+        db_write_item(1, "checkpointed", &value2, &value3, MODIFY);
+        benchmark::DoNotOptimize(db_checkpoint());
+    }
+}
+BENCHMARK(BM_db_checkpoint)->Apply(db_args);
+
+
+static void BM_db_list_items(benchmark::State &state) {
+    /* keys are printed to stdout, which is sent to /dev/null meanwhile */
+    if (!prepare_db(state)) return;
+    fflush(stdout);
+    int saved_stdout = dup(STDOUT_FILENO);
+    int null_fd = open("/dev/null", O_WRONLY);
+    dup2(null_fd, STDOUT_FILENO);
+    close(null_fd);
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(db_list_items());
+        fflush(stdout);
+    }
+
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+    state.SetItemsProcessed(state.iterations() * db_size);
+}
+BENCHMARK(BM_db_list_items)->Apply(db_args);
+
+
+static void BM_db_get_num_items(benchmark::State &state) {
+    if (!prepare_db(state)) return;
+    for (auto _ : state) benchmark::DoNotOptimize(db_get_num_items());
+}
+BENCHMARK(BM_db_get_num_items)->Apply(db_args);
+
+
+static void BM_db_empty_db(benchmark::State &state) {
+    /* emptying the DB; it's filled again, untimed, after every iteration */
+    if (!prepare_db(state)) return;
+    for (auto _ : state) {
+        if (db_empty_db() == -1) {
+            state.SkipWithError("db_empty_db failed"); break;
+        }
+        state.PauseTiming();
+        fill_db(db_size);
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * db_size);
+}
+BENCHMARK(BM_db_empty_db)->Apply(db_args)->Iterations(10);
+
+
+static void BM_db_item_exists(benchmark::State &state) {
+    if (!prepare_db(state)) return;
+    int key = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(db_item_exists(key));
+        key = (key + 1) % db_size;
+    }
+}
+BENCHMARK(BM_db_item_exists)->Apply(db_args);
+
+
+static void BM_db_read_item(benchmark::State &state) {
+    if (!prepare_db(state)) return;
+    arena_t arena;
+    arena_init(&arena);
+    char *value1;
+    int value2;
+    float value3;
+    uint32_t version;
+    int key = 1;
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(db_read_item(key, &value1, &value2, &value3, &version, &arena));
+        arena_reset(&arena);
+        key = key + 1 < db_size ? key + 1 : 1;
+    }
+    arena_free(&arena);
+}
+BENCHMARK(BM_db_read_item)->Apply(db_args);
+
+
+static void BM_db_read_item_stored(benchmark::State &state) {
+    /* reading & releasing item 0, whose value1 is left in storage */
+    if (!prepare_db(state)) return;
+    arena_t arena;
+    arena_init(&arena);
+    stored_value1_t stored;
+    char *value1;
+    int value2;
+    float value3;
+    uint32_t version;
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(db_read_item_stored(0, &stored, &value1, &value2, &value3, &version, &arena));
+        db_release_stored(&stored);
+        arena_reset(&arena);
+    }
+    arena_free(&arena);
+}
+BENCHMARK(BM_db_read_item_stored)->Apply(db_args);
+
+
+static void BM_db_record_read(benchmark::State &state) {
+    /* sampling reads of 256 pinned keys and of every other key in turn, as the server does before GET & exist */
+    if (!prepare_db(state)) return;
+    if (db_set_hot_keys(256) == -1) {
+        state.SkipWithError("could not pin hot keys"); return;
+    }
+    int key = 0, turn = 0;
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(db_record_read(turn++ & 1 ? key % 256 : key));
+        key = (key + 1) % db_size;
+    }
+    db_set_hot_keys(0);
+}
+BENCHMARK(BM_db_record_read)->Apply(db_args);
+
+
+static void BM_db_write_item(benchmark::State &state) {
+    /* modifying existing items, with & without the value2 index; every write moves value2,
+     * so that the index has an entry to replace */
+    if (!prepare_db(state)) return;
+    db_set_value2_index((int) state.range(2));
+    std::string value1(VALUE1_LEN, 'w');
+    int key = 1, shift = 1;
+    for (auto _ : state) {
+        int value2 = key + shift;
+        float value3 = (float) key;
+        if (db_write_item(key, value1.c_str(), &value2, &value3, MODIFY) == -1) {
+            state.SkipWithError("db_write_item failed"); break;
+        }
+        key = key + 1 < db_size ? key + 1 : (shift++, 1);
+    }
+    db_set_value2_index(FALSE);
+    set_index_label(state);
+}
+BENCHMARK(BM_db_write_item)->Apply(db_index_args);
+
+
+static void BM_db_upsert_item(benchmark::State &state) {
+    /* like BM_db_write_item */
+    if (!prepare_db(state)) return;
+    db_set_value2_index((int) state.range(2));
+    std::string value1(VALUE1_LEN, 'u');
+    uint32_t version;
+    int key = 1, shift = 1;
+    for (auto _ : state) {
+        int value2 = key + shift;
+        float value3 = (float) key;
+        benchmark::DoNotOptimize(db_upsert_item(key, value1.c_str(), &value2, &value3, &version));
+        key = key + 1 < db_size ? key + 1 : (shift++, 1);
+    }
+    db_set_value2_index(FALSE);
+    set_index_label(state);
+}
+BENCHMARK(BM_db_upsert_item)->Apply(db_index_args);
+
+
+static void BM_db_cas_item(benchmark::State &state) {
+    /* a successful compare-and-swap, with the version read beforehand; value2 moves like in BM_db_write_item */
+    if (!prepare_db(state)) return;
+    db_set_value2_index((int) state.range(2));
+    std::string value1(VALUE1_LEN, 'c');
+    arena_t arena;
+    arena_init(&arena);
+    char *old_value1;
+    int key = 1;
+    for (auto _ : state) {
+        int value2;
+        float value3;
+        uint32_t version;
+        db_read_item(key, &old_value1, &value2, &value3, &version, &arena);
+        value2++;
+        benchmark::DoNotOptimize(db_cas_item(key, value1.c_str(), &value2, &value3, &version));
+        arena_reset(&arena);
+        key = key + 1 < db_size ? key + 1 : 1;
+    }
+    db_set_value2_index(FALSE);
+    arena_free(&arena);
+    set_index_label(state);
+}
+BENCHMARK(BM_db_cas_item)->Apply(db_index_args);
+
+
+static void BM_db_delete_item(benchmark::State &state) {
+    /* deleting an item; it's stored again, untimed, after every iteration */
+    if (!prepare_db(state)) return;
+    std::string value1(VALUE1_LEN, 'v');
+    int key = 1;
+    for (auto _ : state) {
+        if (db_delete_item(key) == -1) {
+            state.SkipWithError("db_delete_item failed"); break;
+        }
+        state.PauseTiming();
+        int value2 = key;
+        float value3 = (float) key;
+        db_write_item(key, value1.c_str(), &value2, &value3, CREATE);
+        state.ResumeTiming();
+        key = key + 1 < db_size ? key + 1 : 1;
+    }
+}
+BENCHMARK(BM_db_delete_item)->Apply(db_args);
+
+
+static void BM_db_execute_txn(benchmark::State &state) {
+    /* half of the sub-operations read an item, the other half modify another one */
+    if (!prepare_db(state)) return;
+    std::string value1(VALUE1_LEN, 't');
+    arena_t arena;
+    arena_init(&arena);
+    txn_op_t ops[TXN_OPS];
+    int key = 1;
+
+    for (auto _ : state) {
+        for (int i = 0; i < TXN_OPS; i++) {
+            ops[i] = txn_op_t();
+            ops[i].op_code = i % 2 ? MODIFY_VALUE : GET_VALUE;
+            ops[i].item.key = key;
+            ops[i].item.value1 = &value1[0];
+            key = key + 1 < db_size ? key + 1 : 1;
+        }
+        benchmark::DoNotOptimize(db_execute_txn(ops, TXN_OPS, &arena));
+        arena_reset(&arena);
+    }
+    arena_free(&arena);
+    state.SetItemsProcessed(state.iterations() * TXN_OPS);
+}
+BENCHMARK(BM_db_execute_txn)->Apply(db_args);
+
+
+static void BM_db_apply_change(benchmark::State &state) {
+    /* a modification made on another server, as applied by replicas */
+    if (!prepare_db(state)) return;
+    std::string value1(VALUE1_LEN, 'a');
+    change_t change = {};
+    change.op_code = MODIFY_VALUE;
+    change.item.value1 = &value1[0];
+    int key = 1;
+
+    for (auto _ : state) {
+        change.seq++;
+        change.item.key = key;
+        change.item.value2 = key;
+        change.item.version = (uint32_t) change.seq;
+        benchmark::DoNotOptimize(db_apply_change(&change));
+        key = key + 1 < db_size ? key + 1 : 1;
+    }
+}
+BENCHMARK(BM_db_apply_change)->Apply(db_args);
+
+
+static void BM_db_next_change_seq(benchmark::State &state) {
+    if (!prepare_db(state)) return;
+    for (auto _ : state) benchmark::DoNotOptimize(db_next_change_seq());
+}
+BENCHMARK(BM_db_next_change_seq)->Apply(db_args);
+
+
+static void BM_db_read_changes(benchmark::State &state) {
+    /* reading the last CHANGES changes committed, to every key */
+    if (!prepare_db(state)) return;
+    std::string value1(VALUE1_LEN, 'r');
+    for (int key = 1; key <= CHANGES; key++) {
+        int value2 = key;
+        float value3 = (float) key;
+        db_write_item(key % db_size, value1.c_str(), &value2, &value3, MODIFY);
+    }
+    uint64_t from_seq = db_next_change_seq() - CHANGES;
+
+    arena_t arena;
+    arena_init(&arena);
+    std::vector<change_t> changes(CHANGES);
+    uint64_t next_seq, missed;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(db_read_changes(from_seq, INT32_MIN, INT32_MAX, changes.data(), CHANGES, &next_seq,
+                                                 &missed, 0, &arena));
+        arena_reset(&arena);
+    }
+    arena_free(&arena);
+    state.SetItemsProcessed(state.iterations() * CHANGES);
+}
+BENCHMARK(BM_db_read_changes)->Apply(db_args);
+
+
+static void BM_db_scan_items(benchmark::State &state) {
+    /* reading SCAN_ITEMS items in key order, from a different place every time */
+    if (!prepare_db(state)) return;
+    arena_t arena;
+    arena_init(&arena);
+    std::vector<item_t> items(SCAN_ITEMS);
+    int more, lo = 0;
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(db_scan_items(lo, INT32_MAX, items.data(), SCAN_ITEMS, &more, &arena));
+        arena_reset(&arena);
+        lo = (lo + SCAN_ITEMS) % db_size;
+    }
+    arena_free(&arena);
+    state.SetItemsProcessed(state.iterations() * SCAN_ITEMS);
+}
+BENCHMARK(BM_db_scan_items)->Apply(db_args);
+
+
+static void BM_db_aggregate(benchmark::State &state) {
+    /* averaging value3 over every item */
+    if (!prepare_db(state)) return;
+    double result;
+    for (auto _ : state) benchmark::DoNotOptimize(db_aggregate(AGG_AVG, FIELD_VALUE3, 0, INT32_MAX, &result));
+    state.SetItemsProcessed(state.iterations() * db_size);
+}
+BENCHMARK(BM_db_aggregate)->Apply(db_args);
+
+
+static void BM_db_set_value2_index(benchmark::State &state) {
+    /* building the value2 index over every item, and dropping it */
+    if (!prepare_db(state)) return;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(db_set_value2_index(TRUE));
+        db_set_value2_index(FALSE);
+    }
+    state.SetItemsProcessed(state.iterations() * db_size);
+}
+BENCHMARK(BM_db_set_value2_index)->Apply(db_args);
+
+
+static void BM_db_query_items(benchmark::State &state) {
+    /* reading the first SCAN_ITEMS items in value2 order, with & without the value2 index */
+    if (!prepare_db(state)) return;
+    db_set_value2_index((int) state.range(2));
+    arena_t arena;
+    arena_init(&arena);
+    std::vector<item_t> items(SCAN_ITEMS);
+    int more;
+    int64_t next_cursor;
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(db_query_items(0, INT32_MAX, 0, FALSE, items.data(), SCAN_ITEMS, &more,
+                                                &next_cursor, &arena));
+        arena_reset(&arena);
+    }
+    db_set_value2_index(FALSE);
+    arena_free(&arena);
+    set_index_label(state);
+    state.SetItemsProcessed(state.iterations() * SCAN_ITEMS);
+}
+BENCHMARK(BM_db_query_items)->Apply(db_index_args);
+
+
+static void BM_db_search_items(benchmark::State &state) {
+    /* substring search through every value1; nothing matches, so each one is read entirely */
+    if (!prepare_db(state)) return;
+    int32_t *keys = NULL;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(db_search_items(SEARCH_SUBSTRING, "needle", &keys));
+        free(keys);
+        keys = NULL;
+    }
+    state.SetItemsProcessed(state.iterations() * db_size);
+}
+BENCHMARK(BM_db_search_items)->Apply(db_args);
+
+
+static void BM_db_incr_item(benchmark::State &state) {
+    if (!prepare_db(state)) return;
+    int value2;
+    int key = 1;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(db_incr_item(key, 1, &value2));
+        key = key + 1 < db_size ? key + 1 : 1;
+    }
+}
+BENCHMARK(BM_db_incr_item)->Apply(db_args);
+
+
+static void BM_db_add_item(benchmark::State &state) {
+    if (!prepare_db(state)) return;
+    float value3;
+    int key = 1;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(db_add_item(key, 0.5f, &value3));
+        key = key + 1 < db_size ? key + 1 : 1;
+    }
+}
+BENCHMARK(BM_db_add_item)->Apply(db_args);
+
+
+/* in-memory table layouts: item_table's columns against the array of structs a row store would keep,
+ * with value1 in a VALUE1_MAX_STR_SIZE buffer; both hold state.range(0) items with VALUE1_LEN bytes of value1.
+ * bytes_per_item counts everything allocated for them, and scans aggregate value3 over every item */
+
+typedef struct {
+    int32_t key;
+    char value1[VALUE1_MAX_STR_SIZE];
+    int32_t value2;
+    float value3;
+    uint32_t version;
+    uint8_t live;
+} row_item_t;
+
+
+static void layout_args(benchmark::internal::Benchmark *benchmark) {
+    for (int num_items : {1000, 100000, 1000000}) benchmark->Arg(num_items);
+}
+
+
+static bool fill_column_table(benchmark::State &state, column_table_t *table) {
+    std::string value1(VALUE1_LEN, 'v');
+    if (column_table_init(table) == -1) {
+        state.SkipWithError("could not allocate table"); return false;
+    }
+    for (int key = 0; key < state.range(0); key++) {
+        if (column_table_put(table, key, value1.c_str(), (uint32_t) value1.size(), key, (float) key, 1) == -1) {
+            column_table_free(table);
+            state.SkipWithError("could not fill table"); return false;
+        }
+    }
+    return true;
+}
+
+
+static double column_table_bytes(const column_table_t *table) {
+    /* every column, the value1 arena & the key -> row map */
+    size_t row_bytes = 4 * sizeof(int32_t) + sizeof(uint8_t) + sizeof(uint64_t) + sizeof(uint32_t);
+    return (double) (table->capacity * row_bytes + table->arena_size + STRING_SEARCH_PADDING +
+                     table->rows.capacity * sizeof(key_map_entry_t));
+}
+
+
+static void BM_column_table_scan(benchmark::State &state) {
+    column_table_t table;
+    if (!fill_column_table(state, &table)) return;
+    aggregation_t result;
+
+    for (auto _ : state) {
+        column_table_aggregate(&table, FIELD_VALUE3, INT32_MIN, INT32_MAX, &result);
+        benchmark::DoNotOptimize(result);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.counters["bytes_per_item"] = column_table_bytes(&table) / (double) state.range(0);
+    column_table_free(&table);
+}
+BENCHMARK(BM_column_table_scan)->Apply(layout_args);
+
+
+static void BM_row_table_scan(benchmark::State &state) {
+    const int num_items = (int) state.range(0);
+    std::vector<row_item_t> rows(num_items);
+    for (int key = 0; key < num_items; key++) {
+        rows[key] = {key, {}, key, (float) key, 1, 1};
+        memset(rows[key].value1, 'v', VALUE1_LEN);
+    }
+    int32_t lo = INT32_MIN, hi = INT32_MAX;
+    benchmark::DoNotOptimize(lo);
+    benchmark::DoNotOptimize(hi);
+
+    for (auto _ : state) {
+        /* same kernel as the scalar column one: count, sum, min & max of the live rows in [lo, hi] */
+        uint32_t count = 0;
+        double sum = 0;
+        float min = INFINITY, max = -INFINITY;
+        for (const row_item_t &row : rows) {
+            if (!row.live || row.key < lo || row.key > hi) continue;
+            count++;
+            sum += row.value3;
+            if (row.value3 < min) min = row.value3;
+            if (row.value3 > max) max = row.value3;
+        }
+        benchmark::DoNotOptimize(count);
+        benchmark::DoNotOptimize(sum);
+        benchmark::DoNotOptimize(min);
+        benchmark::DoNotOptimize(max);
+    }
+    state.SetItemsProcessed(state.iterations() * num_items);
+    state.counters["bytes_per_item"] = (double) sizeof(row_item_t);
+}
+BENCHMARK(BM_row_table_scan)->Apply(layout_args);
+
+
+static void BM_column_table_churn(benchmark::State &state) {
+    /* removing an item and putting it back with a longer value1, which leaves tombstones & garbage
+     * for the compactions swept along with the writes */
+    column_table_t table;
+    if (!fill_column_table(state, &table)) return;
+    std::string value1(VALUE1_LEN + 1, 'w');
+    int key = 0;
+
+    for (auto _ : state) {
+        column_table_remove(&table, key);
+        column_table_put(&table, key, value1.c_str(), (uint32_t) value1.size(), key, (float) key, 2);
+        key = (key + 1) % (int) state.range(0);
+    }
+    state.counters["bytes_per_item"] = column_table_bytes(&table) / (double) state.range(0);
+    column_table_free(&table);
+}
+BENCHMARK(BM_column_table_churn)->Apply(layout_args);
+
+
+static void remove_db(void) {
+    if (db_engine) {
+        db_empty_db();
+        db_close();
+    }
+    rmdir(DB_NAME);
+    unlink(DB_PAGES_NAME);
+}
+
+
+int main(int argc, char **argv) {
+    /* JSON output by default; options given on the command line come later, so they win */
+    std::vector<char *> args = {argv[0], (char *) "--benchmark_format=json"};
+    for (int i = 1; i < argc; i++) args.push_back(argv[i]);
+    int num_args = (int) args.size();
+
+    benchmark::Initialize(&num_args, args.data());
+    if (benchmark::ReportUnrecognizedArguments(num_args, args.data())) return 1;
+
+    /* the DB goes into a temp directory; TMPDIR if set, /tmp otherwise */
+    const char *tmp = getenv("TMPDIR");
+    std::string dir = std::string(tmp && *tmp ? tmp : "/tmp") + "/microbench.XXXXXX";
+    if (!mkdtemp(&dir[0]) || chdir(dir.c_str()) == -1) {
+        perror("Could not create temp directory"); return 1;
+    }
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+
+    remove_db();
+    if (chdir("/") == -1 || rmdir(dir.c_str()) == -1) perror("Could not remove temp directory");
+    return 0;
+}
@@ -0,0 +1,447 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include "DS-MandatoryExercise/utils.h"
+#include "DS-MandatoryExercise/keys.h"
+#include "DS-MandatoryExercise/kvServer.h"
+
+/* performance regression gate: runs a short, fixed profile against an in-process server, on a free port and a
+ * temp directory, and compares the results with a baseline file within the tolerances it gives.
+ * every metric is relative to a reference measured along with it, so that a machine running slower for a
+ * while slows both down alike: every request is preceded by a bare loopback round trip, a connection each as
+ * the client API does, which creates a small file for SETs, and the server's throughput & p99 latencies are
+ * divided by those of the round trips; its restart time is divided by the time it takes to read those files
+ * back. every metric is the median of its rounds, as is its baseline.
+ * every metric is listed with its change; exits with 1 if any got worse than its tolerance allows,
+ * or if the baseline doesn't have it */
+
+#define GATE_ROUNDS 5               /* rounds per metric; an odd number, so that the median is one of them */
+#define GATE_ITEMS 2000             /* items set per round, on keys of their own */
+#define GATE_GETS 4000              /* gets per round, over the items set in it */
+#define GATE_THREADS 4              /* client threads */
+#define GATE_VALUE1_LEN 64
+#define GATE_KEY_BASE 2000000
+#define GATE_BASELINE_MAX 65536     /* baseline file bytes */
+#define REFERENCE_DIR "reference"   /* files the loopback reference writes, in the temp directory */
+
+typedef struct {
+    const char *name;
+    int higher_is_better;
+    double rounds[GATE_ROUNDS];     /* measured, relative to the reference */
+    double value;                   /* median of the rounds */
+    double baseline;                /* -1 if the baseline doesn't have it */
+    double tolerance;               /* fraction of the baseline the value may be worse by */
+} metric_t;
+
+enum {SET_OPS, GET_OPS, SET_P99, GET_P99, RESTART, NUM_METRICS};
+
+static metric_t metrics[NUM_METRICS] = {
+        {.name = "set_ops_vs_loopback", .higher_is_better = TRUE},
+        {.name = "get_ops_vs_loopback", .higher_is_better = TRUE},
+        {.name = "set_p99_vs_loopback", .higher_is_better = FALSE},
+        {.name = "get_p99_vs_loopback", .higher_is_better = FALSE},
+        {.name = "restart_vs_file_reads", .higher_is_better = FALSE},
+};
+
+static int loopback_sd = -1;        /* listening socket of the loopback reference */
+static struct sockaddr_in loopback_addr;
+static const char *reference_dir;   /* REFERENCE_DIR inside the temp directory */
+static int reference_files = 0;     /* files written by the loopback reference */
+
+typedef struct {
+    char workload;                  /* SET_VALUE or GET_VALUE */
+    int first_key;                  /* keys the thread works on: num_keys from here on */
+    int num_keys;
+    int num_ops;
+    double *latencies;              /* num_ops seconds */
+    double *ref_latencies;          /* num_ops seconds of the round trip before each request */
+    int failed;
+} worker_t;
+
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+
+static int round_trip(const int write_file) {
+    /* one loopback reference request: connects, sends a value1 and reads it back, once it was written to a file of
+     * its own if write_file is TRUE */
+    char buf[GATE_VALUE1_LEN];
+    memset(buf, write_file ? 'w' : 'r', GATE_VALUE1_LEN);
+    int sd = socket(AF_INET, SOCK_STREAM, 0);
+    if (sd == -1) return -1;
+    int result = connect(sd, (struct sockaddr *) &loopback_addr, sizeof(loopback_addr)) == -1 ||
+                 send(sd, buf, GATE_VALUE1_LEN, MSG_NOSIGNAL) != GATE_VALUE1_LEN ||
+                 recv(sd, buf, GATE_VALUE1_LEN, MSG_WAITALL) != GATE_VALUE1_LEN ? -1 : 0;
+    close(sd);
+    return result;
+}
+
+
+static int write_reference_file(const char *buf) {
+    /* creates the next reference file, as the file engine creates a key file */
+    char path[2 * MAX_STR_SIZE];
+    snprintf(path, sizeof(path), "%s/%d", reference_dir, __atomic_fetch_add(&reference_files, 1, __ATOMIC_RELAXED));
+    int fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0600);
+    if (fd == -1) return -1;
+    int result = write(fd, buf, GATE_VALUE1_LEN) == GATE_VALUE1_LEN ? 0 : -1;
+    close(fd);
+    return result;
+}
+
+
+static void *echo_thread(void *args) {
+    /* serves loopback reference requests, a connection each, until loopback_sd is shut down */
+    char buf[GATE_VALUE1_LEN];
+    int sd;
+    while ((sd = accept(loopback_sd, NULL, NULL)) != -1) {
+        if (recv(sd, buf, GATE_VALUE1_LEN, MSG_WAITALL) == GATE_VALUE1_LEN &&
+            (buf[0] != 'w' || write_reference_file(buf) == 0))
+            send(sd, buf, GATE_VALUE1_LEN, MSG_NOSIGNAL);
+        close(sd);
+    }
+    return NULL;
+}
+
+
+static void *worker(void *args) {
+    worker_t *w = (worker_t *) args;
+    char value1[GATE_VALUE1_LEN + 1];
+    int value2;
+    float value3;
+    memset(value1, 'v', GATE_VALUE1_LEN);
+    value1[GATE_VALUE1_LEN] = '\0';
+
+    for (int i = 0; i < w->num_ops; i++) {
+        int key = w->first_key + i % w->num_keys;
+        double start = now();
+        int result = round_trip(w->workload == SET_VALUE);
+        w->ref_latencies[i] = now() - start;
+
+        start = now();
+        if (result == 0) {
+            result = w->workload == SET_VALUE ? set_value(key, value1, key, 1.0f)
+                                              : get_value(key, value1, &value2, &value3);
+        }
+        w->latencies[i] = now() - start;
+        if (result == -1) w->failed++;
+    }
+    return NULL;
+}
+
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+
+static double sum_and_sort(double *latencies, const int ops) {
+    /* sorts latencies, returning their sum */
+    double sum = 0;
+    for (int i = 0; i < ops; i++) sum += latencies[i];
+    qsort(latencies, ops, sizeof(double), compare_doubles);
+    return sum;
+}
+
+
+static int run_phase(const char workload, const int first_key, const int num_ops, const int round) {
+    /* spreads num_ops over the client threads, each on its share of GATE_ITEMS keys from first_key on,
+     * and keeps the round's throughput & p99 latency relative to those of the round trips */
+    worker_t workers[GATE_THREADS];
+    pthread_t threads[GATE_THREADS];
+    double *latencies = malloc(2 * num_ops * sizeof(double));
+    if (!latencies) {
+        perror("Could not allocate latencies"); return -1;
+    }
+    double *ref_latencies = latencies + num_ops;
+
+    int ops_per_thread = num_ops / GATE_THREADS, keys_per_thread = GATE_ITEMS / GATE_THREADS;
+    for (int i = 0; i < GATE_THREADS; i++) {
+        workers[i] = (worker_t) {.workload = workload, .first_key = first_key + i * keys_per_thread,
+                                 .num_keys = keys_per_thread, .num_ops = ops_per_thread,
+                                 .latencies = latencies + i * ops_per_thread,
+                                 .ref_latencies = ref_latencies + i * ops_per_thread};
+    }
+
+    for (int i = 0; i < GATE_THREADS; i++) pthread_create(&threads[i], NULL, worker, &workers[i]);
+    for (int i = 0; i < GATE_THREADS; i++) pthread_join(threads[i], NULL);
+
+    int failed = 0;
+    for (int i = 0; i < GATE_THREADS; i++) failed += workers[i].failed;
+    if (failed) {
+        fprintf(stderr, "%d requests failed\n", failed);
+        free(latencies); return -1;
+    }
+
+    /* as many requests as round trips were made by as many threads, so throughput goes with total time */
+    int ops = ops_per_thread * GATE_THREADS, p99 = (ops * 99 + 99) / 100 - 1;
+    double ref_seconds = sum_and_sort(ref_latencies, ops), seconds = sum_and_sort(latencies, ops);
+    metrics[workload == SET_VALUE ? SET_OPS : GET_OPS].rounds[round] = ref_seconds / seconds;
+    metrics[workload == SET_VALUE ? SET_P99 : GET_P99].rounds[round] = latencies[p99] / ref_latencies[p99];
+    free(latencies);
+    return 0;
+}
+
+
+static double read_reference_files(void) {
+    /* the restart reference: milliseconds it takes to list & read back every reference file; -1 on error */
+    char path[2 * MAX_STR_SIZE], value1[GATE_VALUE1_LEN];
+    double start = now();
+    DIR *files = opendir(reference_dir);
+    if (!files) {
+        perror("Could not open reference directory"); return -1;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(files)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+        snprintf(path, sizeof(path), "%s/%s", reference_dir, entry->d_name);
+        int fd = open(path, O_RDONLY);
+        if (fd == -1 || read(fd, value1, GATE_VALUE1_LEN) != GATE_VALUE1_LEN) {
+            perror("Could not read reference file");
+            if (fd != -1) close(fd);
+            closedir(files); return -1;
+        }
+        close(fd);
+    }
+    closedir(files);
+    return (now() - start) * 1e3;
+}
+
+
+static void remove_reference_files(void) {
+    char path[2 * MAX_STR_SIZE];
+    for (int i = 0; i < reference_files; i++) {
+        snprintf(path, sizeof(path), "%s/%d", reference_dir, i);
+        unlink(path);
+    }
+    rmdir(reference_dir);
+}
+
+
+static int start_loopback(void) {
+    /* listens for loopback reference requests on a free port, serving them with as many threads as the clients */
+    pthread_t thread;
+    if (mkdir(reference_dir, 0700) == -1) {
+        perror("Could not create reference directory"); return -1;
+    }
+    socklen_t addr_len = sizeof(loopback_addr);
+    memset(&loopback_addr, 0, sizeof(loopback_addr));
+    loopback_addr.sin_family = AF_INET;
+    loopback_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if ((loopback_sd = socket(AF_INET, SOCK_STREAM, 0)) == -1 ||
+        bind(loopback_sd, (struct sockaddr *) &loopback_addr, sizeof(loopback_addr)) == -1 ||
+        listen(loopback_sd, SOMAXCONN) == -1 ||
+        getsockname(loopback_sd, (struct sockaddr *) &loopback_addr, &addr_len) == -1) {
+        perror("Could not set up loopback reference"); return -1;
+    }
+    for (int i = 0; i < GATE_THREADS; i++) {
+        if (pthread_create(&thread, NULL, echo_thread, NULL) != 0) {
+            perror("Could not create echo thread"); return -1;
+        }
+        pthread_detach(thread);
+    }
+    return 0;
+}
+
+
+static int start_server(const kv_server_config_t *config) {
+    /* starts the server and points the client API at it */
+    int port = kv_server_start(config);
+    if (port == -1) return -1;
+
+    char port_str[16];
+    snprintf(port_str, sizeof(port_str), "%d", port);
+    unsetenv("SERVERS_TUPLES");
+    unsetenv("REPLICAS_TUPLES");
+    setenv("IP_TUPLES", "localhost", 1);
+    setenv("PORT_TUPLES", port_str, 1);
+    return 0;
+}
+
+
+static int run_profile(const kv_server_config_t *config) {
+    /* every round sets its own items, then reads them back; the server is restarted with all of them at the end */
+    if (start_server(config) == -1 || init() == -1) return -1;
+
+    for (int round = 0; round < GATE_ROUNDS; round++) {
+        int first_key = GATE_KEY_BASE + round * GATE_ITEMS;
+        if (run_phase(SET_VALUE, first_key, GATE_ITEMS, round) == -1 ||
+            run_phase(GET_VALUE, first_key, GATE_GETS, round) == -1) return -1;
+    }
+
+    /* restart time: from stopping the server until it serves again, having loaded every item */
+    for (int round = 0; round < GATE_ROUNDS; round++) {
+        double reference_ms = read_reference_files();
+        if (reference_ms == -1) return -1;
+        double start = now();
+        if (kv_server_stop() == -1 || start_server(config) == -1 || exist(GATE_KEY_BASE) != 1) {
+            fprintf(stderr, "Server didn't restart\n"); return -1;
+        }
+        metrics[RESTART].rounds[round] = (now() - start) * 1e3 / reference_ms;
+    }
+
+    /* leave the DB empty, so that the temp directory can be removed */
+    if (init() == -1) return -1;
+    return kv_server_stop();
+}
+
+
+static void take_medians(void) {
+    for (int i = 0; i < NUM_METRICS; i++) {
+        qsort(metrics[i].rounds, GATE_ROUNDS, sizeof(double), compare_doubles);
+        metrics[i].value = metrics[i].rounds[GATE_ROUNDS / 2];
+    }
+}
+
+
+static int read_baseline(const char *path) {
+    /* the baseline is a JSON object with an object per metric: {"<name>": {"value": <x>, "tolerance": <y>}, ...};
+     * only the metrics measured here are looked for */
+    static char buf[GATE_BASELINE_MAX];
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        perror("Could not open baseline"); return -1;
+    }
+    size_t len = fread(buf, 1, sizeof(buf) - 1, file);
+    fclose(file);
+    buf[len] = '\0';
+
+    for (int i = 0; i < NUM_METRICS; i++) {
+        char quoted[MAX_STR_SIZE];
+        snprintf(quoted, MAX_STR_SIZE, "\"%s\"", metrics[i].name);
+        metrics[i].baseline = -1;
+
+        char *metric = strstr(buf, quoted);
+        char *end = metric ? strchr(metric, '}') : NULL;
+        char *value = metric ? strstr(metric, "\"value\"") : NULL;
+        char *tolerance = metric ? strstr(metric, "\"tolerance\"") : NULL;
+        if (!end) continue;
+
+        if (!value || value > end || sscanf(value + strlen("\"value\""), " : %lf", &metrics[i].baseline) != 1 ||
+            !tolerance || tolerance > end ||
+            sscanf(tolerance + strlen("\"tolerance\""), " : %lf", &metrics[i].tolerance) != 1) {
+            fprintf(stderr, "Invalid baseline for %s\n", metrics[i].name); return -1;
+        }
+    }
+    return 0;
+}
+
+
+static int write_results(const char *path) {
+    /* in the baseline format, with the tolerances in use, so that the file may become the next baseline */
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        perror("Could not open results file"); return -1;
+    }
+    fprintf(file, "{\n");
+    for (int i = 0; i < NUM_METRICS; i++) {
+        fprintf(file, "    \"%s\": {\"value\": %.3f, \"tolerance\": %.2f}%s\n", metrics[i].name, metrics[i].value,
+                metrics[i].tolerance, i < NUM_METRICS - 1 ? "," : "");
+    }
+    fprintf(file, "}\n");
+    return fclose(file) == EOF ? -1 : 0;
+}
+
+
+static int compare(void) {
+    /* prints every metric next to its baseline; returns the number of metrics that regressed or have no baseline */
+    int regressed = 0;
+    printf("%-22s %10s %10s %10s %10s\n", "metric", "baseline", "result", "change", "tolerance");
+    for (int i = 0; i < NUM_METRICS; i++) {
+        metric_t *m = &metrics[i];
+        if (m->baseline <= 0) {
+            printf("%-22s %10s %10.3f %10s %10s  NOT IN BASELINE\n", m->name, "-", m->value, "-", "-");
+            regressed++; continue;
+        }
+
+        double change = (m->value - m->baseline) / m->baseline;
+        int worse = m->higher_is_better ? change < -m->tolerance : change > m->tolerance;
+        printf("%-22s %10.3f %10.3f %+9.1f%% %+9.0f%%  %s\n", m->name, m->baseline, m->value, change * 100,
+                   (m->higher_is_better ? -m->tolerance : m->tolerance) * 100, worse ? "REGRESSED" : "ok");
+        regressed += worse;
+    }
+    return regressed;
+}
+
+
+int main(int argc, char **argv) {
+    kv_server_config_t config;
+    kv_server_default_config(&config);
+    const char *results_path = NULL;
+    double tolerance = -1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "e:n:o:t:")) != -1) {
+        switch (opt) {
+            case 'e':   /* storage engine */
+                if (!strcmp(optarg, "file")) config.engine = FILE_ENGINE;
+                else if (!strcmp(optarg, "page")) config.engine = PAGE_ENGINE;
+                else {
+                    fprintf(stderr, "Invalid storage engine: %s\n", optarg); return -1;
+                }
+                break;
+            case 'n':   /* networking model */
+                if (!strcmp(optarg, "threads")) config.net_ring = FALSE;
+                else if (!strcmp(optarg, "uring")) config.net_ring = TRUE;
+                else {
+                    fprintf(stderr, "Invalid networking model: %s\n", optarg); return -1;
+                }
+                break;
+            case 'o':   /* results file */
+                results_path = optarg; break;
+            case 't':   /* tolerance of every metric, instead of the baseline's */
+                tolerance = strtod(optarg, NULL); break;
+            default:
+                fprintf(stderr, "Usage: perfgate [-e file|page] [-n threads|uring] [-o <RESULTS_JSON>] "
+                                "[-t <TOLERANCE>] <BASELINE_JSON>\n"); return -1;
+        }
+    }
+    if (argc - optind != 1) {
+        fprintf(stderr, "Usage: perfgate [-e file|page] [-n threads|uring] [-o <RESULTS_JSON>] "
+                        "[-t <TOLERANCE>] <BASELINE_JSON>\n"); return -1;
+    }
+    if (read_baseline(argv[optind]) == -1) return -1;
+    for (int i = 0; i < NUM_METRICS && tolerance >= 0; i++) metrics[i].tolerance = tolerance;
+
+    /* the DB goes in a temp directory of its own */
+    char dir[MAX_STR_SIZE];
+    const char *tmp = getenv("TMPDIR");
+    snprintf(dir, MAX_STR_SIZE, "%s/perfgate.XXXXXX", tmp && *tmp ? tmp : "/tmp");
+    if (!mkdtemp(dir)) {
+        perror("Could not create temp directory"); return -1;
+    }
+    config.storage_path = dir;
+    char reference_path[2 * MAX_STR_SIZE];
+    snprintf(reference_path, sizeof(reference_path), "%s/%s", dir, REFERENCE_DIR);
+    reference_dir = reference_path;
+
+    int result = start_loopback() == -1 ? -1 : run_profile(&config);
+    kv_server_stop();
+    if (loopback_sd != -1) shutdown(loopback_sd, SHUT_RDWR);
+    remove_reference_files();
+    char db_path[2 * MAX_STR_SIZE];
+    snprintf(db_path, sizeof(db_path), "%s/%s", dir, config.engine == PAGE_ENGINE ? DB_PAGES_NAME : DB_NAME);
+    remove(db_path);
+    rmdir(dir);
+    if (result == -1) {
+        fprintf(stderr, "Benchmark profile failed\n"); return -1;
+    }
+
+    take_medians();
+    if (results_path && write_results(results_path) == -1) return -1;
+    return compare() ? 1 : 0;
+}
@@ -0,0 +1,33 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/* region allocator: buffers are carved out of blocks that are all released at once by a reset,
+ * so a request's values don't need freeing one by one; used by server & client to hold value1 strings.
+ * buffers may also be file mappings, which are unmapped along with the blocks */
+
+#define ARENA_BLOCK_SIZE 4096   /* size of the block kept between resets; bigger buffers get their own block */
+
+typedef struct arena_block {
+    struct arena_block *next;   /* block allocated before this one */
+    size_t size;                /* bytes in data */
+    size_t used;                /* bytes of data handed out */
+    void *map;                  /* file mapping this block stands for, with size 0; NULL if none */
+    size_t map_size;
+    char data[];
+} arena_block_t;
+
+typedef struct {
+    arena_block_t *head;        /* block buffers are taken from; NULL if none was allocated yet */
+} arena_t;
+
+void arena_init(arena_t *arena);
+void *arena_alloc(arena_t *arena, size_t size);
+char *arena_strndup(arena_t *arena, const char *str, size_t len);
+char *arena_map(arena_t *arena, int fd, size_t size);
+void arena_reset(arena_t *arena);
+void arena_adopt(arena_t *arena, arena_t *other);
+void arena_free(arena_t *arena);
+
+#endif //ARENA_H
@@ -0,0 +1,31 @@
+#ifndef CHANGE_LOG_H
+#define CHANGE_LOG_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "DS-MandatoryExercise/arena.h"
+
+/* ring of the most recent changes committed to the DB, numbered with sequence numbers;
+ * appended to by dbms module and read by watchers, which have their own position in it.
+ * it has its own lock, so readers don't hold the DB lock while they wait */
+
+#define CHANGE_LOG_SIZE 4096    /* changes kept; watchers that fall further behind miss changes */
+#define CHANGE_LOG_MAX_VALUE1_BYTES (64 << 20)  /* value1 bytes kept; older changes are dropped past this */
+
+typedef struct {
+    change_t *changes;          /* change with sequence number seq is at changes[seq % CHANGE_LOG_SIZE] */
+    uint64_t first_seq;         /* sequence number of the oldest change kept */
+    uint64_t next_seq;          /* sequence number of the next change; the first one is 1 */
+    uint64_t value1_bytes;      /* bytes of the value1 copies held by the changes kept */
+    pthread_mutex_t mutex;
+    pthread_cond_t cond_appended;
+} change_log_t;
+
+int change_log_init(change_log_t *log);
+void change_log_free(change_log_t *log);
+uint64_t change_log_next_seq(change_log_t *log);
+void change_log_append(change_log_t *log, char op_code, const item_t *item);
+int change_log_read(change_log_t *log, uint64_t from_seq, int32_t lo, int32_t hi, change_t *changes,
+                    int max_changes, uint64_t *next_seq, uint64_t *missed, int timeout_ms, arena_t *arena);
+
+#endif //CHANGE_LOG_H
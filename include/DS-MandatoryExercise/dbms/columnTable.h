@@ -0,0 +1,70 @@
+#ifndef COLUMN_TABLE_H
+#define COLUMN_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "DS-MandatoryExercise/dbms/keyMap.h"
+
+#define COLUMN_TABLE_PREFIX_LEN 64      /* default value1 bytes kept per row */
+
+/* in-memory copy of every item but its value1, stored column by column so that full-table operations
+ * scan contiguous arrays; only the first prefix_len bytes of each value1 are kept, back to back in an arena,
+ * so that searches only read the rest from storage for the rows their prefix doesn't settle.
+ * tombstones & arena garbage are compacted a few rows at a time by the writes that follow, so that no single write
+ * pays for the whole table: a compaction sweeps rows in order, moving live ones down over tombstones and copying
+ * their value1 prefix to a new arena, while the rows it hasn't reached yet keep theirs in the old one.
+ * used internally in dbms module */
+
+typedef struct {
+    int32_t *keys;          /* key column */
+    int32_t *value2;        /* value2 column */
+    float *value3;          /* value3 column */
+    uint32_t *version;      /* version column */
+    uint8_t *live;          /* 0 for rows deleted since the last compaction (tombstones); otherwise arena_tag
+                             * if value1 is in arena, and the previous tag if it's still in old_arena */
+    uint64_t *value1_off;   /* where each row's value1 prefix starts in the arena */
+    uint32_t *value1_len;   /* whole value1 length, no terminating byte */
+    uint32_t prefix_len;    /* value1 bytes kept per row, COLUMN_TABLE_PREFIX_LEN unless set before the first put */
+    char *arena;            /* value1 prefixes, back to back */
+    uint64_t arena_used;    /* arena bytes in use, garbage included */
+    uint64_t arena_size;    /* arena bytes allocated, not counting the padding used by SIMD loads */
+    uint64_t arena_garbage; /* arena bytes left behind by deleted or modified values */
+    char *old_arena;        /* arena a running compaction copies value1 prefixes from; NULL if none runs */
+    uint8_t arena_tag;      /* live value of the rows whose value1 is in arena; 1 or 2 */
+    uint32_t compact_src;   /* next row a running compaction sweeps */
+    uint32_t compact_dst;   /* where it moves the next live row to */
+    uint32_t num_rows;      /* rows in use, tombstones included */
+    uint32_t num_live;      /* rows holding an item */
+    uint32_t capacity;      /* rows allocated */
+    key_map_t rows;         /* key -> row */
+} column_table_t;
+
+/* result of an aggregation; AVG is computed as sum / count */
+typedef struct {
+    uint32_t count;         /* rows aggregated */
+    double sum;
+    double min;
+    double max;
+} aggregation_t;
+
+int column_table_init(column_table_t *table);
+void column_table_free(column_table_t *table);
+void column_table_clear(column_table_t *table);
+int64_t value2_sort_key(int32_t value2, int32_t key);
+int column_table_get(const column_table_t *table, int32_t key, int32_t *value2, float *value3, uint32_t *version);
+int column_table_set_values(column_table_t *table, int32_t key, int32_t value2, float value3, uint32_t version);
+const char *column_table_get_value1(const column_table_t *table, int32_t key, uint32_t *len);
+int column_table_put(column_table_t *table, int32_t key, const char *value1, uint32_t value1_len, int32_t value2,
+                     float value3, uint32_t version);
+int column_table_prepare_put(column_table_t *table, int32_t key, uint32_t value1_len);
+int column_table_remove(column_table_t *table, int32_t key);
+int column_table_compact(column_table_t *table);
+uint32_t column_table_select_value2(const column_table_t *table, int32_t lo, int32_t hi, int64_t from,
+                                    int64_t *sort_keys, uint32_t max_keys);
+void column_table_aggregate(const column_table_t *table, char field, int32_t lo, int32_t hi,
+                            aggregation_t *result);
+int column_table_search(const column_table_t *table, char mode, const char *pattern,
+                        int (*check)(int32_t key, char mode, const char *pattern, size_t pattern_len),
+                        int32_t **keys, uint32_t *num_keys);
+
+#endif //COLUMN_TABLE_H
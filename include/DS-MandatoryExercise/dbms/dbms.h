@@ -1,13 +1,55 @@
 #ifndef DBMS_H
 #define DBMS_H
 
+#include <sys/types.h>
+#include "DS-MandatoryExercise/arena.h"
+
+#define ZERO_COPY_MIN_LEN 16384     /* shorter value1 strings are cheaper to copy than to read from storage */
+
+/* value1 string left in storage, to be sent from there without copying it to user space */
+typedef struct {
+    int fd;                         /* file holding value1; -1 if value1 was copied to memory instead */
+    off_t offset;                   /* where value1 starts in fd */
+    uint32_t len;                   /* value1 bytes */
+    int in_place;                   /* TRUE if the bytes may be overwritten in place once released */
+} stored_value1_t;
+
 /* functions called by the server to manage the DB */
+int db_open(const char *path, char engine, int io_ring);
+int db_close(void);
+int db_checkpoint(void);
 int db_list_items(void);
 int db_get_num_items(void);
 int db_empty_db(void);
 int db_item_exists(int key);
-int db_read_item(int key, char *value1, int *value2, float *value3);
+int db_read_item(int key, char **value1, int *value2, float *value3, uint32_t *version, arena_t *arena);
+int db_read_item_stored(int key, stored_value1_t *stored, char **value1, int *value2, float *value3,
+                        uint32_t *version, arena_t *arena);
+void db_release_stored(stored_value1_t *stored);
 int db_write_item(int key, const char *value1, const int *value2, const float *value3, char mode);
+int db_upsert_item(int key, const char *value1, const int *value2, const float *value3, uint32_t *version);
+int db_cas_item(int key, const char *value1, const int *value2, const float *value3, uint32_t *version);
 int db_delete_item(int key);
+int db_execute_txn(txn_op_t *ops, int num_ops, arena_t *arena);
+int db_apply_change(const change_t *change);
+uint64_t db_next_change_seq(void);
+int db_read_changes(uint64_t from_seq, int lo, int hi, change_t *changes, int max_changes,
+                    uint64_t *next_seq, uint64_t *missed, int timeout_ms, arena_t *arena);
+int db_scan_items(int lo, int hi, item_t *items, int max_items, int *more, arena_t *arena);
+int db_aggregate(char function, char field, int lo, int hi, double *result);
+int db_set_value2_index(int enabled);
+int db_query_items(int lo, int hi, int64_t cursor, int keys_only,
+                   item_t *items, int max_items, int *more, int64_t *next_cursor, arena_t *arena);
+int db_search_items(char mode, const char *pattern, int32_t **keys);
+void db_set_search_len(uint32_t len);
+int db_incr_item(int key, int delta, int *value2);
+int db_add_item(int key, float delta, float *value3);
+void db_get_io_time(histogram_t *histogram);
+int db_set_hot_keys(int max_keys);
+int db_record_read(int key);
+void db_get_hot_keys(server_stats_t *stats);
+uint64_t db_thread_io_ns(void);
+void db_set_deadline(uint64_t deadline);
+int db_abandoned(void);
 
 #endif //DBMS_H
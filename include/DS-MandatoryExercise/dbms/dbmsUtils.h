@@ -2,13 +2,34 @@
 #define DBMS_UTILS_H
 
 #include <stdio.h>
+#include <stdint.h>
 #include <dirent.h>
+#include "DS-MandatoryExercise/arena.h"
 
+/* key files start with this header, followed by the value1 bytes; files that don't start with
+ * the magic were written by older versions as text, one value per line */
+#define KEY_FILE_MAGIC "KVF1"
+
+typedef struct {
+    char magic[4];          /* KEY_FILE_MAGIC */
+    uint32_t value1_len;    /* value1 bytes following the header, no terminating byte */
+    int32_t value2;
+    float value3;
+    uint32_t version;
+} key_file_header_t;
+
+/* DB file names, under the storage path given to db_open; key file names built from them fit in MAX_STR_SIZE */
+#define DB_FILE_NAME_SIZE (DB_PATH_MAX_LEN + 16)
+extern char db_dir_name[DB_FILE_NAME_SIZE];
+extern char db_pages_name[DB_FILE_NAME_SIZE];
 
 /* functions called internally in dbms module */
+int set_db_path(const char *path);
 DIR *open_db(void);
 int open_keyfile(int key, char mode);
 int read_value_from_keyfile(int key_fd, char *value, int size);
-int write_values_to_keyfile(int key_fd, const char *value1, const int *value2, const float *value3);
+int read_values_from_keyfile(int key_fd, const key_file_header_t *header, char **value1, arena_t *arena);
+int write_keyfile(const char *path, int flags, const char *value1, const int *value2, const float *value3,
+                  uint32_t version, const char *rename_to);
 
 #endif //DBMS_UTILS_H
@@ -0,0 +1,27 @@
+#ifndef FILE_STORE_H
+#define FILE_STORE_H
+
+#include <sys/types.h>
+#include "DS-MandatoryExercise/arena.h"
+
+/* file engine: one key file per item inside DB directory, optionally read & written through io_uring;
+ * functions called internally in dbms module */
+int file_store_open(int io_ring);
+void file_store_close(void);
+int file_store_checkpoint(void);
+int file_store_for_each_item(int (*callback)(int key, const char *value1, int value2, float value3, uint32_t version),
+                             arena_t *arena);
+int file_store_list_items(void);
+int file_store_num_items(void);
+int file_store_empty(void);
+int file_store_item_exists(int key);
+int file_store_read_item(int key, char **value1, int *value2, float *value3, uint32_t *version, arena_t *arena);
+int file_store_open_value1(int key, off_t *offset, uint32_t *len);
+int file_store_write_item(int key, const char *value1, const int *value2, const float *value3, uint32_t version,
+                          char mode);
+int file_store_write_values(int key, const int *value2, const float *value3, uint32_t version);
+int file_store_delete_item(int key);
+void file_store_defer_writes(void);
+int file_store_submit_writes(void);
+
+#endif //FILE_STORE_H
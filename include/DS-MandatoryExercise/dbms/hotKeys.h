@@ -0,0 +1,48 @@
+#ifndef HOT_KEYS_H
+#define HOT_KEYS_H
+
+#include <stdint.h>
+#include "DS-MandatoryExercise/dbms/keyMap.h"
+
+/* hot keys: a count-min sketch estimates how often each key is read, and the keys with the highest estimates
+ * are pinned, up to a max; every counter is halved once a row has taken HOT_SKETCH_RESET_FACTOR samples per counter,
+ * so that estimates follow shifts in popularity (TinyLFU style). pinned keys may hold a copy of their value1,
+ * dropped once they're unpinned. used internally in dbms module */
+
+#define HOT_KEYS_MAX 4096           /* max number of keys that can be pinned */
+#define HOT_KEYS_MIN_COUNT 4        /* estimated reads a key needs to be pinned */
+#define HOT_SKETCH_DEPTH 4          /* rows of counters; a key's estimate is the lowest of its counters */
+#define HOT_SKETCH_WIDTH_FACTOR 16  /* counters per row for every key that can be pinned */
+#define HOT_SKETCH_RESET_FACTOR 10  /* samples per counter of a row between halvings */
+#define HOT_VALUES_MAX_BYTES (16 << 20) /* value1 bytes copied for all pinned keys at most */
+
+typedef struct {
+    int32_t key;
+    uint16_t count;                 /* estimated reads when it was last sampled */
+    char *value1;                   /* copy of its value1; NULL if none */
+    uint32_t value1_size;           /* bytes allocated for it, terminating byte included */
+} hot_key_t;
+
+typedef struct {
+    uint32_t max_keys;              /* 0 if nothing is pinned */
+    uint16_t *counters;             /* HOT_SKETCH_DEPTH rows of width counters */
+    uint32_t width;                 /* always a power of 2 */
+    uint32_t samples;               /* taken since counters were last halved */
+    hot_key_t *keys;                /* pinned keys, in no particular order */
+    uint32_t num_keys;
+    uint32_t coldest;               /* position of the pinned key with the lowest count */
+    key_map_t index;                /* pinned key -> position in keys */
+    uint64_t value1_bytes;          /* allocated for value1 copies */
+} hot_keys_t;
+
+int hot_keys_init(hot_keys_t *hot, uint32_t max_keys);
+void hot_keys_free(hot_keys_t *hot);
+int hot_keys_sample(hot_keys_t *hot, int32_t key);
+int hot_keys_pinned(const hot_keys_t *hot, int32_t key);
+uint32_t hot_keys_top(const hot_keys_t *hot, hot_key_t *top, uint32_t max_keys);
+const char *hot_keys_get_value1(const hot_keys_t *hot, int32_t key);
+int hot_keys_set_value1(hot_keys_t *hot, int32_t key, const char *value1);
+void hot_keys_drop_value1(hot_keys_t *hot, int32_t key);
+void hot_keys_drop_values(hot_keys_t *hot);
+
+#endif //HOT_KEYS_H
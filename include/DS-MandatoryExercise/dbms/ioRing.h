@@ -0,0 +1,33 @@
+#ifndef IO_RING_H
+#define IO_RING_H
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/* file I/O through io_uring, falling back to plain syscalls if the kernel doesn't offer it
+ * or io_ring_open wasn't called. files are opened as direct descriptors, so that opening a file,
+ * reading or writing it and closing it again are chained in a single submission, and several
+ * files are handled per submission; writes can also be deferred, to do those of several files in one
+ * submission. paths are relative to the working directory.
+ * not thread safe: called with the DB lock held, like the rest of the dbms module */
+
+#define IO_RING_ENTRIES 256     /* submission queue entries */
+#define IO_RING_FILES 64        /* files open at once within a submission */
+
+typedef struct {
+    const char *path;
+    char *buf;                  /* gets the first size bytes of the file */
+    size_t size;
+    ssize_t result;             /* bytes read; -errno if the file couldn't be read */
+} io_read_t;
+
+int io_ring_open(void);
+void io_ring_close(void);
+int io_ring_in_use(void);
+int io_ring_read_files(io_read_t *reads, int num_reads);
+int io_ring_write_file(const char *path, int flags, const struct iovec *iov, int iovcnt, const char *rename_to);
+void io_ring_defer_writes(void);
+int io_ring_submit_writes(void);
+int io_ring_unlink_files(const char **paths, int num_paths);
+
+#endif //IO_RING_H
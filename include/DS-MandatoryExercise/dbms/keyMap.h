@@ -0,0 +1,35 @@
+#ifndef KEY_MAP_H
+#define KEY_MAP_H
+
+#include <stdint.h>
+
+/* open-addressing hash table that maps item keys to 64-bit values
+ * (page/slot locations, row numbers...); used internally in dbms module */
+
+/* entry states */
+#define KEY_MAP_EMPTY 0
+#define KEY_MAP_USED 1
+#define KEY_MAP_DELETED 2   /* tombstone: keeps probe sequences unbroken */
+
+typedef struct {
+    int32_t key;
+    uint8_t state;
+    uint64_t value;
+} key_map_entry_t;
+
+typedef struct {
+    key_map_entry_t *entries;
+    uint32_t capacity;      /* always a power of 2 */
+    uint32_t size;          /* number of used entries */
+    uint32_t tombstones;    /* number of deleted entries */
+} key_map_t;
+
+int key_map_init(key_map_t *map, uint32_t capacity);
+void key_map_free(key_map_t *map);
+void key_map_clear(key_map_t *map);
+int key_map_get(const key_map_t *map, int32_t key, uint64_t *value);
+int key_map_reserve(key_map_t *map);
+int key_map_put(key_map_t *map, int32_t key, uint64_t value);
+int key_map_remove(key_map_t *map, int32_t key);
+
+#endif //KEY_MAP_H
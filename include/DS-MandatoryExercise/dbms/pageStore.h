@@ -0,0 +1,25 @@
+#ifndef PAGE_STORE_H
+#define PAGE_STORE_H
+
+#include <sys/types.h>
+#include "DS-MandatoryExercise/arena.h"
+
+/* page engine: items stored in slotted pages of a memory-mapped file;
+ * functions called internally in dbms module */
+int page_store_open(void);
+int page_store_close(void);
+int page_store_checkpoint(void);
+int page_store_for_each_key(int (*callback)(int key));
+int page_store_list_items(void);
+int page_store_num_items(void);
+int page_store_empty(void);
+int page_store_item_exists(int key);
+int page_store_read_item(int key, char **value1, int *value2, float *value3, uint32_t *version, arena_t *arena);
+int page_store_pin_value1(int key, off_t *offset, uint32_t *len);
+void page_store_unpin_value1(off_t offset);
+int page_store_write_item(int key, const char *value1, const int *value2, const float *value3, uint32_t version,
+                          char mode);
+int page_store_write_values(int key, const int *value2, const float *value3, uint32_t version);
+int page_store_delete_item(int key);
+
+#endif //PAGE_STORE_H
@@ -0,0 +1,32 @@
+#ifndef SKIP_LIST_H
+#define SKIP_LIST_H
+
+#include <stdint.h>
+
+/* ordered set of 64-bit sort keys; used internally in dbms module
+ * to keep item keys (and composite secondary keys) in order */
+
+#define SKIP_LIST_MAX_LEVEL 24
+
+typedef struct skip_node {
+    int64_t key;
+    int level;                  /* number of forward pointers */
+    struct skip_node *next[];   /* forward pointer per level */
+} skip_node_t;
+
+typedef struct {
+    skip_node_t *head;          /* sentinel node with SKIP_LIST_MAX_LEVEL levels */
+    int level;                  /* highest level currently in use */
+    uint32_t size;              /* number of keys */
+    uint32_t seed;              /* state of the level generator */
+} skip_list_t;
+
+int skip_list_init(skip_list_t *list);
+void skip_list_free(skip_list_t *list);
+void skip_list_clear(skip_list_t *list);
+int skip_list_insert(skip_list_t *list, int64_t key);
+int skip_list_remove(skip_list_t *list, int64_t key);
+const skip_node_t *skip_list_seek(const skip_list_t *list, int64_t key);
+const skip_node_t *skip_list_next(const skip_node_t *node);
+
+#endif //SKIP_LIST_H
@@ -0,0 +1,14 @@
+#ifndef STRING_SEARCH_H
+#define STRING_SEARCH_H
+
+#include <stddef.h>
+
+/* matching of value1 strings against a search pattern; used internally in dbms module.
+ * strings may be read up to STRING_SEARCH_PADDING bytes past their end by SIMD loads,
+ * so that many bytes must be allocated after them */
+
+#define STRING_SEARCH_PADDING 32
+
+int string_matches(char mode, const char *str, size_t len, const char *pattern, size_t pattern_len);
+
+#endif //STRING_SEARCH_H
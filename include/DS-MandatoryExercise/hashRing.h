@@ -0,0 +1,32 @@
+#ifndef HASH_RING_H
+#define HASH_RING_H
+
+#include <stdint.h>
+
+/* consistent hashing of keys onto servers: every server owns HASH_RING_VNODES points of a 64-bit ring,
+ * and a key belongs to the server owning the first point after the key's hash, so adding or removing
+ * a server only moves the keys next to its points; used by keys library to shard the key space */
+
+#define MAX_SERVERS 64          /* max number of servers the key space can be split across */
+#define HASH_RING_VNODES 128    /* points (virtual nodes) per server; more of them balance servers better */
+
+typedef struct {
+    char host[MAX_STR_SIZE];
+    int port;
+} server_t;
+
+typedef struct {
+    uint64_t point;             /* position in the ring */
+    int server;                 /* server owning it */
+} vnode_t;
+
+typedef struct {
+    int num_servers;
+    server_t servers[MAX_SERVERS];
+    vnode_t vnodes[MAX_SERVERS * HASH_RING_VNODES];     /* sorted by point */
+} hash_ring_t;
+
+int hash_ring_build(hash_ring_t *ring, const char *servers);
+int hash_ring_lookup(const hash_ring_t *ring, int32_t key);
+
+#endif //HASH_RING_H
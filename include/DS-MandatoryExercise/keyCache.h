@@ -0,0 +1,51 @@
+#ifndef KEY_CACHE_H
+#define KEY_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/* read cache: items read from the servers are kept until their lease is over, or until they're invalidated because
+ * they changed, whichever comes first; the least recently used ones are evicted to stay under a byte budget.
+ * reads that raced an invalidation of their key aren't cached: every invalidation is stamped with an epoch,
+ * and a read is only cached if no key of its bucket was invalidated after the epoch it started at.
+ * used by keys library; every function is thread-safe */
+
+#define KEY_CACHE_BUCKETS 4096      /* hash buckets; a power of 2 */
+
+typedef struct key_cache_entry {
+    struct key_cache_entry *next;   /* next entry in its bucket */
+    struct key_cache_entry *newer;  /* neighbours in the LRU list */
+    struct key_cache_entry *older;
+    int32_t key;
+    int32_t value2;
+    float value3;
+    uint32_t version;
+    uint64_t expires_ns;            /* clock_ns at which the lease is over */
+    size_t size;                    /* bytes counted against the budget */
+    char value1[];
+} key_cache_entry_t;
+
+typedef struct {
+    pthread_mutex_t mutex;
+    size_t max_bytes;               /* budget: entries & their value1 strings */
+    key_cache_entry_t *buckets[KEY_CACHE_BUCKETS];
+    uint64_t bucket_epochs[KEY_CACHE_BUCKETS];  /* epoch of the last invalidation of a key in each bucket */
+    key_cache_entry_t *newest;      /* LRU list */
+    key_cache_entry_t *oldest;
+    uint64_t epoch;                 /* bumped by every invalidation */
+    uint64_t cleared_epoch;         /* epoch of the last time every entry was invalidated */
+    cache_stats_t stats;
+} key_cache_t;
+
+void key_cache_init(key_cache_t *cache, size_t max_bytes);
+void key_cache_free(key_cache_t *cache);
+uint64_t key_cache_epoch(key_cache_t *cache);
+int key_cache_get(key_cache_t *cache, int32_t key, char *value1, size_t value1_size, int *value2, float *value3,
+                  uint32_t *version);
+void key_cache_put(key_cache_t *cache, const item_t *item, uint64_t expires_ns, uint64_t read_epoch);
+void key_cache_invalidate(key_cache_t *cache, int32_t key);
+void key_cache_clear(key_cache_t *cache);
+void key_cache_read_stats(key_cache_t *cache, cache_stats_t *stats);
+
+#endif //KEY_CACHE_H
@@ -1,15 +1,116 @@
 #ifndef KEYS_H
 #define KEYS_H
 
+#include <stddef.h>
+#include "DS-MandatoryExercise/arena.h"
+
 /* client API:
  * functions called by the client to perform services;
- * they are all wrappers for 'service' function */
+ * they are all wrappers for 'service' function.
+ * the key space may be split across the servers listed in SERVERS_TUPLES (host:port,host:port...):
+ * each key belongs to one of them, and services that aren't about a single key ask all of them.
+ * value1 strings may be up to VALUE1_DEFAULT_MAX_LEN bytes long, or VALUE1_MAX_LEN if servers were given
+ * another max; functions that read value1 into a buffer of unspecified size assume VALUE1_MAX_STR_SIZE bytes,
+ * and fail if it doesn't fit */
 int init();
 int set_value(int key, char *value1, int value2, float value3);
 int get_value(int key, char *value1, int *value2, float *value3);
+int get_value_sized(int key, char *value1, size_t value1_size, int *value2, float *value3);
+int get_value_version(int key, char *value1, int *value2, float *value3, uint32_t *version);
 int modify_value(int key, char *value1, int value2, float value3);
+int upsert_value(int key, char *value1, int value2, float value3, uint32_t *version);
+int cas_value(int key, uint32_t *version, char *value1, int value2, float value3);
 int delete_key(int key);
 int exist(int key);
 int num_items();
+int incr_value(int key, int delta, int *value2);
+int add_value(int key, float delta, float *value3);
+int aggregate(char function, char field, int lo, int hi, double *result);
+int search(char mode, char *pattern, int *keys, int max_keys);
+int txn(txn_op_t *ops, int num_ops);
+int batch(txn_op_t *ops, int num_ops);
+
+/* timeout: calls made from now on by any thread fail after waiting timeout_ms for a server,
+ * which drops their requests once they're too late to be answered; 0 (the default) waits as long as it takes.
+ * calls that go to several servers, batches & iterators get timeout_ms for every request they send */
+void set_request_timeout(int timeout_ms);
+
+/* range iterator: goes through the tuples whose keys are in [lo, hi], in key order;
+ * tuples are fetched from the server one page at a time */
+#define SCAN_PAGE_ITEMS 64              /* tuples fetched per request */
+
+typedef struct {
+    int32_t cursor;                     /* key where the next page starts */
+    int32_t hi;                         /* last key of the range */
+    int done;                           /* TRUE once the last page has been fetched */
+    uint32_t num_items;                 /* tuples in current page */
+    uint32_t pos;                       /* next tuple to return from current page */
+    item_t items[SCAN_PAGE_ITEMS];      /* current page */
+    arena_t arena;                      /* value1 strings of current page */
+} scan_t;
+
+int scan_open(scan_t *scan, int lo, int hi);
+int scan_next(scan_t *scan, int *key, char *value1, int *value2, float *value3);
+int scan_next_item(scan_t *scan, const item_t **item);
+void scan_close(scan_t *scan);
+
+/* value2 query iterator: goes through the tuples whose value2 is in [lo, hi], ordered by value2 & key;
+ * tuples are fetched from the server one page at a time, with or without their values */
+typedef struct {
+    int32_t lo;                         /* lowest value2 of the query */
+    int32_t hi;                         /* highest value2 of the query */
+    int keys_only;                      /* TRUE if only keys are fetched */
+    int64_t cursor;                     /* position where the next page starts */
+    int done;                           /* TRUE once the last page has been fetched */
+    uint32_t num_items;                 /* tuples in current page */
+    uint32_t pos;                       /* next tuple to return from current page */
+    item_t items[SCAN_PAGE_ITEMS];      /* current page */
+    arena_t arena;                      /* value1 strings of current page */
+} query_t;
+
+int query_open(query_t *query, int lo, int hi, int keys_only);
+int query_next(query_t *query, int *key, char *value1, int *value2, float *value3);
+int query_next_item(query_t *query, const item_t **item);
+void query_close(query_t *query);
+
+/* change feed: the server pushes every change committed to the tuples whose keys are in [lo, hi]
+ * through a connection kept open for it */
+typedef struct {
+    int socket;                         /* connection changes arrive through */
+    uint64_t next_seq;                  /* sequence number of the next change; resume from it after reconnecting */
+    arena_t arena;                      /* value1 string of the last change */
+} watch_t;
+
+int watch_open(watch_t *watch, int lo, int hi, uint64_t from_seq);
+int watch_next(watch_t *watch, change_t *change);
+void watch_close(watch_t *watch);
+
+/* replication: reads made with get_value, get_value_version, exist & num_items are spread over the replicas
+ * listed in REPLICAS_TUPLES (host:port,host:port...), if set; everything else goes to the primary.
+ * replicas lag slightly behind it, so a read may not see a write that was just made */
+int replica_status(int replica, uint64_t *applied_seq, uint64_t *lag);
+
+/* metrics: request counts & latencies, queueing, DB lock waits and storage I/O time of a server */
+int server_stats(int shard, server_stats_t *stats);
+
+/* read cache: from cache_enable on, get_value, get_value_sized & get_value_version keep the tuples they read
+ * for as long as the lease their server grants with them, in up to max_bytes of memory. every server pushes the keys
+ * that change to the client through a keys-only watch, so a cached tuple is dropped soon after it changes, and never
+ * served more than its lease after that; writes made by the client drop their keys right away.
+ * tuples are cached once the watch of their server is up, shortly after cache_enable; replicas grant no leases.
+ * cache_enable & cache_disable must not be called while other threads are making calls */
+typedef struct {
+    uint64_t hits;                      /* reads served from the cache */
+    uint64_t misses;                    /* reads that went to a server */
+    uint64_t expired;                   /* misses on tuples whose lease was over */
+    uint64_t invalidations;             /* tuples dropped because they changed, or may have */
+    uint64_t evictions;                 /* tuples dropped to make room for others */
+    uint64_t entries;                   /* tuples cached right now */
+    uint64_t bytes;                     /* memory they take */
+} cache_stats_t;
+
+int cache_enable(size_t max_bytes);
+void cache_disable(void);
+void cache_stats(cache_stats_t *stats);
 
 #endif //KEYS_H
@@ -0,0 +1,42 @@
+#ifndef KV_SERVER_H
+#define KV_SERVER_H
+
+/* key-value server: serves the client API on a TCP port, from kv_server_start until kv_server_stop;
+ * used by server app, and by tests & benchmarks that run a server in-process.
+ * the DB is a process-wide one, so a process runs one server at a time; it may be started again once stopped */
+
+#define KV_SERVER_THREADS 5         /* default number of service threads */
+#define KV_SERVER_QUEUE_LIMIT 16    /* default conn_q depth at which connections are rejected */
+#define KV_SERVER_LEASE_MS 100      /* default lease granted with GET replies */
+#define KV_SERVER_HOT_KEYS 256      /* default number of most read keys pinned in memory */
+
+typedef struct {
+    int port;                       /* TCP port; 0 lets the kernel pick a free one */
+    int threads;                    /* service threads; 0 for KV_SERVER_THREADS */
+    const char *storage_path;       /* existing directory the DB files go in; NULL for the working directory */
+    char engine;                    /* FILE_ENGINE or PAGE_ENGINE */
+    int io_ring;                    /* TRUE if storage I/O goes through io_uring */
+    int net_ring;                   /* TRUE if io_uring networking replaces the service threads */
+    int request_max_len;            /* bytes a request received through io_uring may take, at least the longest
+                                     * value1 and then some; 0 for NET_RING_REQUEST_MAX_LEN, or more if needed */
+    int zero_copy;                  /* FALSE if GET replies copy long value1 strings through user space */
+    int value2_index;               /* TRUE for a secondary index on value2 */
+    const char *primary;            /* PRIMARY_HOST:PORT of the primary to replicate; NULL if this is one */
+    int dump_interval;              /* seconds between metrics dumps; 0 for none */
+    int queue_limit;                /* conn_q depth at which connections are rejected, up to MAX_CONN_BACKLOG;
+                                     * 0 for KV_SERVER_QUEUE_LIMIT */
+    int write_limit;                /* conn_q depth at which writes are shed; 0 for 3/4 of queue_limit */
+    int bulk_limit;                 /* conn_q depth at which INIT & TXN are shed; 0 for half of queue_limit */
+    int slow_us;                    /* requests slower than this many microseconds go to the slow log; 0 for none */
+    int lease_ms;                   /* milliseconds clients may cache the items they GET; 0 for no caching */
+    int hot_keys;                   /* most read keys whose reads never touch storage, up to HOT_KEYS_MAX;
+                                     * 0 for none */
+    int search_len;                 /* value1 bytes of every item kept in memory for searches, whole strings up to
+                                     * that long; 0 for the COLUMN_TABLE_PREFIX_LEN minimum */
+} kv_server_config_t;
+
+void kv_server_default_config(kv_server_config_t *config);
+int kv_server_start(const kv_server_config_t *config);
+int kv_server_stop(void);
+
+#endif //KV_SERVER_H
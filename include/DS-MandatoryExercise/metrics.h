@@ -0,0 +1,22 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+/* server metrics: every thread records into counters of its own, without locking,
+ * and metrics_read adds them all up; used by kvServer */
+
+#define METRICS_MAX_THREADS 64      /* threads recording metrics at once; the ones beyond this record nothing */
+#define STATS_FILE_NAME "server.stats"  /* file the periodic dump is written to, in the working directory */
+
+void metrics_request(char op_code, uint64_t accepted_ns, uint64_t started_ns);
+void metrics_busy(char op_code);
+void metrics_expired(char op_code);
+void metrics_conn_q_full(void);
+void metrics_conn_q_wait(uint64_t wait_ns);
+void metrics_conn_q_depth(int depth);
+void metrics_lock_db(void);
+const char *metrics_op_name(char op_code);
+void metrics_read(server_stats_t *stats);
+int metrics_dump_start(int interval_s);
+void metrics_dump_stop(void);
+
+#endif //METRICS_H
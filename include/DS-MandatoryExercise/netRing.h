@@ -0,0 +1,23 @@
+#ifndef NET_RING_H
+#define NET_RING_H
+
+#include <stddef.h>
+
+/* io_uring networking: a single thread accepts connections, receives requests and sends replies
+ * through one ring, instead of a service thread blocking on each connection; used by kvServer.
+ * requests are executed by a pool of service threads, which build the replies in memory for the ring
+ * to send, so the GET replies are always copied; requests are received into memory whole, so their size is capped */
+
+#define NET_RING_ENTRIES 1024       /* submission queue entries */
+#define NET_RING_BUFS 256           /* receive buffers shared by every connection; a power of 2 */
+#define NET_RING_BUF_SIZE 16384     /* bytes per receive buffer */
+#define NET_RING_REQUEST_MAX_LEN (8 << 20)  /* default bytes a request may take */
+
+int net_ring_open(int server_sd, int service_threads, int max_queued, size_t max_len);
+int net_ring_run(void);
+int net_ring_in_use(void);
+int net_ring_queued(void);
+void net_ring_stop(void);
+void net_ring_close(void);
+
+#endif //NET_RING_H
@@ -1,20 +1,79 @@
 #ifndef NETUTILS_H
 #define NETUTILS_H
 
-#define MAX_CONN_BACKLOG 10     /* max number of open client connections */
+#include <sys/types.h>
+#include "DS-MandatoryExercise/arena.h"
+
+#define MAX_CONN_BACKLOG 64     /* room in the server's connection queue */
+
+/* value1 strings travel as a 32-bit length followed by their bytes; longer ones than this max are refused */
+void set_value1_max_len(uint32_t max_len);
+uint32_t get_value1_max_len(void);
+
+/* value1 strings longer than this are received into a temp file in the spool directory, if one is set,
+ * instead of memory */
+#define VALUE1_SPOOL_MIN_LEN VALUE1_CHUNK_SIZE
+int set_value1_spool_dir(const char *dir);
+
+/* connecting functions */
+int connect_to_host(const char *host, int port);
 
 /* sending functions */
 int send_common_header(int socket, header_t *header);
+int send_request_header(int socket, header_t *header);
 int send_reply_header(int socket, reply_t *reply);
 int send_num_items(int socket, reply_t *reply);
 int send_key(int socket, item_t *item);
 int send_values(int socket, item_t *item);
+int send_stored_values(int socket, item_t *item, int fd, off_t offset, uint32_t len, int zero_copy);
+int send_range(int socket, range_t *range);
+int send_items(int socket, item_t *items, uint32_t num_items);
+int send_cursor(int socket, reply_t *reply);
+int send_aggregate(int socket, request_t *request);
+int send_query(int socket, request_t *request);
+int send_keys(int socket, item_t *items, uint32_t num_items);
+int send_result(int socket, reply_t *reply);
+int send_search(int socket, request_t *request);
+int send_key_chunk(int socket, reply_t *reply);
+int send_delta(int socket, char op_code, item_t *item);
+int send_version(int socket, item_t *item);
+int send_txn_ops(int socket, request_t *request);
+int send_txn_results(int socket, txn_op_t *ops, uint32_t num_ops);
+int send_change(int socket, change_t *change);
+int send_seq(int socket, request_t *request);
+int send_watch(int socket, request_t *request);
+int send_lease(int socket, reply_t *reply);
+int send_replica_status(int socket, reply_t *reply);
+int send_stats(int socket, reply_t *reply);
 
 /* receiving functions */
 int recv_common_header(int client_socket, header_t *header);
+int recv_request_header(int socket, header_t *header);
 int recv_reply_header(int socket, reply_t *reply);
 int recv_num_items(int socket, reply_t *reply);
 int recv_key(int socket, item_t *item);
-int recv_values(int socket, item_t *item);
+int recv_values(int socket, item_t *item, arena_t *arena);
+int recv_range(int socket, range_t *range);
+int recv_items(int socket, item_t *items, uint32_t num_items, arena_t *arena);
+int recv_cursor(int socket, reply_t *reply);
+int recv_aggregate(int socket, request_t *request);
+int recv_query(int socket, request_t *request);
+int recv_keys(int socket, item_t *items, uint32_t num_items);
+int recv_result(int socket, reply_t *reply);
+int recv_search(int socket, request_t *request, arena_t *arena);
+int recv_key_chunk(int socket, reply_t *reply);
+int recv_delta(int socket, char op_code, item_t *item);
+int recv_version(int socket, item_t *item);
+int recv_txn_ops(int socket, request_t *request, arena_t *arena);
+int recv_txn_results(int socket, txn_op_t *ops, uint32_t num_ops, arena_t *arena);
+int recv_change(int socket, change_t *change, arena_t *arena);
+int recv_seq(int socket, request_t *request);
+int recv_watch(int socket, request_t *request);
+int recv_lease(int socket, reply_t *reply);
+int recv_replica_status(int socket, reply_t *reply);
+int recv_stats(int socket, reply_t *reply);
+
+/* framing function, for servers that receive requests without the receiving functions above */
+ssize_t request_size(const char *buf, size_t len);
 
 #endif //NETUTILS_H
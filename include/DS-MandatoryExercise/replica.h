@@ -0,0 +1,12 @@
+#ifndef REPLICA_H
+#define REPLICA_H
+
+/* replication: a server started as a replica follows a primary server, applying every change
+ * committed on it to its own DB, and only serves reads; used by kvServer */
+
+int replica_start(const char *primary);
+void replica_stop(void);
+int replica_is_running(void);
+void replica_get_status(replica_status_t *status);
+
+#endif //REPLICA_H
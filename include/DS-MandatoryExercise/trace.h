@@ -0,0 +1,19 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/* request tracing: the thread serving a request stamps each stage of it, and the requests slower than a threshold
+ * are put in a lock-free ring that a background thread flushes to the slow request log; used by kvServer */
+
+#define SLOW_LOG_FILE_NAME "server.slowlog" /* file slow requests are appended to, in the working directory */
+#define SLOW_LOG_FLUSH_MS 1000      /* how often the ring is flushed to SLOW_LOG_FILE_NAME */
+#define TRACE_RING_SIZE 1024        /* slow requests kept between flushes, a power of 2; the ones beyond are dropped */
+
+int slow_log_start(uint64_t slow_us);
+void slow_log_stop(void);
+void trace_request(uint32_t id, char op_code, uint64_t accepted_ns, uint64_t started_ns);
+void trace_received(void);
+void trace_lock_wait(uint64_t wait_ns);
+void trace_executed(void);
+void trace_replied(void);
+
+#endif //TRACE_H
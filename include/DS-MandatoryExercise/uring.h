@@ -0,0 +1,36 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stddef.h>
+#include <linux/io_uring.h>
+
+/* io_uring driven through the raw syscalls, so there's no liburing dependency;
+ * used by the file engine for file I/O & by the server for networking.
+ * a ring is used by a single thread at a time */
+typedef struct {
+    int fd;                         /* io_uring instance */
+    void *rings;                    /* submission & completion rings, which share one mapping */
+    size_t rings_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned sq_entries;
+    unsigned sq_mask;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_array;
+    unsigned cq_mask;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    struct io_uring_cqe *cqes;
+    unsigned tail;                  /* submission queue tail; the kernel sees it once entries are submitted */
+} uring_t;
+
+int uring_init(uring_t *ring, unsigned entries);
+void uring_free(uring_t *ring);
+int uring_register(uring_t *ring, unsigned opcode, void *arg, unsigned nr_args);
+struct io_uring_sqe *uring_get_sqe(uring_t *ring);
+int uring_submit(uring_t *ring, unsigned wait_nr);
+struct io_uring_cqe *uring_peek_cqe(uring_t *ring);
+void uring_cqe_seen(uring_t *ring);
+
+#endif //URING_H
@@ -5,8 +5,12 @@
 #define TRUE 1
 #define FALSE 0
 #define MAX_STR_SIZE 512            /* generic string size */
-#define VALUE1_MAX_STR_SIZE 256     /* size of value1 string */
+#define VALUE1_MAX_STR_SIZE 256     /* value1 buffer size assumed by client API functions that take no size */
+#define VALUE1_DEFAULT_MAX_LEN (1 << 20)    /* default max length of value1, no terminating byte */
+#define VALUE1_CHUNK_SIZE 65536     /* bytes of value1 moved by each socket/file call */
 #define DB_NAME "db"                /* database directory name */
+#define DB_PAGES_NAME "db.pages"    /* page file name; used by the page engine */
+#define DB_PATH_MAX_LEN 200         /* max length of the directory the DB files go in */
 
 /* services: operation codes */
 #define INIT 'a'
@@ -16,6 +20,50 @@
 #define DELETE_KEY 'e'
 #define EXIST 'f'
 #define NUM_ITEMS 'g'
+#define SCAN 'h'
+#define AGGREGATE 'i'
+#define QUERY 'j'
+#define SEARCH 'k'
+#define INCR 'l'
+#define ADD 'm'
+#define UPSERT 'n'
+#define CAS 'o'
+#define TXN 'p'
+#define WATCH 'q'
+#define REPLICA_STATUS 'r'
+#define STATS 's'
+
+/* range queries */
+#define SCAN_MAX_ITEMS 128          /* max number of items the server returns per page */
+
+/* aggregations: functions */
+#define AGG_COUNT 'c'
+#define AGG_SUM 's'
+#define AGG_MIN 'n'
+#define AGG_MAX 'x'
+#define AGG_AVG 'a'
+/* aggregations: fields */
+#define FIELD_VALUE2 '2'
+#define FIELD_VALUE3 '3'
+
+/* value1 search: match modes */
+#define SEARCH_EXACT 'e'
+#define SEARCH_PREFIX 'p'
+#define SEARCH_SUBSTRING 's'
+#define SEARCH_CHUNK_KEYS 1024      /* max number of keys the server sends in one chunk */
+
+/* transactions: sub-operations are GET_VALUE, SET_VALUE, MODIFY_VALUE, DELETE_KEY and this one,
+ * which checks that an item still has a given version (0 meaning that it doesn't exist) */
+#define TXN_COMPARE 'v'
+#define TXN_MAX_OPS 64              /* max number of sub-operations in a transaction */
+
+/* change feed */
+#define WATCH_LAGGED 'L'            /* notification sent instead of changes a watcher fell too far behind to get */
+#define WATCH_KEY_CHANGED 'K'       /* notification sent to keys-only watchers instead of a change: just its key */
+#define MAX_WATCHERS 16             /* max number of watch connections served at once */
+
+/* replication: replicas follow the primary through a watch on every key */
+#define REPLICA_RETRY_S 1           /* seconds a replica waits before reconnecting to the primary */
 
 /* server error codes */
 #define SRV_ERROR 0
@@ -23,22 +71,52 @@
 /* these two are used for the "exist" service */
 #define SRV_EXISTS 1
 #define SRV_NOT_EXISTS 0
+/* used for the "cas" service when the item was modified by someone else */
+#define SRV_CONFLICT 2
+/* used for the sub-operations of a transaction that was rolled back because another one failed */
+#define SRV_ABORTED 3
+/* used when the server is overloaded: the reply header is sent alone, and the client retries after backing off */
+#define SRV_BUSY 4
+#define BUSY_RETRIES 8              /* times a request is retried while the server is busy */
+#define BUSY_BACKOFF_US 500         /* wait before the first retry; it doubles with every retry */
+#define BUSY_BACKOFF_MAX_US 64000   /* longest wait before a retry */
 
 /* DB key file opening modes */
 #define READ 'r'
 #define CREATE 'c'
 #define MODIFY 'm'
 
+/* DB storage engines */
+#define FILE_ENGINE 'f'     /* one key file per item inside DB directory */
+#define PAGE_ENGINE 'p'     /* slotted pages in a memory-mapped file */
+
 /* number casting stuff */
 #define INT 'i'
 #define FLOAT 'f'
 int str_to_num(const char *value_str, void *value, char type);
+int str_to_host_port(const char *str, size_t len, char *host, int *port);
 
 /* file & socket stuff */
 int send_msg(int d, char *buffer, int len);
 int recv_msg(int d, char *buffer, int len);
 ssize_t read_line(int d, char *buffer, int buf_space);
 
+/* in-memory stream: send_msg & recv_msg given MEM_STREAM as descriptor write to & read from the stream
+ * set by the calling thread, so that messages can be built & parsed by code that does its own socket I/O */
+#define MEM_STREAM (-2)
+
+typedef struct {
+    const char *in;             /* bytes read by recv_msg */
+    size_t in_len;
+    size_t in_pos;              /* next byte to read */
+    char *out;                  /* bytes written by send_msg; grows as needed, freed by the stream's owner */
+    size_t out_len;
+    size_t out_cap;
+} mem_stream_t;
+
+void mem_stream_set(mem_stream_t *stream);
+void close_stream(int d);
+
 
 /* types */
 #include <stdint.h>
@@ -46,22 +124,100 @@ ssize_t read_line(int d, char *buffer, int buf_space);
 /* type used to represent the actual elements to be stored */
 typedef struct {
     int32_t key;                        /* key attribute */
-    char value1[VALUE1_MAX_STR_SIZE];   /* string attribute */
+    char *value1;                       /* string attribute; owned by whoever filled the item */
     int32_t value2;                     /* int attribute */
     float value3;                       /* float attribute */
+    uint32_t version;                   /* bumped on every write; used for optimistic concurrency */
 } item_t;
 
+/* type used to represent a sub-operation of a transaction */
+typedef struct {
+    char op_code;                       /* sub-operation: GET_VALUE, SET_VALUE, MODIFY_VALUE, DELETE_KEY or TXN_COMPARE */
+    item_t item;                        /* key & values written, or values read; version compared in case of TXN_COMPARE */
+    int32_t result;                     /* server error code of the sub-operation */
+} txn_op_t;
+
+/* type used to represent a change committed to the DB, as sent to watchers */
+typedef struct {
+    uint64_t seq;                       /* sequence number; increases by 1 with every change */
+    char op_code;                       /* SET_VALUE, MODIFY_VALUE, DELETE_KEY, INIT (DB emptied) or WATCH_LAGGED */
+    item_t item;                        /* item after the change; only its key in case of deletions */
+    uint64_t lag;                       /* changes committed after this one by the time it was sent;
+                                         * changes missed in case of WATCH_LAGGED */
+} change_t;
+
+/* type used to represent how far behind its primary a replica is */
+typedef struct {
+    uint8_t connected;                  /* TRUE while the replica follows the primary */
+    uint64_t applied_seq;               /* primary sequence number of the last change applied */
+    uint64_t lag;                       /* changes the primary had committed after that one when it was sent */
+} replica_status_t;
+
+/* server metrics: latencies are kept in histograms whose bucket i counts the ones under 2^i microseconds
+ * (and at least half that), the last bucket counting every longer one too */
+#define STATS_BUCKETS 24
+#define STATS_NUM_OPS (STATS - INIT + 1)    /* requests are counted per op_code, INIT first */
+#define STATS_HOT_KEYS 16                   /* hottest pinned keys reported */
+
+typedef struct {
+    uint64_t count;
+    uint64_t total_ns;                  /* sum of every latency */
+    uint64_t buckets[STATS_BUCKETS];
+} histogram_t;
+
+/* type used to represent what a server has been doing since it started; made of uint64_t fields only */
+typedef struct {
+    uint64_t requests[STATS_NUM_OPS];   /* requests served per op_code */
+    uint64_t busy[STATS_NUM_OPS];       /* requests shed per op_code, which got SRV_BUSY instead */
+    uint64_t expired[STATS_NUM_OPS];    /* requests per op_code dropped or abandoned because their deadline passed */
+    histogram_t service[STATS_NUM_OPS]; /* from a request being picked up by the server to its reply being written */
+    histogram_t end_to_end[STATS_NUM_OPS];  /* from its connection being accepted to its reply being written */
+    histogram_t conn_q_wait;            /* time connections spent in conn_q before a service thread took them */
+    uint64_t conn_q_depth;              /* connections waiting in conn_q right now */
+    uint64_t conn_q_max_depth;          /* most connections that ever waited in conn_q at once */
+    uint64_t conn_q_full;               /* connections rejected with SRV_BUSY because conn_q was full */
+    histogram_t db_lock_wait;           /* time spent waiting for the DB lock */
+    histogram_t storage_io;             /* time spent in storage engine reads & writes */
+    uint64_t hot_reads;                 /* items read from the value1 copies of pinned keys */
+    uint64_t cold_reads;                /* items read from storage */
+    uint64_t hot_num_keys;              /* keys pinned in memory right now */
+    uint64_t hot_keys[STATS_HOT_KEYS];  /* hottest pinned keys, as uint32_t, hottest first; up to hot_num_keys */
+    uint64_t hot_counts[STATS_HOT_KEYS];    /* estimated recent reads of each of them */
+} server_stats_t;
+
+uint64_t clock_ns(void);
+void histogram_add(histogram_t *histogram, uint64_t ns);
+void histogram_merge(histogram_t *total, const histogram_t *histogram);
+
 /* types used for process communication */
 typedef struct {
     /* common header */
-    uint16_t id;                /* transaction ID */
+    uint32_t id;                /* transaction ID; unique per client process */
     char op_code;               /* operation code that indicates the client API function called */
+    uint32_t deadline_us;       /* requests only: how long the client waits for the reply, in microseconds
+ *                              from sending the request; 0 if it waits as long as it takes */
 } header_t;
 
+typedef struct {
+    /* key range used by range queries */
+    int32_t lo;                 /* first key of the range (inclusive) */
+    int32_t hi;                 /* last key of the range (inclusive) */
+    uint32_t max_items;         /* max number of items to return in one page */
+} range_t;
+
 typedef struct {
     /* client request */
     header_t header;
     item_t item;                /* struct containing all required elements of an item */
+    range_t range;              /* key range; filled in case of range queries */
+    char agg_function;          /* aggregate function; filled in case of aggregations */
+    char agg_field;             /* aggregated field; filled in case of aggregations */
+    int64_t cursor;             /* position where a paged query resumes; filled in case of queries */
+    uint8_t keys_only;          /* TRUE if a query returns keys without values, or a watch gets keys without changes */
+    char search_mode;           /* match mode; filled in case of value1 searches, item.value1 holds the pattern */
+    txn_op_t *ops;              /* sub-operations of a transaction; num_ops tells how many */
+    uint32_t num_ops;
+    uint64_t seq;               /* sequence number a watch starts from (0 means new changes only) */
 } request_t;
 
 typedef struct {
@@ -71,6 +227,14 @@ typedef struct {
  *                              to figure out whether the transaction was successful */
     uint32_t num_items;         /* total number of items stored; filled in case of num_items API call */
     item_t item;                /* struct containing all required elements of an item */
+    uint32_t lease_ms;          /* how long the client may cache the item read; filled in case of GET replies */
+    item_t *items;              /* page of items returned by range queries; num_items tells its size */
+    uint8_t more;               /* TRUE if a range query has items left after this page */
+    int64_t cursor;             /* position where the next page of a range query or query starts */
+    double result;              /* aggregation result; num_items tells how many items were aggregated */
+    int32_t *keys;              /* chunk of keys returned by value1 searches; num_items tells its size */
+    replica_status_t replica;   /* replication progress; filled in case of replica status requests */
+    server_stats_t *stats;      /* server metrics; filled in case of stats requests */
 } reply_t;
 
 #endif //UTILS_H
\ No newline at end of file
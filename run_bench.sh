@@ -0,0 +1,22 @@
+#!/bin/sh
+
+# GET benchmark across value1 sizes, for both storage engines, with GET replies copied to user space (-c)
+# and sent straight from storage; usage: run_bench.sh <PORT> [kvbench options]
+export IP_TUPLES=localhost
+export PORT_TUPLES=$1
+shift
+
+BUILD=$(pwd)/build
+cd "$(mktemp -d)"
+for engine in file page; do
+    for copy in -c ""; do
+        if [ -n "$copy" ]; then mode="copied to user space"; else mode="sent from storage"; fi
+        echo "engine: $engine, GET replies $mode"
+        $BUILD/app/server -e $engine $copy $PORT_TUPLES > /dev/null 2>&1 &
+        SERVER_PID=$!
+        sleep 1
+        $BUILD/bench/kvbench -p $SERVER_PID "$@"
+        kill -INT $SERVER_PID; wait $SERVER_PID
+        rm -rf db db.pages
+    done
+done
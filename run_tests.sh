@@ -6,5 +6,5 @@ export PORT_TUPLES=$2
 
 cd build
 app/server $PORT_TUPLES > /dev/null & 2>&1
-ctest -VV
+ctest -VV -LE perf
 pkill -SIGINT '^server$'
\ No newline at end of file
@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "DS-MandatoryExercise/arena.h"
+
+
+void arena_init(arena_t *arena) {
+    arena->head = NULL;
+}
+
+
+void *arena_alloc(arena_t *arena, const size_t size) {
+    /* returns size bytes aligned like malloc would; NULL if they can't be allocated */
+    size_t aligned = (size + 15) & ~(size_t) 15;
+    arena_block_t *block = arena->head;
+
+    if (!block || block->size - block->used < aligned) {
+        size_t block_size = aligned > ARENA_BLOCK_SIZE ? aligned : ARENA_BLOCK_SIZE;
+        block = malloc(sizeof(arena_block_t) + block_size);
+        if (!block) {
+            perror("Could not allocate arena block"); return NULL;
+        }
+        block->size = block_size;
+        block->used = 0;
+        block->map = NULL;
+
+        /* a big buffer doesn't waste what's left of the current block */
+        if (arena->head && aligned > ARENA_BLOCK_SIZE) {
+            block->next = arena->head->next;
+            arena->head->next = block;
+        } else {
+            block->next = arena->head;
+            arena->head = block;
+        }
+    }
+
+    void *buffer = block->data + block->used;
+    block->used += aligned;
+    return buffer;
+}
+
+
+char *arena_strndup(arena_t *arena, const char *str, const size_t len) {
+    /* copies len bytes of str to the arena, adding a terminating byte */
+    char *copy = arena_alloc(arena, len + 1);
+    if (!copy) return NULL;
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+
+char *arena_map(arena_t *arena, const int fd, const size_t size) {
+    /* maps the first size bytes of fd until the arena is reset; writes to them aren't written back.
+     * the mapping holds no memory of its own, its pages being the file's; fd may be closed afterwards */
+    arena_block_t *block = malloc(sizeof(arena_block_t));
+    if (!block) {
+        perror("Could not allocate arena block"); return NULL;
+    }
+    block->map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (block->map == MAP_FAILED) {
+        perror("Could not map arena block");
+        free(block); return NULL;
+    }
+    block->map_size = size;
+    block->size = block->used = 0;
+
+    /* the current block keeps being allocated from */
+    if (arena->head) {
+        block->next = arena->head->next;
+        arena->head->next = block;
+    } else {
+        block->next = NULL;
+        arena->head = block;
+    }
+    return block->map;
+}
+
+
+static void free_block(arena_block_t *block) {
+    if (block->map) munmap(block->map, block->map_size);
+    free(block);
+}
+
+
+void arena_reset(arena_t *arena) {
+    /* hands every buffer back; one standard block is kept for the next use, bigger ones are freed,
+     * so memory held between uses doesn't grow with the biggest value ever seen */
+    arena_block_t *keep = NULL;
+    arena_block_t *block = arena->head;
+
+    while (block) {
+        arena_block_t *next = block->next;
+        if (!keep && block->size == ARENA_BLOCK_SIZE) keep = block;
+        else free_block(block);
+        block = next;
+    }
+
+    if (keep) {
+        keep->next = NULL;
+        keep->used = 0;
+    }
+    arena->head = keep;
+}
+
+
+void arena_adopt(arena_t *arena, arena_t *other) {
+    /* moves other's buffers to arena, which frees them from now on; other is left empty */
+    if (!other->head) return;
+
+    arena_block_t *last = other->head;
+    while (last->next) last = last->next;
+
+    /* arena's current block stays at the head, so it keeps being allocated from */
+    if (arena->head) {
+        last->next = arena->head->next;
+        arena->head->next = other->head;
+    } else {
+        arena->head = other->head;
+    }
+    other->head = NULL;
+}
+
+
+void arena_free(arena_t *arena) {
+    arena_block_t *block = arena->head;
+    while (block) {
+        arena_block_t *next = block->next;
+        free_block(block);
+        block = next;
+    }
+    arena->head = NULL;
+}
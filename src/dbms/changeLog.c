@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include "DS-MandatoryExercise/utils.h"
+#include "DS-MandatoryExercise/dbms/changeLog.h"
+
+
+int change_log_init(change_log_t *log) {
+    log->changes = malloc(CHANGE_LOG_SIZE * sizeof(change_t));
+    if (!log->changes) {
+        perror("Could not allocate change log"); return -1;
+    }
+    log->first_seq = 1;
+    log->next_seq = 1;
+    log->value1_bytes = 0;
+    pthread_mutex_init(&log->mutex, NULL);
+    pthread_cond_init(&log->cond_appended, NULL);
+    return 0;
+}
+
+
+static void drop_oldest(change_log_t *log) {
+    /* frees the value1 copy of the oldest change kept, which watchers can't read anymore */
+    char *value1 = log->changes[log->first_seq % CHANGE_LOG_SIZE].item.value1;
+    if (value1) {
+        log->value1_bytes -= strlen(value1) + 1;
+        free(value1);
+    }
+    log->first_seq++;
+}
+
+
+void change_log_free(change_log_t *log) {
+    /* watchers may still be waiting for changes, so the lock & cond var are kept; they get an error */
+    if (!log->changes) return;
+    pthread_mutex_lock(&log->mutex);
+    while (log->first_seq < log->next_seq) drop_oldest(log);
+    free(log->changes);
+    log->changes = NULL;
+    pthread_cond_broadcast(&log->cond_appended);
+    pthread_mutex_unlock(&log->mutex);
+}
+
+
+uint64_t change_log_next_seq(change_log_t *log) {
+    pthread_mutex_lock(&log->mutex);
+    uint64_t next_seq = log->next_seq;
+    pthread_mutex_unlock(&log->mutex);
+    return next_seq;
+}
+
+
+void change_log_append(change_log_t *log, const char op_code, const item_t *item) {
+    /* records a committed change and wakes up watchers; the log keeps a copy of value1.
+     * drops the oldest changes once the log is full or their value1 copies take too much memory */
+    pthread_mutex_lock(&log->mutex);
+    if (!log->changes) {
+        pthread_mutex_unlock(&log->mutex); return;
+    }
+
+    if (log->next_seq - log->first_seq == CHANGE_LOG_SIZE) drop_oldest(log);
+
+    change_t *change = &log->changes[log->next_seq % CHANGE_LOG_SIZE];
+    change->seq = log->next_seq++;
+    change->op_code = op_code;
+    change->lag = 0;
+    change->item = *item;
+
+    if (item->value1) {
+        change->item.value1 = strdup(item->value1);
+        if (!change->item.value1) {
+            /* watchers are told they missed every change kept, this one included */
+            perror("Could not copy value1 to change log");
+            while (log->first_seq < log->next_seq) drop_oldest(log);
+        } else {
+            log->value1_bytes += strlen(item->value1) + 1;
+        }
+    }
+    while (log->value1_bytes > CHANGE_LOG_MAX_VALUE1_BYTES && log->next_seq - log->first_seq > 1) drop_oldest(log);
+
+    pthread_cond_broadcast(&log->cond_appended);
+    pthread_mutex_unlock(&log->mutex);
+}
+
+
+static int matches(const change_t *change, const int32_t lo, const int32_t hi) {
+    /* INIT empties the whole DB, so every watcher gets it */
+    return change->op_code == INIT || (change->item.key >= lo && change->item.key <= hi);
+}
+
+
+int change_log_read(change_log_t *log, uint64_t from_seq, const int32_t lo, const int32_t hi, change_t *changes,
+                    const int max_changes, uint64_t *next_seq, uint64_t *missed, const int timeout_ms,
+                    arena_t *arena) {
+    /* copies up to max_changes changes to keys in [lo, hi], starting at sequence number from_seq
+     * (0 meaning the next change), with their value1 strings allocated from arena;
+     * waits up to timeout_ms for one if there's none yet.
+     * next_seq gets where the next read should start, and missed how many changes were dropped
+     * from the log before they could be read. returns the number of changes copied, -1 if the log was freed
+     * or value1 couldn't be copied */
+    struct timespec deadline;
+    int num_changes = 0;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long) (timeout_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&log->mutex);
+
+    /* sequence numbers start over when the server restarts, so positions past the end are reset */
+    if (!from_seq || from_seq > log->next_seq) from_seq = log->next_seq;
+
+    *missed = 0;
+    while (!num_changes) {
+        if (!log->changes) {
+            pthread_mutex_unlock(&log->mutex); return -1;
+        }
+        if (from_seq < log->first_seq) {
+            *missed += log->first_seq - from_seq;
+            from_seq = log->first_seq;
+        }
+
+        for (; from_seq < log->next_seq && num_changes < max_changes; from_seq++) {
+            const change_t *change = &log->changes[from_seq % CHANGE_LOG_SIZE];
+            if (!matches(change, lo, hi)) continue;
+            changes[num_changes] = *change;
+            changes[num_changes].lag = log->next_seq - 1 - change->seq;
+            if (change->item.value1 &&
+                !(changes[num_changes].item.value1 = arena_strndup(arena, change->item.value1,
+                                                                   strlen(change->item.value1)))) {
+                pthread_mutex_unlock(&log->mutex); return -1;
+            }
+            num_changes++;
+        }
+
+        if (num_changes || *missed) break;
+        if (pthread_cond_timedwait(&log->cond_appended, &log->mutex, &deadline) == ETIMEDOUT) break;
+    }
+
+    pthread_mutex_unlock(&log->mutex);
+
+    *next_seq = from_seq;
+    return num_changes;
+}
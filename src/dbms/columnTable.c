@@ -0,0 +1,675 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
+#include "DS-MandatoryExercise/utils.h"
+#include "DS-MandatoryExercise/dbms/columnTable.h"
+#include "DS-MandatoryExercise/dbms/stringSearch.h"
+
+#define COLUMN_TABLE_MIN_CAPACITY 1024
+#define COMPACT_MIN_TOMBSTONES 1024     /* compaction isn't worth it for fewer tombstones */
+#define COMPACT_MIN_GARBAGE (1 << 20)   /* same, for arena bytes */
+#define COMPACT_STEP_ROWS 256           /* rows swept by every write while a compaction runs */
+#define COMPACT_STEP_BYTES (256 << 10)  /* value1 prefix bytes a write copies at most, past its first row */
+#define ARENA_MIN_SIZE (64 << 10)
+
+#define SEARCH_MAX_THREADS 4            /* max number of threads scanning value1 strings */
+#define SEARCH_ROWS_PER_THREAD 16384    /* min number of rows worth giving to a thread */
+
+
+static int column_table_reserve(column_table_t *table, const uint32_t capacity) {
+    /* grows every column to hold at least capacity rows */
+    if (capacity <= table->capacity) return 0;
+
+    uint32_t cap = table->capacity ? table->capacity : COLUMN_TABLE_MIN_CAPACITY;
+    while (cap < capacity) cap <<= 1;
+
+    int32_t *keys = realloc(table->keys, cap * sizeof(int32_t));
+    if (keys) table->keys = keys;
+    int32_t *value2 = realloc(table->value2, cap * sizeof(int32_t));
+    if (value2) table->value2 = value2;
+    float *value3 = realloc(table->value3, cap * sizeof(float));
+    if (value3) table->value3 = value3;
+    uint32_t *version = realloc(table->version, cap * sizeof(uint32_t));
+    if (version) table->version = version;
+    uint8_t *live = realloc(table->live, cap);
+    if (live) table->live = live;
+    uint64_t *value1_off = realloc(table->value1_off, cap * sizeof(uint64_t));
+    if (value1_off) table->value1_off = value1_off;
+    uint32_t *value1_len = realloc(table->value1_len, cap * sizeof(uint32_t));
+    if (value1_len) table->value1_len = value1_len;
+
+    if (!keys || !value2 || !value3 || !version || !live || !value1_off || !value1_len) {
+        perror("Could not allocate table columns"); return -1;
+    }
+    table->capacity = cap;
+    return 0;
+}
+
+
+static uint32_t prefix_len(const column_table_t *table, const uint32_t value1_len) {
+    /* value1 bytes kept in the arena */
+    return value1_len < table->prefix_len ? value1_len : table->prefix_len;
+}
+
+
+static int arena_reserve(column_table_t *table, const uint64_t size) {
+    /* grows the arena to hold at least size bytes; SIMD kernels may read up to
+     * STRING_SEARCH_PADDING bytes past the last prefix, so those are always allocated too */
+    if (size <= table->arena_size && table->arena) return 0;
+
+    uint64_t new_size = table->arena_size ? table->arena_size : ARENA_MIN_SIZE;
+    while (new_size < size) new_size <<= 1;
+
+    char *arena = realloc(table->arena, new_size + STRING_SEARCH_PADDING);
+    if (!arena) {
+        perror("Could not allocate value1 arena"); return -1;
+    }
+    memset(arena + table->arena_used, 0, new_size + STRING_SEARCH_PADDING - table->arena_used);
+    table->arena = arena;
+    table->arena_size = new_size;
+    return 0;
+}
+
+
+static int arena_append(column_table_t *table, const uint64_t row, const char *value1, const uint32_t len) {
+    /* keeps the prefix of a value1 of len bytes; value1 needs to hold that prefix only */
+    uint32_t kept = prefix_len(table, len);
+    if (arena_reserve(table, table->arena_used + kept) == -1) return -1;
+
+    memcpy(table->arena + table->arena_used, value1, kept);
+    table->value1_off[row] = table->arena_used;
+    table->value1_len[row] = len;
+    table->arena_used += kept;
+    return 0;
+}
+
+
+static char *value1_at(const column_table_t *table, const uint32_t row) {
+    /* value1 prefix of a live row, in whichever arena holds it */
+    return (table->live[row] == table->arena_tag ? table->arena : table->old_arena) + table->value1_off[row];
+}
+
+
+static uint64_t arena_size_for(const uint64_t used) {
+    uint64_t size = ARENA_MIN_SIZE;
+    while (size < used) size <<= 1;
+    return size;
+}
+
+
+int column_table_init(column_table_t *table) {
+    memset(table, 0, sizeof(column_table_t));
+    table->arena_tag = 1;
+    table->prefix_len = COLUMN_TABLE_PREFIX_LEN;
+    if (key_map_init(&table->rows, 0) == -1) return -1;
+    if (arena_reserve(table, ARENA_MIN_SIZE) == -1) return -1;
+    return column_table_reserve(table, COLUMN_TABLE_MIN_CAPACITY);
+}
+
+
+void column_table_free(column_table_t *table) {
+    free(table->keys);
+    free(table->value2);
+    free(table->value3);
+    free(table->version);
+    free(table->live);
+    free(table->value1_off);
+    free(table->value1_len);
+    free(table->arena);
+    free(table->old_arena);
+    key_map_free(&table->rows);
+    memset(table, 0, sizeof(column_table_t));
+}
+
+
+void column_table_clear(column_table_t *table) {
+    free(table->old_arena);
+    table->old_arena = NULL;
+    table->num_rows = 0;
+    table->num_live = 0;
+    table->arena_used = 0;
+    table->arena_garbage = 0;
+    key_map_clear(&table->rows);
+}
+
+
+int64_t value2_sort_key(const int32_t value2, const int32_t key) {
+    /* composite key that orders items by value2 first and by key next; used by value2 queries */
+    return (int64_t) (((uint64_t) (int64_t) value2 << 32) | (uint32_t) key);
+}
+
+
+int column_table_get(const column_table_t *table, const int32_t key, int32_t *value2, float *value3,
+                     uint32_t *version) {
+    /* any of the value pointers may be NULL if that value isn't needed; value1 is read apart */
+    uint64_t row;
+
+    if (key_map_get(&table->rows, key, &row) == -1) return -1;
+    if (value2) *value2 = table->value2[row];
+    if (value3) *value3 = table->value3[row];
+    if (version) *version = table->version[row];
+    return 0;
+}
+
+
+int column_table_set_values(column_table_t *table, const int32_t key, const int32_t value2, const float value3,
+                            const uint32_t version) {
+    /* updates the numeric values & version of key's row, leaving its value1 as it is; -1 if key doesn't exist */
+    uint64_t row;
+
+    if (key_map_get(&table->rows, key, &row) == -1) return -1;
+    table->value2[row] = value2;
+    table->value3[row] = value3;
+    table->version[row] = version;
+    return 0;
+}
+
+
+const char *column_table_get_value1(const column_table_t *table, const int32_t key, uint32_t *len) {
+    /* returns where the value1 prefix of key is in the arena, without terminating byte, and stores the length of
+     * the whole value1 in len; the prefix is its first prefix_len bytes at most.
+     * the pointer is only valid until the table is modified. returns NULL if key doesn't exist */
+    uint64_t row;
+
+    if (key_map_get(&table->rows, key, &row) == -1) return NULL;
+    *len = table->value1_len[row];
+    return value1_at(table, (uint32_t) row);
+}
+
+
+static int compact_step(column_table_t *table, const uint32_t max_rows, const uint64_t max_bytes) {
+    /* sweeps up to max_rows rows of the running compaction, stopping early once max_bytes of value1 were copied;
+     * the compaction is over once every row is swept */
+    uint64_t copied = 0;
+    for (uint32_t i = 0; i < max_rows && copied < max_bytes && table->compact_src < table->num_rows; i++) {
+        uint32_t src = table->compact_src, dst = table->compact_dst;
+        if (!table->live[src]) {
+            table->compact_src++; continue;
+        }
+
+        if (table->live[src] != table->arena_tag) {
+            if (arena_append(table, src, table->old_arena + table->value1_off[src], table->value1_len[src]) == -1)
+                return -1;
+            table->live[src] = table->arena_tag;
+            copied += prefix_len(table, table->value1_len[src]);
+        }
+        if (src != dst) {
+            if (key_map_put(&table->rows, table->keys[src], dst) == -1) return -1;
+            table->keys[dst] = table->keys[src];
+            table->value2[dst] = table->value2[src];
+            table->value3[dst] = table->value3[src];
+            table->version[dst] = table->version[src];
+            table->value1_off[dst] = table->value1_off[src];
+            table->value1_len[dst] = table->value1_len[src];
+            table->live[dst] = table->live[src];
+            table->live[src] = 0;
+        }
+        table->compact_src++;
+        table->compact_dst++;
+    }
+
+    if (table->compact_src == table->num_rows) {
+        table->num_rows = table->compact_dst;
+        free(table->old_arena);
+        table->old_arena = NULL;
+    }
+    return 0;
+}
+
+
+static int compact_start(column_table_t *table) {
+    /* value1 prefixes are copied to a new arena as their rows are swept; the old one is freed once they all are */
+    uint64_t arena_size = arena_size_for(table->arena_used - table->arena_garbage);
+    char *arena = calloc(1, arena_size + STRING_SEARCH_PADDING);
+    if (!arena) {
+        perror("Could not allocate value1 arena"); return -1;
+    }
+
+    table->old_arena = table->arena;
+    table->arena = arena;
+    table->arena_size = arena_size;
+    table->arena_used = 0;
+    table->arena_garbage = 0;
+    table->arena_tag = table->arena_tag == 1 ? 2 : 1;
+    table->compact_src = 0;
+    table->compact_dst = 0;
+    return 0;
+}
+
+
+static int compact_some(column_table_t *table) {
+    /* called after every write: starts a compaction once tombstones outnumber live rows or garbage fills half
+     * the arena, and sweeps the next few rows of the running one */
+    if (!table->old_arena) {
+        uint32_t tombstones = table->num_rows - table->num_live;
+        if (!(tombstones >= COMPACT_MIN_TOMBSTONES && tombstones > table->num_live) &&
+            !(table->arena_garbage >= COMPACT_MIN_GARBAGE && table->arena_garbage > table->arena_used / 2))
+            return 0;
+        if (compact_start(table) == -1) return -1;
+    }
+    return compact_step(table, COMPACT_STEP_ROWS, COMPACT_STEP_BYTES);
+}
+
+
+int column_table_put(column_table_t *table, const int32_t key, const char *value1, const uint32_t value1_len,
+                     const int32_t value2, const float value3, const uint32_t version) {
+    /* inserts a row for key or updates the one it already has; value1 is value1_len bytes long,
+     * but only its prefix is read */
+    uint64_t row;
+    uint32_t len = value1_len, kept = prefix_len(table, len);
+
+    if (key_map_get(&table->rows, key, &row) == -1) {
+        if (column_table_reserve(table, table->num_rows + 1) == -1) return -1;
+        row = table->num_rows;
+        if (arena_append(table, row, value1, len) == -1) return -1;
+        if (key_map_put(&table->rows, key, row) == -1) return -1;
+        table->keys[row] = key;
+        table->live[row] = table->arena_tag;
+        table->num_rows++;
+        table->num_live++;
+    } else if (kept <= prefix_len(table, table->value1_len[row])) {
+        /* new prefix fits where the old one was, in whichever arena that is */
+        memcpy(value1_at(table, (uint32_t) row), value1, kept);
+        if (table->live[row] == table->arena_tag)
+            table->arena_garbage += prefix_len(table, table->value1_len[row]) - kept;
+        table->value1_len[row] = len;
+    } else {
+        if (table->live[row] == table->arena_tag) table->arena_garbage += prefix_len(table, table->value1_len[row]);
+        if (arena_append(table, row, value1, len) == -1) return -1;
+        table->live[row] = table->arena_tag;
+    }
+    table->value2[row] = value2;
+    table->value3[row] = value3;
+    table->version[row] = version;
+
+    /* the row is in place either way; a compaction step that can't allocate is retried on the next write */
+    compact_some(table);
+    return 0;
+}
+
+
+int column_table_prepare_put(column_table_t *table, const int32_t key, const uint32_t value1_len) {
+    /* allocates whatever column_table_put needs to put a value1 of value1_len bytes for key,
+     * so that putting it right after can't fail */
+    uint64_t row;
+    uint32_t kept = prefix_len(table, value1_len);
+
+    if (key_map_get(&table->rows, key, &row) == -1) {
+        if (column_table_reserve(table, table->num_rows + 1) == -1 || key_map_reserve(&table->rows) == -1)
+            return -1;
+    } else if (kept <= prefix_len(table, table->value1_len[row])) return 0;
+    return arena_reserve(table, table->arena_used + kept);
+}
+
+
+int column_table_remove(column_table_t *table, const int32_t key) {
+    /* leaves a tombstone behind; rows are compacted once tombstones outnumber live rows */
+    uint64_t row;
+
+    if (key_map_get(&table->rows, key, &row) == -1) return -1;
+    key_map_remove(&table->rows, key);
+    if (table->live[row] == table->arena_tag) table->arena_garbage += prefix_len(table, table->value1_len[row]);
+    table->live[row] = 0;
+    table->num_live--;
+
+    return compact_some(table);
+}
+
+
+int column_table_compact(column_table_t *table) {
+    /* runs a whole compaction at once, or finishes the running one: live rows are moved down over tombstones,
+     * keeping their relative order, and their value1 prefixes copied to a new arena without garbage */
+    if (!table->old_arena && compact_start(table) == -1) return -1;
+    return compact_step(table, UINT32_MAX, UINT64_MAX);
+}
+
+
+static void sift_down(int64_t *heap, const uint32_t size, uint32_t pos) {
+    /* restores the max-heap property below pos */
+    while (TRUE) {
+        uint32_t largest = pos, left = 2 * pos + 1, right = 2 * pos + 2;
+        if (left < size && heap[left] > heap[largest]) largest = left;
+        if (right < size && heap[right] > heap[largest]) largest = right;
+        if (largest == pos) return;
+
+        int64_t tmp = heap[pos]; heap[pos] = heap[largest]; heap[largest] = tmp;
+        pos = largest;
+    }
+}
+
+
+uint32_t column_table_select_value2(const column_table_t *table, const int32_t lo, const int32_t hi,
+                                    const int64_t from, int64_t *sort_keys, const uint32_t max_keys) {
+    /* full scan used to answer value2 queries without a secondary index: fills sort_keys with
+     * the max_keys smallest value2 sort keys >= from whose value2 is in [lo, hi], in order;
+     * returns how many were found */
+    uint32_t size = 0;
+
+    if (!max_keys) return 0;
+
+    /* keep the smallest sort keys seen so far in a max-heap */
+    for (uint32_t row = 0; row < table->num_rows; row++) {
+        if (!table->live[row] || table->value2[row] < lo || table->value2[row] > hi) continue;
+
+        int64_t sort_key = value2_sort_key(table->value2[row], table->keys[row]);
+        if (sort_key < from) continue;
+
+        if (size < max_keys) {
+            /* sift up */
+            uint32_t pos = size++;
+            sort_keys[pos] = sort_key;
+            while (pos && sort_keys[(pos - 1) / 2] < sort_keys[pos]) {
+                int64_t tmp = sort_keys[pos]; sort_keys[pos] = sort_keys[(pos - 1) / 2]; sort_keys[(pos - 1) / 2] = tmp;
+                pos = (pos - 1) / 2;
+            }
+        } else if (sort_key < sort_keys[0]) {
+            sort_keys[0] = sort_key;
+            sift_down(sort_keys, size, 0);
+        }
+    }
+
+    /* heap sort leaves them in ascending order */
+    for (uint32_t end = size; end > 1; end--) {
+        int64_t tmp = sort_keys[0]; sort_keys[0] = sort_keys[end - 1]; sort_keys[end - 1] = tmp;
+        sift_down(sort_keys, end - 1, 0);
+    }
+    return size;
+}
+
+
+/* aggregation kernels: every kernel aggregates the live rows whose key is in [lo, hi];
+ * count, sum, min & max are computed in the same pass */
+
+static void aggregate_value2_scalar(const column_table_t *table, const uint32_t first, const int32_t lo,
+                                    const int32_t hi, uint32_t *count, int64_t *sum, int32_t *min, int32_t *max) {
+    for (uint32_t row = first; row < table->num_rows; row++) {
+        if (!table->live[row] || table->keys[row] < lo || table->keys[row] > hi) continue;
+        int32_t value = table->value2[row];
+        (*count)++;
+        *sum += value;
+        if (value < *min) *min = value;
+        if (value > *max) *max = value;
+    }
+}
+
+
+static void aggregate_value3_scalar(const column_table_t *table, const uint32_t first, const int32_t lo,
+                                    const int32_t hi, uint32_t *count, double *sum, float *min, float *max) {
+    for (uint32_t row = first; row < table->num_rows; row++) {
+        if (!table->live[row] || table->keys[row] < lo || table->keys[row] > hi) continue;
+        float value = table->value3[row];
+        (*count)++;
+        *sum += value;
+        if (value < *min) *min = value;
+        if (value > *max) *max = value;
+    }
+}
+
+
+#ifdef HAVE_X86_SIMD
+
+__attribute__((target("avx2")))
+static __m256i row_mask_avx2(const column_table_t *table, const uint32_t row, const __m256i lo, const __m256i hi) {
+    /* all ones in the lanes of the 8 rows starting at row that are live and in [lo, hi] */
+    __m256i keys = _mm256_loadu_si256((const __m256i *) (table->keys + row));
+    __m256i out = _mm256_or_si256(_mm256_cmpgt_epi32(lo, keys), _mm256_cmpgt_epi32(keys, hi));
+    __m256i live = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) (table->live + row)));
+    live = _mm256_cmpgt_epi32(live, _mm256_setzero_si256());
+    return _mm256_andnot_si256(out, live);
+}
+
+
+__attribute__((target("avx2,popcnt")))
+static uint32_t aggregate_value2_avx2(const column_table_t *table, const int32_t lo, const int32_t hi,
+                                      uint32_t *count, int64_t *sum, int32_t *min, int32_t *max) {
+    /* returns the first row left for the scalar kernel */
+    const __m256i v_lo = _mm256_set1_epi32(lo), v_hi = _mm256_set1_epi32(hi);
+    const __m256i v_int_max = _mm256_set1_epi32(INT32_MAX), v_int_min = _mm256_set1_epi32(INT32_MIN);
+    __m256i v_sum = _mm256_setzero_si256(), v_min = v_int_max, v_max = v_int_min;
+    uint32_t row = 0;
+
+    for (; row + 8 <= table->num_rows; row += 8) {
+        __m256i mask = row_mask_avx2(table, row, v_lo, v_hi);
+        __m256i values = _mm256_loadu_si256((const __m256i *) (table->value2 + row));
+        __m256i masked = _mm256_and_si256(values, mask);
+
+        *count += (uint32_t) _mm_popcnt_u32((unsigned) _mm256_movemask_ps(_mm256_castsi256_ps(mask)));
+        /* widen to 64 bits before adding so sums can't overflow */
+        v_sum = _mm256_add_epi64(v_sum, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(masked)));
+        v_sum = _mm256_add_epi64(v_sum, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(masked, 1)));
+        v_min = _mm256_min_epi32(v_min, _mm256_blendv_epi8(v_int_max, values, mask));
+        v_max = _mm256_max_epi32(v_max, _mm256_blendv_epi8(v_int_min, values, mask));
+    }
+
+    int64_t sums[4]; int32_t mins[8], maxs[8];
+    _mm256_storeu_si256((__m256i *) sums, v_sum);
+    _mm256_storeu_si256((__m256i *) mins, v_min);
+    _mm256_storeu_si256((__m256i *) maxs, v_max);
+    for (int i = 0; i < 4; i++) *sum += sums[i];
+    for (int i = 0; i < 8; i++) {
+        if (mins[i] < *min) *min = mins[i];
+        if (maxs[i] > *max) *max = maxs[i];
+    }
+    return row;
+}
+
+
+__attribute__((target("avx2,popcnt")))
+static uint32_t aggregate_value3_avx2(const column_table_t *table, const int32_t lo, const int32_t hi,
+                                      uint32_t *count, double *sum, float *min, float *max) {
+    /* returns the first row left for the scalar kernel */
+    const __m256i v_lo = _mm256_set1_epi32(lo), v_hi = _mm256_set1_epi32(hi);
+    const __m256 v_inf = _mm256_set1_ps(INFINITY), v_neg_inf = _mm256_set1_ps(-INFINITY);
+    __m256d v_sum_lo = _mm256_setzero_pd(), v_sum_hi = _mm256_setzero_pd();
+    __m256 v_min = v_inf, v_max = v_neg_inf;
+    uint32_t row = 0;
+
+    for (; row + 8 <= table->num_rows; row += 8) {
+        __m256 mask = _mm256_castsi256_ps(row_mask_avx2(table, row, v_lo, v_hi));
+        __m256 values = _mm256_loadu_ps(table->value3 + row);
+        __m256 masked = _mm256_and_ps(values, mask);
+
+        *count += (uint32_t) _mm_popcnt_u32((unsigned) _mm256_movemask_ps(mask));
+        /* accumulate in double precision, like the scalar kernel */
+        v_sum_lo = _mm256_add_pd(v_sum_lo, _mm256_cvtps_pd(_mm256_castps256_ps128(masked)));
+        v_sum_hi = _mm256_add_pd(v_sum_hi, _mm256_cvtps_pd(_mm256_extractf128_ps(masked, 1)));
+        v_min = _mm256_min_ps(v_min, _mm256_blendv_ps(v_inf, values, mask));
+        v_max = _mm256_max_ps(v_max, _mm256_blendv_ps(v_neg_inf, values, mask));
+    }
+
+    double sums[4]; float mins[8], maxs[8];
+    _mm256_storeu_pd(sums, _mm256_add_pd(v_sum_lo, v_sum_hi));
+    _mm256_storeu_ps(mins, v_min);
+    _mm256_storeu_ps(maxs, v_max);
+    for (int i = 0; i < 4; i++) *sum += sums[i];
+    for (int i = 0; i < 8; i++) {
+        if (mins[i] < *min) *min = mins[i];
+        if (maxs[i] > *max) *max = maxs[i];
+    }
+    return row;
+}
+
+
+static int use_avx2(void) {
+    static int supported = -1;
+    if (supported == -1) supported = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt");
+    return supported;
+}
+
+#endif // HAVE_X86_SIMD
+
+
+void column_table_aggregate(const column_table_t *table, const char field, const int32_t lo, const int32_t hi,
+                            aggregation_t *result) {
+    /* aggregates the given field of the items whose key is in [lo, hi];
+     * uses AVX2 kernels when the CPU supports them and the scalar ones to finish the last rows */
+    uint32_t first = 0;
+    result->count = 0;
+
+    if (field == FIELD_VALUE2) {
+        int64_t sum = 0; int32_t min = INT32_MAX, max = INT32_MIN;
+#ifdef HAVE_X86_SIMD
+        if (use_avx2()) first = aggregate_value2_avx2(table, lo, hi, &result->count, &sum, &min, &max);
+#endif
+        aggregate_value2_scalar(table, first, lo, hi, &result->count, &sum, &min, &max);
+        result->sum = (double) sum;
+        result->min = min;
+        result->max = max;
+    } else {
+        double sum = 0; float min = INFINITY, max = -INFINITY;
+#ifdef HAVE_X86_SIMD
+        if (use_avx2()) first = aggregate_value3_avx2(table, lo, hi, &result->count, &sum, &min, &max);
+#endif
+        aggregate_value3_scalar(table, first, lo, hi, &result->count, &sum, &min, &max);
+        result->sum = sum;
+        result->min = min;
+        result->max = max;
+    }
+
+    if (!result->count) result->min = result->max = 0;
+}
+
+
+/* value1 search: rows are split among several threads, each one collecting the keys that match, or that might
+ * match but whose prefix is not enough to tell: those are checked against their whole value1 afterwards */
+
+typedef struct {
+    const column_table_t *table;
+    char mode;
+    const char *pattern;
+    size_t pattern_len;
+    uint32_t first_row;     /* rows [first_row, last_row) are scanned by this thread */
+    uint32_t last_row;
+    int32_t *keys;          /* matching keys found */
+    uint8_t *unsettled;     /* TRUE for keys that still have to be checked */
+    uint32_t num_keys;
+    uint32_t capacity;
+    int error;
+} search_task_t;
+
+
+static int prefix_matches(const char mode, const char *prefix, const uint32_t kept, const uint32_t len,
+                          const char *pattern, const size_t pattern_len) {
+    /* tells from the kept bytes of a value1 of len bytes whether it matches pattern: returns TRUE or FALSE,
+     * or -1 if the rest of value1 decides */
+    if (len <= kept) return string_matches(mode, prefix, len, pattern, pattern_len);
+    if (pattern_len > len) return FALSE;
+
+    switch (mode) {
+        case SEARCH_EXACT:
+            if (pattern_len != len) return FALSE;
+            return memcmp(prefix, pattern, kept) == 0 ? -1 : FALSE;
+        case SEARCH_PREFIX:
+            if (pattern_len <= kept) return memcmp(prefix, pattern, pattern_len) == 0;
+            return memcmp(prefix, pattern, kept) == 0 ? -1 : FALSE;
+        default:
+            /* a match within the prefix is enough, any other one may be further on */
+            if (string_matches(mode, prefix, kept, pattern, pattern_len)) return TRUE;
+            return -1;
+    }
+}
+
+
+static void *search_rows(void *args) {
+    search_task_t *task = (search_task_t *) args;
+    const column_table_t *table = task->table;
+
+    for (uint32_t row = task->first_row; row < task->last_row; row++) {
+        if (!table->live[row]) continue;
+        int match = prefix_matches(task->mode, value1_at(table, row), table->prefix_len, table->value1_len[row],
+                                   task->pattern, task->pattern_len);
+        if (!match) continue;
+
+        if (task->num_keys == task->capacity) {
+            uint32_t capacity = task->capacity ? task->capacity * 2 : 256;
+            int32_t *keys = realloc(task->keys, capacity * sizeof(int32_t));
+            if (keys) task->keys = keys;
+            uint8_t *unsettled = realloc(task->unsettled, capacity);
+            if (unsettled) task->unsettled = unsettled;
+            if (!keys || !unsettled) {
+                task->error = TRUE; return NULL;
+            }
+            task->capacity = capacity;
+        }
+        task->unsettled[task->num_keys] = match == -1;
+        task->keys[task->num_keys++] = table->keys[row];
+    }
+    return NULL;
+}
+
+
+int column_table_search(const column_table_t *table, const char mode, const char *pattern,
+                        int (*check)(int32_t key, char mode, const char *pattern, size_t pattern_len),
+                        int32_t **keys, uint32_t *num_keys) {
+    /* finds the keys whose value1 matches pattern (exact, prefix or substring match, depending on mode);
+     * rows whose prefix doesn't settle it are passed to check, from the calling thread and in row order,
+     * which returns TRUE or FALSE after reading their whole value1, or -1 on error.
+     * keys is allocated here, in row order, and must be freed by the caller */
+    search_task_t tasks[SEARCH_MAX_THREADS];
+    pthread_t threads[SEARCH_MAX_THREADS];
+    int started[SEARCH_MAX_THREADS] = {0};
+
+    if (mode != SEARCH_EXACT && mode != SEARCH_PREFIX && mode != SEARCH_SUBSTRING) {
+        fprintf(stderr, "Invalid search mode\n"); return -1;
+    }
+
+    /* one thread per SEARCH_ROWS_PER_THREAD rows, up to the number of CPUs */
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t num_threads = table->num_rows / SEARCH_ROWS_PER_THREAD + 1;
+    if (num_threads > SEARCH_MAX_THREADS) num_threads = SEARCH_MAX_THREADS;
+    if (num_cpus > 0 && num_threads > (uint32_t) num_cpus) num_threads = (uint32_t) num_cpus;
+
+    uint32_t rows_per_thread = table->num_rows / num_threads + 1;
+    for (uint32_t i = 0; i < num_threads; i++) {
+        tasks[i] = (search_task_t) {
+            .table = table, .mode = mode, .pattern = pattern, .pattern_len = strlen(pattern),
+            .first_row = i * rows_per_thread,
+            .last_row = (i + 1) * rows_per_thread < table->num_rows ? (i + 1) * rows_per_thread : table->num_rows
+        };
+        if (tasks[i].first_row > tasks[i].last_row) tasks[i].first_row = tasks[i].last_row;
+    }
+
+    /* current thread scans the first chunk itself */
+    for (uint32_t i = 1; i < num_threads; i++) {
+        if (pthread_create(&threads[i], NULL, search_rows, &tasks[i]) == 0) started[i] = TRUE;
+        else search_rows(&tasks[i]);
+    }
+    search_rows(&tasks[0]);
+
+    /* gather results in row order */
+    uint32_t total = 0;
+    int error = FALSE, check_error = FALSE;
+    for (uint32_t i = 0; i < num_threads; i++) {
+        if (started[i]) pthread_join(threads[i], NULL);
+        total += tasks[i].num_keys;
+        error |= tasks[i].error;
+    }
+
+    *keys = error ? NULL : malloc((total ? total : 1) * sizeof(int32_t));
+    if (!*keys) error = TRUE;
+    *num_keys = 0;
+    for (uint32_t i = 0; i < num_threads; i++) {
+        for (uint32_t k = 0; !error && !check_error && k < tasks[i].num_keys; k++) {
+            int match = TRUE;
+            if (tasks[i].unsettled[k]) match = check(tasks[i].keys[k], mode, pattern, tasks[i].pattern_len);
+            if (match == -1) check_error = TRUE;
+            else if (match) (*keys)[(*num_keys)++] = tasks[i].keys[k];
+        }
+        free(tasks[i].keys);
+        free(tasks[i].unsettled);
+    }
+
+    if (error) fprintf(stderr, "Could not allocate search results\n");
+    if (error || check_error) {
+        free(*keys); *keys = NULL;
+        *num_keys = 0; return -1;
+    }
+    return 0;
+}
@@ -1,166 +1,835 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <dirent.h>
 #include <errno.h>
 #include "DS-MandatoryExercise/utils.h"
+#include "DS-MandatoryExercise/dbms/changeLog.h"
+#include "DS-MandatoryExercise/dbms/columnTable.h"
 #include "DS-MandatoryExercise/dbms/dbmsUtils.h"
+#include "DS-MandatoryExercise/dbms/fileStore.h"
+#include "DS-MandatoryExercise/dbms/hotKeys.h"
+#include "DS-MandatoryExercise/dbms/pageStore.h"
+#include "DS-MandatoryExercise/dbms/skipList.h"
 #include "DS-MandatoryExercise/dbms/dbms.h"
 
 
-int db_list_items(void) {
-    struct dirent *dir_ent;
-    DIR *db = open_db();
+static char db_engine = FILE_ENGINE;    /* storage engine in use */
+static skip_list_t key_index;           /* every stored key, in order; used for range scans */
+static column_table_t item_table;       /* every item but the rest of its value1 past a short prefix;
+                                         * used for aggregations, value1 search & versions */
+static uint32_t search_len = COLUMN_TABLE_PREFIX_LEN;   /* value1 bytes item_table keeps */
+static skip_list_t value2_index;        /* optional secondary index: value2 sort keys, in order */
+static int value2_indexed = FALSE;      /* TRUE if value2_index is in use */
+static change_log_t change_log;         /* recent changes, read by watchers */
+static int in_txn = FALSE;              /* TRUE while a transaction runs; its changes are logged once committed */
+static arena_t scratch_arena;           /* value1 copies needed while an item is loaded or rewritten */
+static hot_keys_t hot_keys;             /* most read keys, which keep a copy of their value1 strings */
+static uint64_t hot_reads, cold_reads;  /* items read from those copies & from storage */
+static histogram_t io_time;             /* time spent in storage engine reads & writes made while serving */
+static _Thread_local uint64_t thread_io_ns; /* part of io_time spent by the calling thread */
+static _Thread_local uint64_t deadline_ns;  /* work the calling thread starts after it is abandoned; 0 for none */
+static _Thread_local int abandoned;         /* TRUE if work was abandoned since the deadline was set */
+
+
+static void add_io_time(const uint64_t start) {
+    /* records a storage engine read or write that started at start (clock_ns) */
+    uint64_t io_ns = clock_ns() - start;
+    histogram_add(&io_time, io_ns);
+    thread_io_ns += io_ns;
+}
+
+
+static int past_deadline(void) {
+    /* TRUE if the calling thread's deadline passed, and the work it was about to start is abandoned;
+     * never within a transaction, which may only stop where it can be rolled back */
+    if (!deadline_ns || in_txn || clock_ns() < deadline_ns) return FALSE;
+    abandoned = TRUE;
+    return TRUE;
+}
+
+
+static int index_item(const int key, const char *value1, const int value2, const float value3,
+                      const uint32_t version) {
+    /* callback used to build key_index & item_table from the stored items when the DB is opened */
+    if (skip_list_insert(&key_index, key) == -1) return -1;
+    return column_table_put(&item_table, key, value1, (uint32_t) strlen(value1), value2, value3, version);
+}
+
+
+static int load_item(const int key) {
+    /* callback used by the page engine, which hands out keys only */
+    char *value1; int value2; float value3; uint32_t version;
+
+    arena_reset(&scratch_arena);
+    if (page_store_read_item(key, &value1, &value2, &value3, &version, &scratch_arena) == -1) return -1;
+    return index_item(key, value1, value2, value3, version);
+}
+
+
+static int read_stored_item(const int key, char **value1, int *value2, float *value3, uint32_t *version,
+                            arena_t *arena) {
+    /* reads an item through the engine in use, value1 allocated from arena */
+    uint64_t start = clock_ns();
+    int result = db_engine == PAGE_ENGINE ? page_store_read_item(key, value1, value2, value3, version, arena)
+                                          : file_store_read_item(key, value1, value2, value3, version, arena);
+    add_io_time(start);
+    return result;
+}
+
+
+static void copy_hot_value1(const int key, const char *value1) {
+    /* pinned keys keep a copy of value1, whatever its length, while the copies fit in HOT_VALUES_MAX_BYTES */
+    if (hot_keys_pinned(&hot_keys, key)) hot_keys_set_value1(&hot_keys, key, value1);
+}
+
+
+static int hot_value1_fits(const int key, const uint32_t len) {
+    /* TRUE if key is pinned and a copy of a len bytes value1 would still fit */
+    return hot_keys_pinned(&hot_keys, key) && hot_keys.value1_bytes + len + 1 <= HOT_VALUES_MAX_BYTES;
+}
+
+
+static int check_value1(const int32_t key, const char mode, const char *pattern, const size_t pattern_len) {
+    /* callback used by value1 searches for the items whose value1 prefix in item_table doesn't tell
+     * whether they match; their whole value1 is read from storage */
+    char *value1; int value2; float value3;
+
+    arena_reset(&scratch_arena);
+    if (read_stored_item(key, &value1, &value2, &value3, NULL, &scratch_arena) == -1) return -1;
+    size_t len = strlen(value1);
+    switch (mode) {
+        case SEARCH_EXACT: return len == pattern_len && memcmp(value1, pattern, len) == 0;
+        case SEARCH_PREFIX: return len >= pattern_len && memcmp(value1, pattern, pattern_len) == 0;
+        default: return strstr(value1, pattern) != NULL;
+    }
+}
 
-    if (!db) {
-        perror("Could not open DB directory");
+
+static void log_change(const char op_code, const int key, const char *value1, const int value2, const float value3,
+                       const uint32_t version) {
+    /* the change log keeps its own copy of value1 */
+    item_t item = {.key = key, .value1 = (char *) value1, .value2 = value2, .value3 = value3, .version = version};
+    change_log_append(&change_log, op_code, &item);
+}
+
+
+static int store_item(const int key, const char *value1, const int *value2, const float *value3, const char mode,
+                      const uint32_t version) {
+    /* writes an item through the engine in use with the given version, and updates in-memory indexes;
+     * they get room for it first, so that once the write is durable nothing is left to fail */
+    int32_t old_value2;
+    int found = column_table_get(&item_table, key, &old_value2, NULL, NULL) == 0;
+    uint32_t len = (uint32_t) strlen(value1);
+    int64_t sort_key = value2_sort_key(*value2, key);
+
+    if (mode != CREATE && mode != MODIFY) {
+        perror("Invalid open file mode");
         return -1;
     }
+    /* found up front, since the file engine may defer its writes */
+    if (mode == CREATE && found) {
+        fprintf(stderr, "Key already exists\n"); return -1;
+    }
+
+    /* new keys go into the key index, and new value2 sort keys into the value2 index; taken out again
+     * if the write fails */
+    int add_key = mode == CREATE && !found;
+    int add_sort_key = value2_indexed && (!found || value2_sort_key(old_value2, key) != sort_key);
+    if (add_key && skip_list_insert(&key_index, key) == -1) return -1;
+    int result = add_sort_key ? skip_list_insert(&value2_index, sort_key) : 0;
+    if (result == -1) {
+        if (add_key) skip_list_remove(&key_index, key);
+        return -1;
+    }
+    result = column_table_prepare_put(&item_table, key, len);
 
-    while ((dir_ent = readdir(db)) != NULL) {
-        if (!strcmp(dir_ent->d_name, ".") || !strcmp(dir_ent->d_name, "..")) continue;
-        printf("%s\n", dir_ent->d_name);
+    if (result == 0) {
+        uint64_t start = clock_ns();
+        result = db_engine == PAGE_ENGINE ? page_store_write_item(key, value1, value2, value3, version, mode)
+                                          : file_store_write_item(key, value1, value2, value3, version, mode);
+        add_io_time(start);
+    }
+    if (result == -1) {
+        if (add_sort_key) skip_list_remove(&value2_index, sort_key);
+        if (add_key) skip_list_remove(&key_index, key);
+        return -1;
     }
 
-    closedir(db); return 0;
+    if (add_sort_key && found) skip_list_remove(&value2_index, value2_sort_key(old_value2, key));
+    copy_hot_value1(key, value1);
+    if (!in_txn) log_change(mode == CREATE ? SET_VALUE : MODIFY_VALUE, key, value1, *value2, *value3, version);
+    return column_table_put(&item_table, key, value1, len, *value2, *value3, version);
 }
 
 
-int db_get_num_items(void) {
-    struct dirent *dir_ent;
-    DIR *db = open_db();
+static int write_item(const int key, const char *value1, const int *value2, const float *value3, const char mode,
+                      uint32_t *version) {
+    /* writes an item with the next version number, which is stored in version if it isn't NULL */
+    uint32_t new_version = 0;
+    int found = column_table_get(&item_table, key, NULL, NULL, &new_version) == 0;
+
+    /* versions start at 1 and are never 0, even after wrapping around */
+    new_version = mode == CREATE || !found || new_version == UINT32_MAX ? 1 : new_version + 1;
+
+    if (store_item(key, value1, value2, value3, mode, new_version) == -1) return -1;
+    if (version) *version = new_version;
+    return 0;
+}
+
+
+static int same_value1(const int key, const char *value1) {
+    /* TRUE if value1 is the one stored for key, as far as memory tells: the hot copy or a complete prefix */
+    uint32_t len;
+    const char *stored = hot_keys_get_value1(&hot_keys, key);
+    if (stored) return strcmp(stored, value1) == 0;
+    stored = column_table_get_value1(&item_table, key, &len);
+    return stored && len <= item_table.prefix_len && strlen(value1) == len && memcmp(stored, value1, len) == 0;
+}
+
+
+static int store_values(const int key, const int value2, const float value3, const uint32_t version) {
+    /* writes new numeric values for an existing item with the given version, leaving its value1 as it is:
+     * the engines update them in place. value1 is only read from storage for the change log, if it isn't in memory */
+    int32_t old_value2;
+    uint32_t len;
+    if (column_table_get(&item_table, key, &old_value2, NULL, NULL) == -1) {
+        fprintf(stderr, "Key doesn't exist\n"); return -1;
+    }
+
+    int64_t sort_key = value2_sort_key(value2, key), old_sort_key = value2_sort_key(old_value2, key);
+    int add_sort_key = value2_indexed && sort_key != old_sort_key;
+    if (add_sort_key && skip_list_insert(&value2_index, sort_key) == -1) return -1;
 
-    if (!db) {
-        perror("Could not open DB directory");
+    uint64_t start = clock_ns();
+    int result = db_engine == PAGE_ENGINE ? page_store_write_values(key, &value2, &value3, version)
+                                          : file_store_write_values(key, &value2, &value3, version);
+    add_io_time(start);
+    if (result == -1) {
+        if (add_sort_key) skip_list_remove(&value2_index, sort_key);
         return -1;
     }
+    if (add_sort_key) skip_list_remove(&value2_index, old_sort_key);
+
+    if (!in_txn) {
+        char *value1 = (char *) hot_keys_get_value1(&hot_keys, key);
+        const char *prefix = column_table_get_value1(&item_table, key, &len);
+        int32_t stored_value2;
+        float stored_value3;
+        arena_reset(&scratch_arena);
+        if (!value1 && len <= item_table.prefix_len) value1 = arena_strndup(&scratch_arena, prefix, len);
+        else if (!value1 && read_stored_item(key, &value1, &stored_value2, &stored_value3, NULL, &scratch_arena) == -1)
+            value1 = NULL;
+        if (value1) log_change(MODIFY_VALUE, key, value1, value2, value3, version);
+        else fprintf(stderr, "Could not log change to key %d\n", key);
+    }
+    return column_table_set_values(&item_table, key, value2, value3, version);
+}
 
-    int num_items = 0;
 
-    while ((dir_ent = readdir(db)) != NULL) {
-        if (!strcmp(dir_ent->d_name, ".") || !strcmp(dir_ent->d_name, "..")) continue;
-        num_items++;
+int db_open(const char *path, const char engine, const int io_ring) {
+    /* selects the storage engine and gets it ready, with its files in directory path (the working directory
+     * if NULL); must be called before any other DB function.
+     * the file engine does its I/O through io_uring if io_ring is TRUE and the kernel offers it */
+    int result;
+    if (set_db_path(path) == -1) return -1;
+
+    switch (engine) {
+        case FILE_ENGINE: result = file_store_open(io_ring); break;
+        case PAGE_ENGINE: result = page_store_open(); break;
+        default: fprintf(stderr, "Invalid storage engine\n"); return -1;
+    }
+    if (result == -1) return -1;
+    db_engine = engine;
+
+    /* build in-memory indexes from stored items */
+    if (skip_list_init(&key_index) == -1 || column_table_init(&item_table) == -1 ||
+        change_log_init(&change_log) == -1) {
+        db_close(); return -1;
     }
+    item_table.prefix_len = search_len;
+    switch (db_engine) {
+        case PAGE_ENGINE: result = page_store_for_each_key(load_item); break;
+        default: result = file_store_for_each_item(index_item, &scratch_arena); break;
+    }
+    arena_free(&scratch_arena);
+    if (result == -1) {
+        fprintf(stderr, "Could not load DB items\n");
+        db_close(); return -1;
+    }
+    return 0;
+}
+
+
+int db_close(void) {
+    /* flushes pending changes and releases engine resources */
+    skip_list_free(&key_index);
+    column_table_free(&item_table);
+    change_log_free(&change_log);
+    arena_free(&scratch_arena);
+    db_set_value2_index(FALSE);
+    db_set_hot_keys(0);
 
-    closedir(db); return num_items;
+    if (db_engine == PAGE_ENGINE) return page_store_close();
+    file_store_close();
+    return 0;
+}
+
+
+int db_checkpoint(void) {
+    /* makes every change done so far durable */
+    uint64_t start = clock_ns();
+    int result = db_engine == PAGE_ENGINE ? page_store_checkpoint() : file_store_checkpoint();
+    add_io_time(start);
+    return result;
+}
+
+
+int db_list_items(void) {
+    if (db_engine == PAGE_ENGINE) return page_store_list_items();
+    return file_store_list_items();
+}
+
+
+int db_get_num_items(void) {
+    if (past_deadline()) return -1;
+    uint64_t start = clock_ns();
+    int result = db_engine == PAGE_ENGINE ? page_store_num_items() : file_store_num_items();
+    add_io_time(start);
+    return result;
 }
 
 
 int db_empty_db(void) {
-    struct dirent *dir_ent;
-    DIR *db = open_db();
+    if (past_deadline()) return -1;
+    uint64_t start = clock_ns();
+    int result = db_engine == PAGE_ENGINE ? page_store_empty() : file_store_empty();
+    add_io_time(start);
+
+    skip_list_clear(&key_index);
+    column_table_clear(&item_table);
+    hot_keys_drop_values(&hot_keys);
+    if (value2_indexed) skip_list_clear(&value2_index);
+    if (!result) log_change(INIT, 0, NULL, 0, 0, 0);
+    return result;
+}
 
-    if (!db) {
-        perror("Could not open DB directory");
-        return -1;
+
+int db_item_exists(const int key) {
+    /* item_table has every key, so storage is never touched */
+    if (past_deadline()) return -1;
+    return column_table_get(&item_table, key, NULL, NULL, NULL) == 0;
+}
+
+
+int db_read_item(const int key, char **value1, int *value2, float *value3, uint32_t *version, arena_t *arena) {
+    /* items are read from storage, unless their key is pinned and keeps a copy of value1; value1 is copied to
+     * a buffer allocated from arena. version may be NULL if it isn't needed */
+    if (past_deadline()) return -1;
+    if (column_table_get(&item_table, key, value2, value3, version) == -1) {
+        fprintf(stderr, "Key doesn't exist\n"); return -1;
     }
 
-    /* change to DB directory to manage inner files easily */
-    chdir(DB_NAME);
+    const char *copy = hot_keys_get_value1(&hot_keys, key);
+    if (copy) {
+        hot_reads++;
+        return (*value1 = arena_strndup(arena, copy, strlen(copy))) ? 0 : -1;
+    }
+    cold_reads++;
+    if (read_stored_item(key, value1, value2, value3, version, arena) == -1) return -1;
+    copy_hot_value1(key, *value1);
+    return 0;
+}
+
+
+int db_read_item_stored(const int key, stored_value1_t *stored, char **value1, int *value2, float *value3,
+                        uint32_t *version, arena_t *arena) {
+    /* like db_read_item, except that value1 strings of at least ZERO_COPY_MIN_LEN bytes are left in storage
+     * if the engine can hand them out: stored->fd is set then, and value1 isn't filled. stored->fd is -1 otherwise.
+     * pinned keys are read from their copy instead, and get one by the read if there's room for it.
+     * value1 stays readable through stored->fd, whatever is written meanwhile, until db_release_stored is called;
+     * the page engine overwrites freed space in place afterwards, while the file engine replaces key files */
+    uint32_t len;
+    stored->fd = -1;
+    stored->in_place = db_engine == PAGE_ENGINE;
+    if (past_deadline()) return -1;
+
+    if (column_table_get_value1(&item_table, key, &len) && len >= ZERO_COPY_MIN_LEN &&
+        !hot_keys_get_value1(&hot_keys, key) && !hot_value1_fits(key, len)) {
+        uint64_t start = clock_ns();
+        stored->fd = db_engine == PAGE_ENGINE ? page_store_pin_value1(key, &stored->offset, &stored->len)
+                                              : file_store_open_value1(key, &stored->offset, &stored->len);
+        add_io_time(start);
+    }
+    if (stored->fd == -1) return db_read_item(key, value1, value2, value3, version, arena);
 
-    /* go through and delete all key files */
-    while ((dir_ent = readdir(db)) != NULL) {
-        if (!strcmp(dir_ent->d_name, ".") || !strcmp(dir_ent->d_name, "..")) continue;
+    cold_reads++;
+    *value1 = NULL;
+    return column_table_get(&item_table, key, value2, value3, version);
+}
+
+
+void db_release_stored(stored_value1_t *stored) {
+    if (stored->fd == -1) return;
+
+    if (db_engine == PAGE_ENGINE) page_store_unpin_value1(stored->offset);
+    else close(stored->fd);
+    stored->fd = -1;
+}
+
+
+int db_write_item(const int key, const char *value1, const int *value2, const float *value3, const char mode) {
+    if (past_deadline()) return -1;
+    return write_item(key, value1, value2, value3, mode, NULL);
+}
+
+
+int db_upsert_item(const int key, const char *value1, const int *value2, const float *value3, uint32_t *version) {
+    /* creates the item or modifies it if it already exists; version gets the new version number */
+    if (past_deadline()) return -1;
+    int exists = column_table_get(&item_table, key, NULL, NULL, NULL) == 0;
+    return write_item(key, value1, value2, value3, exists ? MODIFY : CREATE, version);
+}
 
-        if (remove(dir_ent->d_name) == -1) {
-            perror("Couldn't delete entire DB");
-            chdir(".."); closedir(db); return -1;
+
+int db_cas_item(const int key, const char *value1, const int *value2, const float *value3, uint32_t *version) {
+    /* modifies the item only if its version is still *version; version gets the new version number.
+     * returns 1 if the item was modified in the meantime, and then version gets its current version */
+    uint32_t current;
+
+    if (past_deadline()) return -1;
+    if (column_table_get(&item_table, key, NULL, NULL, &current) == -1) {
+        fprintf(stderr, "Key doesn't exist\n"); return -1;
+    }
+    if (current != *version) {
+        *version = current; return 1;
+    }
+    return write_item(key, value1, value2, value3, MODIFY, version);
+}
+
+
+int db_delete_item(const int key) {
+    if (past_deadline()) return -1;
+    uint64_t start = clock_ns();
+    int result = db_engine == PAGE_ENGINE ? page_store_delete_item(key) : file_store_delete_item(key);
+    add_io_time(start);
+
+    if (!result) {
+        hot_keys_drop_value1(&hot_keys, key);
+        if (!in_txn) log_change(DELETE_KEY, key, NULL, 0, 0, 0);
+        int32_t value2;
+        if (value2_indexed && !column_table_get(&item_table, key, &value2, NULL, NULL))
+            skip_list_remove(&value2_index, value2_sort_key(value2, key));
+        skip_list_remove(&key_index, key);
+        column_table_remove(&item_table, key);
+    }
+    return result;
+}
+
+
+int db_scan_items(const int lo, const int hi, item_t *items, const int max_items, int *more, arena_t *arena) {
+    /* fills items with up to max_items items whose keys are in [lo, hi], in key order, value1 allocated from arena;
+     * more is set to TRUE if there are items left in the range after the last one read;
+     * returns the number of items read; the deadline is checked before reading every one */
+    int num_items = 0;
+    *more = FALSE;
+
+    for (const skip_node_t *node = skip_list_seek(&key_index, lo); node && node->key <= hi;
+         node = skip_list_next(node)) {
+        if (num_items == max_items) {
+            *more = TRUE; break;
         }
+
+        item_t *item = &items[num_items];
+        item->key = (int32_t) node->key;
+        if (db_read_item(item->key, &item->value1, &item->value2, &item->value3, &item->version, arena) == -1)
+            return -1;
+        num_items++;
+    }
+    return num_items;
+}
+
+
+int db_aggregate(const char function, const char field, const int lo, const int hi, double *result) {
+    /* computes an aggregate function over value2 or value3 of the items whose keys are in [lo, hi];
+     * returns the number of items aggregated */
+    aggregation_t aggregation;
+
+    if (past_deadline()) return -1;
+    if (field != FIELD_VALUE2 && field != FIELD_VALUE3) {
+        fprintf(stderr, "Invalid aggregation field\n"); return -1;
     }
 
-    /* change back to executable's directory and finish */
-    chdir(".."); closedir(db); return 0;
+    column_table_aggregate(&item_table, field, lo, hi, &aggregation);
+
+    switch (function) {
+        case AGG_COUNT: *result = aggregation.count; break;
+        case AGG_SUM: *result = aggregation.sum; break;
+        case AGG_MIN: *result = aggregation.min; break;
+        case AGG_MAX: *result = aggregation.max; break;
+        case AGG_AVG: *result = aggregation.count ? aggregation.sum / aggregation.count : 0; break;
+        default: fprintf(stderr, "Invalid aggregate function\n"); return -1;
+    }
+    return (int) aggregation.count;
 }
 
 
-int db_item_exists(const int key) {
-    /* open key file */
-    int key_fd = open_keyfile(key, READ);
+int db_set_value2_index(const int enabled) {
+    /* builds the secondary index on value2 from item_table or drops it */
+    if (!enabled) {
+        if (value2_indexed) skip_list_free(&value2_index);
+        value2_indexed = FALSE;
+        return 0;
+    }
+    if (value2_indexed) return 0;
 
-    /* if there is no file associated with that key */
-    if (key_fd == -1) return 0;     /* key file doesn't exist */
+    if (skip_list_init(&value2_index) == -1) return -1;
+    for (uint32_t row = 0; row < item_table.num_rows; row++) {
+        if (!item_table.live[row]) continue;
+        if (skip_list_insert(&value2_index, value2_sort_key(item_table.value2[row], item_table.keys[row])) == -1) {
+            skip_list_free(&value2_index); return -1;
+        }
+    }
+    value2_indexed = TRUE;
+    return 0;
+}
 
-    /* key file was opened, so it exists */
-    close(key_fd); return 1;
+
+int db_query_items(const int lo, const int hi, const int64_t cursor, const int keys_only,
+                   item_t *items, const int max_items, int *more, int64_t *next_cursor, arena_t *arena) {
+    /* fills items with up to max_items items whose value2 is in [lo, hi], ordered by value2 & key,
+     * value1 allocated from arena, starting at cursor (INT64_MIN to start at the beginning);
+     * only keys are filled if keys_only is TRUE;
+     * more is set to TRUE if there are items left, and next_cursor to where the next page starts;
+     * returns the number of items read */
+    int64_t from = value2_sort_key(lo, 0) > cursor ? value2_sort_key(lo, 0) : cursor;
+    int64_t to = value2_sort_key(hi, -1);       /* keys are ordered as unsigned: -1 goes last */
+    int num_items = 0;
+    *more = FALSE;
+
+    if (past_deadline()) return -1;
+    if (lo > hi || max_items <= 0) return 0;
+
+    if (value2_indexed) {
+        for (const skip_node_t *node = skip_list_seek(&value2_index, from); node && node->key <= to;
+             node = skip_list_next(node)) {
+            if (num_items == max_items) {
+                *more = TRUE; break;
+            }
+            items[num_items++].key = (int32_t) (uint32_t) node->key;
+        }
+    } else {
+        /* no index: select one more sort key than needed to find out whether there are more */
+        int64_t *sort_keys = malloc((max_items + 1) * sizeof(int64_t));
+        if (!sort_keys) {
+            perror("Could not allocate query buffer"); return -1;
+        }
+        uint32_t found = column_table_select_value2(&item_table, lo, hi, from, sort_keys, (uint32_t) max_items + 1);
+        *more = found > (uint32_t) max_items;
+        num_items = *more ? max_items : (int) found;
+        for (int i = 0; i < num_items; i++) items[i].key = (int32_t) (uint32_t) sort_keys[i];
+        free(sort_keys);
+    }
+
+    if (num_items) {
+        int32_t value2;
+        column_table_get(&item_table, items[num_items - 1].key, &value2, NULL, NULL);
+        *next_cursor = value2_sort_key(value2, items[num_items - 1].key) + 1;
+    }
+
+    if (keys_only) return num_items;
+    for (int i = 0; i < num_items; i++) {
+        if (db_read_item(items[i].key, &items[i].value1, &items[i].value2, &items[i].value3, &items[i].version,
+                         arena) == -1) return -1;
+    }
+    return num_items;
 }
 
 
-int db_read_item(const int key, char *value1, int *value2, float *value3) {
-    errno = 0;
+int db_search_items(const char mode, const char *pattern, int32_t **keys) {
+    /* finds the keys of the items whose value1 matches pattern; keys must be freed by the caller.
+     * returns the number of keys found, -1 on error */
+    uint32_t num_keys;
 
-    /* open key file */
-    int key_fd = open_keyfile(key, READ);
+    if (past_deadline()) return -1;
+    if (column_table_search(&item_table, mode, pattern, check_value1, keys, &num_keys) == -1) return -1;
+    return (int) num_keys;
+}
 
-    /* error if there is no file associated with that key */
-    if (key_fd == -1) {
-        /* key file doesn't exist */
-        perror("Key file doesn't exist");
-        return -1;
+
+int db_incr_item(const int key, const int delta, int *value2) {
+    /* adds delta to the value2 of an item and stores the result in value2; fails on overflow.
+     * value1 is neither read nor rewritten */
+    int old_value2; float value3; uint32_t version;
+
+    if (past_deadline()) return -1;
+    if (column_table_get(&item_table, key, &old_value2, &value3, &version) == -1) {
+        fprintf(stderr, "Key doesn't exist\n"); return -1;
+    }
+    if (__builtin_add_overflow(old_value2, delta, value2)) {
+        fprintf(stderr, "value2 overflow\n"); return -1;
+    }
+    return store_values(key, *value2, value3, version == UINT32_MAX ? 1 : version + 1);
+}
+
+
+int db_add_item(const int key, const float delta, float *value3) {
+    /* adds delta to the value3 of an item and stores the result in value3; value1 is neither read nor rewritten */
+    int value2; float old_value3; uint32_t version;
+
+    if (past_deadline()) return -1;
+    if (column_table_get(&item_table, key, &value2, &old_value3, &version) == -1) {
+        fprintf(stderr, "Key doesn't exist\n"); return -1;
     }
+    *value3 = old_value3 + delta;
+    return store_values(key, value2, *value3, version == UINT32_MAX ? 1 : version + 1);
+}
+
 
-    /* read value1 */
-    if (read_value_from_keyfile(key_fd, value1, VALUE1_MAX_STR_SIZE) == -1) return -1;
+/* transactions: every write saves the previous state of its item first, so that the writes already
+ * done can be undone in reverse order if a later sub-operation fails */
 
-    /* read value2 */
-    char value2_str[MAX_STR_SIZE];
-    if (read_value_from_keyfile(key_fd, value2_str, MAX_STR_SIZE) == -1) return -1;
+typedef struct {
+    int exists;         /* FALSE if the item didn't exist before the write */
+    item_t item;        /* previous state of the item */
+} undo_t;
 
-    /* cast value2_str to int */
-    if (str_to_num(value2_str, (void *) value2, INT) == -1) {
-        close(key_fd); return -1;
+
+static int save_undo(const int key, undo_t *undo, arena_t *arena) {
+    undo->item.key = key;
+    undo->exists = column_table_get(&item_table, key, NULL, NULL, NULL) == 0;
+    if (!undo->exists) return 0;
+    return db_read_item(key, &undo->item.value1, &undo->item.value2, &undo->item.value3, &undo->item.version,
+                        arena);
+}
+
+
+static void rollback(const undo_t *undo_log, int num_undo) {
+    /* puts back every item touched by the transaction, versions included */
+    while (num_undo--) {
+        const item_t *item = &undo_log[num_undo].item;
+        int exists = column_table_get(&item_table, item->key, NULL, NULL, NULL) == 0;
+
+        if (!undo_log[num_undo].exists) {
+            if (exists) db_delete_item(item->key);
+        } else if (store_item(item->key, item->value1, &item->value2, &item->value3, exists ? MODIFY : CREATE,
+                              item->version) == -1) {
+            fprintf(stderr, "Could not roll back key %d\n", item->key);
+        }
     }
+}
 
-    /* now read value3 */
-    char value3_str[MAX_STR_SIZE];
-    if (read_value_from_keyfile(key_fd, value3_str, MAX_STR_SIZE) == -1) return -1;
 
-    /* cast value3_str to float */
-    if (str_to_num(value3_str, (void *) value3, FLOAT) == -1) {
-        close(key_fd); return -1;
+static int execute_txn_op(txn_op_t *op, arena_t *arena) {
+    /* returns 0 on success, 1 if a compared version didn't match, -1 on error */
+    item_t *item = &op->item;
+    uint32_t version;
+
+    switch (op->op_code) {
+        case GET_VALUE:
+            return db_read_item(item->key, &item->value1, &item->value2, &item->value3, &item->version, arena);
+        case SET_VALUE:
+            return write_item(item->key, item->value1, &item->value2, &item->value3, CREATE, &item->version);
+        case MODIFY_VALUE:
+            return write_item(item->key, item->value1, &item->value2, &item->value3, MODIFY, &item->version);
+        case DELETE_KEY:
+            return db_delete_item(item->key);
+        case TXN_COMPARE:
+            if (column_table_get(&item_table, item->key, NULL, NULL, &version) == -1) version = 0;
+            if (version == item->version) return 0;
+            item->version = version;
+            return 1;
+        default:
+            fprintf(stderr, "Invalid transaction operation\n"); return -1;
     }
+}
+
 
-    /* all three values were read at this point, so close file and return */
-    close(key_fd); return 0;
+static int written_before(const txn_op_t *ops, const int op) {
+    /* TRUE if a sub-operation before op wrote the item op is on */
+    for (int i = 0; i < op; i++) {
+        if (ops[i].item.key == ops[op].item.key &&
+            (ops[i].op_code == SET_VALUE || ops[i].op_code == MODIFY_VALUE || ops[i].op_code == DELETE_KEY))
+            return TRUE;
+    }
+    return FALSE;
 }
 
 
-int db_write_item(const int key, const char *value1, const int *value2, const float *value3, const char mode) {
-    if (mode != CREATE && mode != MODIFY) {
-        perror("Invalid open file mode");
-        return -1;
+int db_execute_txn(txn_op_t *ops, const int num_ops, arena_t *arena) {
+    /* executes every sub-operation in order, or none of them: if one fails, the previous ones are
+     * rolled back. the file engine defers the key file writes, to do them in a single submission at the end,
+     * unless a key is touched again. a committed transaction is made durable with a single checkpoint;
+     * if that or the deferred writes fail, every sub-operation is rolled back too.
+     * value1 strings read are allocated from arena.
+     * each sub-operation gets its own result; returns 0 if committed, 1 if a comparison failed, -1 on error */
+    if (past_deadline()) return -1;
+    undo_t *undo_log = malloc(num_ops * sizeof(undo_t));
+    arena_t undo_arena;
+    int num_undo = 0;
+
+    if (!undo_log) {
+        perror("Could not allocate undo log"); return -1;
     }
 
-    /* open key file */
-    int key_fd = open_keyfile(key, mode);
+    int result = 0, failed;
+    arena_init(&undo_arena);
+    in_txn = TRUE;
+    if (db_engine == FILE_ENGINE) file_store_defer_writes();
+    for (failed = 0; failed < num_ops; failed++) {
+        txn_op_t *op = &ops[failed];
+
+        /* a key file written by an earlier sub-operation is read or written again: write it first */
+        if (db_engine == FILE_ENGINE && op->op_code != TXN_COMPARE && written_before(ops, failed)) {
+            if (file_store_submit_writes() == -1) {
+                result = -1; break;
+            }
+            file_store_defer_writes();
+        }
 
-    /* error if there is no file associated with that key */
-    if (key_fd == -1) {
-        switch (errno) {
-            /* EEXIST: set_value API call inserting existing key error */
-            case EEXIST: perror("Key file already exists"); return -1;
-            default: perror("Error opening key file"); return -1;
+        if (op->op_code == SET_VALUE || op->op_code == MODIFY_VALUE || op->op_code == DELETE_KEY) {
+            if (save_undo(op->item.key, &undo_log[num_undo], &undo_arena) == -1) {
+                result = -1; break;
+            }
+            num_undo++;
         }
+        result = execute_txn_op(op, arena);
+        if (result) break;
+        op->result = SRV_SUCCESS;
     }
 
-    /* write item to key file, one value per line */
-    int result = write_values_to_keyfile(key_fd, value1, value2, value3);
+    /* deferred writes are done before anything is rolled back */
+    int written = db_engine != FILE_ENGINE || file_store_submit_writes() == 0;
+    if (result) {
+        rollback(undo_log, num_undo);
+        for (int i = 0; i < num_ops; i++) ops[i].result = SRV_ABORTED;
+        ops[failed].result = result == 1 ? SRV_CONFLICT : SRV_ERROR;
+    } else if (!written || db_checkpoint() == -1) {
+        /* the writes failed or may not be durable: undo them, so that the error reply matches the stored state */
+        rollback(undo_log, num_undo);
+        db_checkpoint();
+        for (int i = 0; i < num_ops; i++) ops[i].result = SRV_ABORTED;
+        result = -1;
+    }
+    in_txn = FALSE;
+
+    /* watchers only see the writes of committed transactions */
+    for (int i = 0; !result && i < num_ops; i++) {
+        const item_t *item = &ops[i].item;
+        if (ops[i].op_code == SET_VALUE || ops[i].op_code == MODIFY_VALUE || ops[i].op_code == DELETE_KEY)
+            log_change(ops[i].op_code, item->key, ops[i].op_code == DELETE_KEY ? NULL : item->value1,
+                       item->value2, item->value3, item->version);
+    }
 
-    /* all three values were written at this point, so close file and return */
-    close(key_fd); return result;
+    arena_free(&undo_arena);
+    free(undo_log);
+    return result;
 }
 
 
-int db_delete_item(const int key) {
-    int exists = db_item_exists(key);
-    if (!exists) return -1;     /* key file doesn't exist */
+uint64_t db_next_change_seq(void) {
+    /* sequence number the next change will get; can be called without holding the DB lock */
+    return change_log_next_seq(&change_log);
+}
 
-    /* key file does exist, so delete it */
-    char key_file_name[MAX_STR_SIZE];
-    snprintf(key_file_name, MAX_STR_SIZE, "%s/%d", DB_NAME, key);
 
-    if (remove(key_file_name) == -1) {
-        perror("Couldn't delete key file");
-        return -1;
+int db_read_changes(const uint64_t from_seq, const int lo, const int hi, change_t *changes, const int max_changes,
+                    uint64_t *next_seq, uint64_t *missed, const int timeout_ms, arena_t *arena) {
+    /* reads changes committed to items in [lo, hi]; see change_log_read.
+     * unlike the other DB functions, it must be called WITHOUT holding the DB lock, since it may wait */
+    return change_log_read(&change_log, from_seq, lo, hi, changes, max_changes, next_seq, missed, timeout_ms,
+                           arena);
+}
+
+
+int db_apply_change(const change_t *change) {
+    /* applies a change made on another server, keeping its version; used by replicas.
+     * changes may be applied more than once or over a newer snapshot, which is fine since later ones fix that */
+    const item_t *item = &change->item;
+    int exists = column_table_get(&item_table, item->key, NULL, NULL, NULL) == 0;
+
+    switch (change->op_code) {
+        case SET_VALUE:
+        case MODIFY_VALUE:
+            /* INCR & ADD leave value1 as it is, so they're applied in place too when it's known to be */
+            if (change->op_code == MODIFY_VALUE && exists && same_value1(item->key, item->value1))
+                return store_values(item->key, item->value2, item->value3, item->version);
+            return store_item(item->key, item->value1, &item->value2, &item->value3, exists ? MODIFY : CREATE,
+                              item->version);
+        case DELETE_KEY:
+            return exists ? db_delete_item(item->key) : 0;
+        case INIT:
+            return db_empty_db();
+        default:
+            fprintf(stderr, "Invalid change\n"); return -1;
     }
-    return 0;
+}
+
+
+void db_get_io_time(histogram_t *histogram) {
+    /* adds the time spent in storage engine reads & writes so far to histogram */
+    histogram_merge(histogram, &io_time);
+}
+
+
+void db_set_search_len(const uint32_t len) {
+    /* keeps the first len bytes of every value1 in memory from the next db_open on, so that searches settle
+     * value1 strings up to that long without reading storage; longer ones are still read, one at a time.
+     * len is at least COLUMN_TABLE_PREFIX_LEN */
+    search_len = len < COLUMN_TABLE_PREFIX_LEN ? COLUMN_TABLE_PREFIX_LEN : len;
+}
+
+
+int db_set_hot_keys(const int max_keys) {
+    /* pins up to max_keys of the most read keys, whose value1 strings are copied the first time they're read,
+     * so that later reads never touch storage, up to HOT_VALUES_MAX_BYTES;
+     * writes still go through to storage, and update the copies. 0 to pin none */
+    hot_keys_free(&hot_keys);
+    hot_reads = cold_reads = 0;
+    if (max_keys < 0) {
+        fprintf(stderr, "Invalid number of hot keys\n"); return -1;
+    }
+    return hot_keys_init(&hot_keys, (uint32_t) max_keys);
+}
+
+
+int db_record_read(const int key) {
+    /* samples a read of key, which may get it pinned; called before reading it. returns TRUE if it's pinned */
+    return hot_keys_sample(&hot_keys, key);
+}
+
+
+void db_get_hot_keys(server_stats_t *stats) {
+    /* fills the hot key fields of stats: the hottest pinned keys, and how many items were read from the copies
+     * pinned keys keep, and from storage */
+    hot_key_t top[STATS_HOT_KEYS];
+    stats->hot_reads = hot_reads;
+    stats->cold_reads = cold_reads;
+    stats->hot_num_keys = hot_keys.num_keys;
+    uint32_t num_top = hot_keys_top(&hot_keys, top, STATS_HOT_KEYS);
+    for (uint32_t i = 0; i < num_top; i++) {
+        stats->hot_keys[i] = (uint32_t) top[i].key;
+        stats->hot_counts[i] = top[i].count;
+    }
+}
+
+
+uint64_t db_thread_io_ns(void) {
+    /* time the calling thread has spent in storage engine reads & writes so far; used to trace requests */
+    return thread_io_ns;
+}
+
+
+void db_set_deadline(const uint64_t deadline) {
+    /* storage work the calling thread would start after deadline (clock_ns) is abandoned from now on, failing;
+     * writes are never abandoned halfway. 0 for no deadline */
+    deadline_ns = deadline;
+    abandoned = FALSE;
+}
+
+
+int db_abandoned(void) {
+    /* TRUE if the calling thread abandoned work since its deadline was set */
+    return abandoned;
 }
@@ -4,25 +4,45 @@
 #include <dirent.h>
 #include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <errno.h>
 #include "DS-MandatoryExercise/utils.h"
 #include "DS-MandatoryExercise/dbms/dbmsUtils.h"
+#include "DS-MandatoryExercise/dbms/ioRing.h"
+
+char db_dir_name[DB_FILE_NAME_SIZE] = DB_NAME;
+char db_pages_name[DB_FILE_NAME_SIZE] = DB_PAGES_NAME;
+
+
+int set_db_path(const char *path) {
+    /* DB files go in directory path, or in the working directory if it's NULL */
+    if (!path || !*path) {
+        strcpy(db_dir_name, DB_NAME);
+        strcpy(db_pages_name, DB_PAGES_NAME); return 0;
+    }
+    if (strlen(path) > DB_PATH_MAX_LEN) {
+        fprintf(stderr, "Storage path too long\n"); return -1;
+    }
+    snprintf(db_dir_name, DB_FILE_NAME_SIZE, "%s/%s", path, DB_NAME);
+    snprintf(db_pages_name, DB_FILE_NAME_SIZE, "%s/%s", path, DB_PAGES_NAME);
+    return 0;
+}
 
 
 DIR *open_db(void) {
     errno = 0;
 
     /* open DB directory */
-    DIR *db = opendir(DB_NAME);
+    DIR *db = opendir(db_dir_name);
     if (!db) {
         switch (errno) {
             case ENOENT:
                 /* create it if it doesn't exist */
-                if (mkdir(DB_NAME, S_IRWXU) == -1) {
+                if (mkdir(db_dir_name, S_IRWXU) == -1) {
                     perror("DB directory could not be created"); return NULL;
                 }
                 /* and try to open it */
-                db = opendir(DB_NAME);
+                db = opendir(db_dir_name);
                 if (!db) {
                     perror("Could not open DB directory after creating it"); return NULL;
                 }
@@ -36,7 +56,7 @@ DIR *open_db(void) {
 
 int open_keyfile(const int key, const char mode) {
     char key_str[MAX_STR_SIZE];
-    snprintf(key_str, MAX_STR_SIZE, "%s/%d", DB_NAME, key);
+    snprintf(key_str, MAX_STR_SIZE, "%s/%d", db_dir_name, key);
 
     int key_fd;
     /* open key file */
@@ -66,19 +86,34 @@ int read_value_from_keyfile(const int key_fd, char *value, const int size) {
 }
 
 
-int write_values_to_keyfile(const int key_fd, const char *value1, const int *value2, const float *value3) {
-    /* write item to key file, one value per line */
-    if (dprintf(key_fd, "%s\n", value1) < 0) {
-        fprintf(stderr, "Could not write value1\n");
-        close(key_fd); return -1;
-    }
-    if (dprintf(key_fd, "%d\n", *value2) < 0) {
-        fprintf(stderr, "Could not write value2\n");
+int read_values_from_keyfile(const int key_fd, const key_file_header_t *header, char **value1, arena_t *arena) {
+    /* reads the value1 bytes following header into a buffer allocated from arena, in chunks */
+    *value1 = arena_alloc(arena, (size_t) header->value1_len + 1);
+    if (!*value1) {
         close(key_fd); return -1;
     }
-    if (dprintf(key_fd, "%f\n", *value3) < 0) {
-        fprintf(stderr, "Could not write value3\n");
-        close(key_fd); return -1;
+
+    for (uint32_t read = 0; read < header->value1_len; read += VALUE1_CHUNK_SIZE) {
+        uint32_t chunk = header->value1_len - read < VALUE1_CHUNK_SIZE ? header->value1_len - read : VALUE1_CHUNK_SIZE;
+        if (recv_msg(key_fd, *value1 + read, (int) chunk) == -1) {
+            fprintf(stderr, "Could not read value1\n");
+            close(key_fd); return -1;
+        }
     }
+    (*value1)[header->value1_len] = '\0';
     return 0;
 }
+
+
+int write_keyfile(const char *path, const int flags, const char *value1, const int *value2, const float *value3,
+                  const uint32_t version, const char *rename_to) {
+    /* writes an item to the key file at path, opened with flags: header, then value1 bytes, in one go;
+     * the file is renamed to rename_to afterwards, unless it's NULL. returns -1 with errno set on error */
+    key_file_header_t header = {.value1_len = (uint32_t) strlen(value1), .value2 = *value2, .value3 = *value3,
+                                .version = version};
+    memcpy(header.magic, KEY_FILE_MAGIC, sizeof(header.magic));
+
+    struct iovec iov[2] = {{.iov_base = &header, .iov_len = sizeof(header)},
+                           {.iov_base = (char *) value1, .iov_len = header.value1_len}};
+    return io_ring_write_file(path, flags, iov, 2, rename_to);
+}
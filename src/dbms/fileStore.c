@@ -0,0 +1,427 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <errno.h>
+#include "DS-MandatoryExercise/utils.h"
+#include "DS-MandatoryExercise/dbms/dbmsUtils.h"
+#include "DS-MandatoryExercise/dbms/fileStore.h"
+#include "DS-MandatoryExercise/dbms/ioRing.h"
+
+#define KEY_FILE_READ_SIZE 16384    /* bytes read from each key file while loading; longer ones are read again */
+
+
+int file_store_open(const int io_ring) {
+    /* make sure DB directory exists; key files are read & written through io_uring if io_ring is TRUE */
+    DIR *db = open_db();
+    if (!db) return -1;
+
+    closedir(db);
+    return io_ring ? io_ring_open() : 0;
+}
+
+
+void file_store_close(void) {
+    io_ring_close();
+}
+
+
+int file_store_checkpoint(void) {
+    /* key files are written without syncing; this flushes all of them at once */
+    DIR *db = open_db();
+    if (!db) return -1;
+
+    if (syncfs(dirfd(db)) == -1) {
+        perror("Could not sync DB directory");
+        closedir(db); return -1;
+    }
+
+    closedir(db); return 0;
+}
+
+
+static int load_items(const int *keys, io_read_t *reads, const int num_reads,
+                      int (*callback)(int key, const char *value1, int value2, float value3, uint32_t version),
+                      arena_t *arena) {
+    /* calls callback with the items whose key files were read into reads; value1 strings read again
+     * on their own are allocated from arena, which is reset first */
+    arena_reset(arena);
+
+    for (int i = 0; i < num_reads; i++) {
+        key_file_header_t header;
+        char *value1; int value2; float value3; uint32_t version;
+        ssize_t bytes_read = reads[i].result;
+
+        if (bytes_read < 0) {
+            errno = (int) -bytes_read;
+            perror("Error reading key file"); return -1;
+        }
+        if (bytes_read >= (ssize_t) sizeof(header)) memcpy(&header, reads[i].buf, sizeof(header));
+
+        if (bytes_read >= (ssize_t) sizeof(header) && !memcmp(header.magic, KEY_FILE_MAGIC, sizeof(header.magic)) &&
+            header.value1_len <= (size_t) bytes_read - sizeof(header)) {
+            /* buffers have a spare byte for the terminating one */
+            value1 = reads[i].buf + sizeof(header);
+            value1[header.value1_len] = '\0';
+            value2 = header.value2;
+            value3 = header.value3;
+            version = header.version;
+        } else if (file_store_read_item(keys[i], &value1, &value2, &value3, &version, arena) == -1) {
+            return -1;      /* text key file or long value1 */
+        }
+
+        if (callback(keys[i], value1, value2, value3, version) == -1) return -1;
+    }
+    return 0;
+}
+
+
+int file_store_for_each_item(int (*callback)(int key, const char *value1, int value2, float value3, uint32_t version),
+                             arena_t *arena) {
+    /* calls callback with every stored item; key file names are the keys themselves.
+     * key files are read IO_RING_FILES at a time, KEY_FILE_READ_SIZE bytes each */
+    struct dirent *dir_ent;
+    DIR *db = open_db();
+
+    if (!db) {
+        perror("Could not open DB directory");
+        return -1;
+    }
+
+    char *bufs = malloc(IO_RING_FILES * (KEY_FILE_READ_SIZE + 1));
+    if (!bufs) {
+        perror("Could not allocate key file buffers");
+        closedir(db); return -1;
+    }
+
+    int keys[IO_RING_FILES];
+    char paths[IO_RING_FILES][MAX_STR_SIZE];
+    io_read_t reads[IO_RING_FILES];
+    int result = 0, num_reads;
+
+    do {
+        num_reads = 0;
+        while (num_reads < IO_RING_FILES && (dir_ent = readdir(db)) != NULL) {
+            if (dir_ent->d_name[0] == '.') continue;     /* ., .. & temp files */
+
+            if (str_to_num(dir_ent->d_name, (void *) &keys[num_reads], INT) == -1) {
+                free(bufs); closedir(db); return -1;
+            }
+            snprintf(paths[num_reads], MAX_STR_SIZE, "%s/%s", db_dir_name, dir_ent->d_name);
+            reads[num_reads] = (io_read_t) {.path = paths[num_reads], .size = KEY_FILE_READ_SIZE,
+                                            .buf = bufs + num_reads * (KEY_FILE_READ_SIZE + 1)};
+            num_reads++;
+        }
+
+        if (io_ring_read_files(reads, num_reads) == -1 || load_items(keys, reads, num_reads, callback, arena) == -1)
+            result = -1;
+    } while (!result && num_reads == IO_RING_FILES);
+
+    free(bufs); closedir(db); return result;
+}
+
+
+int file_store_list_items(void) {
+    struct dirent *dir_ent;
+    DIR *db = open_db();
+
+    if (!db) {
+        perror("Could not open DB directory");
+        return -1;
+    }
+
+    while ((dir_ent = readdir(db)) != NULL) {
+        if (dir_ent->d_name[0] == '.') continue;     /* ., .. & temp files */
+        printf("%s\n", dir_ent->d_name);
+    }
+
+    closedir(db); return 0;
+}
+
+
+int file_store_num_items(void) {
+    struct dirent *dir_ent;
+    DIR *db = open_db();
+
+    if (!db) {
+        perror("Could not open DB directory");
+        return -1;
+    }
+
+    int num_items = 0;
+
+    while ((dir_ent = readdir(db)) != NULL) {
+        if (dir_ent->d_name[0] == '.') continue;     /* ., .. & temp files */
+        num_items++;
+    }
+
+    closedir(db); return num_items;
+}
+
+
+int file_store_empty(void) {
+    /* deletes every key file, IO_RING_ENTRIES at a time */
+    struct dirent *dir_ent;
+    DIR *db = open_db();
+
+    if (!db) {
+        perror("Could not open DB directory");
+        return -1;
+    }
+
+    char (*names)[MAX_STR_SIZE] = malloc(IO_RING_ENTRIES * MAX_STR_SIZE);
+    const char *paths[IO_RING_ENTRIES];
+    int num_paths;
+
+    if (!names) {
+        perror("Couldn't delete entire DB");
+        closedir(db); return -1;
+    }
+
+    do {
+        num_paths = 0;
+        while (num_paths < IO_RING_ENTRIES && (dir_ent = readdir(db)) != NULL) {
+            if (!strcmp(dir_ent->d_name, ".") || !strcmp(dir_ent->d_name, "..")) continue;
+
+            snprintf(names[num_paths], MAX_STR_SIZE, "%s/%s", db_dir_name, dir_ent->d_name);
+            paths[num_paths] = names[num_paths];
+            num_paths++;
+        }
+
+        if (io_ring_unlink_files(paths, num_paths) == -1) {
+            perror("Couldn't delete entire DB");
+            free(names); closedir(db); return -1;
+        }
+    } while (num_paths == IO_RING_ENTRIES);
+
+    free(names); closedir(db); return 0;
+}
+
+
+int file_store_item_exists(const int key) {
+    /* open key file */
+    int key_fd = open_keyfile(key, READ);
+
+    /* if there is no file associated with that key */
+    if (key_fd == -1) return 0;     /* key file doesn't exist */
+
+    /* key file was opened, so it exists */
+    close(key_fd); return 1;
+}
+
+
+static int read_text_item(const int key_fd, char **value1, int *value2, float *value3, uint32_t *version,
+                          arena_t *arena) {
+    /* reads a key file written as text by older versions, whose value1 strings were always short */
+    *value1 = arena_alloc(arena, VALUE1_MAX_STR_SIZE);
+    if (!*value1) {
+        close(key_fd); return -1;
+    }
+
+    /* read value1 */
+    if (read_value_from_keyfile(key_fd, *value1, VALUE1_MAX_STR_SIZE) == -1) return -1;
+
+    /* read value2 */
+    char value2_str[MAX_STR_SIZE];
+    if (read_value_from_keyfile(key_fd, value2_str, MAX_STR_SIZE) == -1) return -1;
+
+    /* cast value2_str to int */
+    if (str_to_num(value2_str, (void *) value2, INT) == -1) {
+        close(key_fd); return -1;
+    }
+
+    /* now read value3 */
+    char value3_str[MAX_STR_SIZE];
+    if (read_value_from_keyfile(key_fd, value3_str, MAX_STR_SIZE) == -1) return -1;
+
+    /* cast value3_str to float */
+    if (str_to_num(value3_str, (void *) value3, FLOAT) == -1) {
+        close(key_fd); return -1;
+    }
+
+    /* finally read version; key files written before versions existed don't have it */
+    if (version) {
+        char version_str[MAX_STR_SIZE];
+        ssize_t bytes_read = read_line(key_fd, version_str, MAX_STR_SIZE);
+        int version_num = 1;
+
+        if (bytes_read == -1 || (bytes_read > 0 && str_to_num(version_str, (void *) &version_num, INT) == -1)) {
+            perror("Error reading version");
+            close(key_fd); return -1;
+        }
+        *version = (uint32_t) version_num;
+    }
+
+    /* all values were read at this point, so close file and return */
+    close(key_fd); return 0;
+}
+
+
+int file_store_read_item(const int key, char **value1, int *value2, float *value3, uint32_t *version,
+                         arena_t *arena) {
+    /* value1 is allocated from arena */
+    errno = 0;
+
+    /* open key file */
+    int key_fd = open_keyfile(key, READ);
+
+    /* error if there is no file associated with that key */
+    if (key_fd == -1) {
+        /* key file doesn't exist */
+        perror("Key file doesn't exist");
+        return -1;
+    }
+
+    /* key files without header are text files */
+    key_file_header_t header;
+    if (recv_msg(key_fd, (char *) &header, sizeof(header)) == -1 ||
+        memcmp(header.magic, KEY_FILE_MAGIC, sizeof(header.magic)) != 0) {
+        if (lseek(key_fd, 0, SEEK_SET) == -1) {
+            perror("Error reading key file");
+            close(key_fd); return -1;
+        }
+        return read_text_item(key_fd, value1, value2, value3, version, arena);
+    }
+
+    if (read_values_from_keyfile(key_fd, &header, value1, arena) == -1) return -1;
+    *value2 = header.value2;
+    *value3 = header.value3;
+    if (version) *version = header.version;
+
+    /* all values were read at this point, so close file and return */
+    close(key_fd); return 0;
+}
+
+
+int file_store_open_value1(const int key, off_t *offset, uint32_t *len) {
+    /* opens key file so that value1 can be read straight from it, starting at offset;
+     * modified key files are replaced rather than rewritten, so the file keeps the value1 it had when opened.
+     * returns the file descriptor, to be closed by the caller; -1 if value1 can't be read that way */
+    int key_fd = open_keyfile(key, READ);
+    if (key_fd == -1) return -1;
+
+    /* text key files have no header, so value1 can't be located without parsing them */
+    key_file_header_t header;
+    if (pread(key_fd, &header, sizeof(header), 0) != sizeof(header) ||
+        memcmp(header.magic, KEY_FILE_MAGIC, sizeof(header.magic)) != 0) {
+        close(key_fd); return -1;
+    }
+
+    *offset = sizeof(header);
+    *len = header.value1_len;
+    return key_fd;
+}
+
+
+static int replace_keyfile(const int key, const char *value1, const int *value2, const float *value3,
+                           const uint32_t version) {
+    /* writes a new key file next to the old one and renames it over it,
+     * so that readers holding the old one open keep reading the old values */
+    if (!file_store_item_exists(key)) {
+        perror("Error opening key file"); return -1;
+    }
+
+    char key_file_name[MAX_STR_SIZE], tmp_file_name[MAX_STR_SIZE];
+    snprintf(key_file_name, MAX_STR_SIZE, "%s/%d", db_dir_name, key);
+    snprintf(tmp_file_name, MAX_STR_SIZE, "%s/.%d", db_dir_name, key);
+
+    if (write_keyfile(tmp_file_name, O_WRONLY | O_CREAT | O_TRUNC, value1, value2, value3, version,
+                      key_file_name) == -1) {
+        perror("Could not replace key file");
+        unlink(tmp_file_name); return -1;
+    }
+    return 0;
+}
+
+
+int file_store_write_item(const int key, const char *value1, const int *value2, const float *value3,
+                          const uint32_t version, const char mode) {
+    if (mode == MODIFY) return replace_keyfile(key, value1, value2, value3, version);
+    if (mode != CREATE) return -1;
+
+    char key_file_name[MAX_STR_SIZE];
+    snprintf(key_file_name, MAX_STR_SIZE, "%s/%d", db_dir_name, key);
+
+    /* write item to a new key file */
+    if (write_keyfile(key_file_name, O_WRONLY | O_CREAT | O_EXCL, value1, value2, value3, version, NULL) == -1) {
+        switch (errno) {
+            /* EEXIST: set_value API call inserting existing key error */
+            case EEXIST: perror("Key file already exists"); return -1;
+            /* don't leave a partly written key file behind */
+            default: perror("Error writing key file"); unlink(key_file_name); return -1;
+        }
+    }
+    return 0;
+}
+
+
+int file_store_write_values(const int key, const int *value2, const float *value3, const uint32_t version) {
+    /* rewrites the key file header in place, leaving value1 as it is: readers sending value1 straight from the
+     * key file only read the bytes after it. key files written as text are replaced whole */
+    char key_file_name[MAX_STR_SIZE];
+    snprintf(key_file_name, MAX_STR_SIZE, "%s/%d", db_dir_name, key);
+    int key_fd = open(key_file_name, O_RDWR);
+    if (key_fd == -1) {
+        perror("Error opening key file"); return -1;
+    }
+
+    key_file_header_t header;
+    if (pread(key_fd, &header, sizeof(header), 0) != sizeof(header) ||
+        memcmp(header.magic, KEY_FILE_MAGIC, sizeof(header.magic)) != 0) {
+        close(key_fd);
+
+        arena_t arena;
+        char *value1;
+        int old_value2;
+        float old_value3;
+        arena_init(&arena);
+        int result = file_store_read_item(key, &value1, &old_value2, &old_value3, NULL, &arena);
+        if (result == 0) result = replace_keyfile(key, value1, value2, value3, version);
+        arena_free(&arena);
+        return result;
+    }
+
+    header.value2 = *value2;
+    header.value3 = *value3;
+    header.version = version;
+    if (pwrite(key_fd, &header, sizeof(header), 0) != sizeof(header)) {
+        perror("Error writing key file");
+        close(key_fd); return -1;
+    }
+    close(key_fd); return 0;
+}
+
+
+int file_store_delete_item(const int key) {
+    int exists = file_store_item_exists(key);
+    if (!exists) return -1;     /* key file doesn't exist */
+
+    /* key file does exist, so delete it */
+    char key_file_name[MAX_STR_SIZE];
+    snprintf(key_file_name, MAX_STR_SIZE, "%s/%d", db_dir_name, key);
+
+    if (remove(key_file_name) == -1) {
+        perror("Couldn't delete key file");
+        return -1;
+    }
+    return 0;
+}
+
+
+void file_store_defer_writes(void) {
+    /* key files written from now on are only written by file_store_submit_writes, in one submission if the
+     * io ring is in use (right away otherwise); they mustn't be read, written or removed again in between */
+    io_ring_defer_writes();
+}
+
+
+int file_store_submit_writes(void) {
+    /* writes the key files deferred since file_store_defer_writes; -1 if one of them couldn't be written */
+    if (io_ring_submit_writes() == -1) {
+        perror("Error writing key file"); return -1;
+    }
+    return 0;
+}
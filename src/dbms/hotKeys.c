@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "DS-MandatoryExercise/utils.h"
+#include "DS-MandatoryExercise/dbms/hotKeys.h"
+
+
+static uint64_t mix(uint64_t x) {
+    /* splitmix64 finalizer: every 16 bits of the result make an independent counter position */
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+
+static void find_coldest(hot_keys_t *hot) {
+    hot->coldest = 0;
+    for (uint32_t i = 1; i < hot->num_keys; i++) {
+        if (hot->keys[i].count < hot->keys[hot->coldest].count) hot->coldest = i;
+    }
+}
+
+
+static void drop_value1(hot_keys_t *hot, hot_key_t *pinned) {
+    hot->value1_bytes -= pinned->value1_size;
+    free(pinned->value1);
+    pinned->value1 = NULL;
+    pinned->value1_size = 0;
+}
+
+
+static void age(hot_keys_t *hot) {
+    /* halves every counter & pinned count, so that reads long past weigh less and less */
+    for (uint32_t i = 0; i < HOT_SKETCH_DEPTH * hot->width; i++) hot->counters[i] >>= 1;
+    for (uint32_t i = 0; i < hot->num_keys; i++) hot->keys[i].count >>= 1;
+    hot->samples = 0;
+}
+
+
+int hot_keys_init(hot_keys_t *hot, const uint32_t max_keys) {
+    /* max_keys may be 0, and nothing is ever pinned then */
+    memset(hot, 0, sizeof(hot_keys_t));
+    if (!max_keys) return 0;
+    if (max_keys > HOT_KEYS_MAX) {
+        fprintf(stderr, "Too many hot keys\n"); return -1;
+    }
+
+    hot->width = 1;
+    while (hot->width < max_keys * HOT_SKETCH_WIDTH_FACTOR) hot->width <<= 1;
+    hot->counters = calloc(HOT_SKETCH_DEPTH * hot->width, sizeof(uint16_t));
+    hot->keys = malloc(max_keys * sizeof(hot_key_t));
+    if (!hot->counters || !hot->keys || key_map_init(&hot->index, max_keys * 2) == -1) {
+        perror("Could not allocate hot keys");
+        free(hot->counters);
+        free(hot->keys);
+        memset(hot, 0, sizeof(hot_keys_t)); return -1;
+    }
+    hot->max_keys = max_keys;
+    return 0;
+}
+
+
+void hot_keys_free(hot_keys_t *hot) {
+    if (!hot->max_keys) return;
+    hot_keys_drop_values(hot);
+    free(hot->counters);
+    free(hot->keys);
+    key_map_free(&hot->index);
+    memset(hot, 0, sizeof(hot_keys_t));
+}
+
+
+int hot_keys_sample(hot_keys_t *hot, const int32_t key) {
+    /* counts a read of key, pinning it in place of the coldest pinned key once its estimate is higher;
+     * returns TRUE if key is pinned */
+    if (!hot->max_keys) return FALSE;
+
+    uint64_t hash = mix((uint64_t) (uint32_t) key);
+    uint16_t estimate = UINT16_MAX;
+    for (int row = 0; row < HOT_SKETCH_DEPTH; row++) {
+        uint16_t *counter = &hot->counters[row * hot->width + ((hash >> (16 * row)) & (hot->width - 1))];
+        if (*counter < UINT16_MAX) (*counter)++;
+        if (*counter < estimate) estimate = *counter;
+    }
+    if (++hot->samples == hot->width * HOT_SKETCH_RESET_FACTOR) age(hot);
+
+    uint64_t pos;
+    if (key_map_get(&hot->index, key, &pos) == 0) {
+        hot->keys[pos].count = estimate;
+        if (pos == hot->coldest) find_coldest(hot);
+        return TRUE;
+    }
+    if (estimate < HOT_KEYS_MIN_COUNT) return FALSE;
+
+    if (hot->num_keys < hot->max_keys) {
+        pos = hot->num_keys++;
+        hot->keys[pos].value1 = NULL;
+        hot->keys[pos].value1_size = 0;
+    } else if (estimate > hot->keys[hot->coldest].count) {
+        pos = hot->coldest;
+        key_map_remove(&hot->index, hot->keys[pos].key);
+        drop_value1(hot, &hot->keys[pos]);
+    } else return FALSE;
+
+    if (key_map_put(&hot->index, key, pos) == -1) {
+        /* the slot is given up: the last pinned key moves to it */
+        hot->keys[pos] = hot->keys[--hot->num_keys];
+        if (pos < hot->num_keys) key_map_put(&hot->index, hot->keys[pos].key, pos);
+        find_coldest(hot);
+        return FALSE;
+    }
+    hot->keys[pos].key = key;
+    hot->keys[pos].count = estimate;
+    find_coldest(hot);
+    return TRUE;
+}
+
+
+int hot_keys_pinned(const hot_keys_t *hot, const int32_t key) {
+    return hot->max_keys && key_map_get(&hot->index, key, NULL) == 0;
+}
+
+
+static int compare_counts(const void *a, const void *b) {
+    uint16_t x = ((const hot_key_t *) a)->count, y = ((const hot_key_t *) b)->count;
+    return (x < y) - (x > y);
+}
+
+
+uint32_t hot_keys_top(const hot_keys_t *hot, hot_key_t *top, const uint32_t max_keys) {
+    /* fills top with up to max_keys pinned keys, hottest first; returns how many */
+    hot_key_t *sorted = malloc((hot->num_keys + 1) * sizeof(hot_key_t));
+    if (!sorted) return 0;
+    memcpy(sorted, hot->keys, hot->num_keys * sizeof(hot_key_t));
+    qsort(sorted, hot->num_keys, sizeof(hot_key_t), compare_counts);
+
+    uint32_t num_top = hot->num_keys < max_keys ? hot->num_keys : max_keys;
+    memcpy(top, sorted, num_top * sizeof(hot_key_t));
+    free(sorted);
+    return num_top;
+}
+
+
+const char *hot_keys_get_value1(const hot_keys_t *hot, const int32_t key) {
+    /* copy of the value1 of key; NULL if it isn't pinned or has no copy */
+    uint64_t pos;
+    if (!hot->max_keys || key_map_get(&hot->index, key, &pos) == -1) return NULL;
+    return hot->keys[pos].value1;
+}
+
+
+int hot_keys_set_value1(hot_keys_t *hot, const int32_t key, const char *value1) {
+    /* replaces the copy of the value1 of key, if it's pinned, as long as every copy still fits in
+     * HOT_VALUES_MAX_BYTES; returns TRUE if copied. keys that don't fit are left without any */
+    uint64_t pos;
+    if (!hot->max_keys || key_map_get(&hot->index, key, &pos) == -1) return FALSE;
+
+    hot_key_t *pinned = &hot->keys[pos];
+    drop_value1(hot, pinned);
+    size_t size = strlen(value1) + 1;
+    if (hot->value1_bytes + size > HOT_VALUES_MAX_BYTES || !(pinned->value1 = malloc(size))) return FALSE;
+    memcpy(pinned->value1, value1, size);
+    pinned->value1_size = (uint32_t) size;
+    hot->value1_bytes += size;
+    return TRUE;
+}
+
+
+void hot_keys_drop_value1(hot_keys_t *hot, const int32_t key) {
+    /* drops the copy of the value1 of key, if it has one */
+    uint64_t pos;
+    if (hot->max_keys && key_map_get(&hot->index, key, &pos) == 0) drop_value1(hot, &hot->keys[pos]);
+}
+
+
+void hot_keys_drop_values(hot_keys_t *hot) {
+    for (uint32_t i = 0; i < hot->num_keys; i++) drop_value1(hot, &hot->keys[i]);
+}
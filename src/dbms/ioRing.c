@@ -0,0 +1,395 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include "DS-MandatoryExercise/utils.h"
+#include "DS-MandatoryExercise/arena.h"
+#include "DS-MandatoryExercise/uring.h"
+#include "DS-MandatoryExercise/dbms/ioRing.h"
+
+
+enum {OPEN, WRITE, RENAME, CLOSE, CHAIN_ENTRIES};  /* steps of a file write chain */
+
+typedef struct {
+    char *path;
+    int flags;
+    struct iovec iov;               /* a copy of the bytes to write */
+    char *rename_to;
+} deferred_t;
+
+static uring_t ring;
+static int in_use = FALSE;          /* FALSE if plain syscalls are used */
+static unsigned queued = 0;         /* entries queued since the last submission */
+static int deferring = FALSE;       /* TRUE while file writes are deferred */
+static deferred_t deferred[IO_RING_FILES];
+static int num_deferred = 0;
+static arena_t deferred_arena;      /* paths & bytes of the deferred writes */
+
+
+int io_ring_open(void) {
+    /* sets up the ring; if the kernel doesn't offer io_uring, or one without direct descriptors,
+     * plain syscalls are used instead. returns 0 either way */
+    if (uring_init(&ring, IO_RING_ENTRIES) == -1) {
+        perror("io_uring not available, using plain syscalls"); return 0;
+    }
+
+    /* direct descriptors: a table of empty slots, filled in by opens and emptied by closes */
+    struct io_uring_rsrc_register files = {.nr = IO_RING_FILES, .flags = IORING_RSRC_REGISTER_SPARSE};
+    if (uring_register(&ring, IORING_REGISTER_FILES2, &files, sizeof(files)) == -1) {
+        perror("io_uring without direct descriptors, using plain syscalls");
+        uring_free(&ring); return 0;
+    }
+
+    queued = 0;
+    in_use = TRUE;
+    return 0;
+}
+
+
+void io_ring_close(void) {
+    /* direct descriptors still open are closed along with the ring; writes still deferred are dropped */
+    deferring = FALSE;
+    num_deferred = 0;
+    arena_free(&deferred_arena);
+    if (!in_use) return;
+    uring_free(&ring);
+    in_use = FALSE;
+}
+
+
+int io_ring_in_use(void) {
+    return in_use;
+}
+
+
+static struct io_uring_sqe *get_sqe(const uint64_t user_data) {
+    /* queues an entry; callers never queue more than IO_RING_ENTRIES before submitting, so there's room */
+    struct io_uring_sqe *sqe = uring_get_sqe(&ring);
+    sqe->user_data = user_data;
+    queued++;
+    return sqe;
+}
+
+
+static void prep_open(struct io_uring_sqe *sqe, const char *path, const int flags, const mode_t mode,
+                      const int slot) {
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (uintptr_t) path;
+    sqe->len = mode;
+    sqe->open_flags = (uint32_t) flags;
+    sqe->file_index = (uint32_t) slot + 1;     /* into a direct descriptor slot, never inherited by children */
+}
+
+
+static void prep_close(struct io_uring_sqe *sqe, const int slot) {
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->file_index = (uint32_t) slot + 1;
+}
+
+
+static int submit_and_wait(int *results) {
+    /* submits the entries queued and waits until all of them complete;
+     * results[i] gets the result of the entry whose user data is i.
+     * if the ring fails, it's closed and plain syscalls are used from then on; returns 1 if the kernel didn't
+     * take any of the entries, so that the caller redoes their work with plain syscalls, or -1 if it took some */
+    unsigned total = queued, completed = 0;
+    queued = 0;
+
+    while (completed < total) {
+        if (uring_submit(&ring, total - completed) == -1 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            /* entries may still be in flight, so the ring can't be trusted anymore */
+            int taken = ring.tail - __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE) != total;
+            perror("io_uring failed, using plain syscalls from now on");
+            uring_free(&ring);
+            in_use = FALSE;
+            return taken ? -1 : 1;
+        }
+
+        struct io_uring_cqe *cqe;
+        while ((cqe = uring_peek_cqe(&ring)) != NULL) {
+            results[cqe->user_data] = cqe->res;
+            uring_cqe_seen(&ring);
+            completed++;
+        }
+    }
+    return 0;
+}
+
+
+static ssize_t read_file(const io_read_t *read) {
+    /* plain syscalls version of a read done by io_ring_read_files */
+    int fd = open(read->path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return -errno;
+
+    size_t total = 0;
+    while (total < read->size) {
+        ssize_t bytes_read = pread(fd, read->buf + total, read->size - total, (off_t) total);
+        if (bytes_read == -1 && errno == EINTR) continue;
+        if (bytes_read == -1) {
+            int error = errno;
+            close(fd); return -error;
+        }
+        if (!bytes_read) break;
+        total += (size_t) bytes_read;
+    }
+    close(fd); return (ssize_t) total;
+}
+
+
+int io_ring_read_files(io_read_t *reads, const int num_reads) {
+    /* reads the beginning of every file, IO_RING_FILES files per submission;
+     * a file that can't be read only fails its own read. returns -1 if the reads couldn't be done at all */
+    int results[3 * IO_RING_FILES];
+
+    for (int first = 0; first < num_reads; first += IO_RING_FILES) {
+        int count = num_reads - first < IO_RING_FILES ? num_reads - first : IO_RING_FILES;
+
+        if (!in_use) {
+            for (int i = first; i < first + count; i++) reads[i].result = read_file(&reads[i]);
+            continue;
+        }
+
+        for (int i = 0; i < count; i++) {
+            io_read_t *read = &reads[first + i];
+
+            /* open -> read -> close; the read is hard-linked since reading less than size is fine here,
+             * so the close runs unless the open failed */
+            struct io_uring_sqe *sqe = get_sqe(3 * i);
+            prep_open(sqe, read->path, O_RDONLY, 0, i);
+            sqe->flags = IOSQE_IO_LINK;
+
+            sqe = get_sqe(3 * i + 1);
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = i;
+            sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+            sqe->addr = (uintptr_t) read->buf;
+            sqe->len = (uint32_t) read->size;
+
+            prep_close(get_sqe(3 * i + 2), i);
+        }
+        int result = submit_and_wait(results);
+        if (result == -1) return -1;
+        if (result == 1) {
+            first -= IO_RING_FILES; continue;
+        }
+
+        for (int i = 0; i < count; i++) reads[first + i].result = results[3 * i] < 0 ? results[3 * i]
+                                                                                     : results[3 * i + 1];
+    }
+    return 0;
+}
+
+
+static int write_file(const char *path, const int flags, const struct iovec *iov, const int iovcnt,
+                      const size_t len, const char *rename_to) {
+    /* plain syscalls version of io_ring_write_file */
+    int fd = open(path, flags | O_CLOEXEC, 0600);
+    if (fd == -1) return -1;
+
+    ssize_t written = writev(fd, iov, iovcnt);
+    if (written != (ssize_t) len) {
+        int error = written == -1 ? errno : EIO;
+        close(fd);
+        errno = error; return -1;
+    }
+    if (close(fd) == -1) return -1;
+    return rename_to ? rename(path, rename_to) : 0;
+}
+
+
+static void queue_write(const int slot, const char *path, const int flags, const struct iovec *iov, const int iovcnt,
+                        const char *rename_to) {
+    /* queues open -> write -> rename -> close of a file opened into slot; a failure cancels whatever follows it.
+     * entries get CHAIN_ENTRIES * slot plus their step as user data */
+    struct io_uring_sqe *sqe = get_sqe(CHAIN_ENTRIES * slot + OPEN);
+    prep_open(sqe, path, flags, 0600, slot);
+    sqe->flags = IOSQE_IO_LINK;
+
+    sqe = get_sqe(CHAIN_ENTRIES * slot + WRITE);
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->fd = slot;
+    sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_LINK;
+    sqe->addr = (uintptr_t) iov;
+    sqe->len = (uint32_t) iovcnt;
+
+    if (rename_to) {
+        sqe = get_sqe(CHAIN_ENTRIES * slot + RENAME);
+        sqe->opcode = IORING_OP_RENAMEAT;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (uintptr_t) path;
+        sqe->len = AT_FDCWD;
+        sqe->addr2 = (uintptr_t) rename_to;
+        sqe->flags = IOSQE_IO_LINK;
+    }
+
+    prep_close(get_sqe(CHAIN_ENTRIES * slot + CLOSE), slot);
+}
+
+
+static int close_cancelled(const int *results, const int num_chains) {
+    /* files stay open if their close was cancelled after the open succeeded; closing the ring closes them too */
+    int close_results[IO_RING_FILES];
+
+    for (int slot = 0; slot < num_chains; slot++) {
+        const int *chain = results + CHAIN_ENTRIES * slot;
+        if (chain[OPEN] >= 0 && chain[CLOSE] == -ECANCELED) prep_close(get_sqe(slot), slot);
+    }
+    if (!queued) return 0;
+    return submit_and_wait(close_results) == -1 ? -1 : 0;
+}
+
+
+static int chain_error(const int *chain, const size_t len) {
+    /* the errno of the first failure of a chain queued by queue_write, 0 if there was none;
+     * short writes are failures too, and cancel the rest of the chain */
+    for (int i = OPEN; i <= CLOSE; i++) {
+        if (chain[i] < 0 && chain[i] != -ECANCELED) return -chain[i];
+        if (i == WRITE && chain[WRITE] != (int) len) return EIO;
+    }
+    return 0;
+}
+
+
+static int submit_deferred(void) {
+    /* does every deferred write, in a single submission if the ring is in use; returns -1 with errno set
+     * if one of them failed, after removing the file it was writing, unless it was there before */
+    int results[CHAIN_ENTRIES * IO_RING_FILES] = {0};
+    int count = num_deferred, result = 1, error = 0;
+    num_deferred = 0;
+
+    if (in_use) {
+        for (int slot = 0; slot < count; slot++) {
+            deferred_t *write = &deferred[slot];
+            queue_write(slot, write->path, write->flags, &write->iov, 1, write->rename_to);
+        }
+        result = submit_and_wait(results);
+        if (result == 0) result = close_cancelled(results, count);
+    }
+
+    for (int slot = 0; result != -1 && slot < count; slot++) {
+        deferred_t *write = &deferred[slot];
+        int write_error;
+        if (result == 1)
+            write_error = write_file(write->path, write->flags, &write->iov, 1, write->iov.iov_len,
+                                     write->rename_to) == -1 ? errno : 0;
+        else
+            write_error = chain_error(results + CHAIN_ENTRIES * slot, write->iov.iov_len);
+        if (write_error && write_error != EEXIST) unlink(write->path);
+        if (write_error && !error) error = write_error;
+    }
+    arena_reset(&deferred_arena);
+
+    if (result == -1) return -1;
+    if (error) {
+        errno = error; return -1;
+    }
+    return 0;
+}
+
+
+void io_ring_defer_writes(void) {
+    /* from now on, io_ring_write_file only copies what it's given, until io_ring_submit_writes does every write
+     * at once; no-op if the ring isn't in use. files written must not be touched in between */
+    deferring = in_use;
+}
+
+
+int io_ring_submit_writes(void) {
+    /* does the writes deferred since io_ring_defer_writes, and stops deferring them;
+     * returns -1 with errno set if one of them failed */
+    deferring = FALSE;
+    return submit_deferred();
+}
+
+
+static int defer_write(const char *path, const int flags, const struct iovec *iov, const int iovcnt,
+                       const size_t len, const char *rename_to) {
+    /* copies a write for submit_deferred, which is called first if there are already IO_RING_FILES of them */
+    if (num_deferred == IO_RING_FILES && submit_deferred() == -1) return -1;
+
+    deferred_t *write = &deferred[num_deferred];
+    char *data = arena_alloc(&deferred_arena, len);
+    write->path = arena_strndup(&deferred_arena, path, strlen(path));
+    write->rename_to = rename_to ? arena_strndup(&deferred_arena, rename_to, strlen(rename_to)) : NULL;
+    if (!data || !write->path || (rename_to && !write->rename_to)) {
+        errno = ENOMEM; return -1;
+    }
+
+    size_t copied = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        memcpy(data + copied, iov[i].iov_base, iov[i].iov_len);
+        copied += iov[i].iov_len;
+    }
+    write->flags = flags;
+    write->iov.iov_base = data;
+    write->iov.iov_len = len;
+    num_deferred++;
+    return 0;
+}
+
+
+int io_ring_write_file(const char *path, const int flags, const struct iovec *iov, const int iovcnt,
+                       const char *rename_to) {
+    /* opens path with flags (creating it with mode 0600 if they say so), writes iov to it from the beginning
+     * and closes it; then renames it to rename_to, unless it's NULL. returns -1 with errno set on error.
+     * while writes are deferred, errors are only reported by io_ring_submit_writes */
+    int results[CHAIN_ENTRIES] = {0};
+    size_t len = 0;
+
+    for (int i = 0; i < iovcnt; i++) len += iov[i].iov_len;
+    if (!in_use) return write_file(path, flags, iov, iovcnt, len, rename_to);
+    if (deferring) return defer_write(path, flags, iov, iovcnt, len, rename_to);
+
+    /* open -> write -> rename -> close in a single submission */
+    queue_write(0, path, flags, iov, iovcnt, rename_to);
+    int result = submit_and_wait(results);
+    if (result == -1) return -1;
+    if (result == 1) return write_file(path, flags, iov, iovcnt, len, rename_to);
+    if (close_cancelled(results, 1) == -1) return -1;
+
+    int error = chain_error(results, len);
+    if (error) {
+        errno = error; return -1;
+    }
+    return 0;
+}
+
+
+int io_ring_unlink_files(const char **paths, const int num_paths) {
+    /* removes every file, IO_RING_ENTRIES per submission. returns -1 with errno set if one couldn't be removed */
+    int results[IO_RING_ENTRIES];
+
+    for (int first = 0; first < num_paths; first += IO_RING_ENTRIES) {
+        int count = num_paths - first < IO_RING_ENTRIES ? num_paths - first : IO_RING_ENTRIES;
+
+        if (!in_use) {
+            for (int i = first; i < first + count; i++) {
+                if (unlink(paths[i]) == -1) return -1;
+            }
+            continue;
+        }
+
+        for (int i = 0; i < count; i++) {
+            struct io_uring_sqe *sqe = get_sqe(i);
+            sqe->opcode = IORING_OP_UNLINKAT;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (uintptr_t) paths[first + i];
+        }
+        int result = submit_and_wait(results);
+        if (result == -1) return -1;
+        if (result == 1) {
+            first -= IO_RING_ENTRIES; continue;
+        }
+
+        for (int i = 0; i < count; i++) {
+            if (results[i] < 0) {
+                errno = -results[i]; return -1;
+            }
+        }
+    }
+    return 0;
+}
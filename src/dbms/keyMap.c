@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "DS-MandatoryExercise/dbms/keyMap.h"
+
+#define KEY_MAP_MIN_CAPACITY 64
+
+
+static uint32_t hash_key(const int32_t key) {
+    /* multiplicative hashing spreads consecutive keys over the table */
+    uint32_t h = (uint32_t) key * 2654435761u;
+    return h ^ (h >> 16);
+}
+
+
+static int key_map_resize(key_map_t *map, const uint32_t capacity) {
+    /* rehashes every used entry into a new table; drops tombstones */
+    key_map_entry_t *old_entries = map->entries;
+    uint32_t old_capacity = map->capacity;
+
+    map->entries = calloc(capacity, sizeof(key_map_entry_t));
+    if (!map->entries) {
+        perror("Could not allocate key map");
+        map->entries = old_entries; return -1;
+    }
+    map->capacity = capacity;
+    map->size = 0;
+    map->tombstones = 0;
+
+    for (uint32_t i = 0; i < old_capacity; i++) {
+        if (old_entries[i].state != KEY_MAP_USED) continue;
+
+        uint32_t pos = hash_key(old_entries[i].key) & (capacity - 1);
+        while (map->entries[pos].state == KEY_MAP_USED) pos = (pos + 1) & (capacity - 1);
+        map->entries[pos] = old_entries[i];
+        map->size++;
+    }
+
+    free(old_entries); return 0;
+}
+
+
+int key_map_init(key_map_t *map, const uint32_t capacity) {
+    /* capacity is rounded up to a power of 2 */
+    uint32_t cap = KEY_MAP_MIN_CAPACITY;
+    while (cap < capacity) cap <<= 1;
+
+    map->entries = calloc(cap, sizeof(key_map_entry_t));
+    if (!map->entries) {
+        perror("Could not allocate key map"); return -1;
+    }
+    map->capacity = cap;
+    map->size = 0;
+    map->tombstones = 0;
+    return 0;
+}
+
+
+void key_map_free(key_map_t *map) {
+    free(map->entries);
+    map->entries = NULL;
+    map->capacity = map->size = map->tombstones = 0;
+}
+
+
+void key_map_clear(key_map_t *map) {
+    memset(map->entries, 0, map->capacity * sizeof(key_map_entry_t));
+    map->size = 0;
+    map->tombstones = 0;
+}
+
+
+int key_map_get(const key_map_t *map, const int32_t key, uint64_t *value) {
+    /* returns 0 and sets value if key is found, -1 otherwise */
+    uint32_t pos = hash_key(key) & (map->capacity - 1);
+
+    while (map->entries[pos].state != KEY_MAP_EMPTY) {
+        if (map->entries[pos].state == KEY_MAP_USED && map->entries[pos].key == key) {
+            if (value) *value = map->entries[pos].value;
+            return 0;
+        }
+        pos = (pos + 1) & (map->capacity - 1);
+    }
+    return -1;
+}
+
+
+int key_map_reserve(key_map_t *map) {
+    /* makes room for one more key, so that putting it can't fail */
+
+    /* keep load factor (tombstones included) below 70% */
+    if ((map->size + map->tombstones + 1) * 10 >= map->capacity * 7) {
+        uint32_t capacity = (map->size + 1) * 10 >= map->capacity * 5 ? map->capacity << 1 : map->capacity;
+        if (key_map_resize(map, capacity) == -1) return -1;
+    }
+    return 0;
+}
+
+
+int key_map_put(key_map_t *map, const int32_t key, const uint64_t value) {
+    /* inserts key or overwrites its value if it's already there */
+    if (key_map_reserve(map) == -1) return -1;
+
+    uint32_t pos = hash_key(key) & (map->capacity - 1);
+    int64_t first_free = -1;    /* first tombstone found; reused if key isn't in the map */
+
+    while (map->entries[pos].state != KEY_MAP_EMPTY) {
+        if (map->entries[pos].state == KEY_MAP_USED && map->entries[pos].key == key) {
+            map->entries[pos].value = value; return 0;
+        }
+        if (map->entries[pos].state == KEY_MAP_DELETED && first_free == -1) first_free = pos;
+        pos = (pos + 1) & (map->capacity - 1);
+    }
+
+    if (first_free != -1) {
+        pos = (uint32_t) first_free;
+        map->tombstones--;
+    }
+    map->entries[pos].key = key;
+    map->entries[pos].value = value;
+    map->entries[pos].state = KEY_MAP_USED;
+    map->size++;
+    return 0;
+}
+
+
+int key_map_remove(key_map_t *map, const int32_t key) {
+    /* returns 0 if key was removed, -1 if it wasn't in the map */
+    uint32_t pos = hash_key(key) & (map->capacity - 1);
+
+    while (map->entries[pos].state != KEY_MAP_EMPTY) {
+        if (map->entries[pos].state == KEY_MAP_USED && map->entries[pos].key == key) {
+            map->entries[pos].state = KEY_MAP_DELETED;
+            map->size--;
+            map->tombstones++;
+            return 0;
+        }
+        pos = (pos + 1) & (map->capacity - 1);
+    }
+    return -1;
+}
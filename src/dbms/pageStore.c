@@ -0,0 +1,796 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include "DS-MandatoryExercise/utils.h"
+#include "DS-MandatoryExercise/dbms/dbmsUtils.h"
+#include "DS-MandatoryExercise/dbms/keyMap.h"
+#include "DS-MandatoryExercise/dbms/pageStore.h"
+
+/* page file layout:
+ *  page 0:  file header
+ *  page 1+: data pages; each one starts with a page header followed by the slot directory,
+ *           which grows upwards, while records are allocated from the end of the page downwards.
+ *           extents, runs of pages holding a value1 too long to fit in a record, are mixed with them;
+ *           their first page starts with an extent header, followed by the value1 bytes */
+
+#define PAGE_SIZE 4096
+#define PAGE_STORE_MAGIC 0x4b565047u    /* "KVPG" */
+#define INLINE_VALUE1_MAX 1024          /* longer value1 strings are stored in an extent */
+#define EXTENT_MARK 0xffff              /* num_slots of extents, which data pages can't reach */
+#define PAGE_STORE_GROW_PAGES 64        /* min number of pages added when the file is full */
+#define CHECKPOINT_DIRTY_PAGES 256      /* dirty pages that trigger an automatic checkpoint */
+
+typedef struct {
+    uint32_t magic;
+    uint32_t page_size;
+    uint32_t num_pages;     /* pages in use, header page included */
+    uint32_t num_items;
+} file_header_t;
+
+typedef struct {
+    uint16_t num_slots;     /* entries in the slot directory */
+    uint16_t free_start;    /* first byte after the slot directory */
+    uint16_t free_end;      /* first byte of the record area */
+    uint16_t free_bytes;    /* total free bytes, holes left by deleted records included */
+} page_header_t;
+
+typedef struct {
+    uint16_t offset;        /* record offset inside the page; 0 means the slot is free */
+    uint16_t length;        /* bytes allocated to the record */
+} slot_t;
+
+typedef struct {
+    uint16_t mark;          /* EXTENT_MARK; overlaps num_slots of page headers */
+    uint16_t in_use;        /* FALSE for extents freed, which are reused by later writes */
+    uint32_t num_pages;     /* pages in the extent, this one included */
+} extent_header_t;
+
+typedef struct {
+    int32_t key;
+    int32_t value2;
+    float value3;
+    uint32_t version;       /* bumped on every write */
+    uint32_t value1_len;    /* value1 bytes, no terminating byte; they follow the record header if there are at
+                             * most INLINE_VALUE1_MAX of them, otherwise the first page of their extent does */
+} record_header_t;
+
+typedef struct {
+    uint32_t page;          /* first page */
+    uint32_t num_pages;
+} extent_t;
+
+typedef struct {
+    uint32_t page;          /* first page of the extent */
+    uint32_t pins;          /* value1 strings being read straight from it */
+    int freed;              /* TRUE once no record points to it */
+} pin_t;
+
+/* page store state */
+static struct {
+    int fd;                 /* page file descriptor */
+    char *map;              /* page file mapped into memory */
+    uint32_t capacity;      /* number of mapped pages */
+    uint8_t *dirty;         /* dirty page flags, one per mapped page */
+    uint32_t num_dirty;     /* number of dirty pages */
+    uint16_t *page_free;    /* free-space map: free bytes per page */
+    uint32_t alloc_hint;    /* page where the next free-space search starts */
+    extent_t *free_extents; /* extents not in use; rebuilt when the file is opened */
+    uint32_t num_free_extents;
+    uint32_t free_extents_cap;
+    pin_t *pins;            /* extents being read from the page file; neither reused nor freed until unpinned */
+    uint32_t num_pins;
+    uint32_t pins_cap;
+    key_map_t keys;         /* key -> (page, slot) */
+} ps = { .fd = -1 };
+
+
+/* page & record access helpers */
+
+static file_header_t *file_header(void) {
+    return (file_header_t *) ps.map;
+}
+
+
+static page_header_t *page_header(const uint32_t page) {
+    return (page_header_t *) (ps.map + (size_t) page * PAGE_SIZE);
+}
+
+
+static slot_t *page_slots(const uint32_t page) {
+    return (slot_t *) (ps.map + (size_t) page * PAGE_SIZE + sizeof(page_header_t));
+}
+
+
+static record_header_t *slot_record(const uint32_t page, const uint16_t slot) {
+    return (record_header_t *) (ps.map + (size_t) page * PAGE_SIZE + page_slots(page)[slot].offset);
+}
+
+
+static extent_header_t *extent_header(const uint32_t page) {
+    return (extent_header_t *) (ps.map + (size_t) page * PAGE_SIZE);
+}
+
+
+static int is_extent(const uint32_t page) {
+    return extent_header(page)->mark == EXTENT_MARK;
+}
+
+
+static uint32_t next_page(const uint32_t page) {
+    /* pages of an extent are skipped all at once */
+    return is_extent(page) ? page + extent_header(page)->num_pages : page + 1;
+}
+
+
+static char *extent_data(const uint32_t page) {
+    return ps.map + (size_t) page * PAGE_SIZE + sizeof(extent_header_t);
+}
+
+
+static uint32_t extent_pages(const size_t value1_len) {
+    return (uint32_t) ((sizeof(extent_header_t) + value1_len + PAGE_SIZE - 1) / PAGE_SIZE);
+}
+
+
+static uint32_t record_extent(const record_header_t *record) {
+    /* returns the first page of the extent holding the record's value1; 0 if it's stored inline */
+    if (record->value1_len <= INLINE_VALUE1_MAX) return 0;
+    return *(const uint32_t *) (record + 1);
+}
+
+
+static uint16_t record_size(const size_t body_len) {
+    /* records are 4-byte aligned so their headers can be accessed in place */
+    return (uint16_t) ((sizeof(record_header_t) + body_len + 3) & ~(size_t) 3);
+}
+
+
+static uint64_t location(const uint32_t page, const uint16_t slot) {
+    return ((uint64_t) page << 16) | slot;
+}
+
+
+static void mark_dirty(const uint32_t page) {
+    if (!ps.dirty[page]) {
+        ps.dirty[page] = 1;
+        ps.num_dirty++;
+    }
+}
+
+
+static void init_page(const uint32_t page) {
+    page_header_t *header = page_header(page);
+    header->num_slots = 0;
+    header->free_start = sizeof(page_header_t);
+    header->free_end = PAGE_SIZE;
+    header->free_bytes = PAGE_SIZE - sizeof(page_header_t);
+    ps.page_free[page] = header->free_bytes;
+    mark_dirty(page);
+}
+
+
+static int map_file(const uint32_t num_pages) {
+    /* (re)maps the page file, resizing it to num_pages pages */
+    if (ps.map && munmap(ps.map, (size_t) ps.capacity * PAGE_SIZE) == -1) {
+        perror("Could not unmap page file"); return -1;
+    }
+    ps.map = NULL;
+
+    if (ftruncate(ps.fd, (off_t) num_pages * PAGE_SIZE) == -1) {
+        perror("Could not resize page file"); return -1;
+    }
+
+    ps.map = mmap(NULL, (size_t) num_pages * PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, ps.fd, 0);
+    if (ps.map == MAP_FAILED) {
+        perror("Could not map page file");
+        ps.map = NULL; return -1;
+    }
+
+    /* resize per-page bookkeeping */
+    uint8_t *dirty = realloc(ps.dirty, num_pages);
+    uint16_t *page_free = realloc(ps.page_free, num_pages * sizeof(uint16_t));
+    if (!dirty || !page_free) {
+        perror("Could not allocate page bookkeeping");
+        if (dirty) ps.dirty = dirty;
+        if (page_free) ps.page_free = page_free;
+        return -1;
+    }
+    ps.dirty = dirty; ps.page_free = page_free;
+
+    for (uint32_t page = ps.capacity; page < num_pages; page++) {
+        ps.dirty[page] = 0;
+        ps.page_free[page] = 0;
+    }
+    /* pages dropped by a shrink can't be dirty anymore */
+    if (num_pages < ps.capacity) {
+        ps.num_dirty = 0;
+        for (uint32_t page = 0; page < num_pages; page++) ps.num_dirty += ps.dirty[page];
+    }
+
+    ps.capacity = num_pages;
+    return 0;
+}
+
+
+static int reserve_pages(const uint32_t num_pages) {
+    /* grows the page file if needed so that it has at least num_pages pages */
+    if (num_pages <= ps.capacity) return 0;
+
+    uint32_t capacity = ps.capacity * 2;
+    if (capacity < ps.capacity + PAGE_STORE_GROW_PAGES) capacity = ps.capacity + PAGE_STORE_GROW_PAGES;
+    if (capacity < num_pages) capacity = num_pages;
+    return map_file(capacity);
+}
+
+
+static int add_page(void) {
+    /* appends a new data page, growing the page file if needed; returns its number */
+    uint32_t page = file_header()->num_pages;
+
+    if (reserve_pages(page + 1) == -1) return -1;
+
+    file_header()->num_pages = page + 1;
+    mark_dirty(0);
+    init_page(page);
+    return (int) page;
+}
+
+
+static void init_extent(const uint32_t page, const uint32_t num_pages, const int in_use) {
+    /* extent pages never hold records, so the free-space map keeps them out of searches */
+    extent_header_t *header = extent_header(page);
+    header->mark = EXTENT_MARK;
+    header->in_use = (uint16_t) in_use;
+    header->num_pages = num_pages;
+    for (uint32_t i = 0; i < num_pages; i++) ps.page_free[page + i] = 0;
+    mark_dirty(page);
+}
+
+
+static int add_free_extent(const uint32_t page, const uint32_t num_pages) {
+    /* if the list can't grow, the extent is only lost until the file is opened again */
+    if (ps.num_free_extents == ps.free_extents_cap) {
+        uint32_t cap = ps.free_extents_cap ? ps.free_extents_cap * 2 : 16;
+        extent_t *free_extents = realloc(ps.free_extents, cap * sizeof(extent_t));
+        if (!free_extents) {
+            perror("Could not allocate free extent list"); return -1;
+        }
+        ps.free_extents = free_extents;
+        ps.free_extents_cap = cap;
+    }
+    ps.free_extents[ps.num_free_extents++] = (extent_t) {.page = page, .num_pages = num_pages};
+    return 0;
+}
+
+
+static void shrink_extent(const uint32_t page, const uint32_t num_pages) {
+    /* gives the pages of an extent past the first num_pages back as a free extent */
+    uint32_t extra = extent_header(page)->num_pages - num_pages;
+    if (!extra) return;
+
+    extent_header(page)->num_pages = num_pages;
+    mark_dirty(page);
+    init_extent(page + num_pages, extra, FALSE);
+    add_free_extent(page + num_pages, extra);
+}
+
+
+static int alloc_extent(const uint32_t num_pages) {
+    /* first fit among free extents, appending a new one to the page file if none is big enough;
+     * returns its first page. the file may be remapped, so pointers into it must be fetched again */
+    for (uint32_t i = 0; i < ps.num_free_extents; i++) {
+        extent_t extent = ps.free_extents[i];
+        if (extent.num_pages < num_pages) continue;
+
+        ps.free_extents[i] = ps.free_extents[--ps.num_free_extents];
+        init_extent(extent.page, extent.num_pages, TRUE);
+        shrink_extent(extent.page, num_pages);
+        return (int) extent.page;
+    }
+
+    uint32_t page = file_header()->num_pages;
+    if (reserve_pages(page + num_pages) == -1) return -1;
+
+    file_header()->num_pages = page + num_pages;
+    mark_dirty(0);
+    init_extent(page, num_pages, TRUE);
+    return (int) page;
+}
+
+
+static void free_extent(const uint32_t page) {
+    init_extent(page, extent_header(page)->num_pages, FALSE);
+    add_free_extent(page, extent_header(page)->num_pages);
+}
+
+
+static pin_t *find_pin(const uint32_t page) {
+    for (uint32_t i = 0; i < ps.num_pins; i++)
+        if (ps.pins[i].page == page) return &ps.pins[i];
+    return NULL;
+}
+
+
+static void release_extent(const uint32_t page) {
+    /* frees an extent no record points to anymore; pinned extents are marked free in the file right away,
+     * so that they are reclaimed if the server stops, but they are only reused once unpinned */
+    pin_t *pin = find_pin(page);
+    if (!pin) {
+        free_extent(page); return;
+    }
+    init_extent(page, extent_header(page)->num_pages, FALSE);
+    pin->freed = TRUE;
+}
+
+
+static int compare_pins(const void *a, const void *b) {
+    uint32_t page_a = ((const pin_t *) a)->page, page_b = ((const pin_t *) b)->page;
+    return (page_a > page_b) - (page_a < page_b);
+}
+
+
+static void write_extent(const uint32_t page, const char *value1, const size_t value1_len) {
+    memcpy(extent_data(page), value1, value1_len);
+    for (uint32_t i = 0; i < extent_pages(value1_len); i++) mark_dirty(page + i);
+}
+
+
+static void compact_page(const uint32_t page) {
+    /* moves live records to the end of the page so that all free space is contiguous;
+     * slot numbers don't change, so key locations stay valid */
+    char buffer[PAGE_SIZE];
+    char *page_start = ps.map + (size_t) page * PAGE_SIZE;
+    page_header_t *header = page_header(page);
+    slot_t *slots = page_slots(page);
+
+    memcpy(buffer, page_start, PAGE_SIZE);
+
+    uint16_t free_end = PAGE_SIZE;
+    for (uint16_t slot = 0; slot < header->num_slots; slot++) {
+        if (!slots[slot].offset) continue;
+        free_end -= slots[slot].length;
+        memcpy(page_start + free_end, buffer + slots[slot].offset, slots[slot].length);
+        slots[slot].offset = free_end;
+    }
+    header->free_end = free_end;
+    mark_dirty(page);
+}
+
+
+static int page_insert(const uint32_t page, const int key, const char *body, const size_t body_len,
+                       const size_t value1_len, const int value2, const float value3, const uint32_t version) {
+    /* stores a record in page, followed by body (value1 itself or the first page of its extent);
+     * returns the slot used or -1 if there's no room for it */
+    page_header_t *header = page_header(page);
+    slot_t *slots = page_slots(page);
+    uint16_t size = record_size(body_len);
+
+    /* reuse a slot freed by a deletion if there's one */
+    uint16_t slot = header->num_slots;
+    for (uint16_t i = 0; i < header->num_slots; i++) {
+        if (!slots[i].offset) {
+            slot = i; break;
+        }
+    }
+    uint16_t needed = size + (slot == header->num_slots ? sizeof(slot_t) : 0);
+
+    if (header->free_bytes < needed) return -1;
+    if (header->free_end - header->free_start < needed) compact_page(page);
+
+    if (slot == header->num_slots) {
+        header->num_slots++;
+        header->free_start += sizeof(slot_t);
+    }
+    header->free_end -= size;
+    header->free_bytes -= needed;
+    slots[slot].offset = header->free_end;
+    slots[slot].length = size;
+
+    record_header_t *record = slot_record(page, slot);
+    record->key = key;
+    record->value2 = value2;
+    record->value3 = value3;
+    record->version = version;
+    record->value1_len = (uint32_t) value1_len;
+    memcpy((char *) (record + 1), body, body_len);
+
+    ps.page_free[page] = header->free_bytes;
+    mark_dirty(page);
+    return slot;
+}
+
+
+static void page_remove(const uint32_t page, const uint16_t slot) {
+    /* frees a record's slot so that later insertions can reuse it */
+    page_header_t *header = page_header(page);
+    slot_t *slots = page_slots(page);
+
+    header->free_bytes += slots[slot].length;
+    slots[slot].offset = 0;
+    slots[slot].length = 0;
+
+    /* trailing free slots give their space back to the page */
+    while (header->num_slots && !slots[header->num_slots - 1].offset) {
+        header->num_slots--;
+        header->free_start -= sizeof(slot_t);
+        header->free_bytes += sizeof(slot_t);
+    }
+
+    ps.page_free[page] = header->free_bytes;
+    if (page < ps.alloc_hint) ps.alloc_hint = page;
+    mark_dirty(page);
+}
+
+
+static int find_page(const size_t body_len) {
+    /* free-space map lookup: first page that can fit a record; adds a page if none can */
+    uint16_t needed = record_size(body_len) + sizeof(slot_t);
+    uint32_t num_pages = file_header()->num_pages;
+
+    if (ps.alloc_hint < 1) ps.alloc_hint = 1;
+    for (uint32_t page = ps.alloc_hint; page < num_pages; page++) {
+        if (ps.page_free[page] >= needed) {
+            ps.alloc_hint = page;
+            return (int) page;
+        }
+    }
+    int page = add_page();
+    if (page != -1) ps.alloc_hint = (uint32_t) page;
+    return page;
+}
+
+
+static int maybe_checkpoint(void) {
+    if (ps.num_dirty < CHECKPOINT_DIRTY_PAGES) return 0;
+    return page_store_checkpoint();
+}
+
+
+/* page engine API */
+
+int page_store_open(void) {
+    struct stat st;
+
+    ps.fd = open(db_pages_name, O_RDWR | O_CREAT, 0600);
+    if (ps.fd == -1) {
+        perror("Could not open page file"); return -1;
+    }
+    if (fstat(ps.fd, &st) == -1) {
+        perror("Could not stat page file");
+        close(ps.fd); ps.fd = -1; return -1;
+    }
+    if (st.st_size % PAGE_SIZE) {
+        fprintf(stderr, "Page file is corrupt\n");
+        close(ps.fd); ps.fd = -1; return -1;
+    }
+
+    int new_file = st.st_size == 0;
+    uint32_t num_pages = new_file ? PAGE_STORE_GROW_PAGES : (uint32_t) (st.st_size / PAGE_SIZE);
+    if (map_file(num_pages) == -1 || key_map_init(&ps.keys, 0) == -1) {
+        page_store_close(); return -1;
+    }
+
+    file_header_t *header = file_header();
+    if (new_file) {
+        header->magic = PAGE_STORE_MAGIC;
+        header->page_size = PAGE_SIZE;
+        header->num_pages = 1;
+        header->num_items = 0;
+        mark_dirty(0);
+        return page_store_checkpoint();
+    }
+
+    if (header->magic != PAGE_STORE_MAGIC || header->page_size != PAGE_SIZE || header->num_pages > num_pages) {
+        fprintf(stderr, "Page file is corrupt\n");
+        page_store_close(); return -1;
+    }
+
+    /* rebuild key locations, the free-space map and the free extent list */
+    header->num_items = 0;
+    extent_t last_free = {0, 0};
+    for (uint32_t page = 1; page < header->num_pages; page = next_page(page)) {
+        if (is_extent(page)) {
+            extent_header_t *extent = extent_header(page);
+            if (!extent->num_pages || extent->num_pages > header->num_pages - page) {
+                fprintf(stderr, "Page file is corrupt\n");
+                page_store_close(); return -1;
+            }
+            for (uint32_t i = 0; i < extent->num_pages; i++) ps.page_free[page + i] = 0;
+            if (extent->in_use) continue;
+
+            /* free extents next to each other are merged */
+            if (last_free.num_pages && last_free.page + extent_header(last_free.page)->num_pages == page) {
+                extent_header(last_free.page)->num_pages += extent->num_pages;
+                mark_dirty(last_free.page);
+                ps.free_extents[ps.num_free_extents - 1].num_pages += extent->num_pages;
+            } else if (add_free_extent(page, extent->num_pages) == 0) {
+                last_free = (extent_t) {.page = page, .num_pages = extent->num_pages};
+            }
+            continue;
+        }
+
+        slot_t *slots = page_slots(page);
+        for (uint16_t slot = 0; slot < page_header(page)->num_slots; slot++) {
+            if (!slots[slot].offset) continue;
+            if (key_map_put(&ps.keys, slot_record(page, slot)->key, location(page, slot)) == -1) {
+                page_store_close(); return -1;
+            }
+            header->num_items++;
+        }
+        ps.page_free[page] = page_header(page)->free_bytes;
+    }
+    ps.alloc_hint = 1;
+    return 0;
+}
+
+
+int page_store_close(void) {
+    int result = 0;
+
+    if (ps.map) {
+        result = page_store_checkpoint();
+        munmap(ps.map, (size_t) ps.capacity * PAGE_SIZE);
+    }
+    if (ps.fd != -1) close(ps.fd);
+    free(ps.dirty);
+    free(ps.page_free);
+    free(ps.free_extents);
+    free(ps.pins);
+    key_map_free(&ps.keys);
+
+    memset(&ps, 0, sizeof(ps));
+    ps.fd = -1;
+    return result;
+}
+
+
+int page_store_checkpoint(void) {
+    /* flushes dirty pages to disk; contiguous dirty pages are synced together */
+    uint32_t page = 0;
+
+    while (page < ps.capacity && ps.num_dirty) {
+        if (!ps.dirty[page]) {
+            page++; continue;
+        }
+        uint32_t first = page;
+        while (page < ps.capacity && ps.dirty[page]) {
+            ps.dirty[page++] = 0;
+            ps.num_dirty--;
+        }
+        if (msync(ps.map + (size_t) first * PAGE_SIZE, (size_t) (page - first) * PAGE_SIZE, MS_SYNC) == -1) {
+            perror("Could not sync dirty pages"); return -1;
+        }
+    }
+
+    if (fsync(ps.fd) == -1) {
+        perror("Could not sync page file"); return -1;
+    }
+    return 0;
+}
+
+
+int page_store_for_each_key(int (*callback)(int key)) {
+    /* calls callback with every stored key */
+    for (uint32_t page = 1; page < file_header()->num_pages; page = next_page(page)) {
+        if (is_extent(page)) continue;
+        slot_t *slots = page_slots(page);
+        for (uint16_t slot = 0; slot < page_header(page)->num_slots; slot++) {
+            if (slots[slot].offset && callback(slot_record(page, slot)->key) == -1) return -1;
+        }
+    }
+    return 0;
+}
+
+
+int page_store_list_items(void) {
+    for (uint32_t page = 1; page < file_header()->num_pages; page = next_page(page)) {
+        if (is_extent(page)) continue;
+        slot_t *slots = page_slots(page);
+        for (uint16_t slot = 0; slot < page_header(page)->num_slots; slot++) {
+            if (slots[slot].offset) printf("%d\n", slot_record(page, slot)->key);
+        }
+    }
+    return 0;
+}
+
+
+int page_store_num_items(void) {
+    return (int) file_header()->num_items;
+}
+
+
+int page_store_empty(void) {
+    /* drop every data page and give the space back to the file system;
+     * pinned extents keep their pages until they are unpinned, and the ones in between become free extents */
+    uint32_t num_pages = 1;
+    ps.num_free_extents = 0;
+    qsort(ps.pins, ps.num_pins, sizeof(pin_t), compare_pins);
+    for (uint32_t i = 0; i < ps.num_pins; i++) {
+        pin_t *pin = &ps.pins[i];
+        if (pin->page > num_pages) {
+            init_extent(num_pages, pin->page - num_pages, FALSE);
+            add_free_extent(num_pages, pin->page - num_pages);
+        }
+        init_extent(pin->page, extent_header(pin->page)->num_pages, FALSE);
+        pin->freed = TRUE;
+        num_pages = pin->page + extent_header(pin->page)->num_pages;
+    }
+
+    file_header()->num_pages = num_pages;
+    file_header()->num_items = 0;
+    mark_dirty(0);
+    key_map_clear(&ps.keys);
+    ps.alloc_hint = 1;
+
+    if (map_file(num_pages > PAGE_STORE_GROW_PAGES ? num_pages : PAGE_STORE_GROW_PAGES) == -1) return -1;
+    return page_store_checkpoint();
+}
+
+
+int page_store_item_exists(const int key) {
+    return key_map_get(&ps.keys, key, NULL) == 0;
+}
+
+
+int page_store_read_item(const int key, char **value1, int *value2, float *value3, uint32_t *version,
+                         arena_t *arena) {
+    /* reads straight from mapped memory; value1 is copied to a buffer allocated from arena */
+    uint64_t loc;
+
+    if (key_map_get(&ps.keys, key, &loc) == -1) {
+        fprintf(stderr, "Key doesn't exist\n"); return -1;
+    }
+
+    record_header_t *record = slot_record((uint32_t) (loc >> 16), (uint16_t) loc);
+    uint32_t extent = record_extent(record);
+    *value1 = arena_strndup(arena, extent ? extent_data(extent) : (char *) (record + 1), record->value1_len);
+    if (!*value1) return -1;
+    *value2 = record->value2;
+    *value3 = record->value3;
+    if (version) *version = record->version;
+    return 0;
+}
+
+
+int page_store_pin_value1(const int key, off_t *offset, uint32_t *len) {
+    /* pins the extent holding value1 so that it can be read straight from the page file, starting at offset,
+     * until page_store_unpin_value1 is called; returns the page file descriptor, which must not be closed,
+     * or -1 if value1 is stored inline */
+    uint64_t loc;
+    if (key_map_get(&ps.keys, key, &loc) == -1) return -1;
+
+    record_header_t *record = slot_record((uint32_t) (loc >> 16), (uint16_t) loc);
+    uint32_t extent = record_extent(record);
+    if (!extent) return -1;
+
+    pin_t *pin = find_pin(extent);
+    if (!pin) {
+        if (ps.num_pins == ps.pins_cap) {
+            uint32_t cap = ps.pins_cap ? ps.pins_cap * 2 : 16;
+            pin_t *pins = realloc(ps.pins, cap * sizeof(pin_t));
+            if (!pins) {
+                perror("Could not allocate extent pins"); return -1;
+            }
+            ps.pins = pins;
+            ps.pins_cap = cap;
+        }
+        pin = &ps.pins[ps.num_pins++];
+        *pin = (pin_t) {.page = extent, .pins = 0, .freed = FALSE};
+    }
+    pin->pins++;
+
+    *offset = (off_t) extent * PAGE_SIZE + (off_t) sizeof(extent_header_t);
+    *len = record->value1_len;
+    return ps.fd;
+}
+
+
+void page_store_unpin_value1(const off_t offset) {
+    /* extents freed while pinned are given back once their last pin is gone */
+    pin_t *pin = find_pin((uint32_t) (offset / PAGE_SIZE));
+    if (!pin || --pin->pins) return;
+
+    if (pin->freed) add_free_extent(pin->page, extent_header(pin->page)->num_pages);
+    *pin = ps.pins[--ps.num_pins];
+}
+
+
+int page_store_write_item(const int key, const char *value1, const int *value2, const float *value3,
+                          const uint32_t version, const char mode) {
+    uint64_t loc;
+    int exists = key_map_get(&ps.keys, key, &loc) == 0;
+
+    if (mode == CREATE && exists) {
+        fprintf(stderr, "Key already exists\n"); return -1;
+    }
+    if (mode == MODIFY && !exists) {
+        fprintf(stderr, "Key doesn't exist\n"); return -1;
+    }
+
+    size_t value1_len = strlen(value1);
+
+    /* the new record & extent are written before the old ones are given up, so that a write that fails
+     * leaves the item as it was: long value1 strings go to a new extent, and the old one is freed afterwards */
+    uint32_t extent = 0;
+    if (value1_len > INLINE_VALUE1_MAX) {
+        int new_extent = alloc_extent(extent_pages(value1_len));
+        if (new_extent == -1) return -1;
+        extent = (uint32_t) new_extent;
+        write_extent(extent, value1, value1_len);
+    }
+    /* the file may have been remapped */
+    uint32_t old_extent = exists ? record_extent(slot_record((uint32_t) (loc >> 16), (uint16_t) loc)) : 0;
+
+    /* records hold value1 itself or the first page of its extent */
+    const char *body = extent ? (const char *) &extent : value1;
+    size_t body_len = extent ? sizeof(uint32_t) : value1_len;
+
+    /* new values fit in the old record: overwrite it in place, which can't fail */
+    if (exists && record_size(body_len) <= page_slots((uint32_t) (loc >> 16))[(uint16_t) loc].length) {
+        record_header_t *record = slot_record((uint32_t) (loc >> 16), (uint16_t) loc);
+        record->value2 = *value2;
+        record->value3 = *value3;
+        record->version = version;
+        record->value1_len = (uint32_t) value1_len;
+        memcpy((char *) (record + 1), body, body_len);
+        mark_dirty((uint32_t) (loc >> 16));
+        if (old_extent) release_extent(old_extent);
+        return maybe_checkpoint();
+    }
+
+    int page = find_page(body_len);
+    int slot = page == -1 ? -1 : page_insert((uint32_t) page, key, body, body_len, value1_len, *value2, *value3,
+                                              version);
+    if (slot == -1 || key_map_put(&ps.keys, key, location((uint32_t) page, (uint16_t) slot)) == -1) {
+        fprintf(stderr, "Could not store item\n");
+        if (slot != -1) page_remove((uint32_t) page, (uint16_t) slot);
+        if (extent) free_extent(extent);
+        return -1;
+    }
+
+    /* the key points to the new record now */
+    if (exists) {
+        page_remove((uint32_t) (loc >> 16), (uint16_t) loc);
+        if (old_extent) release_extent(old_extent);
+    } else file_header()->num_items++;
+    mark_dirty(0);
+
+    return maybe_checkpoint();
+}
+
+
+int page_store_write_values(const int key, const int *value2, const float *value3, const uint32_t version) {
+    /* overwrites the numeric values & version in the record header, leaving value1 as it is */
+    uint64_t loc;
+    if (key_map_get(&ps.keys, key, &loc) == -1) {
+        fprintf(stderr, "Key doesn't exist\n"); return -1;
+    }
+
+    record_header_t *record = slot_record((uint32_t) (loc >> 16), (uint16_t) loc);
+    record->value2 = *value2;
+    record->value3 = *value3;
+    record->version = version;
+    mark_dirty((uint32_t) (loc >> 16));
+    return maybe_checkpoint();
+}
+
+
+int page_store_delete_item(const int key) {
+    uint64_t loc;
+
+    if (key_map_get(&ps.keys, key, &loc) == -1) return -1;     /* key doesn't exist */
+
+    uint32_t extent = record_extent(slot_record((uint32_t) (loc >> 16), (uint16_t) loc));
+    if (extent) release_extent(extent);
+    page_remove((uint32_t) (loc >> 16), (uint16_t) loc);
+    key_map_remove(&ps.keys, key);
+    file_header()->num_items--;
+    mark_dirty(0);
+
+    return maybe_checkpoint();
+}
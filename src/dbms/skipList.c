@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "DS-MandatoryExercise/dbms/skipList.h"
+
+
+static skip_node_t *new_node(const int64_t key, const int level) {
+    skip_node_t *node = calloc(1, sizeof(skip_node_t) + level * sizeof(skip_node_t *));
+    if (!node) {
+        perror("Could not allocate skip list node"); return NULL;
+    }
+    node->key = key;
+    node->level = level;
+    return node;
+}
+
+
+static int random_level(skip_list_t *list) {
+    /* each level is 4 times sparser than the one below it */
+    int level = 1;
+
+    /* xorshift32 */
+    list->seed ^= list->seed << 13;
+    list->seed ^= list->seed >> 17;
+    list->seed ^= list->seed << 5;
+
+    uint32_t bits = list->seed;
+    while (level < SKIP_LIST_MAX_LEVEL && (bits & 3) == 0) {
+        level++;
+        bits >>= 2;
+    }
+    return level;
+}
+
+
+int skip_list_init(skip_list_t *list) {
+    list->head = new_node(INT64_MIN, SKIP_LIST_MAX_LEVEL);
+    if (!list->head) return -1;
+    list->level = 1;
+    list->size = 0;
+    list->seed = 2463534242u;
+    return 0;
+}
+
+
+void skip_list_clear(skip_list_t *list) {
+    skip_node_t *node = list->head->next[0];
+    while (node) {
+        skip_node_t *next = node->next[0];
+        free(node);
+        node = next;
+    }
+    for (int i = 0; i < SKIP_LIST_MAX_LEVEL; i++) list->head->next[i] = NULL;
+    list->level = 1;
+    list->size = 0;
+}
+
+
+void skip_list_free(skip_list_t *list) {
+    if (!list->head) return;
+    skip_list_clear(list);
+    free(list->head);
+    list->head = NULL;
+}
+
+
+int skip_list_insert(skip_list_t *list, const int64_t key) {
+    /* returns 0 if key was inserted, 1 if it was already there, -1 on error */
+    skip_node_t *update[SKIP_LIST_MAX_LEVEL];
+    skip_node_t *node = list->head;
+
+    for (int i = list->level - 1; i >= 0; i--) {
+        while (node->next[i] && node->next[i]->key < key) node = node->next[i];
+        update[i] = node;
+    }
+    if (node->next[0] && node->next[0]->key == key) return 1;
+
+    int level = random_level(list);
+    for (int i = list->level; i < level; i++) update[i] = list->head;
+    if (level > list->level) list->level = level;
+
+    skip_node_t *new = new_node(key, level);
+    if (!new) return -1;
+    for (int i = 0; i < level; i++) {
+        new->next[i] = update[i]->next[i];
+        update[i]->next[i] = new;
+    }
+    list->size++;
+    return 0;
+}
+
+
+int skip_list_remove(skip_list_t *list, const int64_t key) {
+    /* returns 0 if key was removed, -1 if it wasn't in the list */
+    skip_node_t *update[SKIP_LIST_MAX_LEVEL];
+    skip_node_t *node = list->head;
+
+    for (int i = list->level - 1; i >= 0; i--) {
+        while (node->next[i] && node->next[i]->key < key) node = node->next[i];
+        update[i] = node;
+    }
+    node = node->next[0];
+    if (!node || node->key != key) return -1;
+
+    for (int i = 0; i < node->level; i++) update[i]->next[i] = node->next[i];
+    while (list->level > 1 && !list->head->next[list->level - 1]) list->level--;
+
+    free(node);
+    list->size--;
+    return 0;
+}
+
+
+const skip_node_t *skip_list_seek(const skip_list_t *list, const int64_t key) {
+    /* returns the node holding the smallest key >= key; NULL if there's none */
+    const skip_node_t *node = list->head;
+
+    for (int i = list->level - 1; i >= 0; i--) {
+        while (node->next[i] && node->next[i]->key < key) node = node->next[i];
+    }
+    return node->next[0];
+}
+
+
+const skip_node_t *skip_list_next(const skip_node_t *node) {
+    return node->next[0];
+}
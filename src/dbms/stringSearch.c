@@ -0,0 +1,87 @@
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
+#include "DS-MandatoryExercise/utils.h"
+#include "DS-MandatoryExercise/dbms/stringSearch.h"
+
+
+static int contains_scalar(const char *str, const size_t len, const char *pattern, const size_t pattern_len) {
+    /* looks for the first pattern byte with memchr, then compares the rest */
+    const char *end = str + len - pattern_len + 1;
+
+    for (const char *p = str; p < end; p++) {
+        p = memchr(p, pattern[0], end - p);
+        if (!p) return FALSE;
+        if (!memcmp(p + 1, pattern + 1, pattern_len - 1)) return TRUE;
+    }
+    return FALSE;
+}
+
+
+#ifdef HAVE_X86_SIMD
+
+__attribute__((target("avx2,bmi")))
+static int contains_avx2(const char *str, const size_t len, const char *pattern, const size_t pattern_len) {
+    /* compares the first and last pattern bytes against 32 positions at once, and only
+     * checks the middle of the pattern where both match; loads may go past the end of str,
+     * which is fine as long as STRING_SEARCH_PADDING bytes are allocated after it */
+    const __m256i first = _mm256_set1_epi8(pattern[0]);
+    const __m256i last = _mm256_set1_epi8(pattern[pattern_len - 1]);
+    const size_t num_positions = len - pattern_len + 1;    /* positions where pattern could start */
+
+    for (size_t i = 0; i < num_positions; i += 32) {
+        __m256i block_first = _mm256_loadu_si256((const __m256i *) (str + i));
+        __m256i block_last = _mm256_loadu_si256((const __m256i *) (str + i + pattern_len - 1));
+        uint32_t mask = (uint32_t) _mm256_movemask_epi8(
+                _mm256_and_si256(_mm256_cmpeq_epi8(first, block_first), _mm256_cmpeq_epi8(last, block_last)));
+
+        /* drop candidates where pattern would run past the end of str */
+        if (num_positions - i < 32) mask &= (1u << (num_positions - i)) - 1;
+
+        while (mask) {
+            unsigned pos = (unsigned) __builtin_ctz(mask);
+            if (!memcmp(str + i + pos + 1, pattern + 1, pattern_len - 2)) return TRUE;
+            mask = _blsr_u32(mask);
+        }
+    }
+    return FALSE;
+}
+
+
+static int use_avx2(void) {
+    static int supported = -1;
+    if (supported == -1) supported = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi");
+    return supported;
+}
+
+#endif // HAVE_X86_SIMD
+
+
+static int contains(const char *str, const size_t len, const char *pattern, const size_t pattern_len) {
+    if (pattern_len > len) return FALSE;
+    if (pattern_len == 0) return TRUE;
+    if (pattern_len == 1) return memchr(str, pattern[0], len) != NULL;
+
+#ifdef HAVE_X86_SIMD
+    if (use_avx2()) return contains_avx2(str, len, pattern, pattern_len);
+#endif
+    return contains_scalar(str, len, pattern, pattern_len);
+}
+
+
+int string_matches(const char mode, const char *str, const size_t len, const char *pattern,
+                   const size_t pattern_len) {
+    /* TRUE if str (which isn't null-terminated) matches pattern, depending on mode */
+    switch (mode) {
+        case SEARCH_EXACT:
+            return len == pattern_len && !memcmp(str, pattern, len);
+        case SEARCH_PREFIX:
+            return len >= pattern_len && !memcmp(str, pattern, pattern_len);
+        case SEARCH_SUBSTRING:
+            return contains(str, len, pattern, pattern_len);
+        default:
+            return FALSE;
+    }
+}
@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "DS-MandatoryExercise/utils.h"
+#include "DS-MandatoryExercise/hashRing.h"
+
+
+static uint64_t mix(uint64_t x) {
+    /* splitmix64 finalizer: spreads consecutive keys all over the ring */
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+
+static uint64_t hash_server(const server_t *server) {
+    /* FNV-1a of host:port, so every client places a server at the same points */
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const char *c = server->host; *c; c++) hash = (hash ^ (uint8_t) *c) * 0x100000001b3ULL;
+    return mix(hash ^ (uint64_t) server->port);
+}
+
+
+static int compare_vnodes(const void *a, const void *b) {
+    const vnode_t *va = (const vnode_t *) a, *vb = (const vnode_t *) b;
+    if (va->point != vb->point) return va->point < vb->point ? -1 : 1;
+    return va->server - vb->server;
+}
+
+
+int hash_ring_build(hash_ring_t *ring, const char *servers) {
+    /* builds the ring of the servers listed in servers, as host:port,host:port... */
+    ring->num_servers = 0;
+
+    for (const char *entry = servers; *entry; ) {
+        size_t len = strcspn(entry, ",");
+        if (ring->num_servers == MAX_SERVERS) {
+            fprintf(stderr, "Too many servers\n"); return -1;
+        }
+
+        server_t *server = &ring->servers[ring->num_servers];
+        if (str_to_host_port(entry, len, server->host, &server->port) == -1) return -1;
+
+        /* place the server's points on the ring */
+        uint64_t hash = hash_server(server);
+        for (int i = 0; i < HASH_RING_VNODES; i++) {
+            vnode_t *vnode = &ring->vnodes[ring->num_servers * HASH_RING_VNODES + i];
+            vnode->point = mix(hash + (uint64_t) i);
+            vnode->server = ring->num_servers;
+        }
+        ring->num_servers++;
+
+        entry += len;
+        if (*entry == ',') entry++;
+    }
+
+    if (!ring->num_servers) {
+        fprintf(stderr, "No servers\n"); return -1;
+    }
+    qsort(ring->vnodes, ring->num_servers * HASH_RING_VNODES, sizeof(vnode_t), compare_vnodes);
+    return 0;
+}
+
+
+int hash_ring_lookup(const hash_ring_t *ring, const int32_t key) {
+    /* returns the server that owns key */
+    uint64_t hash = mix((uint64_t) (uint32_t) key);
+    int lo = 0, hi = ring->num_servers * HASH_RING_VNODES;
+
+    /* first point >= hash; past the last point, the ring wraps around */
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (ring->vnodes[mid].point < hash) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo == ring->num_servers * HASH_RING_VNODES) lo = 0;
+    return ring->vnodes[lo].server;
+}
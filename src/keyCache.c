@@ -0,0 +1,182 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "DS-MandatoryExercise/utils.h"
+#include "DS-MandatoryExercise/keys.h"
+#include "DS-MandatoryExercise/keyCache.h"
+
+
+static uint32_t bucket_of(const int32_t key) {
+    /* Fibonacci hashing: consecutive keys land in different buckets */
+    return ((uint32_t) key * 2654435761u) & (KEY_CACHE_BUCKETS - 1);
+}
+
+
+static key_cache_entry_t **find(key_cache_t *cache, const int32_t key) {
+    /* returns the link pointing to key's entry, or to NULL at the end of its bucket if it isn't cached */
+    key_cache_entry_t **link = &cache->buckets[bucket_of(key)];
+    while (*link && (*link)->key != key) link = &(*link)->next;
+    return link;
+}
+
+
+static void unlink_lru(key_cache_t *cache, key_cache_entry_t *entry) {
+    if (entry->newer) entry->newer->older = entry->older;
+    else cache->newest = entry->older;
+    if (entry->older) entry->older->newer = entry->newer;
+    else cache->oldest = entry->newer;
+}
+
+
+static void push_lru(key_cache_t *cache, key_cache_entry_t *entry) {
+    /* makes entry the most recently used one */
+    entry->newer = NULL;
+    entry->older = cache->newest;
+    if (cache->newest) cache->newest->newer = entry;
+    else cache->oldest = entry;
+    cache->newest = entry;
+}
+
+
+static void remove_entry(key_cache_t *cache, key_cache_entry_t **link) {
+    /* frees the entry link points to, taking it out of its bucket & the LRU list */
+    key_cache_entry_t *entry = *link;
+    *link = entry->next;
+    unlink_lru(cache, entry);
+    cache->stats.entries--;
+    cache->stats.bytes -= entry->size;
+    free(entry);
+}
+
+
+void key_cache_init(key_cache_t *cache, const size_t max_bytes) {
+    memset(cache, 0, sizeof(key_cache_t));
+    pthread_mutex_init(&cache->mutex, NULL);
+    cache->max_bytes = max_bytes;
+}
+
+
+void key_cache_free(key_cache_t *cache) {
+    key_cache_clear(cache);
+    pthread_mutex_destroy(&cache->mutex);
+}
+
+
+uint64_t key_cache_epoch(key_cache_t *cache) {
+    /* epoch a read starts at; taken before its request is sent */
+    pthread_mutex_lock(&cache->mutex);
+    uint64_t epoch = cache->epoch;
+    pthread_mutex_unlock(&cache->mutex);
+    return epoch;
+}
+
+
+int key_cache_get(key_cache_t *cache, const int32_t key, char *value1, const size_t value1_size, int *value2,
+                  float *value3, uint32_t *version) {
+    /* copies key's item into the caller's buffers if it's cached & its lease isn't over;
+     * returns 1 if so, 0 if it must be read from its server, -1 if value1 doesn't fit in value1_size bytes */
+    pthread_mutex_lock(&cache->mutex);
+    key_cache_entry_t **link = find(cache, key);
+    key_cache_entry_t *entry = *link;
+
+    if (entry && clock_ns() >= entry->expires_ns) {
+        remove_entry(cache, link);
+        cache->stats.expired++;
+        entry = NULL;
+    }
+    if (!entry) {
+        cache->stats.misses++;
+        pthread_mutex_unlock(&cache->mutex);
+        return 0;
+    }
+
+    cache->stats.hits++;
+    unlink_lru(cache, entry);
+    push_lru(cache, entry);
+
+    int result = 1;
+    size_t len = strlen(entry->value1);
+    if (len >= value1_size) {
+        fprintf(stderr, "value1 doesn't fit in buffer\n");
+        result = -1;
+    } else {
+        memcpy(value1, entry->value1, len + 1);
+        *value2 = entry->value2;
+        *value3 = entry->value3;
+        if (version) *version = entry->version;
+    }
+    pthread_mutex_unlock(&cache->mutex);
+    return result;
+}
+
+
+void key_cache_put(key_cache_t *cache, const item_t *item, const uint64_t expires_ns, const uint64_t read_epoch) {
+    /* caches an item read from its server until expires_ns, unless it was invalidated after read_epoch,
+     * evicting the least recently used entries to make room; items bigger than the whole budget aren't cached */
+    size_t len = strlen(item->value1);
+    size_t size = sizeof(key_cache_entry_t) + len + 1;
+    if (size > cache->max_bytes) return;
+
+    key_cache_entry_t *entry = malloc(size);
+    if (!entry) return;
+    entry->key = item->key;
+    entry->value2 = item->value2;
+    entry->value3 = item->value3;
+    entry->version = item->version;
+    entry->expires_ns = expires_ns;
+    entry->size = size;
+    memcpy(entry->value1, item->value1, len + 1);
+
+    pthread_mutex_lock(&cache->mutex);
+    uint32_t bucket = bucket_of(item->key);
+    if (cache->bucket_epochs[bucket] > read_epoch || cache->cleared_epoch > read_epoch) {
+        pthread_mutex_unlock(&cache->mutex);
+        free(entry); return;
+    }
+
+    key_cache_entry_t **link = find(cache, item->key);
+    if (*link) remove_entry(cache, link);
+    while (cache->stats.bytes + size > cache->max_bytes) {
+        remove_entry(cache, find(cache, cache->oldest->key));
+        cache->stats.evictions++;
+    }
+
+    entry->next = cache->buckets[bucket];
+    cache->buckets[bucket] = entry;
+    push_lru(cache, entry);
+    cache->stats.entries++;
+    cache->stats.bytes += size;
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+
+void key_cache_invalidate(key_cache_t *cache, const int32_t key) {
+    /* drops key's item, which changed; reads of it already on their way aren't cached */
+    pthread_mutex_lock(&cache->mutex);
+    cache->bucket_epochs[bucket_of(key)] = ++cache->epoch;
+    key_cache_entry_t **link = find(cache, key);
+    if (*link) {
+        remove_entry(cache, link);
+        cache->stats.invalidations++;
+    }
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+
+void key_cache_clear(key_cache_t *cache) {
+    /* drops every item, when changes may have been missed; reads already on their way aren't cached */
+    pthread_mutex_lock(&cache->mutex);
+    cache->cleared_epoch = ++cache->epoch;
+    while (cache->oldest) {
+        remove_entry(cache, find(cache, cache->oldest->key));
+        cache->stats.invalidations++;
+    }
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+
+void key_cache_read_stats(key_cache_t *cache, cache_stats_t *stats) {
+    pthread_mutex_lock(&cache->mutex);
+    *stats = cache->stats;
+    pthread_mutex_unlock(&cache->mutex);
+}
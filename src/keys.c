@@ -2,113 +2,366 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <time.h>
 #include <sys/socket.h>
+#include <sys/time.h>
 #include <arpa/inet.h>
 #include <netdb.h>
+#include <pthread.h>
 #include "DS-MandatoryExercise/utils.h"
 #include "DS-MandatoryExercise/netUtils.h"
+#include "DS-MandatoryExercise/hashRing.h"
 #include "DS-MandatoryExercise/keys.h"
+#include "DS-MandatoryExercise/keyCache.h"
 
 
 /* functions used to connect with server */
-int connect_to_server(void);
+int num_shards(void);
+int shard_of(int key);
+int connect_to_shard(int shard);
+int connect_to_replica(int replica);
+int connect_for_read(int shard);
 void disconnect_from_server(void);
 
 /* one-size-fits-all function that performs the required services;
  * can perform all 7 services given the proper arguments;
- * op_code determines the service */
-int service(char op_code, int key, char *value1, int *value2, float *value3);
+ * op_code determines the service, and shard the server that performs it */
+int service(int shard, char op_code, item_t *item, arena_t *arena);
 
+/* functions used by the iterators to fetch pages */
+int scan_fetch_page(scan_t *scan);
+int query_fetch_page(query_t *query);
 
-int client_socket;      /* global client socket descriptor */
 
+_Thread_local int client_socket;    /* client socket descriptor; one per thread, so shards are served in parallel */
+_Thread_local arena_t results_arena;    /* value1 strings read by the last txn or batch call of the thread */
 
-int connect_to_server(void) {
-    struct sockaddr_in server_addr;
-    struct hostent *hp;
-    int server_port;
+static pthread_once_t value1_max_len_once = PTHREAD_ONCE_INIT;
 
-    const char *server_ip = getenv("IP_TUPLES");
+/* sharding: servers listed in SERVERS_TUPLES (host:port,host:port...) split the key space by consistent hashing;
+ * if it isn't set, IP_TUPLES & PORT_TUPLES give the only server */
+static hash_ring_t ring;                /* ring of the servers in use */
+static char *ring_servers = NULL;       /* server list ring was built from; NULL if none */
+static pthread_mutex_t mutex_ring = PTHREAD_MUTEX_INITIALIZER;
 
-    if (!server_ip) {
-        fprintf(stderr, "getenv error\n"); return -1;
-    }
+/* read cache: a keys-only watch per server feeds the invalidations of its keys to the cache. a read is only cached
+ * if its server's feed was up when it was sent; the cache is cleared whenever a feed breaks, since changes may be
+ * missed until it's up again */
+#define CACHE_FEED_RETRY_MS 1000        /* how long a broken feed waits before reconnecting */
 
-    if (str_to_num(getenv("PORT_TUPLES"), (void *) &server_port, INT) == -1) {
-        perror("Invalid server port"); return -1;
-    }
+typedef struct {
+    int shard;                          /* server whose changes the feed receives */
+    pthread_t thread;
+    int up;                             /* TRUE while every change is being received */
+    int socket;                         /* copy of the watch socket, shut down to stop the feed; -1 if none */
+} cache_feed_t;
+
+static key_cache_t cache;
+static int caching = FALSE;             /* TRUE from cache_enable to cache_disable */
+static cache_feed_t feeds[MAX_SERVERS];
+static int num_feeds = 0;
+static pthread_mutex_t mutex_feeds = PTHREAD_MUTEX_INITIALIZER;     /* guards feed sockets & feeds_stopping */
+static pthread_cond_t cond_feeds_stop = PTHREAD_COND_INITIALIZER;
+static int feeds_stopping = FALSE;
+static _Thread_local uint32_t granted_lease_ms;     /* lease granted with the last GET reply the thread received */
 
-    /* create client socket */
-    client_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-    if (client_socket < 0) {
-        perror("Error creating socket"); return -1;
-    }
 
-    /* obtain server address */
-    bzero((char*) &server_addr, sizeof server_addr);
-    hp = gethostbyname(server_ip);
-    if (!hp) {
-        perror("Error getting hostname"); return -1;
+static int load_ring(void) {
+    /* (re)builds ring if the server list changed since it was built; called with mutex_ring held */
+    char single_server[MAX_STR_SIZE];
+    const char *servers = getenv("SERVERS_TUPLES");
+
+    if (!servers || !*servers) {
+        const char *server_ip = getenv("IP_TUPLES");
+        const char *server_port = getenv("PORT_TUPLES");
+        if (!server_ip || !server_port) {
+            fprintf(stderr, "getenv error\n"); return -1;
+        }
+        snprintf(single_server, MAX_STR_SIZE, "%s:%s", server_ip, server_port);
+        servers = single_server;
     }
-    memcpy (&(server_addr.sin_addr), hp->h_addr, hp->h_length);
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(server_port);
 
-    /* connecting to server */
-    if (connect(client_socket, (struct sockaddr *) &server_addr, sizeof(server_addr)) == -1) {
-        perror("Error connecting to server"); return -1;
+    if (ring_servers && !strcmp(ring_servers, servers)) return 0;
+
+    free(ring_servers);
+    ring_servers = NULL;
+    if (hash_ring_build(&ring, servers) == -1) return -1;
+    ring_servers = strdup(servers);
+    if (!ring_servers) {
+        perror("Could not allocate server list"); return -1;
     }
     return 0;
 }
 
 
+static void load_value1_max_len(void) {
+    /* servers started with a max value1 length other than the default one need VALUE1_MAX_LEN to match it */
+    const char *max_len_str = getenv("VALUE1_MAX_LEN");
+    int max_len;
+    if (max_len_str && str_to_num(max_len_str, (void *) &max_len, INT) == 0 && max_len > 0)
+        set_value1_max_len((uint32_t) max_len);
+}
+
+
+static int value1_fits(const char *value1) {
+    /* strings longer than the servers accept are refused before anything is sent */
+    pthread_once(&value1_max_len_once, load_value1_max_len);
+    if (strlen(value1) <= get_value1_max_len()) return TRUE;
+    fprintf(stderr, "value1 too long\n");
+    return FALSE;
+}
+
+
+int num_shards(void) {
+    /* returns how many servers the key space is split across */
+    pthread_mutex_lock(&mutex_ring);
+    int num_servers = load_ring() == -1 ? -1 : ring.num_servers;
+    pthread_mutex_unlock(&mutex_ring);
+    return num_servers;
+}
+
+
+int shard_of(const int key) {
+    /* returns the server key belongs to */
+    pthread_mutex_lock(&mutex_ring);
+    int shard = load_ring() == -1 ? -1 : hash_ring_lookup(&ring, key);
+    pthread_mutex_unlock(&mutex_ring);
+    return shard;
+}
+
+
+int connect_to_shard(const int shard) {
+    /* connects to the shard-th server */
+    server_t server;
+
+    pthread_mutex_lock(&mutex_ring);
+    int error = load_ring() == -1 || shard < 0 || shard >= ring.num_servers;
+    if (!error) server = ring.servers[shard];
+    pthread_mutex_unlock(&mutex_ring);
+    if (error) return -1;
+
+    pthread_once(&value1_max_len_once, load_value1_max_len);
+    client_socket = connect_to_host(server.host, server.port);
+    return client_socket == -1 ? -1 : 0;
+}
+
+
+int connect_to_replica(const int replica) {
+    /* connects to the replica-th server (from 0) listed in REPLICAS_TUPLES, as host:port,host:port... */
+    const char *replicas = getenv("REPLICAS_TUPLES");
+    if (!replicas || replica < 0) return -1;
+
+    for (int i = 0; i < replica && replicas; i++) {
+        replicas = strchr(replicas, ',');
+        if (replicas) replicas++;
+    }
+    if (!replicas) return -1;
+
+    char host[MAX_STR_SIZE];
+    int port;
+    if (str_to_host_port(replicas, strcspn(replicas, ","), host, &port) == -1) return -1;
+
+    pthread_once(&value1_max_len_once, load_value1_max_len);
+    client_socket = connect_to_host(host, port);
+    return client_socket == -1 ? -1 : 0;
+}
+
+
+int connect_for_read(const int shard) {
+    /* reads are spread round-robin over the replicas, if there are any, and go to the primary otherwise;
+     * replicas apply writes asynchronously, so a read may not see a write that was just made.
+     * replicas follow a single primary, so they aren't used when the key space is sharded */
+    static unsigned int next_replica = 0;
+    const char *replicas = getenv("REPLICAS_TUPLES");
+    if (!replicas || !*replicas || num_shards() != 1) return connect_to_shard(shard);
+
+    int num_replicas = 1;
+    for (const char *c = replicas; *c; c++) num_replicas += *c == ',';
+
+    if (connect_to_replica((int) (__atomic_fetch_add(&next_replica, 1, __ATOMIC_RELAXED) % num_replicas)) == 0)
+        return 0;
+    return connect_to_shard(shard);
+}
+
+
 void disconnect_from_server(void) {
     close(client_socket);
 }
 
 
-int service(const char op_code, const int key, char *value1, int *value2, float *value3) {
-    if (connect_to_server() == -1) return -1;
+static uint32_t next_txn_id(void) {
+    /* transaction IDs tell the requests of a client process apart in the server's slow request log */
+    static uint32_t last_txn_id = 0;
+    return __atomic_add_fetch(&last_txn_id, 1, __ATOMIC_RELAXED);
+}
+
+
+/* overload: a server too busy for a request replies SRV_BUSY alone. functions sending a single request
+ * return BUSY then, and are called again by a wrapper after backing off, up to BUSY_RETRIES times */
+#define BUSY (-2)
+
+static int recv_reply(reply_t *reply) {
+    /* receives the reply header; returns BUSY, once disconnected, if the server was too busy for the request */
+    if (recv_reply_header(client_socket, reply) == -1) return -1;
+    if (reply->server_error_code != SRV_BUSY) return 0;
+    disconnect_from_server();
+    return BUSY;
+}
+
+
+/* timeouts: once set_request_timeout is called, every function sending a single request gives up on it after
+ * timeout_ms, backing off included, and tells the server the time it has left, so that the server doesn't work
+ * for a client that's gone. start_deadline is called by the wrapper before the first attempt */
+static int request_timeout_ms = 0;      /* 0 if calls wait as long as it takes */
+static _Thread_local uint64_t call_deadline_ns;     /* clock_ns at which the thread's call gives up; 0 for never */
+
+
+void set_request_timeout(const int timeout_ms) {
+    __atomic_store_n(&request_timeout_ms, timeout_ms > 0 ? timeout_ms : 0, __ATOMIC_RELAXED);
+}
+
+
+static void start_deadline(void) {
+    int timeout_ms = __atomic_load_n(&request_timeout_ms, __ATOMIC_RELAXED);
+    call_deadline_ns = timeout_ms ? clock_ns() + (uint64_t) timeout_ms * 1000000 : 0;
+}
+
+
+static int send_header(header_t *header) {
+    /* sends the request header to the server connected, with the time the call has left as its deadline;
+     * sending & receiving the rest of the request give up then too. watches have no deadline,
+     * since their connection stays open. a call past its deadline fails, disconnected */
+    header->deadline_us = 0;
+    if (call_deadline_ns && header->op_code != WATCH) {
+        uint64_t now = clock_ns();
+        if (now >= call_deadline_ns) {
+            fprintf(stderr, "Request timed out\n");
+            disconnect_from_server(); return -1;
+        }
+
+        uint64_t left_us = (call_deadline_ns - now) / 1000;
+        if (!left_us) left_us = 1;
+        header->deadline_us = left_us > UINT32_MAX ? UINT32_MAX : (uint32_t) left_us;
+        struct timeval timeout = {.tv_sec = (time_t) (left_us / 1000000),
+                                  .tv_usec = (suseconds_t) (left_us % 1000000)};
+        if (setsockopt(client_socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) == -1 ||
+            setsockopt(client_socket, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) == -1) {
+            perror("Could not set request timeout");
+            disconnect_from_server(); return -1;
+        }
+    }
+    return send_request_header(client_socket, header);
+}
+
+
+static int back_off(int *attempt) {
+    /* waits before the next attempt, twice as long as before the previous one, at random between half & all of it
+     * so that clients rejected together don't come back together; returns FALSE once there are no attempts left,
+     * or the wait would take the call past its deadline */
+    static _Thread_local unsigned int seed = 0;
+    if (*attempt >= BUSY_RETRIES) return FALSE;
+    if (!seed) seed = (unsigned int) clock_ns() ^ (unsigned int) (uintptr_t) &seed;
+
+    unsigned int backoff_us = BUSY_BACKOFF_US << *attempt;
+    if (backoff_us > BUSY_BACKOFF_MAX_US) backoff_us = BUSY_BACKOFF_MAX_US;
+    unsigned int wait_us = backoff_us / 2 + rand_r(&seed) % (backoff_us / 2 + 1);
+    if (call_deadline_ns && clock_ns() + (uint64_t) wait_us * 1000 >= call_deadline_ns) return FALSE;
+    usleep(wait_us);
+    (*attempt)++;
+    return TRUE;
+}
+
+
+static int service_once(const int shard, const char op_code, item_t *item, arena_t *arena) {
+    if ((op_code == SET_VALUE || op_code == MODIFY_VALUE || op_code == UPSERT || op_code == CAS) &&
+        !value1_fits(item->value1)) return -1;
+
+    /* point reads may be served by a replica */
+    if ((op_code == GET_VALUE || op_code == EXIST || op_code == NUM_ITEMS ? connect_for_read(shard)
+                                                                          : connect_to_shard(shard)) == -1) return -1;
 
     request_t request;  /* client request */
+    request.header.id = next_txn_id();
     request.header.op_code = op_code;
     reply_t reply;      /* server reply */
 
     /* send client request header */
-    if (send_common_header(client_socket, &request.header) == -1) return -1;
+    if (send_header(&request.header) == -1) return -1;
+
+    /* send functions convert the members they send, so send a copy of item */
+    if (item) request.item = *item;
 
     /* send key member if called service requires it */
     if (op_code == GET_VALUE || op_code == DELETE_KEY || op_code == EXIST ||
-    op_code == SET_VALUE || op_code == MODIFY_VALUE) {
-        request.item.key = key;
+    op_code == SET_VALUE || op_code == MODIFY_VALUE || op_code == INCR || op_code == ADD ||
+    op_code == UPSERT || op_code == CAS) {
         if (send_key(client_socket, &request.item) == -1) return -1;
     }
 
     /* send value members if called service requires it */
-    if (op_code == SET_VALUE || op_code == MODIFY_VALUE) {
-        strcpy(request.item.value1, value1);
-        request.item.value2 = *value2;
-        request.item.value3 = *value3;
+    if (op_code == SET_VALUE || op_code == MODIFY_VALUE || op_code == UPSERT || op_code == CAS) {
         if (send_values(client_socket, &request.item) == -1) return -1;
     }
 
+    /* send expected version if called service requires it */
+    if (op_code == CAS) {
+        if (send_version(client_socket, &request.item) == -1) return -1;
+    }
+
+    /* send delta if called service requires it */
+    if (op_code == INCR || op_code == ADD) {
+        if (send_delta(client_socket, op_code, &request.item) == -1) return -1;
+    }
+
     /* receive reply header */
-    if (recv_reply_header(client_socket, &reply) == -1) return -1;
+    int status = recv_reply(&reply);
+    if (status) return status;
 
     /* receive rest of server reply & check it;
      * different actions depending on the called service */
     switch (op_code) {
         case GET_VALUE:
             /* receive rest of server reply */
-            if (recv_values(client_socket, &reply.item) == -1) return -1;
+            if (recv_values(client_socket, &reply.item, arena) == -1 ||
+                recv_version(client_socket, &reply.item) == -1 ||
+                recv_lease(client_socket, &reply) == -1) return -1;
 
             disconnect_from_server();
+            granted_lease_ms = reply.lease_ms;
 
             /* return the tuple values obtained from the DB */
             if (reply.server_error_code == SRV_SUCCESS) {
-                strcpy(value1, reply.item.value1);
-                *value2 = reply.item.value2;
-                *value3 = reply.item.value3;
+                item->value1 = reply.item.value1;
+                item->value2 = reply.item.value2;
+                item->value3 = reply.item.value3;
+                item->version = reply.item.version;
+                return 0;
+            }
+            break;
+        case UPSERT:
+        case CAS:
+            /* receive rest of server reply */
+            if (recv_version(client_socket, &reply.item) == -1) return -1;
+
+            disconnect_from_server();
+
+            /* return the new version, or the current one if CAS found another */
+            if (reply.server_error_code == SRV_SUCCESS || reply.server_error_code == SRV_CONFLICT) {
+                item->version = reply.item.version;
+                return reply.server_error_code == SRV_CONFLICT;
+            }
+            break;
+        case INCR:
+        case ADD:
+            /* receive rest of server reply */
+            if (recv_delta(client_socket, op_code, &reply.item) == -1) return -1;
+
+            disconnect_from_server();
+
+            /* return the updated value */
+            if (reply.server_error_code == SRV_SUCCESS) {
+                if (op_code == INCR) item->value2 = reply.item.value2;
+                else item->value3 = reply.item.value3;
                 return 0;
             }
             break;
@@ -134,51 +387,1045 @@ int service(const char op_code, const int key, char *value1, int *value2, float
             if (reply.server_error_code == SRV_SUCCESS) return 0;
             break;
     } // end switch
-    disconnect_from_server();
+    /* every case disconnected already; closing again could close another thread's connection */
     return -1;      /* server error, service was executed unsuccessfully */
 }
 
 
+int service(const int shard, const char op_code, item_t *item, arena_t *arena) {
+    /* item holds the key & values sent to the server, and gets the ones it sends back;
+     * value1 strings read are allocated from arena */
+    int result, attempt = 0;
+    start_deadline();
+    while ((result = service_once(shard, op_code, item, arena)) == BUSY && back_off(&attempt));
+
+    /* cached tuples the client writes are dropped whether the write worked or not, since it may have */
+    if (caching && op_code == INIT) key_cache_clear(&cache);
+    else if (caching && op_code != GET_VALUE && op_code != EXIST && op_code != NUM_ITEMS)
+        key_cache_invalidate(&cache, item->key);
+    return result == BUSY ? -1 : result;
+}
+
+
+/* fan-out: requests meant for several servers are sent in parallel, one thread per server */
+
+typedef struct {
+    int shard;                  /* server the task talks to */
+    char op_code;               /* INIT or NUM_ITEMS; GET_VALUE, SET_VALUE... for batches are in ops */
+    txn_op_t **ops;             /* batch sub-operations sent to shard; num_ops tells how many */
+    int num_ops;
+    arena_t arena;              /* value1 strings read by batch sub-operations */
+    int result;                 /* service result; failed sub-operations in case of batches */
+} shard_task_t;
+
+
+static int batch_op(const int shard, txn_op_t *op, arena_t *arena) {
+    /* performs a sub-operation of a batch on its server */
+    switch (op->op_code) {
+        case GET_VALUE:
+        case SET_VALUE:
+        case MODIFY_VALUE:
+        case DELETE_KEY:
+            return service(shard, op->op_code, &op->item, arena);
+        default:
+            fprintf(stderr, "Invalid batch operation\n"); return -1;
+    }
+}
+
+
+static void *shard_task(void *args) {
+    shard_task_t *task = (shard_task_t *) args;
+
+    if (!task->ops) {
+        task->result = service(task->shard, task->op_code, NULL, NULL);
+        return NULL;
+    }
+
+    task->result = 0;
+    for (int i = 0; i < task->num_ops; i++) {
+        txn_op_t *op = task->ops[i];
+        op->result = batch_op(task->shard, op, &task->arena) == -1 ? SRV_ERROR : SRV_SUCCESS;
+        if (op->result == SRV_ERROR) task->result++;
+    }
+    return NULL;
+}
+
+
+static void run_shard_tasks(shard_task_t *tasks, const int num_tasks) {
+    /* runs every task in its own thread; the calling thread runs the last one,
+     * and any task whose thread can't be created */
+    pthread_t threads[MAX_SERVERS];
+    int started[MAX_SERVERS];
+
+    for (int i = 0; i < num_tasks - 1; i++) {
+        started[i] = pthread_create(&threads[i], NULL, shard_task, &tasks[i]) == 0;
+        if (!started[i]) shard_task(&tasks[i]);
+    }
+    if (num_tasks) shard_task(&tasks[num_tasks - 1]);
+    for (int i = 0; i < num_tasks - 1; i++) {
+        if (started[i]) pthread_join(threads[i], NULL);
+    }
+}
+
+
+static int fan_out(const char op_code, int *total) {
+    /* performs a keyless service on every server; total gets the sum of their results */
+    shard_task_t tasks[MAX_SERVERS];
+    int num_tasks = num_shards();
+    if (num_tasks == -1) return -1;
+
+    for (int i = 0; i < num_tasks; i++) {
+        tasks[i].shard = i;
+        tasks[i].op_code = op_code;
+        tasks[i].ops = NULL;
+    }
+    run_shard_tasks(tasks, num_tasks);
+
+    *total = 0;
+    for (int i = 0; i < num_tasks; i++) {
+        if (tasks[i].result == -1) return -1;
+        *total += tasks[i].result;
+    }
+    return 0;
+}
+
+
 /* client API functions call service function to perform their services;
  * they are just wrappers, really, since most services are very similar */
 
 int init() {
-    /* function used to initialize the DB */
-    return service(INIT, 0, NULL, NULL, NULL);
+    /* function used to initialize the DB; every server is emptied */
+    int total;
+    return fan_out(INIT, &total);
 }
 
 
 int set_value(int key, char *value1, int value2, float value3) {
     /* function used to insert a tuple into the DB */
-    return service(SET_VALUE, key, value1, &value2, &value3);
+    item_t item = {.key = key, .value1 = value1, .value2 = value2, .value3 = value3};
+    return service(shard_of(key), SET_VALUE, &item, NULL);
+}
+
+
+static int read_value(const int key, char *value1, const size_t value1_size, int *value2, float *value3,
+                      uint32_t *version) {
+    /* reads a tuple into the caller's buffers, from the cache if it's there; fails if value1 doesn't fit
+     * in value1_size bytes. leases start when the request is sent, so a tuple is never cached past its own */
+    int shard = shard_of(key);
+    int cacheable = caching && shard >= 0 && shard < num_feeds;
+    uint64_t epoch = 0, sent_ns = 0;
+    if (cacheable) {
+        int hit = key_cache_get(&cache, key, value1, value1_size, value2, value3, version);
+        if (hit) return hit == 1 ? 0 : -1;
+        epoch = key_cache_epoch(&cache);
+        sent_ns = clock_ns();
+        cacheable = __atomic_load_n(&feeds[shard].up, __ATOMIC_ACQUIRE);
+    }
+
+    arena_t arena;
+    arena_init(&arena);
+    item_t item = {.key = key};
+
+    int result = service(shard, GET_VALUE, &item, &arena);
+    if (!result && cacheable && granted_lease_ms)
+        key_cache_put(&cache, &item, sent_ns + (uint64_t) granted_lease_ms * 1000000, epoch);
+    if (!result) {
+        size_t len = strlen(item.value1);
+        if (len >= value1_size) {
+            fprintf(stderr, "value1 doesn't fit in buffer\n");
+            result = -1;
+        } else {
+            memcpy(value1, item.value1, len + 1);
+            *value2 = item.value2;
+            *value3 = item.value3;
+            if (version) *version = item.version;
+        }
+    }
+
+    arena_free(&arena);
+    return result;
 }
 
 
 int get_value(int key, char *value1, int *value2, float *value3) {
-    /* function used to read a tuple from the DB */
-    return service(GET_VALUE, key, value1, value2, value3);
+    /* function used to read a tuple from the DB; value1 must have room for VALUE1_MAX_STR_SIZE bytes */
+    return read_value(key, value1, VALUE1_MAX_STR_SIZE, value2, value3, NULL);
+}
+
+
+int get_value_sized(int key, char *value1, size_t value1_size, int *value2, float *value3) {
+    /* function used to read a tuple from the DB whose value1 may be long; value1 has room for value1_size bytes */
+    return read_value(key, value1, value1_size, value2, value3, NULL);
+}
+
+
+int get_value_version(int key, char *value1, int *value2, float *value3, uint32_t *version) {
+    /* function used to read a tuple from the DB along with its version */
+    return read_value(key, value1, VALUE1_MAX_STR_SIZE, value2, value3, version);
 }
 
 
 int modify_value(int key, char *value1, int value2, float value3) {
     /* function used to modify a tuple from the DB */
-    return service(MODIFY_VALUE, key, value1, &value2, &value3);
+    item_t item = {.key = key, .value1 = value1, .value2 = value2, .value3 = value3};
+    return service(shard_of(key), MODIFY_VALUE, &item, NULL);
+}
+
+
+int upsert_value(int key, char *value1, int value2, float value3, uint32_t *version) {
+    /* function used to insert a tuple into the DB, or modify it if it already exists;
+     * version gets its new version if it isn't NULL */
+    item_t item = {.key = key, .value1 = value1, .value2 = value2, .value3 = value3};
+    int result = service(shard_of(key), UPSERT, &item, NULL);
+    if (result != -1 && version) *version = item.version;
+    return result;
+}
+
+
+int cas_value(int key, uint32_t *version, char *value1, int value2, float value3) {
+    /* function used to modify a tuple only if its version is still *version (compare-and-swap);
+     * returns 1 if someone else modified it first, and then version gets its current version;
+     * otherwise version gets the new version */
+    item_t item = {.key = key, .value1 = value1, .value2 = value2, .value3 = value3, .version = *version};
+    int result = service(shard_of(key), CAS, &item, NULL);
+    if (result != -1) *version = item.version;
+    return result;
 }
 
 
 int delete_key(int key) {
     /* function used to delete a tuple from the DB */
-    return service(DELETE_KEY, key, NULL, NULL, NULL);
+    item_t item = {.key = key};
+    return service(shard_of(key), DELETE_KEY, &item, NULL);
 }
 
 
 int exist(int key) {
     /* function used to figure out whether a tuple exists in the DB */
-    return service(EXIST, key, NULL, NULL, NULL);
+    item_t item = {.key = key};
+    return service(shard_of(key), EXIST, &item, NULL);
 }
 
 
 int num_items() {
-    /* function used to figure out how many tuples are in the DB */
-    return service(NUM_ITEMS, 0, NULL, NULL, NULL);
+    /* function used to figure out how many tuples are in the DB; every server counts its own */
+    int total;
+    if (fan_out(NUM_ITEMS, &total) == -1) return -1;
+    return total;
+}
+
+
+int incr_value(int key, int delta, int *value2) {
+    /* function used to atomically add delta to the value2 of a tuple; value2 gets the result */
+    item_t item = {.key = key, .value2 = delta};
+    if (service(shard_of(key), INCR, &item, NULL) == -1) return -1;
+    *value2 = item.value2;
+    return 0;
+}
+
+
+int add_value(int key, float delta, float *value3) {
+    /* function used to atomically add delta to the value3 of a tuple; value3 gets the result */
+    item_t item = {.key = key, .value3 = delta};
+    if (service(shard_of(key), ADD, &item, NULL) == -1) return -1;
+    *value3 = item.value3;
+    return 0;
+}
+
+
+int batch(txn_op_t *ops, int num_ops) {
+    /* function used to perform several independent operations (GET_VALUE, SET_VALUE, MODIFY_VALUE or DELETE_KEY);
+     * unlike txn, they may span several servers and each one may fail on its own: each operation gets its result,
+     * and GET_VALUE ones get the values read, which stay valid until the next txn or batch call of the thread.
+     * operations are grouped by server, and groups are sent in parallel; returns how many operations failed */
+    if (num_ops < 0) return -1;
+    int num_tasks = num_shards();
+    if (num_tasks == -1) return -1;
+
+    /* group operations by server, keeping their order within each group */
+    txn_op_t **grouped = malloc((num_ops + 1) * sizeof(txn_op_t *));
+    int *op_shards = malloc((num_ops + 1) * sizeof(int));
+    if (!grouped || !op_shards) {
+        perror("Could not allocate batch");
+        free(grouped); free(op_shards); return -1;
+    }
+
+    shard_task_t tasks[MAX_SERVERS];
+    for (int i = 0; i < num_tasks; i++) {
+        tasks[i].shard = i;
+        tasks[i].num_ops = 0;
+        arena_init(&tasks[i].arena);
+    }
+    int failed = 0;
+    for (int i = 0; i < num_ops; i++) {
+        op_shards[i] = shard_of(ops[i].item.key);
+        if (op_shards[i] == -1) {
+            ops[i].result = SRV_ERROR;
+            failed++;
+        } else tasks[op_shards[i]].num_ops++;
+    }
+    for (int i = 0, start = 0; i < num_tasks; i++) {
+        tasks[i].ops = grouped + start;
+        start += tasks[i].num_ops;
+        tasks[i].num_ops = 0;
+    }
+    for (int i = 0; i < num_ops; i++) {
+        if (op_shards[i] != -1) tasks[op_shards[i]].ops[tasks[op_shards[i]].num_ops++] = &ops[i];
+    }
+
+    /* only servers with operations are sent any */
+    int num_busy = 0;
+    for (int i = 0; i < num_tasks; i++) {
+        if (tasks[i].num_ops) tasks[num_busy++] = tasks[i];
+    }
+    run_shard_tasks(tasks, num_busy);
+    for (int i = 0; i < num_busy; i++) failed += tasks[i].result;
+
+    /* values read are kept until the next call; the ones read by the previous call may have been sent by this one */
+    arena_free(&results_arena);
+    for (int i = 0; i < num_busy; i++) arena_adopt(&results_arena, &tasks[i].arena);
+
+    free(grouped);
+    free(op_shards);
+    return failed;
+}
+
+
+static int aggregate_shard_once(const int shard, const char function, const char field, const int lo, const int hi,
+                                double *result) {
+    if (connect_to_shard(shard) == -1) return -1;
+
+    request_t request;  /* client request */
+    request.header.id = next_txn_id();
+    request.header.op_code = AGGREGATE;
+    request.agg_function = function;
+    request.agg_field = field;
+    request.range.lo = lo;
+    request.range.hi = hi;
+    request.range.max_items = 0;
+    reply_t reply;      /* server reply */
+
+    /* send client request */
+    if (send_header(&request.header) == -1 ||
+        send_aggregate(client_socket, &request) == -1 ||
+        send_range(client_socket, &request.range) == -1) return -1;
+
+    /* receive server reply */
+    int status = recv_reply(&reply);
+    if (status) return status;
+    if (recv_num_items(client_socket, &reply) == -1 ||
+        recv_result(client_socket, &reply) == -1) return -1;
+
+    disconnect_from_server();
+
+    if (reply.server_error_code != SRV_SUCCESS) return -1;
+    *result = reply.result;
+    return (int) reply.num_items;
+}
+
+
+static int aggregate_shard(const int shard, const char function, const char field, const int lo, const int hi,
+                           double *result) {
+    /* computes the aggregation on one server; returns how many tuples were aggregated */
+    int count, attempt = 0;
+    start_deadline();
+    while ((count = aggregate_shard_once(shard, function, field, lo, hi, result)) == BUSY && back_off(&attempt));
+    return count == BUSY ? -1 : count;
+}
+
+
+int aggregate(char function, char field, int lo, int hi, double *result) {
+    /* function used to compute COUNT, SUM, MIN, MAX or AVG of value2 or value3 inside the server,
+     * over the tuples whose keys are in [lo, hi]; returns how many tuples were aggregated.
+     * every server aggregates its own tuples, and their results are combined */
+    int shards = num_shards();
+    if (shards == -1) return -1;
+    if (shards == 1) return aggregate_shard(0, function, field, lo, hi, result);
+
+    int count = 0;
+    double combined = 0;
+    for (int shard = 0; shard < shards; shard++) {
+        double shard_result;
+        int shard_count = aggregate_shard(shard, function, field, lo, hi, &shard_result);
+        if (shard_count == -1) return -1;
+        if (!shard_count) continue;
+
+        switch (function) {
+            case AGG_MIN: if (!count || shard_result < combined) combined = shard_result; break;
+            case AGG_MAX: if (!count || shard_result > combined) combined = shard_result; break;
+            case AGG_AVG: combined += shard_result * shard_count; break;     /* weighted by tuple count */
+            default: combined += shard_result; break;                      /* COUNT & SUM add up */
+        }
+        count += shard_count;
+    }
+
+    if (function == AGG_AVG && count) combined /= count;
+    *result = combined;
+    return count;
+}
+
+
+static int search_shard_once(const int shard, const char mode, const char *pattern, int *keys, const int max_keys) {
+    if (connect_to_shard(shard) == -1) return -1;
+
+    request_t request;  /* client request */
+    request.header.id = next_txn_id();
+    request.header.op_code = SEARCH;
+    request.search_mode = mode;
+    request.item.value1 = (char *) pattern;
+    reply_t reply;      /* server reply */
+
+    /* send client request */
+    if (send_header(&request.header) == -1 ||
+        send_search(client_socket, &request) == -1) return -1;
+
+    /* receive server reply */
+    int status = recv_reply(&reply);
+    if (status) return status;
+    if (reply.server_error_code != SRV_SUCCESS) {
+        disconnect_from_server(); return -1;
+    }
+
+    /* keys arrive in chunks, the last one being empty */
+    int32_t chunk[SEARCH_CHUNK_KEYS];
+    int num_keys = 0;
+    reply.keys = chunk;
+    do {
+        if (recv_key_chunk(client_socket, &reply) == -1) return -1;
+        for (uint32_t i = 0; i < reply.num_items; i++, num_keys++) {
+            if (num_keys < max_keys) keys[num_keys] = chunk[i];
+        }
+    } while (reply.num_items);
+
+    disconnect_from_server();
+    return num_keys;
+}
+
+
+static int search_shard(const int shard, const char mode, const char *pattern, int *keys, const int max_keys) {
+    /* searches one server; stores up to max_keys of the keys found, and returns how many were found */
+    int num_keys, attempt = 0;
+    start_deadline();
+    while ((num_keys = search_shard_once(shard, mode, pattern, keys, max_keys)) == BUSY && back_off(&attempt));
+    return num_keys == BUSY ? -1 : num_keys;
+}
+
+
+int search(char mode, char *pattern, int *keys, int max_keys) {
+    /* function used to find the tuples whose value1 is equal to, starts with or contains pattern,
+     * depending on mode; stores up to max_keys of their keys in keys, and returns how many were found */
+    if (!value1_fits(pattern)) return -1;
+    int shards = num_shards();
+    if (shards == -1) return -1;
+
+    int num_keys = 0;
+    for (int shard = 0; shard < shards; shard++) {
+        int room = max_keys > num_keys ? max_keys - num_keys : 0;
+        int found = search_shard(shard, mode, pattern, room ? keys + num_keys : keys, room);
+        if (found == -1) return -1;
+        num_keys += found;
+    }
+    return num_keys;
+}
+
+
+static int txn_once(const int shard, txn_op_t *ops, const int num_ops) {
+    if (connect_to_shard(shard) == -1) return -1;
+
+    request_t request;  /* client request */
+    request.header.id = next_txn_id();
+    request.header.op_code = TXN;
+    request.num_ops = (uint32_t) num_ops;
+    reply_t reply;      /* server reply */
+
+    /* send client request; send functions convert keys & values, so send a copy of ops */
+    txn_op_t sent_ops[TXN_MAX_OPS];
+    memcpy(sent_ops, ops, num_ops * sizeof(txn_op_t));
+    request.ops = sent_ops;
+    if (send_header(&request.header) == -1 ||
+        send_txn_ops(client_socket, &request) == -1) return -1;
+
+    /* receive server reply; values read by the previous call may have been sent by this one, so they're kept
+     * until the results arrive */
+    int status = recv_reply(&reply);
+    if (status) return status;
+    arena_t arena;
+    arena_init(&arena);
+    if (recv_txn_results(client_socket, ops, (uint32_t) num_ops, &arena) == -1) {
+        arena_free(&arena); return -1;
+    }
+
+    disconnect_from_server();
+    arena_free(&results_arena);
+    results_arena = arena;
+
+    if (reply.server_error_code == SRV_SUCCESS) return 0;
+    if (reply.server_error_code == SRV_CONFLICT) return 1;
+    return -1;
+}
+
+
+int txn(txn_op_t *ops, int num_ops) {
+    /* function used to perform several operations atomically: either all of them are done or none is.
+     * each operation gets its own result, and GET_VALUE ones get the values read, which stay valid until
+     * the next txn or batch call of the thread; returns 0 if done, 1 if a TXN_COMPARE operation found
+     * another version, -1 on error */
+    if (num_ops < 0 || num_ops > TXN_MAX_OPS) return -1;
+    for (int i = 0; i < num_ops; i++) {
+        if ((ops[i].op_code == SET_VALUE || ops[i].op_code == MODIFY_VALUE) && !value1_fits(ops[i].item.value1))
+            return -1;
+    }
+
+    /* a transaction runs on a single server, so all its keys must belong to the same one */
+    int shard = num_ops ? shard_of(ops[0].item.key) : 0;
+    for (int i = 1; i < num_ops && shard != -1; i++) {
+        if (shard_of(ops[i].item.key) != shard) {
+            fprintf(stderr, "Transaction keys belong to several servers\n"); return -1;
+        }
+    }
+
+    int result, attempt = 0;
+    start_deadline();
+    while ((result = txn_once(shard, ops, num_ops)) == BUSY && back_off(&attempt));
+
+    for (int i = 0; caching && i < num_ops; i++) {
+        if (ops[i].op_code != GET_VALUE && ops[i].op_code != TXN_COMPARE)
+            key_cache_invalidate(&cache, ops[i].item.key);
+    }
+    return result == BUSY ? -1 : result;
+}
+
+
+static int fetch_shard_page_once(const int shard, request_t *request, item_t *items, reply_t *reply,
+                                 arena_t *arena) {
+    uint32_t max_items = request->range.max_items;
+    int keys_only = request->header.op_code == QUERY && request->keys_only;
+    if (connect_to_shard(shard) == -1) return -1;
+
+    /* send client request; send functions convert the members they send, and request may be sent again */
+    request_t sent = *request;
+    if (send_header(&sent.header) == -1 ||
+        send_range(client_socket, &sent.range) == -1 ||
+        (sent.header.op_code == QUERY && send_query(client_socket, &sent) == -1)) return -1;
+
+    /* receive server reply */
+    int status = recv_reply(reply);
+    if (status) return status;
+    if (recv_num_items(client_socket, reply) == -1) return -1;
+
+    if (reply->num_items > max_items) {
+        fprintf(stderr, "Server sent a page too big\n");
+        disconnect_from_server(); return -1;
+    }
+
+    if ((keys_only ? recv_keys(client_socket, items, reply->num_items)
+                   : recv_items(client_socket, items, reply->num_items, arena)) == -1 ||
+        recv_cursor(client_socket, reply) == -1) return -1;
+
+    disconnect_from_server();
+
+    return reply->server_error_code == SRV_SUCCESS ? 0 : -1;
+}
+
+
+static int fetch_shard_page(const int shard, request_t *request, item_t *items, reply_t *reply, arena_t *arena) {
+    /* fetches a page of a range (SCAN) or value2 query (QUERY) from one server;
+     * reply gets how many items were fetched, whether there are more and where the next page starts */
+    int result, attempt = 0;
+    start_deadline();
+    while ((result = fetch_shard_page_once(shard, request, items, reply, arena)) == BUSY && back_off(&attempt));
+    return result == BUSY ? -1 : result;
+}
+
+
+/* range iterator functions: pages are fetched on demand, and since the cursor is just
+ * the next key to read, the server keeps no state between pages.
+ * when the key space is sharded, every server sends its share of the page and they're merged */
+
+static int compare_keys(const void *a, const void *b) {
+    const item_t *ia = (const item_t *) a, *ib = (const item_t *) b;
+    return (ia->key > ib->key) - (ia->key < ib->key);
+}
+
+
+int scan_fetch_page(scan_t *scan) {
+    /* fetches the next page of the range from the servers; value1 strings of the previous page are released */
+    int shards = num_shards();
+    if (shards == -1) return -1;
+    arena_reset(&scan->arena);
+
+    int32_t last = scan->hi;    /* items past it are fetched again with the next page */
+    int more = FALSE;
+    uint32_t num_items = 0;
+
+    for (int shard = 0; shard < shards; shard++) {
+        request_t request;  /* client request */
+        request.header.id = next_txn_id();
+        request.header.op_code = SCAN;
+        request.range.lo = scan->cursor;
+        request.range.hi = scan->hi;
+        request.range.max_items = SCAN_PAGE_ITEMS / shards;
+        reply_t reply;      /* server reply */
+
+        if (fetch_shard_page(shard, &request, scan->items + num_items, &reply, &scan->arena) == -1) return -1;
+
+        /* a server with items left bounds the page: other servers may have keys past its last one */
+        if (reply.more) {
+            more = TRUE;
+            if (scan->items[num_items + reply.num_items - 1].key < last)
+                last = scan->items[num_items + reply.num_items - 1].key;
+        }
+        num_items += reply.num_items;
+    }
+
+    /* keep the items up to last, in key order */
+    scan->num_items = 0;
+    for (uint32_t i = 0; i < num_items; i++) {
+        if (scan->items[i].key <= last) scan->items[scan->num_items++] = scan->items[i];
+    }
+    if (shards > 1) qsort(scan->items, scan->num_items, sizeof(item_t), compare_keys);
+
+    scan->pos = 0;
+    scan->done = !more;
+    if (more) scan->cursor = last + 1;
+    return 0;
+}
+
+
+int scan_open(scan_t *scan, int lo, int hi) {
+    /* function used to start going through the tuples whose keys are in [lo, hi] */
+    scan->cursor = lo;
+    scan->hi = hi;
+    scan->done = lo > hi;
+    scan->num_items = 0;
+    scan->pos = 0;
+    arena_init(&scan->arena);
+    return 0;
+}
+
+
+int scan_next_item(scan_t *scan, const item_t **item) {
+    /* function used to get the next tuple of the range, whose value1 may be long;
+     * item is valid until the next call. returns 1 if a tuple was read, 0 at the end of the range and -1 on error */
+    while (scan->pos == scan->num_items) {
+        if (scan->done) {
+            arena_free(&scan->arena); return 0;
+        }
+        if (scan_fetch_page(scan) == -1) return -1;
+    }
+
+    *item = &scan->items[scan->pos++];
+    return 1;
+}
+
+
+int scan_next(scan_t *scan, int *key, char *value1, int *value2, float *value3) {
+    /* function used to get the next tuple of the range; value1 must have room for VALUE1_MAX_STR_SIZE bytes.
+     * returns 1 if a tuple was read, 0 at the end of the range and -1 on error */
+    const item_t *item;
+    int result = scan_next_item(scan, &item);
+    if (result != 1) return result;
+
+    if (strlen(item->value1) >= VALUE1_MAX_STR_SIZE) {
+        fprintf(stderr, "value1 doesn't fit in buffer\n"); return -1;
+    }
+    *key = item->key;
+    strcpy(value1, item->value1);
+    *value2 = item->value2;
+    *value3 = item->value3;
+    return 1;
+}
+
+
+void scan_close(scan_t *scan) {
+    /* function used to finish going through a range early */
+    scan->done = TRUE;
+    scan->num_items = 0;
+    scan->pos = 0;
+    arena_free(&scan->arena);
+}
+
+
+/* value2 query iterator functions: same as the range iterator, but the cursor
+ * is a position in value2 & key order given by the server */
+
+static int64_t query_sort_key(const item_t *item) {
+    /* position of an item in value2 & key order; same as the one the servers use for cursors */
+    return (int64_t) (((uint64_t) (int64_t) item->value2 << 32) | (uint32_t) item->key);
+}
+
+
+static int compare_sort_keys(const void *a, const void *b) {
+    int64_t ka = query_sort_key((const item_t *) a), kb = query_sort_key((const item_t *) b);
+    return (ka > kb) - (ka < kb);
+}
+
+
+int query_fetch_page(query_t *query) {
+    /* fetches the next page of the query from the servers; merging pages needs value2,
+     * so servers send values even for keys-only queries when the key space is sharded */
+    int shards = num_shards();
+    if (shards == -1) return -1;
+    arena_reset(&query->arena);
+
+    int64_t next_cursor = INT64_MAX;    /* items from here on are fetched again with the next page */
+    int more = FALSE;
+    uint32_t num_items = 0;
+
+    for (int shard = 0; shard < shards; shard++) {
+        request_t request;  /* client request */
+        request.header.id = next_txn_id();
+        request.header.op_code = QUERY;
+        request.range.lo = query->lo;
+        request.range.hi = query->hi;
+        request.range.max_items = SCAN_PAGE_ITEMS / shards;
+        request.cursor = query->cursor;
+        request.keys_only = (uint8_t) (query->keys_only && shards == 1);
+        reply_t reply;      /* server reply */
+
+        if (fetch_shard_page(shard, &request, query->items + num_items, &reply, &query->arena) == -1) return -1;
+
+        if (reply.more) {
+            more = TRUE;
+            if (reply.cursor < next_cursor) next_cursor = reply.cursor;
+        }
+        num_items += reply.num_items;
+    }
+
+    if (shards == 1) query->num_items = num_items;
+    else {
+        /* keep the items before next_cursor, in value2 & key order */
+        query->num_items = 0;
+        for (uint32_t i = 0; i < num_items; i++) {
+            if (query_sort_key(&query->items[i]) < next_cursor) query->items[query->num_items++] = query->items[i];
+        }
+        qsort(query->items, query->num_items, sizeof(item_t), compare_sort_keys);
+    }
+
+    query->pos = 0;
+    query->done = !more;
+    if (more) query->cursor = next_cursor;
+    return 0;
+}
+
+
+int query_open(query_t *query, int lo, int hi, int keys_only) {
+    /* function used to start going through the tuples whose value2 is in [lo, hi] */
+    query->lo = lo;
+    query->hi = hi;
+    query->keys_only = keys_only;
+    query->cursor = INT64_MIN;
+    query->done = lo > hi;
+    query->num_items = 0;
+    query->pos = 0;
+    arena_init(&query->arena);
+    return 0;
+}
+
+
+int query_next_item(query_t *query, const item_t **item) {
+    /* function used to get the next tuple of the query, whose value1 may be long; only its key is set
+     * if the query fetches keys only. item is valid until the next call.
+     * returns 1 if a tuple was read, 0 at the end and -1 on error */
+    while (query->pos == query->num_items) {
+        if (query->done) {
+            arena_free(&query->arena); return 0;
+        }
+        if (query_fetch_page(query) == -1) return -1;
+    }
+
+    *item = &query->items[query->pos++];
+    return 1;
+}
+
+
+int query_next(query_t *query, int *key, char *value1, int *value2, float *value3) {
+    /* function used to get the next tuple of the query; values aren't set if the query
+     * fetches keys only, and value1 must have room for VALUE1_MAX_STR_SIZE bytes otherwise;
+     * returns 1 if a tuple was read, 0 at the end and -1 on error */
+    const item_t *item;
+    int result = query_next_item(query, &item);
+    if (result != 1) return result;
+
+    *key = item->key;
+    if (!query->keys_only) {
+        if (strlen(item->value1) >= VALUE1_MAX_STR_SIZE) {
+            fprintf(stderr, "value1 doesn't fit in buffer\n"); return -1;
+        }
+        strcpy(value1, item->value1);
+        *value2 = item->value2;
+        *value3 = item->value3;
+    }
+    return 1;
+}
+
+
+void query_close(query_t *query) {
+    /* function used to finish going through a query early */
+    query->done = TRUE;
+    query->num_items = 0;
+    query->pos = 0;
+    arena_free(&query->arena);
+}
+
+
+/* change feed functions */
+
+static int watch_open_once(watch_t *watch, const int shard, const int lo, const int hi, const uint64_t from_seq,
+                           const int keys_only) {
+    if (connect_to_shard(shard) == -1) return -1;
+
+    request_t request;  /* client request */
+    request.header.id = next_txn_id();
+    request.header.op_code = WATCH;
+    request.range.lo = lo;
+    request.range.hi = hi;
+    request.range.max_items = 0;
+    request.seq = from_seq;
+    request.keys_only = (uint8_t) keys_only;
+    reply_t reply;      /* server reply */
+
+    /* send client request */
+    if (send_header(&request.header) == -1 ||
+        send_range(client_socket, &request.range) == -1 ||
+        send_watch(client_socket, &request) == -1) return -1;
+
+    /* receive server reply; the server tells where the watch actually starts */
+    int status = recv_reply(&reply);
+    if (status) return status;
+    if (reply.server_error_code != SRV_SUCCESS || recv_seq(client_socket, &request) == -1) {
+        disconnect_from_server(); return -1;
+    }
+
+    /* the connection stays open and belongs to the watch from now on */
+    watch->socket = client_socket;
+    watch->next_seq = request.seq;
+    arena_init(&watch->arena);
+    return 0;
+}
+
+
+int watch_open(watch_t *watch, int lo, int hi, uint64_t from_seq) {
+    /* function used to subscribe to the changes to the tuples whose keys are in [lo, hi],
+     * starting at sequence number from_seq; 0 means only changes committed from now on.
+     * sequence numbers belong to a server, so the key space can't be sharded */
+    if (num_shards() != 1) {
+        fprintf(stderr, "Watches need a single server\n"); return -1;
+    }
+
+    int result, attempt = 0;
+    start_deadline();
+    while ((result = watch_open_once(watch, 0, lo, hi, from_seq, FALSE)) == BUSY && back_off(&attempt));
+    return result == BUSY ? -1 : result;
+}
+
+
+int watch_next(watch_t *watch, change_t *change) {
+    /* function used to wait for the next change; a WATCH_LAGGED change means that its lag
+     * changes were missed because the client didn't keep up, and seq is the first one after them.
+     * the value1 of the change is valid until the next call */
+    if (watch->socket == -1) return -1;
+    arena_reset(&watch->arena);
+    if (recv_change(watch->socket, change, &watch->arena) == -1) {
+        /* recv_change already closed the socket */
+        watch->socket = -1; return -1;
+    }
+    watch->next_seq = change->op_code == WATCH_LAGGED ? change->seq : change->seq + 1;
+    return 0;
+}
+
+
+void watch_close(watch_t *watch) {
+    /* function used to unsubscribe; next_seq is kept, so the watch can be opened again from it */
+    arena_free(&watch->arena);
+    if (watch->socket == -1) return;
+    close(watch->socket);
+    watch->socket = -1;
+}
+
+
+static int replica_status_once(const int replica, uint64_t *applied_seq, uint64_t *lag) {
+    if (connect_to_replica(replica) == -1) return -1;
+
+    request_t request;  /* client request */
+    request.header.id = next_txn_id();
+    request.header.op_code = REPLICA_STATUS;
+    reply_t reply;      /* server reply */
+
+    if (send_header(&request.header) == -1) return -1;
+    int status = recv_reply(&reply);
+    if (status) return status;
+    if (recv_replica_status(client_socket, &reply) == -1) return -1;
+
+    disconnect_from_server();
+
+    if (reply.server_error_code != SRV_SUCCESS) return -1;
+
+    *applied_seq = reply.replica.applied_seq;
+    *lag = reply.replica.lag;
+    return !reply.replica.connected;
+}
+
+
+int replica_status(int replica, uint64_t *applied_seq, uint64_t *lag) {
+    /* function used to check how far behind the primary the replica-th server in REPLICAS_TUPLES is;
+     * returns 0 while it follows the primary, 1 while it's (re)connecting to it */
+    int result, attempt = 0;
+    start_deadline();
+    while ((result = replica_status_once(replica, applied_seq, lag)) == BUSY && back_off(&attempt));
+    return result == BUSY ? -1 : result;
+}
+
+
+static int server_stats_once(const int shard, server_stats_t *stats) {
+    if (connect_to_shard(shard) == -1) return -1;
+
+    request_t request;  /* client request */
+    request.header.id = next_txn_id();
+    request.header.op_code = STATS;
+    reply_t reply;      /* server reply */
+    reply.stats = stats;
+
+    if (send_header(&request.header) == -1) return -1;
+    int status = recv_reply(&reply);
+    if (status) return status;
+    if (recv_stats(client_socket, &reply) == -1) return -1;
+
+    disconnect_from_server();
+
+    return reply.server_error_code == SRV_SUCCESS ? 0 : -1;
+}
+
+
+int server_stats(int shard, server_stats_t *stats) {
+    /* function used to read the metrics of the shard-th server (0 unless SERVERS_TUPLES lists several),
+     * counted since it started */
+    int result, attempt = 0;
+    start_deadline();
+    while ((result = server_stats_once(shard, stats)) == BUSY && back_off(&attempt));
+    return result == BUSY ? -1 : result;
+}
+
+
+/* read cache functions */
+
+static int follow_feed(cache_feed_t *feed) {
+    /* invalidates the cached tuples of the feed's server as they change, until its watch breaks */
+    watch_t watch;
+    int result, attempt = 0;
+    start_deadline();
+    while ((result = watch_open_once(&watch, feed->shard, INT32_MIN, INT32_MAX, 0, TRUE)) == BUSY &&
+           back_off(&attempt));
+    if (result) return -1;
+
+    /* the copy stays open until following ends, even once watch_next has closed the socket */
+    pthread_mutex_lock(&mutex_feeds);
+    feed->socket = feeds_stopping ? -1 : dup(watch.socket);
+    int error = feed->socket == -1;
+    if (!error) __atomic_store_n(&feed->up, TRUE, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&mutex_feeds);
+    if (error) {
+        watch_close(&watch); return -1;
+    }
+
+    change_t change;
+    while (watch_next(&watch, &change) == 0) {
+        /* anything but a key that changed is the DB being emptied, or changes that were missed */
+        if (change.op_code == WATCH_KEY_CHANGED) key_cache_invalidate(&cache, change.item.key);
+        else key_cache_clear(&cache);
+    }
+
+    /* changes to the server's tuples go unnoticed from now on */
+    pthread_mutex_lock(&mutex_feeds);
+    __atomic_store_n(&feed->up, FALSE, __ATOMIC_RELEASE);
+    close(feed->socket);
+    feed->socket = -1;
+    pthread_mutex_unlock(&mutex_feeds);
+    key_cache_clear(&cache);
+    watch_close(&watch);
+    return -1;
+}
+
+
+static void *feed_thread(void *args) {
+    cache_feed_t *feed = (cache_feed_t *) args;
+
+    pthread_mutex_lock(&mutex_feeds);
+    while (!feeds_stopping) {
+        pthread_mutex_unlock(&mutex_feeds);
+        follow_feed(feed);
+
+        pthread_mutex_lock(&mutex_feeds);
+        struct timespec retry;
+        clock_gettime(CLOCK_REALTIME, &retry);
+        retry.tv_sec += CACHE_FEED_RETRY_MS / 1000;
+        retry.tv_nsec += (CACHE_FEED_RETRY_MS % 1000) * 1000000L;
+        if (retry.tv_nsec >= 1000000000L) {
+            retry.tv_sec++;
+            retry.tv_nsec -= 1000000000L;
+        }
+        while (!feeds_stopping && pthread_cond_timedwait(&cond_feeds_stop, &mutex_feeds, &retry) == 0);
+    }
+    pthread_mutex_unlock(&mutex_feeds);
+    return NULL;
+}
+
+
+static void stop_feeds(void) {
+    pthread_mutex_lock(&mutex_feeds);
+    feeds_stopping = TRUE;
+    for (int i = 0; i < num_feeds; i++) {
+        if (feeds[i].socket != -1) shutdown(feeds[i].socket, SHUT_RDWR);
+    }
+    pthread_cond_broadcast(&cond_feeds_stop);
+    pthread_mutex_unlock(&mutex_feeds);
+
+    for (int i = 0; i < num_feeds; i++) pthread_join(feeds[i].thread, NULL);
+    num_feeds = 0;
+}
+
+
+int cache_enable(size_t max_bytes) {
+    /* function used to start caching the tuples read, in up to max_bytes of memory,
+     * for the servers the key space is split across now */
+    if (caching) {
+        fprintf(stderr, "Cache already enabled\n"); return -1;
+    }
+    int shards = num_shards();
+    if (shards == -1) return -1;
+
+    key_cache_init(&cache, max_bytes);
+    feeds_stopping = FALSE;
+    for (num_feeds = 0; num_feeds < shards; num_feeds++) {
+        cache_feed_t *feed = &feeds[num_feeds];
+        feed->shard = num_feeds;
+        feed->up = FALSE;
+        feed->socket = -1;
+        if (pthread_create(&feed->thread, NULL, feed_thread, feed) != 0) {
+            perror("Could not create cache feed thread");
+            stop_feeds();
+            key_cache_free(&cache); return -1;
+        }
+    }
+
+    caching = TRUE;
+    return 0;
+}
+
+
+void cache_disable(void) {
+    /* function used to stop caching, dropping every cached tuple; the stats are reset */
+    if (!caching) return;
+    caching = FALSE;
+    stop_feeds();
+    key_cache_free(&cache);
+}
+
+
+void cache_stats(cache_stats_t *stats) {
+    /* function used to read the cache stats, counted since cache_enable; all zero if the cache is disabled */
+    if (!caching) {
+        memset(stats, 0, sizeof(cache_stats_t)); return;
+    }
+    key_cache_read_stats(&cache, stats);
 }
@@ -0,0 +1,1357 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <signal.h>
+#include "DS-MandatoryExercise/utils.h"
+#include "DS-MandatoryExercise/netUtils.h"
+#include "DS-MandatoryExercise/replica.h"
+#include "DS-MandatoryExercise/netRing.h"
+#include "DS-MandatoryExercise/metrics.h"
+#include "DS-MandatoryExercise/trace.h"
+#include "DS-MandatoryExercise/kvServer.h"
+#include "DS-MandatoryExercise/dbms/dbms.h"
+
+/* prototypes */
+void *service_thread(void *args);
+int serve_request(int stream, int client_socket, uint64_t accepted_ns, arena_t *arena);
+void *watch_thread(void *args);
+void set_server_error_code_std(reply_t *reply, int req_error_code);
+int reject_write(reply_t *reply);
+
+/* services */
+void init_db(reply_t *reply);
+void insert_item(request_t *request, reply_t *reply);
+void get_item(request_t *request, reply_t *reply, stored_value1_t *stored, arena_t *arena);
+void release_item(stored_value1_t *stored);
+void modify_item(request_t *request, reply_t *reply);
+void delete_item(request_t *request, reply_t *reply);
+void item_exists(request_t *request, reply_t *reply);
+void get_num_items(reply_t *reply);
+void scan_items(request_t *request, reply_t *reply, arena_t *arena);
+void aggregate_items(request_t *request, reply_t *reply);
+void query_items(request_t *request, reply_t *reply, arena_t *arena);
+void search_items(request_t *request, reply_t *reply);
+void add_to_item(request_t *request, reply_t *reply);
+void upsert_item(request_t *request, reply_t *reply);
+void cas_item(request_t *request, reply_t *reply);
+void execute_txn(request_t *request, reply_t *reply, arena_t *arena);
+void start_watch(int client_socket, request_t *request, reply_t *reply);
+void get_replica_status(reply_t *reply);
+void get_stats(reply_t *reply);
+
+
+/* connection queue */
+int conn_q[MAX_CONN_BACKLOG];   /* array of client sockets; used as a connection queue */
+uint64_t conn_q_accepted[MAX_CONN_BACKLOG];     /* when each connection in conn_q was accepted */
+int conn_q_size = 0;            /* current number of backlogged connections */
+int service_th_pos = 0;         /* connection queue position used by service threads to handle connections */
+
+/* mutex and cond var for conn_q access */
+pthread_mutex_t mutex_conn_q = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t cond_conn_q_not_empty = PTHREAD_COND_INITIALIZER;
+
+/* admission control: connections that find conn_q holding queue_limit are rejected right away, and requests are
+ * shed once picked up if as many connections are still waiting as their op_code's limit; every reject is a reply
+ * with SRV_BUSY alone, which clients retry after backing off. the ring applies the same limits to the requests
+ * waiting for its service threads */
+int queue_limit;                /* conn_q depth at which connections are rejected; reads are only shed then */
+int write_limit;                /* conn_q depth at which writes are shed */
+int bulk_limit;                 /* conn_q depth at which INIT & TXN are shed */
+
+pthread_mutex_t mutex_db = PTHREAD_MUTEX_INITIALIZER;  /* mutex for atomic operations on the DB */
+int zero_copy = TRUE;                       /* FALSE if GET replies copy long value1 strings through user space */
+uint32_t lease_ms;                          /* lease granted with GET replies; 0 if items mustn't be cached */
+#define STORED_SEND_WAIT_MS 5000            /* how long clients are given to read value1 sent from storage */
+#define REQUEST_MAX_OVERHEAD 64             /* bytes a SET request takes besides its value1 string, and more */
+#define REJECTED_MAX 128                    /* connections waiting for their client to close them */
+#define REJECTED_WAIT_MS 1000               /* how long rejected ones wait for it */
+pthread_attr_t th_attr;                     /* watch thread attributes */
+pthread_t *thread_pool;                     /* array of service threads */
+int thread_pool_size;                       /* number of service threads running */
+int *serving;                               /* socket each service thread is serving, -1 if none; for shutdown */
+
+/* server state, from kv_server_start to kv_server_stop */
+static int server_sd = -1;                  /* listening socket; -1 while the server isn't running */
+static int net_ring = FALSE;                /* TRUE if connections are served through io_uring */
+static pthread_t accept_th;                 /* thread accepting connections: the main loop or the ring's */
+static int accepting = FALSE;               /* TRUE while accept_th runs */
+static int stopping = FALSE;                /* TRUE once kv_server_stop was called; read by every server thread */
+
+/* connections the service threads reject, and GET connections whose value1 was sent from pinned storage pages,
+ * are handed over to accept_th, which waits for their client to close them along with its own rejected ones
+ * and then unpins the pages, so that no service thread is kept waiting for a client */
+typedef struct {
+    int socket;
+    uint64_t until_ns;                      /* when the client is given up on (clock_ns) */
+    stored_value1_t stored;                 /* pages released once the client is done; fd -1 if none */
+} handed_t;
+
+static pthread_mutex_t mutex_rejected = PTHREAD_MUTEX_INITIALIZER;  /* mutex for the members below */
+static int rejecting = FALSE;               /* TRUE while accept_th takes connections handed over */
+static int num_rejected = 0;                /* connections accept_th is waiting on, handed over ones included */
+static handed_t handed[REJECTED_MAX];       /* handed over, not taken by accept_th yet */
+static int num_handed = 0;
+static int wake_pipe[2] = {-1, -1};         /* written to wake accept_th up when a connection is handed over */
+
+/* change feed: each watch connection gets its own thread, so it doesn't take a service thread forever */
+#define WATCH_BATCH 64                      /* max number of changes a watch thread sends at once */
+#define WATCH_POLL_MS 1000                  /* how often idle watch threads check whether the client is gone */
+
+typedef struct {
+    int socket;
+    uint32_t id;                            /* transaction ID of the watch request */
+    int32_t lo;                             /* watched key range */
+    int32_t hi;
+    uint64_t next_seq;                      /* sequence number of the next change to send */
+    int keys_only;                          /* TRUE if only the keys changed are sent, to invalidate caches */
+} watcher_t;
+
+pthread_mutex_t mutex_watchers = PTHREAD_MUTEX_INITIALIZER;   /* mutex for num_watchers access */
+pthread_cond_t cond_no_watchers = PTHREAD_COND_INITIALIZER;
+int num_watchers = 0;                       /* current number of watch connections */
+
+
+void set_server_error_code_std(reply_t *reply, const int req_error_code) {
+    /* most services follow this error code model */
+    switch (req_error_code) {
+        case 0: reply->server_error_code = SRV_SUCCESS; break;
+        case -1: reply->server_error_code = SRV_ERROR; break;
+        default: break;
+    }
+}
+
+
+int reject_write(reply_t *reply) {
+    /* replicas only change their DB with what the primary sends them */
+    if (!replica_is_running()) return FALSE;
+    fprintf(stderr, "Replicas don't accept writes\n");
+    reply->server_error_code = SRV_ERROR;
+    return TRUE;
+}
+
+
+static void wait_client_done(const int client_socket) {
+    /* bytes sent with sendfile keep referencing the storage pages until the client reads them,
+     * and clients close the connection once they've read the reply; only used once accept_th can't wait */
+    struct pollfd pfd = {.fd = client_socket, .events = POLLIN};
+    char byte;
+    while (poll(&pfd, 1, STORED_SEND_WAIT_MS) == 1 && recv(client_socket, &byte, 1, 0) > 0);
+}
+
+
+static int rejected_done(const int client_socket) {
+    /* reads whatever the client of a rejected connection sent; returns TRUE once it closed the connection */
+    char buf[BUFSIZ];
+    ssize_t received;
+    while ((received = recv(client_socket, buf, sizeof(buf), MSG_DONTWAIT)) > 0);
+    return received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+}
+
+
+static int hand_over(const int client_socket, const stored_value1_t *stored, const int wait_ms) {
+    /* gives accept_th a connection whose reply was sent, so that it waits up to wait_ms for the client to close it
+     * and then releases stored, if not NULL; returns -1 if it's waiting on as many as it can,
+     * or isn't accepting anymore */
+    pthread_mutex_lock(&mutex_rejected);
+    if (!rejecting || num_rejected == REJECTED_MAX) {
+        pthread_mutex_unlock(&mutex_rejected); return -1;
+    }
+    handed_t *conn = &handed[num_handed++];
+    conn->socket = client_socket;
+    conn->until_ns = clock_ns() + (uint64_t) wait_ms * 1000000;
+    conn->stored.fd = -1;
+    if (stored) conn->stored = *stored;
+    num_rejected++;
+    pthread_mutex_unlock(&mutex_rejected);
+
+    char byte = 0;
+    if (write(wake_pipe[1], &byte, 1) == -1 && errno != EAGAIN) perror("Could not wake accept thread");
+    return 0;
+}
+
+
+static int shed_request(const char op_code) {
+    /* TRUE if a request of op_code must be shed, given the connections still waiting in conn_q,
+     * or the requests waiting for the ring's service threads */
+    int depth = net_ring ? net_ring_queued() : __atomic_load_n(&conn_q_size, __ATOMIC_RELAXED);
+    switch (op_code) {
+        case INIT:
+        case TXN:
+            return depth >= bulk_limit;
+        case SET_VALUE:
+        case MODIFY_VALUE:
+        case DELETE_KEY:
+        case INCR:
+        case ADD:
+        case UPSERT:
+        case CAS:
+            return depth >= write_limit;
+        default:
+            return depth >= queue_limit;
+    }
+}
+
+
+void * service_thread(void *args) {
+    /* value1 strings received or sent while handling a connection are allocated from this arena,
+     * which is reset before the next one; memory used per request grows with its values */
+    int th = (int) (intptr_t) args;     /* position in thread_pool */
+    arena_t arena;
+    arena_init(&arena);
+
+    while (TRUE) {
+        int client_socket;
+        /* copy client socket descriptor and free the original */
+        pthread_mutex_lock(&mutex_conn_q);
+
+        /* there are no connections to handle, so sleep */
+        while (conn_q_size == 0 && !stopping)
+            pthread_cond_wait(&cond_conn_q_not_empty, &mutex_conn_q);
+
+        /* once the server is stopped, the requests queued connections already sent are still served */
+        if (conn_q_size == 0) {
+            pthread_mutex_unlock(&mutex_conn_q); break;
+        }
+
+        client_socket = conn_q[service_th_pos];
+        uint64_t accepted_ns = conn_q_accepted[service_th_pos];
+        service_th_pos = (service_th_pos + 1) % MAX_CONN_BACKLOG;
+        __atomic_store_n(&conn_q_size, conn_q_size - 1, __ATOMIC_RELAXED);
+        metrics_conn_q_depth(conn_q_size);
+
+        serving[th] = client_socket;
+        if (stopping) shutdown(client_socket, SHUT_RD);
+        pthread_mutex_unlock(&mutex_conn_q);
+        metrics_conn_q_wait(clock_ns() - accepted_ns);
+        arena_reset(&arena);
+
+        /* handle connection now; every connection serves a single request */
+        int result = serve_request(client_socket, client_socket, accepted_ns, &arena);
+
+        pthread_mutex_lock(&mutex_conn_q);
+        serving[th] = -1;
+        pthread_mutex_unlock(&mutex_conn_q);
+        if (!result) close(client_socket);
+    } // end outer while
+
+    arena_free(&arena);
+    return NULL;
+}
+
+
+int serve_request(const int stream, const int client_socket, const uint64_t accepted_ns, arena_t *arena) {
+    /* receives a request from stream, executes it and sends the reply to stream; stream is client_socket,
+     * or MEM_STREAM for callers that do the socket I/O themselves. value1 strings are allocated from arena,
+     * and the connection was accepted at accepted_ns (clock_ns). returns 0 once the reply is sent,
+     * 1 if client_socket was handed over to a watch thread or to accept_th, -1 on error;
+     * the receiving & sending functions close stream on error, unless it's MEM_STREAM */
+    uint64_t started_ns = clock_ns();
+    request_t request;
+    /* receive transaction ID, op_code & deadline */
+    if (recv_request_header(stream, &request.header) == -1) return -1;
+    trace_request(request.header.id, request.header.op_code, accepted_ns, started_ns);
+
+    /* the client stops waiting for the reply deadline_us after sending the request, which was about when
+     * its connection was accepted: once that's passed there's no one left to serve, so it's dropped unanswered */
+    uint64_t deadline = request.header.deadline_us ?
+                        accepted_ns + (uint64_t) request.header.deadline_us * 1000 : 0;
+    if (deadline && clock_ns() >= deadline) {
+        metrics_expired(request.header.op_code);
+        close_stream(stream); return -1;
+    }
+    db_set_deadline(deadline);
+
+    /* set up server reply */
+    reply_t reply;
+    reply.header.id = request.header.id;
+    reply.header.op_code = request.header.op_code;
+    reply.item.value1 = NULL;
+
+    /* low priority requests make way for the rest while conn_q is deep */
+    if (shed_request(request.header.op_code)) {
+        metrics_busy(request.header.op_code);
+        reply.server_error_code = SRV_BUSY;
+        if (send_reply_header(stream, &reply) == -1) return -1;
+        /* the ring received the whole request already */
+        if (net_ring) return 0;
+        /* the rest of the request is left unread, so the client closes first; if accept_th can't wait for it,
+         * the request is read if it arrived already */
+        if (hand_over(client_socket, NULL, REJECTED_WAIT_MS) == 0) return 1;
+        rejected_done(client_socket);
+        return 0;
+    }
+
+    /* check whether client request is valid and execute it */
+    int handed_over = FALSE;
+    switch (request.header.op_code) {
+        case INIT:
+            /* execute client request */
+            trace_received();
+            init_db(&reply);
+
+            /* send server reply */
+            trace_executed();
+            if (send_reply_header(stream, &reply) == -1) return -1;
+            break;
+        case SET_VALUE:
+            /* receive rest of client request */
+            if (recv_key(stream, &request.item) == -1 ||
+            recv_values(stream, &request.item, arena) == -1) return -1;
+
+            /* execute client request */
+            trace_received();
+            insert_item(&request, &reply);
+
+            /* send server reply */
+            trace_executed();
+            if (send_reply_header(stream, &reply) == -1) return -1;
+            break;
+        case GET_VALUE:
+            /* receive rest of client request */
+            if (recv_key(stream, &request.item) == -1) return -1;
+
+            /* execute client request */
+            trace_received();
+            stored_value1_t stored;
+            get_item(&request, &reply, &stored, arena);
+
+            /* send server reply; long value1 strings are sent from storage, never held in memory whole */
+            trace_executed();
+            int send_error = send_reply_header(stream, &reply) == -1 ||
+                    (stored.fd != -1 ? send_stored_values(stream, &reply.item, stored.fd, stored.offset,
+                                                          stored.len, zero_copy)
+                                     : send_values(stream, &reply.item)) == -1 ||
+                    send_version(stream, &reply.item) == -1 ||
+                    send_lease(stream, &reply) == -1;
+            /* pages that may be overwritten in place are kept until the client has read what sendfile queued:
+             * accept_th releases them once it's closed the connection */
+            if (!send_error && stored.fd != -1 && stored.in_place && zero_copy) {
+                handed_over = hand_over(client_socket, &stored, STORED_SEND_WAIT_MS) == 0;
+                if (!handed_over) wait_client_done(stream);
+            }
+            if (!handed_over) release_item(&stored);
+            if (send_error) return -1;
+            break;
+        case MODIFY_VALUE:
+            /* receive rest of client request */
+            if (recv_key(stream, &request.item) == -1 ||
+                recv_values(stream, &request.item, arena) == -1) return -1;
+
+            /* execute client request */
+            trace_received();
+            modify_item(&request, &reply);
+
+            /* send server reply */
+            trace_executed();
+            if (send_reply_header(stream, &reply) == -1) return -1;
+            break;
+        case DELETE_KEY:
+            /* receive rest of client request */
+            if (recv_key(stream, &request.item) == -1) return -1;
+
+            /* execute client request */
+            trace_received();
+            delete_item(&request, &reply);
+
+            /* send server reply */
+            trace_executed();
+            if (send_reply_header(stream, &reply) == -1) return -1;
+            break;
+        case EXIST:
+            /* receive rest of client request */
+            if (recv_key(stream, &request.item) == -1) return -1;
+
+            /* execute client request */
+            trace_received();
+            item_exists(&request, &reply);
+
+            /* send server reply */
+            trace_executed();
+            if (send_reply_header(stream, &reply) == -1) return -1;
+            break;
+        case NUM_ITEMS:
+            /* execute client request */
+            trace_received();
+            get_num_items(&reply);
+
+            /* send server reply */
+            trace_executed();
+            if (send_reply_header(stream, &reply) == -1 ||
+            send_num_items(stream, &reply) == -1) return -1;
+            break;
+        case SCAN: {
+            /* receive rest of client request */
+            if (recv_range(stream, &request.range) == -1) return -1;
+
+            /* execute client request */
+            trace_received();
+            scan_items(&request, &reply, arena);
+
+            /* send server reply; send functions convert num_items, so keep a copy */
+            trace_executed();
+            uint32_t num_items = reply.num_items;
+            int send_error = send_reply_header(stream, &reply) == -1 ||
+                    send_num_items(stream, &reply) == -1 ||
+                    send_items(stream, reply.items, num_items) == -1 ||
+                    send_cursor(stream, &reply) == -1;
+            free(reply.items);
+            if (send_error) return -1;
+            break;
+        }
+        case AGGREGATE:
+            /* receive rest of client request */
+            if (recv_aggregate(stream, &request) == -1 ||
+                recv_range(stream, &request.range) == -1) return -1;
+
+            /* execute client request */
+            trace_received();
+            aggregate_items(&request, &reply);
+
+            /* send server reply */
+            trace_executed();
+            if (send_reply_header(stream, &reply) == -1 ||
+                send_num_items(stream, &reply) == -1 ||
+                send_result(stream, &reply) == -1) return -1;
+            break;
+        case QUERY: {
+            /* receive rest of client request */
+            if (recv_range(stream, &request.range) == -1 ||
+                recv_query(stream, &request) == -1) return -1;
+
+            /* execute client request */
+            trace_received();
+            query_items(&request, &reply, arena);
+
+            /* send server reply; send functions convert num_items, so keep a copy */
+            trace_executed();
+            uint32_t num_items = reply.num_items;
+            int send_error = send_reply_header(stream, &reply) == -1 ||
+                    send_num_items(stream, &reply) == -1 ||
+                    (request.keys_only ? send_keys(stream, reply.items, num_items)
+                                       : send_items(stream, reply.items, num_items)) == -1 ||
+                    send_cursor(stream, &reply) == -1;
+            free(reply.items);
+            if (send_error) return -1;
+            break;
+        }
+        case SEARCH: {
+            /* receive rest of client request */
+            if (recv_search(stream, &request, arena) == -1) return -1;
+
+            /* execute client request */
+            trace_received();
+            search_items(&request, &reply);
+
+            /* send server reply; matching keys are streamed in chunks, ending with an empty one */
+            trace_executed();
+            uint32_t num_keys = reply.num_items;
+            int success = reply.server_error_code == SRV_SUCCESS;
+            int send_error = send_reply_header(stream, &reply) == -1;
+            reply_t chunk;
+            for (uint32_t sent = 0; !send_error && success; sent += chunk.num_items) {
+                chunk.keys = reply.keys + sent;
+                chunk.num_items = num_keys - sent < SEARCH_CHUNK_KEYS ? num_keys - sent : SEARCH_CHUNK_KEYS;
+                uint32_t chunk_size = chunk.num_items;
+                send_error = send_key_chunk(stream, &chunk) == -1;
+                chunk.num_items = chunk_size;
+                if (!chunk_size) break;
+            }
+            free(reply.keys);
+            if (send_error) return -1;
+            break;
+        }
+        case INCR:
+        case ADD:
+            /* receive rest of client request */
+            if (recv_key(stream, &request.item) == -1 ||
+                recv_delta(stream, request.header.op_code, &request.item) == -1) return -1;
+
+            /* execute client request */
+            trace_received();
+            add_to_item(&request, &reply);
+
+            /* send server reply */
+            trace_executed();
+            if (send_reply_header(stream, &reply) == -1 ||
+                send_delta(stream, reply.header.op_code, &reply.item) == -1) return -1;
+            break;
+        case UPSERT:
+            /* receive rest of client request */
+            if (recv_key(stream, &request.item) == -1 ||
+                recv_values(stream, &request.item, arena) == -1) return -1;
+
+            /* execute client request */
+            trace_received();
+            upsert_item(&request, &reply);
+
+            /* send server reply */
+            trace_executed();
+            if (send_reply_header(stream, &reply) == -1 ||
+                send_version(stream, &reply.item) == -1) return -1;
+            break;
+        case CAS:
+            /* receive rest of client request */
+            if (recv_key(stream, &request.item) == -1 ||
+                recv_values(stream, &request.item, arena) == -1 ||
+                recv_version(stream, &request.item) == -1) return -1;
+
+            /* execute client request */
+            trace_received();
+            cas_item(&request, &reply);
+
+            /* send server reply */
+            trace_executed();
+            if (send_reply_header(stream, &reply) == -1 ||
+                send_version(stream, &reply.item) == -1) return -1;
+            break;
+        case TXN: {
+            /* receive rest of client request */
+            request.ops = malloc(TXN_MAX_OPS * sizeof(txn_op_t));
+            if (!request.ops) {
+                perror("Could not allocate transaction");
+                close_stream(stream); return -1;
+            }
+            if (recv_txn_ops(stream, &request, arena) == -1) {
+                free(request.ops); return -1;
+            }
+
+            /* execute client request */
+            trace_received();
+            execute_txn(&request, &reply, arena);
+
+            /* send server reply */
+            trace_executed();
+            int send_error = send_reply_header(stream, &reply) == -1 ||
+                    send_txn_results(stream, request.ops, request.num_ops) == -1;
+            free(request.ops);
+            if (send_error) return -1;
+            break;
+        }
+        case WATCH:
+            /* receive rest of client request */
+            if (recv_range(stream, &request.range) == -1 ||
+                recv_watch(stream, &request) == -1) return -1;
+
+            /* execute client request; the connection is handed over to a watch thread */
+            start_watch(client_socket, &request, &reply);
+            if (reply.server_error_code != SRV_SUCCESS) {
+                send_reply_header(client_socket, &reply);
+                close(client_socket);
+            }
+            return 1;
+        case REPLICA_STATUS:
+            /* execute client request */
+            trace_received();
+            get_replica_status(&reply);
+
+            /* send server reply */
+            trace_executed();
+            if (send_reply_header(stream, &reply) == -1 ||
+                send_replica_status(stream, &reply) == -1) return -1;
+            break;
+        case STATS: {
+            /* execute client request */
+            trace_received();
+            server_stats_t stats;
+            reply.stats = &stats;
+            get_stats(&reply);
+
+            /* send server reply */
+            trace_executed();
+            if (send_reply_header(stream, &reply) == -1 ||
+                send_stats(stream, &reply) == -1) return -1;
+            break;
+        }
+        default:    /* invalid operation */
+            fprintf(stderr, "Requested invalid operation\n");
+            close_stream(stream); return -1;
+    } // end switch
+
+    metrics_request(request.header.op_code, accepted_ns, started_ns);
+    if (db_abandoned()) metrics_expired(request.header.op_code);
+    trace_replied();
+    return handed_over;
+}
+
+
+void init_db(reply_t *reply) {
+    if (reject_write(reply)) return;
+
+    /* execute client request */
+    metrics_lock_db();
+
+    int req_error_code = db_empty_db();
+
+    pthread_mutex_unlock(&mutex_db);
+
+    /* fill server reply */
+    set_server_error_code_std(reply, req_error_code);
+}
+
+
+void insert_item(request_t *request, reply_t *reply) {
+    if (reject_write(reply)) return;
+
+    /* execute client request */
+    metrics_lock_db();
+
+    int req_error_code = db_write_item(request->item.key, request->item.value1,
+                                       &(request->item.value2),&(request->item.value3), CREATE);
+
+    pthread_mutex_unlock(&mutex_db);
+
+    /* fill server reply */
+    set_server_error_code_std(reply, req_error_code);
+}
+
+
+void get_item(request_t *request, reply_t *reply, stored_value1_t *stored, arena_t *arena) {
+    /* execute client request */
+    metrics_lock_db();
+    db_record_read(request->item.key);
+
+    int req_error_code = db_read_item_stored(request->item.key, stored, &(reply->item.value1),
+                                             &(reply->item.value2), &(reply->item.value3), &(reply->item.version),
+                                             arena);
+
+    pthread_mutex_unlock(&mutex_db);
+
+    /* fill server reply; clients caching the item hear about its changes from a keys-only watch */
+    reply->item.key = request->item.key;
+    reply->lease_ms = req_error_code == -1 ? 0 : lease_ms;
+    set_server_error_code_std(reply, req_error_code);
+}
+
+
+void release_item(stored_value1_t *stored) {
+    /* lets storage reuse the space of a value1 sent by get_item once it's been sent */
+    if (stored->fd == -1) return;
+
+    metrics_lock_db();
+    db_release_stored(stored);
+    pthread_mutex_unlock(&mutex_db);
+}
+
+
+void modify_item(request_t *request, reply_t *reply){
+    if (reject_write(reply)) return;
+
+    /* execute client request */
+    metrics_lock_db();
+
+    int req_error_code = db_write_item(request->item.key, request->item.value1,
+                                       &(request->item.value2), &(request->item.value3), MODIFY);
+
+    pthread_mutex_unlock(&mutex_db);
+
+    /* fill server reply */
+    set_server_error_code_std(reply, req_error_code);
+}
+
+
+void delete_item(request_t *request, reply_t *reply) {
+    if (reject_write(reply)) return;
+
+    /* execute client request */
+    metrics_lock_db();
+
+    int req_error_code = db_delete_item(request->item.key);
+
+    pthread_mutex_unlock(&mutex_db);
+
+    /* fill server reply */
+    set_server_error_code_std(reply, req_error_code);
+}
+
+
+void item_exists(request_t *request, reply_t *reply) {
+    /* execute client request */
+    metrics_lock_db();
+    db_record_read(request->item.key);
+
+    int req_error_code = db_item_exists(request->item.key);
+
+    pthread_mutex_unlock(&mutex_db);
+
+    /* fill server reply */
+    switch (req_error_code) {
+        case 1: reply->server_error_code = SRV_EXISTS; break;
+        case 0: reply->server_error_code = SRV_NOT_EXISTS; break;
+        default: break;
+    }
+}
+
+
+void get_num_items(reply_t *reply) {
+    /* execute client request */
+    metrics_lock_db();
+
+    int num_items = db_get_num_items();
+
+    pthread_mutex_unlock(&mutex_db);
+
+    /* fill server reply */
+    if (num_items == -1) reply->server_error_code = SRV_ERROR;
+    else {
+        reply->server_error_code = SRV_SUCCESS;
+        reply->num_items = num_items;
+    }
+}
+
+
+void scan_items(request_t *request, reply_t *reply, arena_t *arena) {
+    /* clamp page size to what the server is willing to send at once */
+    uint32_t max_items = request->range.max_items;
+    if (!max_items || max_items > SCAN_MAX_ITEMS) max_items = SCAN_MAX_ITEMS;
+
+    reply->num_items = 0;
+    reply->more = FALSE;
+    reply->cursor = request->range.hi;
+    reply->items = malloc(max_items * sizeof(item_t));
+    if (!reply->items) {
+        perror("Could not allocate scan page");
+        reply->server_error_code = SRV_ERROR; return;
+    }
+
+    /* execute client request */
+    metrics_lock_db();
+
+    int more;
+    int num_items = db_scan_items(request->range.lo, request->range.hi, reply->items, (int) max_items, &more,
+                                  arena);
+
+    pthread_mutex_unlock(&mutex_db);
+
+    /* fill server reply */
+    if (num_items == -1) reply->server_error_code = SRV_ERROR;
+    else {
+        reply->server_error_code = SRV_SUCCESS;
+        reply->num_items = num_items;
+        reply->more = (uint8_t) more;
+        /* next page starts right after the last key sent */
+        if (more) reply->cursor = reply->items[num_items - 1].key + 1;
+    }
+}
+
+
+void aggregate_items(request_t *request, reply_t *reply) {
+    /* execute client request */
+    metrics_lock_db();
+
+    int num_items = db_aggregate(request->agg_function, request->agg_field,
+                                 request->range.lo, request->range.hi, &reply->result);
+
+    pthread_mutex_unlock(&mutex_db);
+
+    /* fill server reply */
+    if (num_items == -1) {
+        reply->server_error_code = SRV_ERROR;
+        reply->num_items = 0;
+        reply->result = 0;
+    } else {
+        reply->server_error_code = SRV_SUCCESS;
+        reply->num_items = num_items;
+    }
+}
+
+
+void query_items(request_t *request, reply_t *reply, arena_t *arena) {
+    /* clamp page size to what the server is willing to send at once */
+    uint32_t max_items = request->range.max_items;
+    if (!max_items || max_items > SCAN_MAX_ITEMS) max_items = SCAN_MAX_ITEMS;
+
+    reply->num_items = 0;
+    reply->more = FALSE;
+    reply->cursor = request->cursor;
+    reply->items = malloc(max_items * sizeof(item_t));
+    if (!reply->items) {
+        perror("Could not allocate query page");
+        reply->server_error_code = SRV_ERROR; return;
+    }
+
+    /* execute client request */
+    metrics_lock_db();
+
+    int more;
+    int num_items = db_query_items(request->range.lo, request->range.hi, request->cursor, request->keys_only,
+                                   reply->items, (int) max_items, &more, &reply->cursor, arena);
+
+    pthread_mutex_unlock(&mutex_db);
+
+    /* fill server reply */
+    if (num_items == -1) reply->server_error_code = SRV_ERROR;
+    else {
+        reply->server_error_code = SRV_SUCCESS;
+        reply->num_items = num_items;
+        reply->more = (uint8_t) more;
+    }
+}
+
+
+void search_items(request_t *request, reply_t *reply) {
+    /* execute client request; only the search runs under the DB lock, keys are sent afterwards */
+    metrics_lock_db();
+
+    int num_keys = db_search_items(request->search_mode, request->item.value1, &reply->keys);
+
+    pthread_mutex_unlock(&mutex_db);
+
+    /* fill server reply */
+    if (num_keys == -1) {
+        reply->server_error_code = SRV_ERROR;
+        reply->num_items = 0;
+        reply->keys = NULL;
+    } else {
+        reply->server_error_code = SRV_SUCCESS;
+        reply->num_items = num_keys;
+    }
+}
+
+
+void add_to_item(request_t *request, reply_t *reply) {
+    if (reject_write(reply)) return;
+
+    /* execute client request; read & write happen under the same lock, so concurrent updates aren't lost */
+    metrics_lock_db();
+
+    int req_error_code = request->header.op_code == INCR
+            ? db_incr_item(request->item.key, request->item.value2, &(reply->item.value2))
+            : db_add_item(request->item.key, request->item.value3, &(reply->item.value3));
+
+    pthread_mutex_unlock(&mutex_db);
+
+    /* fill server reply */
+    reply->item.key = request->item.key;
+    set_server_error_code_std(reply, req_error_code);
+}
+
+
+void upsert_item(request_t *request, reply_t *reply) {
+    if (reject_write(reply)) return;
+
+    /* execute client request */
+    metrics_lock_db();
+
+    int req_error_code = db_upsert_item(request->item.key, request->item.value1,
+                                        &(request->item.value2), &(request->item.value3), &(reply->item.version));
+
+    pthread_mutex_unlock(&mutex_db);
+
+    /* fill server reply */
+    set_server_error_code_std(reply, req_error_code);
+}
+
+
+void cas_item(request_t *request, reply_t *reply) {
+    /* execute client request; version checked & item written under the same lock */
+    reply->item.version = request->item.version;
+    if (reject_write(reply)) return;
+
+    metrics_lock_db();
+
+    int req_error_code = db_cas_item(request->item.key, request->item.value1,
+                                     &(request->item.value2), &(request->item.value3), &(reply->item.version));
+
+    pthread_mutex_unlock(&mutex_db);
+
+    /* fill server reply */
+    if (req_error_code == 1) reply->server_error_code = SRV_CONFLICT;
+    else set_server_error_code_std(reply, req_error_code);
+}
+
+
+void execute_txn(request_t *request, reply_t *reply, arena_t *arena) {
+    /* only transactions made of reads & comparisons may run on a replica */
+    for (uint32_t i = 0; i < request->num_ops; i++) {
+        char op_code = request->ops[i].op_code;
+        if (op_code == GET_VALUE || op_code == TXN_COMPARE) continue;
+        if (reject_write(reply)) {
+            for (uint32_t j = 0; j < request->num_ops; j++) request->ops[j].result = SRV_ABORTED;
+            return;
+        }
+        break;
+    }
+
+    /* execute client request; every sub-operation runs under a single DB lock acquisition */
+    metrics_lock_db();
+
+    int req_error_code = db_execute_txn(request->ops, (int) request->num_ops, arena);
+
+    pthread_mutex_unlock(&mutex_db);
+
+    /* fill server reply */
+    if (req_error_code == 1) reply->server_error_code = SRV_CONFLICT;
+    else set_server_error_code_std(reply, req_error_code);
+}
+
+
+void start_watch(const int client_socket, request_t *request, reply_t *reply) {
+    reply->server_error_code = SRV_ERROR;
+
+    watcher_t *watcher = malloc(sizeof(watcher_t));
+    if (!watcher) {
+        perror("Could not allocate watcher"); return;
+    }
+    watcher->socket = client_socket;
+    watcher->id = request->header.id;
+    watcher->lo = request->range.lo;
+    watcher->hi = request->range.hi;
+    watcher->next_seq = request->seq;
+    watcher->keys_only = request->keys_only;
+
+    pthread_mutex_lock(&mutex_watchers);
+    if (num_watchers == MAX_WATCHERS) {
+        pthread_mutex_unlock(&mutex_watchers);
+        fprintf(stderr, "Too many watchers\n");
+        free(watcher); return;
+    }
+    num_watchers++;
+    pthread_mutex_unlock(&mutex_watchers);
+
+    /* the watch thread sends the reply header itself, so nothing is sent to the client concurrently */
+    pthread_t thread;
+    if (pthread_create(&thread, &th_attr, watch_thread, watcher) != 0) {
+        perror("Could not create watch thread");
+        pthread_mutex_lock(&mutex_watchers);
+        if (--num_watchers == 0) pthread_cond_broadcast(&cond_no_watchers);
+        pthread_mutex_unlock(&mutex_watchers);
+        free(watcher); return;
+    }
+    reply->server_error_code = SRV_SUCCESS;
+}
+
+
+void get_replica_status(reply_t *reply) {
+    /* only replicas have a replication status */
+    if (!replica_is_running()) {
+        memset(&reply->replica, 0, sizeof(replica_status_t));
+        reply->server_error_code = SRV_ERROR; return;
+    }
+    replica_get_status(&reply->replica);
+    reply->server_error_code = SRV_SUCCESS;
+}
+
+
+void get_stats(reply_t *reply) {
+    metrics_read(reply->stats);
+    reply->server_error_code = SRV_SUCCESS;
+}
+
+
+static int client_gone(const int client_socket) {
+    /* watch clients never send anything, so a readable socket means they closed it */
+    struct pollfd pfd = {.fd = client_socket, .events = POLLIN};
+    return poll(&pfd, 1, 0) != 0;
+}
+
+
+void *watch_thread(void *args) {
+    /* pushes the changes to the watched keys to the client, from the requested sequence number on;
+     * changes are read from the DB change log in batches, without holding the DB lock */
+    watcher_t *watcher = (watcher_t *) args;
+    change_t *changes = malloc(WATCH_BATCH * sizeof(change_t));
+    arena_t arena;      /* value1 strings of the batch being sent */
+    arena_init(&arena);
+
+    /* reply with the position the watch starts from, so the client can resume from it */
+    request_t start;
+    if (!watcher->next_seq) watcher->next_seq = db_next_change_seq();
+    start.seq = watcher->next_seq;
+
+    reply_t reply;
+    reply.header.id = watcher->id;
+    reply.header.op_code = WATCH;
+    reply.server_error_code = changes ? SRV_SUCCESS : SRV_ERROR;
+    int send_error = send_reply_header(watcher->socket, &reply) == -1 ||
+            send_seq(watcher->socket, &start) == -1;
+
+    /* watches end when the server is stopped, at most WATCH_POLL_MS later */
+    while (changes && !send_error && !__atomic_load_n(&stopping, __ATOMIC_RELAXED)) {
+        uint64_t missed;
+        arena_reset(&arena);
+        int num_changes = db_read_changes(watcher->next_seq, watcher->lo, watcher->hi, changes, WATCH_BATCH,
+                                          &watcher->next_seq, &missed, WATCH_POLL_MS, &arena);
+        if (num_changes == -1) break;
+
+        /* the watcher fell too far behind: tell it how many changes it lost */
+        if (missed) {
+            change_t lagged = {.seq = watcher->next_seq - missed, .op_code = WATCH_LAGGED, .lag = missed};
+            send_error = send_change(watcher->socket, &lagged) == -1;
+        }
+        for (int i = 0; i < num_changes && !send_error; i++) {
+            if (watcher->keys_only && changes[i].op_code != INIT) changes[i].op_code = WATCH_KEY_CHANGED;
+            send_error = send_change(watcher->socket, &changes[i]) == -1;
+        }
+
+        if (!num_changes && !missed && client_gone(watcher->socket)) break;
+    }
+
+    /* send functions close the socket when they fail */
+    if (!send_error) close(watcher->socket);
+    arena_free(&arena);
+    free(changes);
+    free(watcher);
+
+    pthread_mutex_lock(&mutex_watchers);
+    if (--num_watchers == 0) pthread_cond_broadcast(&cond_no_watchers);
+    pthread_mutex_unlock(&mutex_watchers);
+    pthread_exit(NULL);
+}
+
+
+int reject_request(const int stream) {
+    /* replies SRV_BUSY to stream without reading the request; returns -1 on error */
+    reply_t reply;
+    reply.header.id = 0;
+    reply.header.op_code = 0;
+    reply.server_error_code = SRV_BUSY;
+    return send_reply_header(stream, &reply);
+}
+
+
+static int reject_conn(const int client_socket) {
+    /* replies SRV_BUSY without waiting for the request; returns -1 if the connection was closed meanwhile */
+    if (reject_request(client_socket) == -1) return -1;
+    shutdown(client_socket, SHUT_WR);
+    return 0;
+}
+
+
+static void *accept_thread(void *args) {
+    /* queues every connection accepted for the service threads, until the server socket is shut down.
+     * rejected connections, its own & the ones service threads hand over, are kept until their client closes
+     * them, reading its request meanwhile: closing them with data left unread would reset them,
+     * and the client could lose the reply. GET connections handed over release their pages once closed */
+    int producer_pos = 0;   /* conn_q position used to enqueue connections */
+    struct pollfd fds[2 + REJECTED_MAX];        /* server socket, wake_pipe, then rejected connections */
+    handed_t rejected[2 + REJECTED_MAX];        /* each rejected connection, at the same position */
+    int num_fds = 2;
+    fds[0].fd = server_sd;
+    fds[0].events = POLLIN;
+    fds[1].fd = wake_pipe[0];
+    fds[1].events = POLLIN;
+
+    /* a connection poll reported may be gone by the time it's accepted, and accept mustn't block then */
+    fcntl(server_sd, F_SETFL, fcntl(server_sd, F_GETFL) | O_NONBLOCK);
+
+    pthread_mutex_lock(&mutex_rejected);
+    rejecting = TRUE;
+    pthread_mutex_unlock(&mutex_rejected);
+
+    while (TRUE) {
+        if (poll(fds, num_fds, num_fds > 2 ? REJECTED_WAIT_MS : -1) == -1 && errno != EINTR) {
+            perror("Server poll error"); break;
+        }
+
+        uint64_t now = clock_ns();
+        int closed = 0;
+        for (int i = num_fds - 1; i > 1; i--) {
+            if ((fds[i].revents && rejected_done(fds[i].fd)) || now > rejected[i].until_ns) {
+                close(fds[i].fd);
+                release_item(&rejected[i].stored);
+                closed++;
+                num_fds--;
+                fds[i] = fds[num_fds];
+                rejected[i] = rejected[num_fds];
+            }
+        }
+
+        /* take the connections handed over */
+        char buf[REJECTED_MAX];
+        if (fds[1].revents) while (read(wake_pipe[0], buf, sizeof(buf)) > 0);
+        pthread_mutex_lock(&mutex_rejected);
+        num_rejected -= closed;
+        for (int i = 0; i < num_handed; i++) {
+            fds[num_fds].fd = handed[i].socket;
+            fds[num_fds].events = POLLIN;
+            rejected[num_fds++] = handed[i];
+        }
+        num_handed = 0;
+        pthread_mutex_unlock(&mutex_rejected);
+        if (!fds[0].revents) continue;
+
+        int client_sd = accept(server_sd, NULL, NULL);
+        if (client_sd == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ECONNABORTED) continue;
+            if (!__atomic_load_n(&stopping, __ATOMIC_RELAXED)) perror("Server accept error");
+            break;
+        }
+        uint64_t accepted_ns = clock_ns();
+
+        /* add connection to conn_q backlog */
+        pthread_mutex_lock(&mutex_conn_q);
+
+        /* if the connection queue is full, the connection is rejected instead of waiting for room,
+         * so that accepting never stops and clients know the server is busy */
+        if (conn_q_size >= queue_limit) {
+            pthread_mutex_unlock(&mutex_conn_q);
+            metrics_conn_q_full();
+            if (reject_conn(client_sd) == -1) continue;
+
+            pthread_mutex_lock(&mutex_rejected);
+            int full = num_rejected == REJECTED_MAX;
+            if (!full) num_rejected++;
+            pthread_mutex_unlock(&mutex_rejected);
+            if (full) {
+                /* too many to keep: the request is read if it arrived already */
+                rejected_done(client_sd);
+                close(client_sd); continue;
+            }
+            fds[num_fds].fd = client_sd;
+            fds[num_fds].events = POLLIN;
+            rejected[num_fds].socket = client_sd;
+            rejected[num_fds].until_ns = accepted_ns + REJECTED_WAIT_MS * 1000000ULL;
+            rejected[num_fds++].stored.fd = -1;
+            continue;
+        }
+
+        /* enqueue new connection */
+        conn_q[producer_pos] = client_sd;
+        conn_q_accepted[producer_pos] = accepted_ns;
+        producer_pos = (producer_pos + 1) % MAX_CONN_BACKLOG;
+        __atomic_store_n(&conn_q_size, conn_q_size + 1, __ATOMIC_RELAXED);
+        metrics_conn_q_depth(conn_q_size);
+
+        /* signal that there are connections to handle */
+        if (conn_q_size == 1)
+            pthread_cond_signal(&cond_conn_q_not_empty);
+
+        pthread_mutex_unlock(&mutex_conn_q);
+    } // END while
+
+    /* service threads keep the connections they'd hand over from now on */
+    pthread_mutex_lock(&mutex_rejected);
+    rejecting = FALSE;
+    for (int i = 0; i < num_handed; i++) rejected[num_fds++] = handed[i];
+    num_handed = 0;
+    num_rejected = 0;
+    pthread_mutex_unlock(&mutex_rejected);
+    for (int i = 2; i < num_fds; i++) {
+        close(rejected[i].socket);
+        release_item(&rejected[i].stored);
+    }
+    return NULL;
+}
+
+
+static void *ring_thread(void *args) {
+    net_ring_run();
+    return NULL;
+}
+
+
+static int open_server_socket(const int port, int *bound_port) {
+    /* returns a socket listening on port, or on a free one if port is 0; bound_port is set to the port used */
+    struct sockaddr_in server_addr;
+    socklen_t addr_size = sizeof(struct sockaddr_in);
+    int val = 1;
+    int sd;
+
+    if ((sd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)) == -1) {
+        perror("Can't create server socket"); return -1;
+    }
+
+    setsockopt(sd, SOL_SOCKET, SO_REUSEADDR, (char *) &val, sizeof(int));
+
+    bzero((char *) &server_addr, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_addr.s_addr = INADDR_ANY;
+    server_addr.sin_port = htons(port);
+
+    if (bind(sd, (struct sockaddr *) &server_addr, sizeof server_addr) == -1) {
+        perror("Server socket binding error");
+        close(sd); return -1;
+    }
+
+    /* connections are taken as fast as they come, or rejected, so the kernel may queue as many as it likes */
+    if (listen(sd, SOMAXCONN) == -1) {
+        perror("Server listen error");
+        close(sd); return -1;
+    }
+
+    if (getsockname(sd, (struct sockaddr *) &server_addr, &addr_size) == -1) {
+        perror("Could not get server port");
+        close(sd); return -1;
+    }
+    *bound_port = ntohs(server_addr.sin_port);
+    return sd;
+}
+
+
+void kv_server_default_config(kv_server_config_t *config) {
+    memset(config, 0, sizeof(kv_server_config_t));
+    config->threads = KV_SERVER_THREADS;
+    config->engine = FILE_ENGINE;
+    config->zero_copy = TRUE;
+    config->lease_ms = KV_SERVER_LEASE_MS;
+    config->hot_keys = KV_SERVER_HOT_KEYS;
+}
+
+
+int kv_server_start(const kv_server_config_t *config) {
+    /* opens the DB and starts serving on the configured port; returns the port, -1 on error */
+    int port;
+    if (server_sd != -1) {
+        fprintf(stderr, "Server already running\n"); return -1;
+    }
+    queue_limit = config->queue_limit ? config->queue_limit : KV_SERVER_QUEUE_LIMIT;
+    write_limit = config->write_limit ? config->write_limit : (queue_limit * 3 + 3) / 4;
+    bulk_limit = config->bulk_limit ? config->bulk_limit : (queue_limit + 1) / 2;
+    /* the ring must take a request with the longest value1 */
+    size_t request_min_len = get_value1_max_len() + REQUEST_MAX_OVERHEAD;
+    size_t request_max_len = config->request_max_len ? (size_t) config->request_max_len :
+                             request_min_len > NET_RING_REQUEST_MAX_LEN ? request_min_len : NET_RING_REQUEST_MAX_LEN;
+    if (config->threads < 0 || config->dump_interval < 0 || config->slow_us < 0 || config->lease_ms < 0 ||
+        config->search_len < 0 ||
+        queue_limit > MAX_CONN_BACKLOG || bulk_limit < 1 || bulk_limit > write_limit || write_limit > queue_limit ||
+        config->request_max_len < 0 || request_max_len < request_min_len) {
+        fprintf(stderr, "Invalid server configuration\n"); return -1;
+    }
+    zero_copy = config->zero_copy;
+    net_ring = config->net_ring;
+    /* replicas may be behind their primary already, and clients hear about changes from the primary */
+    lease_ms = config->primary ? 0 : (uint32_t) config->lease_ms;
+    stopping = FALSE;
+    conn_q_size = 0;
+    service_th_pos = 0;
+
+    /* get storage engine ready */
+    db_set_search_len((uint32_t) config->search_len);
+    if (db_open(config->storage_path, config->engine, config->io_ring) == -1 ||
+        db_set_value2_index(config->value2_index) == -1 || db_set_hot_keys(config->hot_keys) == -1) {
+        fprintf(stderr, "Could not open DB\n");
+        db_close(); return -1;
+    }
+
+    /* clients may close their connection at any time, watch clients in particular;
+     * writing to it must fail instead of killing the process */
+    signal(SIGPIPE, SIG_IGN);
+
+    /* get server up & running; kv_server_stop undoes whatever is done from here on */
+    if ((server_sd = open_server_socket(config->port, &port)) == -1) {
+        db_close(); return -1;
+    }
+
+    /* long value1 strings are received next to the DB, a chunk at a time, rather than into memory */
+    if (set_value1_spool_dir(config->storage_path ? config->storage_path : ".") == -1) {
+        kv_server_stop(); return -1;
+    }
+
+    /* watch threads are detached */
+    pthread_attr_init(&th_attr);
+    pthread_attr_setdetachstate(&th_attr, PTHREAD_CREATE_DETACHED);
+
+    if (net_ring && net_ring_open(server_sd, config->threads ? config->threads : KV_SERVER_THREADS, queue_limit,
+                                  request_max_len) == -1) {
+        perror("io_uring networking not available, using service threads");
+        net_ring = FALSE;
+    }
+    /* GET replies are built in memory, so that the ring sends them */
+    if (net_ring) zero_copy = FALSE;
+
+    /* requests are traced from the first one served */
+    if (config->slow_us && slow_log_start((uint64_t) config->slow_us) == -1) {
+        kv_server_stop(); return -1;
+    }
+
+    /* service threads wake accept_th up through wake_pipe, which mustn't block them if it's full */
+    if (!net_ring && pipe(wake_pipe) == -1) {
+        perror("Could not create wake pipe");
+        kv_server_stop(); return -1;
+    }
+    for (int i = 0; !net_ring && i < 2; i++) fcntl(wake_pipe[i], F_SETFL, fcntl(wake_pipe[i], F_GETFL) | O_NONBLOCK);
+
+    /* now create thread pool; the ring has its own */
+    int num_threads = net_ring ? 0 : config->threads ? config->threads : KV_SERVER_THREADS;
+    thread_pool = malloc((num_threads + 1) * sizeof(pthread_t));
+    serving = malloc((num_threads + 1) * sizeof(int));
+    if (!thread_pool || !serving) {
+        perror("Could not allocate thread pool");
+        kv_server_stop(); return -1;
+    }
+    for (thread_pool_size = 0; thread_pool_size < num_threads; thread_pool_size++) {
+        serving[thread_pool_size] = -1;
+        if (pthread_create(&thread_pool[thread_pool_size], NULL, service_thread,
+                           (void *) (intptr_t) thread_pool_size) != 0) {
+            perror("Could not create service thread");
+            kv_server_stop(); return -1;
+        }
+    }
+
+    if (pthread_create(&accept_th, NULL, net_ring ? ring_thread : accept_thread, NULL) != 0) {
+        perror("Could not create accept thread");
+        kv_server_stop(); return -1;
+    }
+    accepting = TRUE;
+
+    if (config->dump_interval && metrics_dump_start(config->dump_interval) == -1) {
+        kv_server_stop(); return -1;
+    }
+
+    /* replicas start copying the primary's DB right away */
+    if (config->primary && replica_start(config->primary) == -1) {
+        kv_server_stop(); return -1;
+    }
+    return port;
+}
+
+
+int kv_server_stop(void) {
+    /* stops accepting connections, lets the ones accepted so far be served and the watches end,
+     * then closes the DB; also undoes a kv_server_start that failed halfway */
+    if (server_sd == -1) return 0;
+
+    /* accepting stops once the server socket is shut down */
+    pthread_mutex_lock(&mutex_conn_q);
+    __atomic_store_n(&stopping, TRUE, __ATOMIC_RELAXED);
+    pthread_cond_broadcast(&cond_conn_q_not_empty);
+    pthread_mutex_unlock(&mutex_conn_q);
+    if (net_ring) net_ring_stop();
+    else shutdown(server_sd, SHUT_RDWR);
+
+    if (accepting) pthread_join(accept_th, NULL);
+    accepting = FALSE;
+    if (net_ring) net_ring_close();
+
+    /* requests already received are still served; clients that didn't send theirs yet won't be waited for */
+    pthread_mutex_lock(&mutex_conn_q);
+    for (int i = 0; i < thread_pool_size; i++) {
+        if (serving[i] != -1) shutdown(serving[i], SHUT_RD);
+    }
+    pthread_mutex_unlock(&mutex_conn_q);
+    for (int i = 0; i < thread_pool_size; i++) pthread_join(thread_pool[i], NULL);
+    free(thread_pool);
+    free(serving);
+    thread_pool = NULL;
+    serving = NULL;
+    thread_pool_size = 0;
+
+    /* no more watchers are started once the requests are all served */
+    pthread_mutex_lock(&mutex_watchers);
+    while (num_watchers)
+        pthread_cond_wait(&cond_no_watchers, &mutex_watchers);
+    pthread_mutex_unlock(&mutex_watchers);
+
+    replica_stop();
+    metrics_dump_stop();
+    slow_log_stop();
+
+    close(server_sd);
+    server_sd = -1;
+    set_value1_spool_dir(NULL);
+    for (int i = 0; i < 2; i++) {
+        if (wake_pipe[i] != -1) close(wake_pipe[i]);
+        wake_pipe[i] = -1;
+    }
+    pthread_attr_destroy(&th_attr);
+    return db_close();
+}
@@ -0,0 +1,309 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "DS-MandatoryExercise/utils.h"
+#include "DS-MandatoryExercise/metrics.h"
+#include "DS-MandatoryExercise/trace.h"
+#include "DS-MandatoryExercise/dbms/dbms.h"
+
+extern pthread_mutex_t mutex_db;            /* DB lock, owned by the server */
+
+typedef struct {
+    server_stats_t stats;                   /* counters of one thread; conn_q depths & storage I/O aren't among them */
+    int in_use;
+} slot_t;
+
+static pthread_mutex_t mutex_slots = PTHREAD_MUTEX_INITIALIZER;
+static slot_t slots[METRICS_MAX_THREADS];
+static server_stats_t retired;              /* counters of the threads that exited */
+static pthread_once_t slot_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t slot_key;              /* gives the slot of a thread back when it exits */
+static _Thread_local slot_t *slot;          /* slot of the calling thread; NULL until it records something */
+static _Thread_local int no_slot = FALSE;   /* TRUE if there was no slot left for the calling thread */
+
+static uint64_t conn_q_depth;               /* written with mutex_conn_q held */
+static uint64_t conn_q_max_depth;
+
+static pthread_t dump_th;
+static int dumping = FALSE;                 /* TRUE while dump_th runs */
+static pthread_mutex_t mutex_dump = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond_dump_stop = PTHREAD_COND_INITIALIZER;
+static int dump_stopping;                   /* guarded by mutex_dump */
+
+static const char *op_names[STATS_NUM_OPS] = {
+        "init", "set_value", "get_value", "modify_value", "delete_key", "exist", "num_items", "scan", "aggregate",
+        "query", "search", "incr", "add", "upsert", "cas", "txn", "watch", "replica_status", "stats"
+};
+
+
+static void add_stats(server_stats_t *total, const server_stats_t *stats) {
+    /* adds the counters kept per thread to total */
+    for (int i = 0; i < STATS_NUM_OPS; i++) {
+        total->requests[i] += __atomic_load_n(&stats->requests[i], __ATOMIC_RELAXED);
+        total->busy[i] += __atomic_load_n(&stats->busy[i], __ATOMIC_RELAXED);
+        total->expired[i] += __atomic_load_n(&stats->expired[i], __ATOMIC_RELAXED);
+        histogram_merge(&total->service[i], &stats->service[i]);
+        histogram_merge(&total->end_to_end[i], &stats->end_to_end[i]);
+    }
+    histogram_merge(&total->conn_q_wait, &stats->conn_q_wait);
+    total->conn_q_full += __atomic_load_n(&stats->conn_q_full, __ATOMIC_RELAXED);
+    histogram_merge(&total->db_lock_wait, &stats->db_lock_wait);
+}
+
+
+static void release_slot(void *arg) {
+    /* the counters of an exiting thread are kept, and its slot is given to the next thread that needs one */
+    slot_t *released = (slot_t *) arg;
+
+    pthread_mutex_lock(&mutex_slots);
+    add_stats(&retired, &released->stats);
+    released->in_use = FALSE;
+    pthread_mutex_unlock(&mutex_slots);
+}
+
+
+static void create_slot_key(void) {
+    pthread_key_create(&slot_key, release_slot);
+}
+
+
+static server_stats_t *thread_stats(void) {
+    /* counters of the calling thread, which gets a slot the first time it records something;
+     * NULL if every slot is taken */
+    if (slot) return &slot->stats;
+    if (no_slot) return NULL;
+    pthread_once(&slot_key_once, create_slot_key);
+
+    pthread_mutex_lock(&mutex_slots);
+    for (int i = 0; i < METRICS_MAX_THREADS && !slot; i++) {
+        if (slots[i].in_use) continue;
+        memset(&slots[i].stats, 0, sizeof(server_stats_t));
+        slots[i].in_use = TRUE;
+        slot = &slots[i];
+    }
+    pthread_mutex_unlock(&mutex_slots);
+
+    if (!slot) {
+        no_slot = TRUE; return NULL;
+    }
+    pthread_setspecific(slot_key, slot);
+    return &slot->stats;
+}
+
+
+void metrics_request(const char op_code, const uint64_t accepted_ns, const uint64_t started_ns) {
+    /* records a request whose reply was just written; its connection was accepted at accepted_ns,
+     * and the server started serving it at started_ns */
+    server_stats_t *stats = thread_stats();
+    if (!stats || op_code < INIT || op_code > STATS) return;
+
+    uint64_t now = clock_ns();
+    int op = op_code - INIT;
+    __atomic_store_n(&stats->requests[op], stats->requests[op] + 1, __ATOMIC_RELAXED);
+    histogram_add(&stats->service[op], now - started_ns);
+    histogram_add(&stats->end_to_end[op], now - accepted_ns);
+}
+
+
+void metrics_busy(const char op_code) {
+    /* records a request that was shed */
+    server_stats_t *stats = thread_stats();
+    if (!stats || op_code < INIT || op_code > STATS) return;
+    __atomic_store_n(&stats->busy[op_code - INIT], stats->busy[op_code - INIT] + 1, __ATOMIC_RELAXED);
+}
+
+
+void metrics_expired(const char op_code) {
+    /* records a request that was dropped, or whose storage work was abandoned, because its deadline passed */
+    server_stats_t *stats = thread_stats();
+    if (!stats || op_code < INIT || op_code > STATS) return;
+    __atomic_store_n(&stats->expired[op_code - INIT], stats->expired[op_code - INIT] + 1, __ATOMIC_RELAXED);
+}
+
+
+void metrics_conn_q_full(void) {
+    /* records a connection that was rejected because conn_q was full */
+    server_stats_t *stats = thread_stats();
+    if (stats) __atomic_store_n(&stats->conn_q_full, stats->conn_q_full + 1, __ATOMIC_RELAXED);
+}
+
+
+void metrics_conn_q_wait(const uint64_t wait_ns) {
+    server_stats_t *stats = thread_stats();
+    if (stats) histogram_add(&stats->conn_q_wait, wait_ns);
+}
+
+
+void metrics_conn_q_depth(const int depth) {
+    /* called with mutex_conn_q held whenever conn_q grows or shrinks */
+    __atomic_store_n(&conn_q_depth, (uint64_t) depth, __ATOMIC_RELAXED);
+    if ((uint64_t) depth > conn_q_max_depth) __atomic_store_n(&conn_q_max_depth, (uint64_t) depth, __ATOMIC_RELAXED);
+}
+
+
+void metrics_lock_db(void) {
+    /* locks mutex_db, recording how long it took; the clock is only read if the lock is taken */
+    uint64_t wait = 0;
+    if (pthread_mutex_trylock(&mutex_db)) {
+        uint64_t start = clock_ns();
+        pthread_mutex_lock(&mutex_db);
+        wait = clock_ns() - start;
+    }
+
+    server_stats_t *stats = thread_stats();
+    if (stats) histogram_add(&stats->db_lock_wait, wait);
+    trace_lock_wait(wait);
+}
+
+
+const char *metrics_op_name(const char op_code) {
+    return op_code < INIT || op_code > STATS ? "invalid" : op_names[op_code - INIT];
+}
+
+
+void metrics_read(server_stats_t *stats) {
+    /* adds up the counters of every thread, the ones that exited included; must not be called with mutex_db held */
+    memset(stats, 0, sizeof(server_stats_t));
+
+    pthread_mutex_lock(&mutex_slots);
+    add_stats(stats, &retired);
+    for (int i = 0; i < METRICS_MAX_THREADS; i++) {
+        if (slots[i].in_use) add_stats(stats, &slots[i].stats);
+    }
+    pthread_mutex_unlock(&mutex_slots);
+
+    stats->conn_q_depth = __atomic_load_n(&conn_q_depth, __ATOMIC_RELAXED);
+    stats->conn_q_max_depth = __atomic_load_n(&conn_q_max_depth, __ATOMIC_RELAXED);
+
+    pthread_mutex_lock(&mutex_db);
+    db_get_io_time(&stats->storage_io);
+    db_get_hot_keys(stats);
+    pthread_mutex_unlock(&mutex_db);
+}
+
+
+static double percentile_us(const histogram_t *histogram, const double fraction) {
+    /* upper bound of the bucket holding the given fraction of the latencies */
+    uint64_t rank = (uint64_t) ((double) histogram->count * fraction), seen = 0;
+    for (int i = 0; i < STATS_BUCKETS; i++) {
+        seen += histogram->buckets[i];
+        if (seen > rank || i == STATS_BUCKETS - 1) return (double) (1 << i);
+    }
+    return 0;
+}
+
+
+static void print_histogram(FILE *file, const char *name, const histogram_t *histogram) {
+    if (!histogram->count) {
+        fprintf(file, "%-16s %12d %12s %12s %12s\n", name, 0, "-", "-", "-"); return;
+    }
+    double avg = (double) histogram->total_ns / (double) histogram->count / 1000;
+    fprintf(file, "%-16s %12lu %12.1f %12.0f %12.0f\n", name, (unsigned long) histogram->count, avg,
+            percentile_us(histogram, 0.5), percentile_us(histogram, 0.99));
+}
+
+
+static int dump_stats(const server_stats_t *stats) {
+    /* writes stats to STATS_FILE_NAME, replacing the previous dump at once */
+    FILE *file = fopen(STATS_FILE_NAME ".tmp", "w");
+    if (!file) return -1;
+
+    fprintf(file, "time %ld\n\n", (long) time(NULL));
+    fprintf(file, "%-16s %12s %12s %12s %12s\n", "service", "requests", "avg us", "p50 us", "p99 us");
+    for (int i = 0; i < STATS_NUM_OPS; i++) {
+        if (stats->requests[i]) print_histogram(file, op_names[i], &stats->service[i]);
+    }
+    fprintf(file, "\n%-16s %12s %12s %12s %12s\n", "end to end", "requests", "avg us", "p50 us", "p99 us");
+    for (int i = 0; i < STATS_NUM_OPS; i++) {
+        if (stats->requests[i]) print_histogram(file, op_names[i], &stats->end_to_end[i]);
+    }
+    fprintf(file, "\n%-16s %12s %12s %12s %12s\n", "waits", "count", "avg us", "p50 us", "p99 us");
+    print_histogram(file, "conn_q", &stats->conn_q_wait);
+    print_histogram(file, "db_lock", &stats->db_lock_wait);
+    print_histogram(file, "storage_io", &stats->storage_io);
+    fprintf(file, "\nconn_q depth %lu, max %lu, rejected when full %lu\n", (unsigned long) stats->conn_q_depth,
+            (unsigned long) stats->conn_q_max_depth, (unsigned long) stats->conn_q_full);
+    fprintf(file, "\n%-16s %12s\n", "shed", "requests");
+    for (int i = 0; i < STATS_NUM_OPS; i++) {
+        if (stats->busy[i]) fprintf(file, "%-16s %12lu\n", op_names[i], (unsigned long) stats->busy[i]);
+    }
+    fprintf(file, "\n%-16s %12s\n", "expired", "requests");
+    for (int i = 0; i < STATS_NUM_OPS; i++) {
+        if (stats->expired[i]) fprintf(file, "%-16s %12lu\n", op_names[i], (unsigned long) stats->expired[i]);
+    }
+    uint64_t reads = stats->hot_reads + stats->cold_reads;
+    fprintf(file, "\nhot keys %lu, items read %lu, from pinned copies %.1f%%\n", (unsigned long) stats->hot_num_keys,
+            (unsigned long) reads, reads ? 100.0 * (double) stats->hot_reads / (double) reads : 0.0);
+    fprintf(file, "%-16s %12s\n", "hot key", "reads");
+    for (uint64_t i = 0; i < stats->hot_num_keys && i < STATS_HOT_KEYS; i++) {
+        fprintf(file, "%-16d %12lu\n", (int32_t) stats->hot_keys[i], (unsigned long) stats->hot_counts[i]);
+    }
+
+    if (fclose(file) == EOF) return -1;
+    return rename(STATS_FILE_NAME ".tmp", STATS_FILE_NAME);
+}
+
+
+static int wait_dump(const int interval_s) {
+    /* sleeps for interval_s seconds; returns FALSE if metrics_dump_stop was called meanwhile */
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += interval_s;
+
+    pthread_mutex_lock(&mutex_dump);
+    while (!dump_stopping && pthread_cond_timedwait(&cond_dump_stop, &mutex_dump, &deadline) == 0);
+    int stop = dump_stopping;
+    pthread_mutex_unlock(&mutex_dump);
+    return !stop;
+}
+
+
+static void *dump_thread(void *args) {
+    int interval_s = *(int *) args;
+    free(args);
+
+    server_stats_t *stats = malloc(sizeof(server_stats_t));
+    if (!stats) {
+        perror("Could not allocate stats"); pthread_exit(NULL);
+    }
+
+    while (wait_dump(interval_s)) {
+        metrics_read(stats);
+        if (dump_stats(stats) == -1) perror("Could not dump stats");
+    }
+    free(stats);
+    return NULL;
+}
+
+
+int metrics_dump_start(const int interval_s) {
+    /* dumps the metrics to STATS_FILE_NAME every interval_s seconds from now on */
+    int *args = malloc(sizeof(int));
+    if (!args) {
+        perror("Could not allocate stats dump"); return -1;
+    }
+    *args = interval_s;
+    dump_stopping = FALSE;
+
+    if (pthread_create(&dump_th, NULL, dump_thread, args) != 0) {
+        free(args);
+        fprintf(stderr, "Could not start stats dump\n"); return -1;
+    }
+    dumping = TRUE;
+    return 0;
+}
+
+
+void metrics_dump_stop(void) {
+    if (!dumping) return;
+
+    pthread_mutex_lock(&mutex_dump);
+    dump_stopping = TRUE;
+    pthread_cond_signal(&cond_dump_stop);
+    pthread_mutex_unlock(&mutex_dump);
+
+    pthread_join(dump_th, NULL);
+    dumping = FALSE;
+}
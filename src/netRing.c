@@ -0,0 +1,499 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include "DS-MandatoryExercise/utils.h"
+#include "DS-MandatoryExercise/netUtils.h"
+#include "DS-MandatoryExercise/metrics.h"
+#include "DS-MandatoryExercise/uring.h"
+#include "DS-MandatoryExercise/netRing.h"
+
+/* request dispatch & rejection, owned by the server */
+int serve_request(int stream, int client_socket, uint64_t accepted_ns, arena_t *arena);
+int reject_request(int stream);
+
+#define BUF_GROUP 0                 /* provided buffer group receives pick their buffer from */
+
+/* what a completion is for: kept in the low bits of its user data, the rest being the connection */
+enum {OP_ACCEPT, OP_RECV, OP_SEND, OP_CLOSE, OP_CANCEL, OP_WAKE};
+#define OP_MASK 7
+
+/* SERVING while a service thread executes the request, which only it touches meanwhile;
+ * DONE once the request was served or the connection is being closed */
+enum {RECEIVING, SERVING, DONE};
+
+typedef struct conn {
+    int socket;
+    int state;
+    int recv_armed;                 /* TRUE while the multishot receive is in flight */
+    int pending;                    /* sends, closes & cancels in flight */
+    uint64_t accepted_ns;           /* when the connection was accepted */
+    uint64_t queued_ns;             /* when the request was queued for a service thread */
+    char *in;                       /* request bytes received so far */
+    size_t in_len;
+    size_t in_cap;
+    mem_stream_t stream;            /* the reply is built in stream.out, and sent from there */
+    int result;                     /* of serve_request, once a service thread executed the request */
+    struct conn *prev;              /* connections not released yet */
+    struct conn *next;
+    struct conn *next_queued;       /* requests waiting for a service thread, or served & waiting for the ring */
+} conn_t;
+
+static uring_t ring;
+static int listen_sd;
+static struct io_uring_buf_ring *buf_ring;
+static char *bufs;                  /* NET_RING_BUFS buffers of NET_RING_BUF_SIZE bytes */
+static uint16_t buf_tail;
+static conn_t *conns;               /* connections not released yet */
+static int accept_armed;            /* TRUE while the multishot accept is in flight */
+static int stopping;                /* TRUE once net_ring_stop was called */
+static int in_use = FALSE;          /* TRUE from net_ring_open to net_ring_close */
+static int failed;                  /* TRUE once the ring took no more entries; net_ring_run returns then */
+static size_t request_max_len;      /* bytes a request may take; longer ones are refused */
+
+/* requests are executed by service threads, so that one waiting on the DB or the disk doesn't stall the ring;
+ * they hand the connections back through served, and wake the ring up through wake_fd */
+static pthread_t *threads;
+static int num_threads;             /* service threads running */
+static pthread_mutex_t mutex_queues = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond_requests = PTHREAD_COND_INITIALIZER;
+static conn_t *requests;            /* FIFO of requests received, from requests to requests_tail */
+static conn_t *requests_tail;
+static int queued = 0;              /* requests in the FIFO; admission control works on it as on conn_q */
+static int queue_limit;             /* queued requests at which more are rejected */
+static conn_t *served;              /* requests served, in no particular order */
+static int threads_stopping;        /* TRUE once the service threads are to end */
+static int wake_fd;                 /* eventfd the service threads signal once they served a request */
+static uint64_t wake_count;         /* read from wake_fd */
+
+
+static struct io_uring_sqe *get_sqe(const conn_t *conn, const int op) {
+    /* queues an entry, submitting the ones queued so far if there's no room left;
+     * returns NULL if the kernel took none of them, and net_ring_run is to return */
+    struct io_uring_sqe *sqe;
+    if (failed) return NULL;
+    while (!(sqe = uring_get_sqe(&ring))) {
+        if (uring_submit(&ring, 0) == -1 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            perror("io_uring submission error");
+            failed = TRUE; return NULL;
+        }
+    }
+    sqe->user_data = (uintptr_t) conn | (uint64_t) op;
+    return sqe;
+}
+
+
+static void provide_buffer(const uint16_t id) {
+    /* hands receive buffer id (back) to the kernel */
+    struct io_uring_buf *buf = &buf_ring->bufs[buf_tail & (NET_RING_BUFS - 1)];
+    buf->addr = (uintptr_t) (bufs + (size_t) id * NET_RING_BUF_SIZE);
+    buf->len = NET_RING_BUF_SIZE;
+    buf->bid = id;
+    __atomic_store_n(&buf_ring->tail, ++buf_tail, __ATOMIC_RELEASE);
+}
+
+
+static void arm_accept(void) {
+    struct io_uring_sqe *sqe = get_sqe(NULL, OP_ACCEPT);
+    if (!sqe) return;
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listen_sd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    accept_armed = TRUE;
+}
+
+
+static void arm_recv(conn_t *conn) {
+    /* every chunk received completes with a buffer of the group, until the receive is cancelled */
+    struct io_uring_sqe *sqe = get_sqe(conn, OP_RECV);
+    if (!sqe) return;
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = conn->socket;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUF_GROUP;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    conn->recv_armed = TRUE;
+}
+
+
+static void finish(conn_t *conn, const int send_reply, const int close_socket) {
+    /* stops receiving; then sends the reply, if any, and closes the socket after it whether it was sent or not */
+    conn->state = DONE;
+    if (conn->recv_armed) {
+        struct io_uring_sqe *sqe = get_sqe(conn, OP_CANCEL);
+        if (!sqe) return;
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = (uintptr_t) conn | OP_RECV;
+        conn->pending++;
+    }
+
+    if (send_reply) {
+        struct io_uring_sqe *sqe = get_sqe(conn, OP_SEND);
+        if (!sqe) return;
+        sqe->opcode = IORING_OP_SEND;
+        sqe->fd = conn->socket;
+        sqe->addr = (uintptr_t) conn->stream.out;
+        sqe->len = (uint32_t) conn->stream.out_len;
+        sqe->msg_flags = MSG_WAITALL;
+        sqe->flags = IOSQE_IO_HARDLINK;
+        conn->pending++;
+    }
+
+    if (close_socket) {
+        struct io_uring_sqe *sqe = get_sqe(conn, OP_CLOSE);
+        if (!sqe) return;
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->fd = conn->socket;
+        conn->pending++;
+    }
+}
+
+
+static void release_conn(conn_t *conn) {
+    /* frees the connection once the kernel is done with its buffers */
+    if (conn->state != DONE || conn->recv_armed || conn->pending) return;
+    if (conn->prev) conn->prev->next = conn->next;
+    else conns = conn->next;
+    if (conn->next) conn->next->prev = conn->prev;
+    free(conn->in);
+    free(conn->stream.out);
+    free(conn);
+}
+
+
+static void arm_wake(void) {
+    struct io_uring_sqe *sqe = get_sqe(NULL, OP_WAKE);
+    if (!sqe) return;
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = wake_fd;
+    sqe->addr = (uintptr_t) &wake_count;
+    sqe->len = sizeof(wake_count);
+}
+
+
+static void serve(conn_t *conn) {
+    /* the whole request has arrived: a service thread executes it, building the reply in memory.
+     * if queue_limit requests are waiting for one already, it's rejected right away instead */
+    conn->state = SERVING;
+    conn->stream.in = conn->in;
+    conn->stream.in_len = conn->in_len;
+    conn->next_queued = NULL;
+    conn->queued_ns = clock_ns();
+
+    pthread_mutex_lock(&mutex_queues);
+    if (queued >= queue_limit) {
+        pthread_mutex_unlock(&mutex_queues);
+        metrics_conn_q_full();
+        mem_stream_set(&conn->stream);
+        int result = reject_request(MEM_STREAM);
+        mem_stream_set(NULL);
+        finish(conn, result == 0, TRUE); return;
+    }
+    if (requests_tail) requests_tail->next_queued = conn;
+    else requests = conn;
+    requests_tail = conn;
+    __atomic_store_n(&queued, queued + 1, __ATOMIC_RELAXED);
+    metrics_conn_q_depth(queued);
+    pthread_cond_signal(&cond_requests);
+    pthread_mutex_unlock(&mutex_queues);
+}
+
+
+static void woken(void) {
+    /* replies to the requests served since the last wake up */
+    arm_wake();
+    pthread_mutex_lock(&mutex_queues);
+    conn_t *conn = served;
+    served = NULL;
+    pthread_mutex_unlock(&mutex_queues);
+
+    while (conn) {
+        conn_t *next = conn->next_queued;
+        /* a watch request hands the socket over to a watch thread */
+        if (conn->result == 1) finish(conn, FALSE, FALSE);
+        else finish(conn, conn->result == 0, TRUE);
+        release_conn(conn);
+        conn = next;
+    }
+}
+
+
+static void *service_thread(void *args) {
+    /* value1 strings received or sent while serving a request are allocated from this arena,
+     * which is reset before the next one */
+    arena_t arena;
+    arena_init(&arena);
+
+    while (TRUE) {
+        pthread_mutex_lock(&mutex_queues);
+        while (!requests && !threads_stopping)
+            pthread_cond_wait(&cond_requests, &mutex_queues);
+        if (!requests) {
+            pthread_mutex_unlock(&mutex_queues); break;
+        }
+        conn_t *conn = requests;
+        requests = conn->next_queued;
+        if (!requests) requests_tail = NULL;
+        __atomic_store_n(&queued, queued - 1, __ATOMIC_RELAXED);
+        metrics_conn_q_depth(queued);
+        pthread_mutex_unlock(&mutex_queues);
+        metrics_conn_q_wait(clock_ns() - conn->queued_ns);
+
+        arena_reset(&arena);
+        mem_stream_set(&conn->stream);
+        conn->result = serve_request(MEM_STREAM, conn->socket, conn->accepted_ns, &arena);
+        mem_stream_set(NULL);
+
+        pthread_mutex_lock(&mutex_queues);
+        conn->next_queued = served;
+        served = conn;
+        pthread_mutex_unlock(&mutex_queues);
+
+        /* the counter can't overflow in practice, as the ring reads it back to 0 */
+        uint64_t one = 1;
+        if (write(wake_fd, &one, sizeof(one)) == -1) perror("Could not wake the ring up");
+    }
+
+    arena_free(&arena);
+    return NULL;
+}
+
+
+static void stop_threads(void) {
+    /* lets the service threads end once there are no requests left for them */
+    pthread_mutex_lock(&mutex_queues);
+    threads_stopping = TRUE;
+    pthread_cond_broadcast(&cond_requests);
+    pthread_mutex_unlock(&mutex_queues);
+    for (int i = 0; i < num_threads; i++) pthread_join(threads[i], NULL);
+    free(threads);
+    threads = NULL;
+    num_threads = 0;
+}
+
+
+static void received(conn_t *conn, const struct io_uring_cqe *cqe) {
+    /* appends the chunk received to the request, and serves it once it's complete */
+    if (!(cqe->flags & IORING_CQE_F_MORE)) conn->recv_armed = FALSE;
+    if (cqe->res > 0) {
+        uint16_t id = (uint16_t) (cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+        size_t len = (size_t) cqe->res;
+
+        /* requests are received into memory whole, so their size is capped */
+        if (conn->state == RECEIVING && conn->in_len + len > request_max_len) {
+            fprintf(stderr, "Receive request error: more than %zu bytes\n", request_max_len);
+            provide_buffer(id);
+            finish(conn, FALSE, TRUE); return;
+        }
+        if (conn->state == RECEIVING && conn->in_len + len > conn->in_cap) {
+            size_t cap = conn->in_cap ? conn->in_cap : NET_RING_BUF_SIZE;
+            while (cap < conn->in_len + len) cap *= 2;
+
+            char *in = realloc(conn->in, cap);
+            if (!in) {
+                perror("Could not allocate request");
+                provide_buffer(id);
+                finish(conn, FALSE, TRUE); return;
+            }
+            conn->in = in;
+            conn->in_cap = cap;
+        }
+        if (conn->state == RECEIVING) {
+            memcpy(conn->in + conn->in_len, bufs + (size_t) id * NET_RING_BUF_SIZE, len);
+            conn->in_len += len;
+        }
+        provide_buffer(id);
+    }
+    if (conn->state != RECEIVING) return;
+
+    if (cqe->res > 0) {
+        ssize_t size = request_size(conn->in, conn->in_len);
+        if (size > 0) {
+            serve(conn); return;
+        }
+        if (size == -1) {
+            fprintf(stderr, "Received malformed request\n");
+            finish(conn, FALSE, TRUE); return;
+        }
+    }
+
+    /* out of buffers: receive again once some are given back; otherwise the client is gone */
+    if (cqe->res > 0 || cqe->res == -ENOBUFS) {
+        if (!conn->recv_armed) arm_recv(conn);
+    } else finish(conn, FALSE, TRUE);
+}
+
+
+static int accepted(const struct io_uring_cqe *cqe) {
+    /* once stopping, the accept ends with an error, as the server socket was shut down */
+    int stop = __atomic_load_n(&stopping, __ATOMIC_ACQUIRE);
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+        accept_armed = FALSE;
+        if (!stop) arm_accept();
+    }
+    if (cqe->res < 0) {
+        if (stop) return 0;
+        errno = -cqe->res;
+        perror("Server accept error"); return -1;
+    }
+    if (stop) {
+        close(cqe->res); return 0;
+    }
+
+    conn_t *conn = calloc(1, sizeof(conn_t));
+    if (!conn) {
+        perror("Could not allocate connection");
+        close(cqe->res); return 0;
+    }
+    conn->socket = cqe->res;
+    conn->state = RECEIVING;
+    conn->accepted_ns = clock_ns();
+    conn->next = conns;
+    if (conns) conns->prev = conn;
+    conns = conn;
+    arm_recv(conn);
+    return 0;
+}
+
+
+int net_ring_open(const int server_sd, const int service_threads, const int max_queued, const size_t max_len) {
+    /* sets up the ring & its receive buffers, and starts service_threads service threads;
+     * requests are rejected once max_queued are waiting for them, and refused if longer than max_len bytes.
+     * returns -1 if the kernel doesn't offer them, or the threads couldn't be started */
+    if (uring_init(&ring, NET_RING_ENTRIES) == -1) return -1;
+
+    size_t ring_size = NET_RING_BUFS * sizeof(struct io_uring_buf);
+    buf_ring = mmap(NULL, ring_size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (buf_ring == MAP_FAILED) {
+        uring_free(&ring); return -1;
+    }
+    bufs = malloc((size_t) NET_RING_BUFS * NET_RING_BUF_SIZE);
+    struct io_uring_buf_reg reg = {.ring_addr = (uintptr_t) buf_ring, .ring_entries = NET_RING_BUFS,
+                                   .bgid = BUF_GROUP};
+    if (!bufs || uring_register(&ring, IORING_REGISTER_PBUF_RING, &reg, 1) == -1) {
+        free(bufs);
+        munmap(buf_ring, ring_size);
+        uring_free(&ring); return -1;
+    }
+
+    buf_tail = 0;
+    for (uint16_t id = 0; id < NET_RING_BUFS; id++) provide_buffer(id);
+    listen_sd = server_sd;
+    conns = NULL;
+    accept_armed = FALSE;
+    stopping = FALSE;
+    failed = FALSE;
+    request_max_len = max_len;
+
+    requests = requests_tail = served = NULL;
+    queued = 0;
+    queue_limit = max_queued;
+    threads_stopping = FALSE;
+    threads = malloc(service_threads * sizeof(pthread_t));
+    wake_fd = eventfd(0, EFD_CLOEXEC);
+    if (!threads || wake_fd == -1) {
+        perror("Could not set up service threads");
+        num_threads = 0;
+        net_ring_close(); return -1;
+    }
+    for (num_threads = 0; num_threads < service_threads; num_threads++) {
+        if (pthread_create(&threads[num_threads], NULL, service_thread, NULL) != 0) {
+            perror("Could not create service thread");
+            net_ring_close(); return -1;
+        }
+    }
+    in_use = TRUE;
+    return 0;
+}
+
+
+void net_ring_close(void) {
+    /* frees what net_ring_open set up; net_ring_run must not be running */
+    in_use = FALSE;
+    stop_threads();
+    if (wake_fd != -1) close(wake_fd);
+    wake_fd = -1;
+    uring_free(&ring);
+
+    /* connections left if net_ring_run failed: the ones still receiving were never handed over */
+    while (conns) {
+        conn_t *conn = conns;
+        conns = conn->next;
+        if (conn->state == RECEIVING) close(conn->socket);
+        free(conn->in);
+        free(conn->stream.out);
+        free(conn);
+    }
+    munmap(buf_ring, NET_RING_BUFS * sizeof(struct io_uring_buf));
+    free(bufs);
+}
+
+
+int net_ring_run(void) {
+    /* serves connections until net_ring_stop is called, then returns 0, or until an error happens: whatever
+     * completed meanwhile is handled, and every entry it queued goes to the kernel in a single submission.
+     * once stopping, connections still receiving are closed, and the ones being served or replied to are
+     * let finish */
+    int draining = FALSE;
+    arm_accept();
+    arm_wake();
+
+    while (TRUE) {
+        if (failed) return -1;
+        if (uring_submit(&ring, 1) == -1 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            perror("io_uring submission error"); return -1;
+        }
+
+        struct io_uring_cqe *cqe;
+        while ((cqe = uring_peek_cqe(&ring)) != NULL) {
+            struct io_uring_cqe done = *cqe;
+            uring_cqe_seen(&ring);
+
+            conn_t *conn = (conn_t *) (uintptr_t) (done.user_data & ~(uint64_t) OP_MASK);
+            switch (done.user_data & OP_MASK) {
+                case OP_ACCEPT:
+                    if (accepted(&done) == -1) return -1;
+                    break;
+                case OP_RECV:
+                    received(conn, &done); break;
+                case OP_WAKE:
+                    woken(); break;
+                default:    /* send, close or cancel */
+                    conn->pending--; break;
+            }
+            if (conn) release_conn(conn);
+        }
+
+        if (!__atomic_load_n(&stopping, __ATOMIC_ACQUIRE)) continue;
+        if (!draining) {
+            for (conn_t *conn = conns; conn; conn = conn->next) {
+                if (conn->state == RECEIVING) finish(conn, FALSE, TRUE);
+            }
+            draining = TRUE;
+        }
+        if (!conns && !accept_armed) return 0;
+    }
+}
+
+
+int net_ring_in_use(void) {
+    return in_use;
+}
+
+
+int net_ring_queued(void) {
+    /* requests waiting for a service thread; can be called from any thread */
+    return __atomic_load_n(&queued, __ATOMIC_RELAXED);
+}
+
+
+void net_ring_stop(void) {
+    /* makes net_ring_run return; called from another thread */
+    __atomic_store_n(&stopping, TRUE, __ATOMIC_RELEASE);
+    shutdown(listen_sd, SHUT_RDWR);
+}
@@ -1,23 +1,224 @@
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <limits.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
+#include <endian.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
 #include <arpa/inet.h>
+#include <netdb.h>
 #include "DS-MandatoryExercise/utils.h"
 #include "DS-MandatoryExercise/netUtils.h"
 
+static uint32_t value1_max_len = VALUE1_DEFAULT_MAX_LEN;    /* longest value1 accepted from a socket */
+static char spool_dir[PATH_MAX];                            /* where long value1 strings are received; "" for none */
+
+
+void set_value1_max_len(const uint32_t max_len) {
+    value1_max_len = max_len;
+}
+
+
+uint32_t get_value1_max_len(void) {
+    return value1_max_len;
+}
+
+
+int set_value1_spool_dir(const char *dir) {
+    /* long value1 strings are spooled to temp files in dir from now on; NULL to keep them in memory */
+    if (!dir) {
+        spool_dir[0] = '\0'; return 0;
+    }
+    if (snprintf(spool_dir, PATH_MAX, "%s", dir) >= PATH_MAX) {
+        fprintf(stderr, "Spool directory path too long\n");
+        spool_dir[0] = '\0'; return -1;
+    }
+    return 0;
+}
+
+
+static int send_string(const int socket, const char *str) {
+    /* function that sends a string preceded by its length, in chunks of VALUE1_CHUNK_SIZE bytes;
+     * NULL is sent as an empty string */
+    uint32_t len = str ? (uint32_t) strlen(str) : 0;
+    uint32_t tmp = htonl(len);
+    if (send_msg(socket, (char *) &tmp, sizeof(uint32_t)) == -1) return -1;
+
+    for (uint32_t sent = 0; sent < len; sent += VALUE1_CHUNK_SIZE) {
+        uint32_t chunk = len - sent < VALUE1_CHUNK_SIZE ? len - sent : VALUE1_CHUNK_SIZE;
+        if (send_msg(socket, (char *) str + sent, (int) chunk) == -1) return -1;
+    }
+
+    return 0;
+}
+
+
+static int copy_file_string(const int socket, const int fd, off_t offset, const uint32_t len) {
+    /* function that sends len bytes of fd, starting at offset, read in chunks of VALUE1_CHUNK_SIZE bytes
+     * that are sent one at a time, so that only one chunk is ever held in memory */
+    char chunk[VALUE1_CHUNK_SIZE];
+
+    for (uint32_t sent = 0; sent < len;) {
+        uint32_t size = len - sent < VALUE1_CHUNK_SIZE ? len - sent : VALUE1_CHUNK_SIZE;
+        ssize_t bytes_read = pread(fd, chunk, size, offset);
+        if (bytes_read == -1 && errno == EINTR) continue;
+        if (bytes_read <= 0) {
+            if (!bytes_read) errno = EIO;   /* file is shorter than expected */
+            return -1;
+        }
+        if (send_msg(socket, chunk, (int) bytes_read) == -1) return -1;
+        offset += bytes_read;
+        sent += (uint32_t) bytes_read;
+    }
+
+    return 0;
+}
+
+
+static int send_file_string(const int socket, const int fd, off_t offset, const uint32_t len, const int zero_copy) {
+    /* function that sends len bytes of fd, starting at offset, the way send_string sends strings;
+     * with zero_copy they go from the page cache to the socket with sendfile, without being copied to user space */
+    uint32_t tmp = htonl(len);
+    if (send_msg(socket, (char *) &tmp, sizeof(uint32_t)) == -1) return -1;
+    if (!zero_copy) return copy_file_string(socket, fd, offset, len);
+
+    for (uint32_t sent = 0; sent < len;) {
+        ssize_t bytes_sent = sendfile(socket, fd, &offset, len - sent);
+        if (bytes_sent == -1 && errno == EINTR) continue;
+        if (bytes_sent <= 0) {
+            if (!bytes_sent) errno = EIO;   /* file is shorter than expected */
+            return -1;
+        }
+        sent += (uint32_t) bytes_sent;
+    }
+
+    return 0;
+}
+
+
+static int spool_string(const int socket, char **str, const uint32_t len, arena_t *arena) {
+    /* function that receives the len bytes of a string sent by send_string into an unlinked temp file,
+     * one chunk at a time, and maps it from arena; the file is gone once the arena is reset */
+    char path[PATH_MAX + 16], chunk[VALUE1_CHUNK_SIZE];
+    snprintf(path, sizeof(path), "%s/.spool.XXXXXX", spool_dir);
+    int fd = mkstemp(path);
+    if (fd == -1) {
+        perror("Could not create spool file"); return -1;
+    }
+    unlink(path);
+
+    for (uint32_t received = 0; received < len; received += VALUE1_CHUNK_SIZE) {
+        uint32_t size = len - received < VALUE1_CHUNK_SIZE ? len - received : VALUE1_CHUNK_SIZE;
+        if (recv_msg(socket, chunk, (int) size) == -1) {
+            close(fd); return -1;
+        }
+        for (uint32_t written = 0; written < size;) {
+            ssize_t bytes_written = write(fd, chunk + written, size - written);
+            if (bytes_written == -1 && errno == EINTR) continue;
+            if (bytes_written == -1) {
+                perror("Could not write spool file");
+                close(fd); return -1;
+            }
+            written += (uint32_t) bytes_written;
+        }
+    }
+
+    /* the byte the file is extended by terminates the string */
+    if (ftruncate(fd, (off_t) len + 1) == -1) {
+        perror("Could not write spool file");
+        close(fd); return -1;
+    }
+    *str = arena_map(arena, fd, (size_t) len + 1);
+    close(fd);
+    return *str ? 0 : -1;
+}
+
+
+static int recv_string(const int socket, char **str, arena_t *arena) {
+    /* function that receives a string sent by send_string into a buffer allocated from arena;
+     * strings longer than value1_max_len are refused, and the ones longer than VALUE1_SPOOL_MIN_LEN
+     * are spooled if there's a spool directory and socket is a real one */
+    uint32_t len;
+    if (recv_msg(socket, (char *) &len, sizeof(uint32_t)) == -1) return -1;
+    len = ntohl(len);
+    if (len > value1_max_len) {
+        fprintf(stderr, "Receive string error: %u bytes, max is %u\n", len, value1_max_len); return -1;
+    }
+    if (len > VALUE1_SPOOL_MIN_LEN && spool_dir[0] && socket != MEM_STREAM)
+        return spool_string(socket, str, len, arena);
+
+    *str = arena_alloc(arena, len + 1);
+    if (!*str) return -1;
+    for (uint32_t received = 0; received < len; received += VALUE1_CHUNK_SIZE) {
+        uint32_t chunk = len - received < VALUE1_CHUNK_SIZE ? len - received : VALUE1_CHUNK_SIZE;
+        if (recv_msg(socket, *str + received, (int) chunk) == -1) return -1;
+    }
+    (*str)[len] = '\0';
+
+    return 0;
+}
+
+
+int connect_to_host(const char *host, const int port) {
+    /* function that opens a TCP connection to host:port; returns the socket */
+    struct addrinfo hints, *addrs;
+    char port_str[MAX_STR_SIZE];
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf(port_str, MAX_STR_SIZE, "%d", port);
+
+    /* obtain server address */
+    if (getaddrinfo(host, port_str, &hints, &addrs) != 0) {
+        fprintf(stderr, "Error getting hostname\n"); return -1;
+    }
+
+    /* create socket & connect */
+    int sd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (sd < 0) {
+        perror("Error creating socket");
+        freeaddrinfo(addrs); return -1;
+    }
+    if (connect(sd, addrs->ai_addr, addrs->ai_addrlen) == -1) {
+        perror("Error connecting to server");
+        close(sd); freeaddrinfo(addrs); return -1;
+    }
+
+    freeaddrinfo(addrs);
+    return sd;
+}
+
 
 int send_common_header(const int socket, header_t *header) {
     /* function that sends transaction ID, op_code members to socket */
     header->id = htonl(header->id);
     if (send_msg(socket, (char *) &header->id, sizeof(uint32_t)) == -1) {
         perror("Send transaction ID error");
-        close(socket); return -1;
+        close_stream(socket); return -1;
     }
 
     if (send_msg(socket, &header->op_code, 1) == -1) {
         perror("Send op_code error");
-        close(socket); return -1;
+        close_stream(socket); return -1;
+    }
+
+    return 0;
+}
+
+
+int send_request_header(const int socket, header_t *header) {
+    /* function that sends transaction ID, op_code & deadline_us members to socket */
+    if (send_common_header(socket, header) == -1) return -1;
+
+    header->deadline_us = htonl(header->deadline_us);
+    if (send_msg(socket, (char *) &header->deadline_us, sizeof(uint32_t)) == -1) {
+        perror("Send deadline error");
+        close_stream(socket); return -1;
     }
 
     return 0;
@@ -31,7 +232,7 @@ int send_reply_header(const int socket, reply_t *reply) {
     reply->server_error_code = (int32_t) htonl(reply->server_error_code);
     if (send_msg(socket, (char *) &reply->server_error_code, sizeof(int32_t)) == -1) {
         perror("Send server_error_code error");
-        close(socket); return -1;
+        close_stream(socket); return -1;
     }
 
     return 0;
@@ -43,7 +244,7 @@ int send_num_items(const int socket, reply_t *reply) {
     reply->num_items = htonl(reply->num_items);
     if (send_msg(socket, (char *) &reply->num_items, sizeof(uint32_t)) == -1) {
         perror("Send num_items error");
-        close(socket); return -1;
+        close_stream(socket); return -1;
     }
 
     return 0;
@@ -55,27 +256,21 @@ int send_key(const int socket, item_t *item) {
     item->key = (int32_t) htonl(item->key);
     if (send_msg(socket, (char *) &item->key, sizeof(int32_t)) == -1) {
         perror("Send key error");
-        close(socket); return -1;
+        close_stream(socket); return -1;
     }
 
     return 0;
 }
 
 
-int send_values(const int socket, item_t *item) {
-    /* function that sends value members to socket */
-
-    /* send value1 */
-    if (send_msg(socket, item->value1, (int) (strlen(item->value1) + 1)) == -1) {
-        perror("Send value1 error");
-        close(socket); return -1;
-    }
+static int send_numbers(const int socket, item_t *item) {
+    /* function that sends value2 & value3 to socket */
 
     /* send value2 */
     item->value2 = (int32_t) htonl(item->value2);
     if (send_msg(socket, (char *) &item->value2, sizeof(int32_t)) == -1) {
         perror("Send value2 error");
-        close(socket); return -1;
+        close_stream(socket); return -1;
     }
 
     /* send value3 */
@@ -84,7 +279,346 @@ int send_values(const int socket, item_t *item) {
     tmp = htonl(tmp);
     if (send_msg(socket, (char *) &tmp, sizeof(float)) == -1) {
         perror("Send value3 error");
-        close(socket); return -1;
+        close_stream(socket); return -1;
+    }
+
+    return 0;
+}
+
+
+int send_values(const int socket, item_t *item) {
+    /* function that sends value members to socket */
+
+    /* send value1 */
+    if (send_string(socket, item->value1) == -1) {
+        perror("Send value1 error");
+        close_stream(socket); return -1;
+    }
+
+    return send_numbers(socket, item);
+}
+
+
+int send_stored_values(const int socket, item_t *item, const int fd, const off_t offset, const uint32_t len,
+                       const int zero_copy) {
+    /* function that sends value members to socket like send_values,
+     * except for value1, which is sent from the len bytes of fd starting at offset: with sendfile if zero_copy is
+     * TRUE, and one chunk at a time otherwise */
+
+    /* send value1 */
+    if (send_file_string(socket, fd, offset, len, zero_copy) == -1) {
+        perror("Send value1 error");
+        close_stream(socket); return -1;
+    }
+
+    return send_numbers(socket, item);
+}
+
+
+int send_range(const int socket, range_t *range) {
+    /* function that sends the members of a key range to socket */
+    range->lo = (int32_t) htonl(range->lo);
+    if (send_msg(socket, (char *) &range->lo, sizeof(int32_t)) == -1) {
+        perror("Send range lo error");
+        close_stream(socket); return -1;
+    }
+
+    range->hi = (int32_t) htonl(range->hi);
+    if (send_msg(socket, (char *) &range->hi, sizeof(int32_t)) == -1) {
+        perror("Send range hi error");
+        close_stream(socket); return -1;
+    }
+
+    range->max_items = htonl(range->max_items);
+    if (send_msg(socket, (char *) &range->max_items, sizeof(uint32_t)) == -1) {
+        perror("Send range max_items error");
+        close_stream(socket); return -1;
+    }
+
+    return 0;
+}
+
+
+int send_items(const int socket, item_t *items, const uint32_t num_items) {
+    /* function that sends a page of items (key, values & version of each one) to socket */
+    for (uint32_t i = 0; i < num_items; i++) {
+        if (send_key(socket, &items[i]) == -1 || send_values(socket, &items[i]) == -1 ||
+            send_version(socket, &items[i]) == -1) return -1;
+    }
+
+    return 0;
+}
+
+
+int send_cursor(const int socket, reply_t *reply) {
+    /* function that sends more & cursor members to socket */
+    if (send_msg(socket, (char *) &reply->more, 1) == -1) {
+        perror("Send more error");
+        close_stream(socket); return -1;
+    }
+
+    reply->cursor = (int64_t) htobe64(reply->cursor);
+    if (send_msg(socket, (char *) &reply->cursor, sizeof(int64_t)) == -1) {
+        perror("Send cursor error");
+        close_stream(socket); return -1;
+    }
+
+    return 0;
+}
+
+
+int send_aggregate(const int socket, request_t *request) {
+    /* function that sends aggregate function & field members to socket; range is sent apart */
+    if (send_msg(socket, &request->agg_function, 1) == -1) {
+        perror("Send aggregate function error");
+        close_stream(socket); return -1;
+    }
+
+    if (send_msg(socket, &request->agg_field, 1) == -1) {
+        perror("Send aggregate field error");
+        close_stream(socket); return -1;
+    }
+
+    return 0;
+}
+
+
+int send_result(const int socket, reply_t *reply) {
+    /* function that sends the aggregation result member to socket */
+    uint64_t tmp;
+    memcpy((char *) &tmp, (char *) &reply->result, sizeof(double));
+    tmp = htobe64(tmp);
+    if (send_msg(socket, (char *) &tmp, sizeof(double)) == -1) {
+        perror("Send result error");
+        close_stream(socket); return -1;
+    }
+
+    return 0;
+}
+
+
+int send_query(const int socket, request_t *request) {
+    /* function that sends cursor & keys_only members to socket; range is sent apart */
+    request->cursor = (int64_t) htobe64(request->cursor);
+    if (send_msg(socket, (char *) &request->cursor, sizeof(int64_t)) == -1) {
+        perror("Send cursor error");
+        close_stream(socket); return -1;
+    }
+
+    if (send_msg(socket, (char *) &request->keys_only, 1) == -1) {
+        perror("Send keys_only error");
+        close_stream(socket); return -1;
+    }
+
+    return 0;
+}
+
+
+int send_keys(const int socket, item_t *items, const uint32_t num_items) {
+    /* function that sends the keys of a page of items to socket */
+    for (uint32_t i = 0; i < num_items; i++) {
+        if (send_key(socket, &items[i]) == -1) return -1;
+    }
+
+    return 0;
+}
+
+
+int send_search(const int socket, request_t *request) {
+    /* function that sends search_mode member & pattern (stored in item.value1) to socket */
+    if (send_msg(socket, &request->search_mode, 1) == -1) {
+        perror("Send search_mode error");
+        close_stream(socket); return -1;
+    }
+
+    if (send_string(socket, request->item.value1) == -1) {
+        perror("Send pattern error");
+        close_stream(socket); return -1;
+    }
+
+    return 0;
+}
+
+
+int send_key_chunk(const int socket, reply_t *reply) {
+    /* function that sends a chunk of keys to socket, preceded by its size (num_items member);
+     * an empty chunk tells the client there are no more keys */
+    uint32_t num_keys = reply->num_items;
+
+    if (send_num_items(socket, reply) == -1) return -1;
+    for (uint32_t i = 0; i < num_keys; i++) reply->keys[i] = (int32_t) htonl(reply->keys[i]);
+    if (num_keys && send_msg(socket, (char *) reply->keys, (int) (num_keys * sizeof(int32_t))) == -1) {
+        perror("Send keys error");
+        close_stream(socket); return -1;
+    }
+
+    return 0;
+}
+
+
+int send_delta(const int socket, const char op_code, item_t *item) {
+    /* function that sends the value member used by INCR (value2) or ADD (value3) to socket;
+     * it holds the delta in requests and the updated value in replies */
+    if (op_code == INCR) {
+        item->value2 = (int32_t) htonl(item->value2);
+        if (send_msg(socket, (char *) &item->value2, sizeof(int32_t)) == -1) {
+            perror("Send value2 error");
+            close_stream(socket); return -1;
+        }
+    } else {
+        uint32_t tmp;
+        memcpy((char *) &tmp, (char *) &item->value3, sizeof(float));
+        tmp = htonl(tmp);
+        if (send_msg(socket, (char *) &tmp, sizeof(float)) == -1) {
+            perror("Send value3 error");
+            close_stream(socket); return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+int send_version(const int socket, item_t *item) {
+    /* function that sends the version member to socket */
+    item->version = htonl(item->version);
+    if (send_msg(socket, (char *) &item->version, sizeof(uint32_t)) == -1) {
+        perror("Send version error");
+        close_stream(socket); return -1;
+    }
+
+    return 0;
+}
+
+
+int send_txn_ops(const int socket, request_t *request) {
+    /* function that sends the number of sub-operations of a transaction and then each one of them:
+     * op_code, key, and the values or version it needs */
+    uint32_t num_ops = htonl(request->num_ops);
+    if (send_msg(socket, (char *) &num_ops, sizeof(uint32_t)) == -1) {
+        perror("Send num_ops error");
+        close_stream(socket); return -1;
+    }
+
+    for (uint32_t i = 0; i < request->num_ops; i++) {
+        txn_op_t *op = &request->ops[i];
+        if (send_msg(socket, &op->op_code, 1) == -1) {
+            perror("Send txn op_code error");
+            close_stream(socket); return -1;
+        }
+        if (send_key(socket, &op->item) == -1) return -1;
+        if ((op->op_code == SET_VALUE || op->op_code == MODIFY_VALUE) && send_values(socket, &op->item) == -1)
+            return -1;
+        if (op->op_code == TXN_COMPARE && send_version(socket, &op->item) == -1) return -1;
+    }
+
+    return 0;
+}
+
+
+int send_txn_results(const int socket, txn_op_t *ops, const uint32_t num_ops) {
+    /* function that sends the result of each sub-operation of a transaction,
+     * followed by the values & version read by the successful GET_VALUE ones */
+    for (uint32_t i = 0; i < num_ops; i++) {
+        int32_t result = ops[i].result;
+        int32_t tmp = (int32_t) htonl(result);
+        if (send_msg(socket, (char *) &tmp, sizeof(int32_t)) == -1) {
+            perror("Send txn result error");
+            close_stream(socket); return -1;
+        }
+        if (ops[i].op_code == GET_VALUE && result == SRV_SUCCESS &&
+            (send_values(socket, &ops[i].item) == -1 || send_version(socket, &ops[i].item) == -1)) return -1;
+    }
+
+    return 0;
+}
+
+
+int send_change(const int socket, change_t *change) {
+    /* function that sends a change notification to socket: op_code, seq, lag & key,
+     * followed by the values & version of the item unless it was deleted */
+    if (send_msg(socket, &change->op_code, 1) == -1) {
+        perror("Send change op_code error");
+        close_stream(socket); return -1;
+    }
+
+    uint64_t tmp[2] = {htobe64(change->seq), htobe64(change->lag)};
+    if (send_msg(socket, (char *) tmp, sizeof(tmp)) == -1) {
+        perror("Send change seq error");
+        close_stream(socket); return -1;
+    }
+
+    if (send_key(socket, &change->item) == -1) return -1;
+    if ((change->op_code == SET_VALUE || change->op_code == MODIFY_VALUE) &&
+        (send_values(socket, &change->item) == -1 || send_version(socket, &change->item) == -1)) return -1;
+
+    return 0;
+}
+
+
+int send_seq(const int socket, request_t *request) {
+    /* function that sends seq member to socket */
+    request->seq = htobe64(request->seq);
+    if (send_msg(socket, (char *) &request->seq, sizeof(uint64_t)) == -1) {
+        perror("Send seq error");
+        close_stream(socket); return -1;
+    }
+
+    return 0;
+}
+
+
+int send_watch(const int socket, request_t *request) {
+    /* function that sends seq & keys_only members to socket; range is sent apart */
+    if (send_seq(socket, request) == -1) return -1;
+
+    if (send_msg(socket, (char *) &request->keys_only, 1) == -1) {
+        perror("Send keys_only error");
+        close_stream(socket); return -1;
+    }
+
+    return 0;
+}
+
+
+int send_lease(const int socket, reply_t *reply) {
+    /* function that sends lease_ms member to socket */
+    uint32_t lease_ms = htonl(reply->lease_ms);
+    if (send_msg(socket, (char *) &lease_ms, sizeof(uint32_t)) == -1) {
+        perror("Send lease error");
+        close_stream(socket); return -1;
+    }
+
+    return 0;
+}
+
+
+int send_replica_status(const int socket, reply_t *reply) {
+    /* function that sends replica member to socket: connected flag, applied_seq & lag */
+    if (send_msg(socket, (char *) &reply->replica.connected, 1) == -1) {
+        perror("Send replica state error");
+        close_stream(socket); return -1;
+    }
+
+    uint64_t tmp[2] = {htobe64(reply->replica.applied_seq), htobe64(reply->replica.lag)};
+    if (send_msg(socket, (char *) tmp, sizeof(tmp)) == -1) {
+        perror("Send replica progress error");
+        close_stream(socket); return -1;
+    }
+
+    return 0;
+}
+
+
+int send_stats(const int socket, reply_t *reply) {
+    /* function that sends stats member to socket, one big-endian uint64_t field after another */
+    const uint64_t *fields = (const uint64_t *) reply->stats;
+    uint64_t tmp[sizeof(server_stats_t) / sizeof(uint64_t)];
+    for (size_t i = 0; i < sizeof(tmp) / sizeof(uint64_t); i++) tmp[i] = htobe64(fields[i]);
+
+    if (send_msg(socket, (char *) tmp, sizeof(tmp)) == -1) {
+        perror("Send stats error");
+        close_stream(socket); return -1;
     }
 
     return 0;
@@ -97,20 +631,35 @@ int recv_common_header(const int socket, header_t *header) {
     /* receive transaction ID */
     if (recv_msg(socket, (char *) &header->id, sizeof(uint32_t)) == -1) {
         perror("Receive transaction ID error");
-        close(socket); return -1;
+        close_stream(socket); return -1;
     }
     header->id = ntohl(header->id);
 
     /* receive op_code */
     if (recv_msg(socket, &header->op_code, 1) == -1) {
         perror("Receive op_code error");
-        close(socket); return -1;
+        close_stream(socket); return -1;
     }
 
     return 0;
 }
 
 
+int recv_request_header(const int socket, header_t *header) {
+    /* function that receives transaction ID, op_code & deadline_us members from socket */
+    if (recv_common_header(socket, header) == -1) return -1;
+
+    /* receive deadline */
+    if (recv_msg(socket, (char *) &header->deadline_us, sizeof(uint32_t)) == -1) {
+        perror("Receive deadline error");
+        close_stream(socket); return -1;
+    }
+    header->deadline_us = ntohl(header->deadline_us);
+
+    return 0;
+}
+
+
 int recv_reply_header(const int socket, reply_t *reply) {
     /* function that receives transaction ID, op_code & server_error_code members from socket */
     if (recv_common_header(socket, &reply->header) == -1) return -1;
@@ -118,7 +667,7 @@ int recv_reply_header(const int socket, reply_t *reply) {
     /* receive server_error_code */
     if (recv_msg(socket, (char *) &reply->server_error_code, sizeof(int32_t)) == -1) {
         perror("Receive server_error_code error");
-        close(socket); return -1;
+        close_stream(socket); return -1;
     }
     reply->server_error_code = (int32_t) ntohl(reply->server_error_code);
 
@@ -130,7 +679,7 @@ int recv_num_items(const int socket, reply_t *reply) {
     /* function that receives num_items member from socket */
     if (recv_msg(socket, (char *) &reply->num_items, sizeof(uint32_t)) == -1) {
         perror("Receive num_items error");
-        close(socket); return -1;
+        close_stream(socket); return -1;
     }
     reply->num_items = ntohl(reply->num_items);
 
@@ -142,7 +691,7 @@ int recv_key(const int socket, item_t *item) {
     /* function that receives the key member from socket */
     if (recv_msg(socket, (char *) &item->key, sizeof(int32_t)) == -1) {
         perror("Receive key error");
-        close(socket); return -1;
+        close_stream(socket); return -1;
     }
     item->key = (int32_t) ntohl(item->key);
 
@@ -150,19 +699,19 @@ int recv_key(const int socket, item_t *item) {
 }
 
 
-int recv_values(const int socket, item_t *item) {
-    /* function that receives value members from socket */
+int recv_values(const int socket, item_t *item, arena_t *arena) {
+    /* function that receives value members from socket; value1 is allocated from arena */
 
     /* receive value1 */
-    if (read_line(socket, item->value1, VALUE1_MAX_STR_SIZE) == -1) {
+    if (recv_string(socket, &item->value1, arena) == -1) {
         perror("Receive value1 error");
-        close(socket); return -1;
+        close_stream(socket); return -1;
     }
 
     /* receive value2 */
     if (recv_msg(socket, (char *) &item->value2, sizeof(int32_t)) == -1) {
         perror("Receive value2 error");
-        close(socket); return -1;
+        close_stream(socket); return -1;
     }
     item->value2 = (int32_t) ntohl(item->value2);
 
@@ -170,10 +719,422 @@ int recv_values(const int socket, item_t *item) {
     uint32_t tmp;
     if (recv_msg(socket, (char *) &tmp, sizeof(float)) == -1) {
         perror("Receive value3 error");
-        close(socket); return -1;
+        close_stream(socket); return -1;
     }
     tmp = ntohl(tmp);
     memcpy((char *) &item->value3, (char *) &tmp, sizeof(float));
 
     return 0;
 }
+
+
+int recv_range(const int socket, range_t *range) {
+    /* function that receives the members of a key range from socket */
+    if (recv_msg(socket, (char *) &range->lo, sizeof(int32_t)) == -1) {
+        perror("Receive range lo error");
+        close_stream(socket); return -1;
+    }
+    range->lo = (int32_t) ntohl(range->lo);
+
+    if (recv_msg(socket, (char *) &range->hi, sizeof(int32_t)) == -1) {
+        perror("Receive range hi error");
+        close_stream(socket); return -1;
+    }
+    range->hi = (int32_t) ntohl(range->hi);
+
+    if (recv_msg(socket, (char *) &range->max_items, sizeof(uint32_t)) == -1) {
+        perror("Receive range max_items error");
+        close_stream(socket); return -1;
+    }
+    range->max_items = ntohl(range->max_items);
+
+    return 0;
+}
+
+
+int recv_items(const int socket, item_t *items, const uint32_t num_items, arena_t *arena) {
+    /* function that receives a page of items (key, values & version of each one) from socket */
+    for (uint32_t i = 0; i < num_items; i++) {
+        if (recv_key(socket, &items[i]) == -1 || recv_values(socket, &items[i], arena) == -1 ||
+            recv_version(socket, &items[i]) == -1) return -1;
+    }
+
+    return 0;
+}
+
+
+int recv_cursor(const int socket, reply_t *reply) {
+    /* function that receives more & cursor members from socket */
+    if (recv_msg(socket, (char *) &reply->more, 1) == -1) {
+        perror("Receive more error");
+        close_stream(socket); return -1;
+    }
+
+    if (recv_msg(socket, (char *) &reply->cursor, sizeof(int64_t)) == -1) {
+        perror("Receive cursor error");
+        close_stream(socket); return -1;
+    }
+    reply->cursor = (int64_t) be64toh(reply->cursor);
+
+    return 0;
+}
+
+
+int recv_aggregate(const int socket, request_t *request) {
+    /* function that receives aggregate function & field members from socket */
+    if (recv_msg(socket, &request->agg_function, 1) == -1) {
+        perror("Receive aggregate function error");
+        close_stream(socket); return -1;
+    }
+
+    if (recv_msg(socket, &request->agg_field, 1) == -1) {
+        perror("Receive aggregate field error");
+        close_stream(socket); return -1;
+    }
+
+    return 0;
+}
+
+
+int recv_result(const int socket, reply_t *reply) {
+    /* function that receives the aggregation result member from socket */
+    uint64_t tmp;
+    if (recv_msg(socket, (char *) &tmp, sizeof(double)) == -1) {
+        perror("Receive result error");
+        close_stream(socket); return -1;
+    }
+    tmp = be64toh(tmp);
+    memcpy((char *) &reply->result, (char *) &tmp, sizeof(double));
+
+    return 0;
+}
+
+
+int recv_query(const int socket, request_t *request) {
+    /* function that receives cursor & keys_only members from socket */
+    if (recv_msg(socket, (char *) &request->cursor, sizeof(int64_t)) == -1) {
+        perror("Receive cursor error");
+        close_stream(socket); return -1;
+    }
+    request->cursor = (int64_t) be64toh(request->cursor);
+
+    if (recv_msg(socket, (char *) &request->keys_only, 1) == -1) {
+        perror("Receive keys_only error");
+        close_stream(socket); return -1;
+    }
+
+    return 0;
+}
+
+
+int recv_keys(const int socket, item_t *items, const uint32_t num_items) {
+    /* function that receives the keys of a page of items from socket */
+    for (uint32_t i = 0; i < num_items; i++) {
+        if (recv_key(socket, &items[i]) == -1) return -1;
+    }
+
+    return 0;
+}
+
+
+int recv_search(const int socket, request_t *request, arena_t *arena) {
+    /* function that receives search_mode member & pattern (stored in item.value1) from socket */
+    if (recv_msg(socket, &request->search_mode, 1) == -1) {
+        perror("Receive search_mode error");
+        close_stream(socket); return -1;
+    }
+
+    if (recv_string(socket, &request->item.value1, arena) == -1) {
+        perror("Receive pattern error");
+        close_stream(socket); return -1;
+    }
+
+    return 0;
+}
+
+
+int recv_key_chunk(const int socket, reply_t *reply) {
+    /* function that receives a chunk of keys from socket; reply->keys must have room for
+     * SEARCH_CHUNK_KEYS keys, and num_items member tells how many were received */
+    if (recv_num_items(socket, reply) == -1) return -1;
+    if (reply->num_items > SEARCH_CHUNK_KEYS) {
+        fprintf(stderr, "Receive keys error: chunk too large\n");
+        close_stream(socket); return -1;
+    }
+
+    if (reply->num_items && recv_msg(socket, (char *) reply->keys, (int) (reply->num_items * sizeof(int32_t))) == -1) {
+        perror("Receive keys error");
+        close_stream(socket); return -1;
+    }
+    for (uint32_t i = 0; i < reply->num_items; i++) reply->keys[i] = (int32_t) ntohl(reply->keys[i]);
+
+    return 0;
+}
+
+
+int recv_delta(const int socket, const char op_code, item_t *item) {
+    /* function that receives the value member used by INCR (value2) or ADD (value3) from socket */
+    if (op_code == INCR) {
+        if (recv_msg(socket, (char *) &item->value2, sizeof(int32_t)) == -1) {
+            perror("Receive value2 error");
+            close_stream(socket); return -1;
+        }
+        item->value2 = (int32_t) ntohl(item->value2);
+    } else {
+        uint32_t tmp;
+        if (recv_msg(socket, (char *) &tmp, sizeof(float)) == -1) {
+            perror("Receive value3 error");
+            close_stream(socket); return -1;
+        }
+        tmp = ntohl(tmp);
+        memcpy((char *) &item->value3, (char *) &tmp, sizeof(float));
+    }
+
+    return 0;
+}
+
+
+int recv_version(const int socket, item_t *item) {
+    /* function that receives the version member from socket */
+    if (recv_msg(socket, (char *) &item->version, sizeof(uint32_t)) == -1) {
+        perror("Receive version error");
+        close_stream(socket); return -1;
+    }
+    item->version = ntohl(item->version);
+
+    return 0;
+}
+
+
+int recv_txn_ops(const int socket, request_t *request, arena_t *arena) {
+    /* function that receives the sub-operations of a transaction from socket;
+     * request->ops must have room for TXN_MAX_OPS of them */
+    if (recv_msg(socket, (char *) &request->num_ops, sizeof(uint32_t)) == -1) {
+        perror("Receive num_ops error");
+        close_stream(socket); return -1;
+    }
+    request->num_ops = ntohl(request->num_ops);
+    if (request->num_ops > TXN_MAX_OPS) {
+        fprintf(stderr, "Receive num_ops error: too many operations\n");
+        close_stream(socket); return -1;
+    }
+
+    for (uint32_t i = 0; i < request->num_ops; i++) {
+        txn_op_t *op = &request->ops[i];
+        if (recv_msg(socket, &op->op_code, 1) == -1) {
+            perror("Receive txn op_code error");
+            close_stream(socket); return -1;
+        }
+        if (recv_key(socket, &op->item) == -1) return -1;
+        if ((op->op_code == SET_VALUE || op->op_code == MODIFY_VALUE) && recv_values(socket, &op->item, arena) == -1)
+            return -1;
+        if (op->op_code == TXN_COMPARE && recv_version(socket, &op->item) == -1) return -1;
+    }
+
+    return 0;
+}
+
+
+int recv_txn_results(const int socket, txn_op_t *ops, const uint32_t num_ops, arena_t *arena) {
+    /* function that receives the result of each sub-operation of a transaction from socket */
+    for (uint32_t i = 0; i < num_ops; i++) {
+        if (recv_msg(socket, (char *) &ops[i].result, sizeof(int32_t)) == -1) {
+            perror("Receive txn result error");
+            close_stream(socket); return -1;
+        }
+        ops[i].result = (int32_t) ntohl(ops[i].result);
+        if (ops[i].op_code == GET_VALUE && ops[i].result == SRV_SUCCESS &&
+            (recv_values(socket, &ops[i].item, arena) == -1 || recv_version(socket, &ops[i].item) == -1)) return -1;
+    }
+
+    return 0;
+}
+
+
+int recv_change(const int socket, change_t *change, arena_t *arena) {
+    /* function that receives a change notification from socket */
+    if (recv_msg(socket, &change->op_code, 1) == -1) {
+        perror("Receive change op_code error");
+        close_stream(socket); return -1;
+    }
+
+    uint64_t tmp[2];
+    if (recv_msg(socket, (char *) tmp, sizeof(tmp)) == -1) {
+        perror("Receive change seq error");
+        close_stream(socket); return -1;
+    }
+    change->seq = be64toh(tmp[0]);
+    change->lag = be64toh(tmp[1]);
+
+    if (recv_key(socket, &change->item) == -1) return -1;
+    if ((change->op_code == SET_VALUE || change->op_code == MODIFY_VALUE) &&
+        (recv_values(socket, &change->item, arena) == -1 || recv_version(socket, &change->item) == -1)) return -1;
+
+    return 0;
+}
+
+
+int recv_seq(const int socket, request_t *request) {
+    /* function that receives seq member from socket */
+    if (recv_msg(socket, (char *) &request->seq, sizeof(uint64_t)) == -1) {
+        perror("Receive seq error");
+        close_stream(socket); return -1;
+    }
+    request->seq = be64toh(request->seq);
+
+    return 0;
+}
+
+
+int recv_watch(const int socket, request_t *request) {
+    /* function that receives seq & keys_only members from socket */
+    if (recv_seq(socket, request) == -1) return -1;
+
+    if (recv_msg(socket, (char *) &request->keys_only, 1) == -1) {
+        perror("Receive keys_only error");
+        close_stream(socket); return -1;
+    }
+
+    return 0;
+}
+
+
+int recv_lease(const int socket, reply_t *reply) {
+    /* function that receives lease_ms member from socket */
+    if (recv_msg(socket, (char *) &reply->lease_ms, sizeof(uint32_t)) == -1) {
+        perror("Receive lease error");
+        close_stream(socket); return -1;
+    }
+    reply->lease_ms = ntohl(reply->lease_ms);
+
+    return 0;
+}
+
+
+int recv_replica_status(const int socket, reply_t *reply) {
+    /* function that receives replica member from socket */
+    if (recv_msg(socket, (char *) &reply->replica.connected, 1) == -1) {
+        perror("Receive replica state error");
+        close_stream(socket); return -1;
+    }
+
+    uint64_t tmp[2];
+    if (recv_msg(socket, (char *) tmp, sizeof(tmp)) == -1) {
+        perror("Receive replica progress error");
+        close_stream(socket); return -1;
+    }
+    reply->replica.applied_seq = be64toh(tmp[0]);
+    reply->replica.lag = be64toh(tmp[1]);
+
+    return 0;
+}
+
+
+int recv_stats(const int socket, reply_t *reply) {
+    /* function that receives stats member from socket */
+    uint64_t tmp[sizeof(server_stats_t) / sizeof(uint64_t)];
+    if (recv_msg(socket, (char *) tmp, sizeof(tmp)) == -1) {
+        perror("Receive stats error");
+        close_stream(socket); return -1;
+    }
+
+    uint64_t *fields = (uint64_t *) reply->stats;
+    for (size_t i = 0; i < sizeof(tmp) / sizeof(uint64_t); i++) fields[i] = be64toh(tmp[i]);
+
+    return 0;
+}
+
+
+/* framing: sizes of requests as sent by the client API */
+#define RANGE_SIZE (2 * sizeof(int32_t) + sizeof(uint32_t))     /* lo, hi & max_items */
+
+
+static int string_size(const char *buf, const size_t len, size_t *size) {
+    /* adds the size of the string sent by send_string at *size to it;
+     * returns 1 if its length hasn't arrived yet, -1 if it's too long */
+    uint32_t str_len;
+    if (len < *size + sizeof(uint32_t)) return 1;
+    memcpy(&str_len, buf + *size, sizeof(uint32_t));
+    str_len = ntohl(str_len);
+    if (str_len > value1_max_len) {
+        fprintf(stderr, "Receive string error: %u bytes, max is %u\n", str_len, value1_max_len); return -1;
+    }
+
+    *size += sizeof(uint32_t) + str_len;
+    return 0;
+}
+
+
+static int txn_ops_size(const char *buf, const size_t len, size_t *size) {
+    /* adds the size of the sub-operations sent by send_txn_ops at *size to it;
+     * returns 1 if some of them haven't arrived yet, -1 if there are too many */
+    uint32_t num_ops;
+    if (len < *size + sizeof(uint32_t)) return 1;
+    memcpy(&num_ops, buf + *size, sizeof(uint32_t));
+    num_ops = ntohl(num_ops);
+    if (num_ops > TXN_MAX_OPS) {
+        fprintf(stderr, "Receive num_ops error: too many operations\n"); return -1;
+    }
+    *size += sizeof(uint32_t);
+
+    for (uint32_t i = 0; i < num_ops; i++) {
+        if (len < *size + 1) return 1;
+        char op_code = buf[*size];
+        *size += 1 + sizeof(int32_t);      /* op_code & key */
+
+        if (op_code == SET_VALUE || op_code == MODIFY_VALUE) {
+            int result = string_size(buf, len, size);
+            if (result) return result;
+            *size += sizeof(int32_t) + sizeof(float);
+        } else if (op_code == TXN_COMPARE) *size += sizeof(uint32_t);
+    }
+
+    return 0;
+}
+
+
+ssize_t request_size(const char *buf, const size_t len) {
+    /* function that tells the size of the request at the beginning of buf, as sent by the client API:
+     * 0 if some of it hasn't arrived yet, -1 if it's malformed. requests with an invalid op_code
+     * are as long as their header */
+    size_t size = 2 * sizeof(uint32_t) + 1;     /* transaction ID, op_code & deadline */
+    int result = 0;
+    if (len < size) return 0;
+
+    switch (buf[sizeof(uint32_t)]) {
+        case GET_VALUE:
+        case DELETE_KEY:
+        case EXIST:
+            size += sizeof(int32_t); break;
+        case SET_VALUE:
+        case MODIFY_VALUE:
+        case UPSERT:
+        case CAS:
+            size += sizeof(int32_t);
+            result = string_size(buf, len, &size);
+            size += sizeof(int32_t) + sizeof(float);
+            if (buf[sizeof(uint32_t)] == CAS) size += sizeof(uint32_t);
+            break;
+        case SCAN:
+            size += RANGE_SIZE; break;
+        case AGGREGATE:
+            size += 2 + RANGE_SIZE; break;
+        case QUERY:
+            size += RANGE_SIZE + sizeof(int64_t) + 1; break;
+        case SEARCH:
+            size += 1;
+            result = string_size(buf, len, &size);
+            break;
+        case INCR:
+        case ADD:
+            size += sizeof(int32_t) + sizeof(int32_t); break;
+        case TXN:
+            result = txn_ops_size(buf, len, &size); break;
+        case WATCH:
+            size += RANGE_SIZE + sizeof(uint64_t) + 1; break;
+        default: break;     /* INIT, NUM_ITEMS, REPLICA_STATUS & STATS have no body */
+    }
+
+    if (result) return result == 1 ? 0 : -1;
+    return len >= size ? (ssize_t) size : 0;
+}
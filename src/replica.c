@@ -0,0 +1,252 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include "DS-MandatoryExercise/utils.h"
+#include "DS-MandatoryExercise/netUtils.h"
+#include "DS-MandatoryExercise/replica.h"
+#include "DS-MandatoryExercise/metrics.h"
+#include "DS-MandatoryExercise/dbms/dbms.h"
+
+extern pthread_mutex_t mutex_db;            /* DB lock, owned by the server */
+
+static char primary_host[MAX_STR_SIZE];     /* primary server address */
+static int primary_port;
+static int running = FALSE;                 /* TRUE once the server was started as a replica */
+static arena_t arena;                       /* value1 strings of the snapshot page or change being applied */
+
+static pthread_mutex_t mutex_status = PTHREAD_MUTEX_INITIALIZER;
+static replica_status_t status;             /* replication progress, reported to clients */
+
+static pthread_t thread;
+static pthread_cond_t cond_stop = PTHREAD_COND_INITIALIZER;
+static int stopping = FALSE;                /* TRUE once replica_stop was called; guarded by mutex_status */
+static int watch_socket = -1;               /* copy of the watch socket, shut down to stop following the primary;
+                                             * guarded by mutex_status */
+
+
+static void set_status(const int connected, const uint64_t applied_seq, const uint64_t lag) {
+    pthread_mutex_lock(&mutex_status);
+    status.connected = (uint8_t) connected;
+    status.applied_seq = applied_seq;
+    status.lag = lag;
+    pthread_mutex_unlock(&mutex_status);
+}
+
+
+static int open_watch(uint64_t *start_seq) {
+    /* subscribes to every change committed on the primary from now on; returns the watch socket */
+    int socket = connect_to_host(primary_host, primary_port);
+    if (socket == -1) return -1;
+
+    request_t request;
+    request.header.id = 0;
+    request.header.op_code = WATCH;
+    request.header.deadline_us = 0;
+    request.range.lo = INT32_MIN;
+    request.range.hi = INT32_MAX;
+    request.range.max_items = 0;
+    request.seq = 0;
+    request.keys_only = FALSE;
+    reply_t reply;
+
+    if (send_request_header(socket, &request.header) == -1 ||
+        send_range(socket, &request.range) == -1 ||
+        send_watch(socket, &request) == -1 ||
+        recv_reply_header(socket, &reply) == -1) return -1;
+
+    if (reply.server_error_code != SRV_SUCCESS || recv_seq(socket, &request) == -1) {
+        fprintf(stderr, "Primary refused to replicate\n");
+        close(socket); return -1;
+    }
+    *start_seq = request.seq;
+    return socket;
+}
+
+
+static int copy_items(void) {
+    /* replaces the local DB with a snapshot of the primary's, fetched one scan page at a time;
+     * changes committed meanwhile are applied again afterwards, which is harmless */
+    item_t *items = malloc(SCAN_MAX_ITEMS * sizeof(item_t));
+    if (!items) {
+        perror("Could not allocate snapshot page"); return -1;
+    }
+
+    metrics_lock_db();
+    int error = db_empty_db() == -1;
+    pthread_mutex_unlock(&mutex_db);
+
+    int32_t cursor = INT32_MIN;
+    for (int more = TRUE; more && !error;) {
+        int socket = connect_to_host(primary_host, primary_port);
+        if (socket == -1) {
+            error = TRUE; break;
+        }
+
+        request_t request;
+        request.header.id = 0;
+        request.header.op_code = SCAN;
+        request.header.deadline_us = 0;
+        request.range.lo = cursor;
+        request.range.hi = INT32_MAX;
+        request.range.max_items = SCAN_MAX_ITEMS;
+        reply_t reply;
+
+        if (send_request_header(socket, &request.header) == -1 ||
+            send_range(socket, &request.range) == -1 ||
+            recv_reply_header(socket, &reply) == -1 ||
+            recv_num_items(socket, &reply) == -1) {
+            error = TRUE; break;
+        }
+        if (reply.num_items > SCAN_MAX_ITEMS) {
+            fprintf(stderr, "Primary sent a page too big\n");
+            close(socket); error = TRUE; break;
+        }
+        arena_reset(&arena);
+        if (recv_items(socket, items, reply.num_items, &arena) == -1 || recv_cursor(socket, &reply) == -1) {
+            error = TRUE; break;
+        }
+        close(socket);
+        if (reply.server_error_code != SRV_SUCCESS) {
+            error = TRUE; break;
+        }
+
+        /* apply the page as if its items had just been set on the primary */
+        metrics_lock_db();
+        for (uint32_t i = 0; i < reply.num_items && !error; i++) {
+            change_t change = {.op_code = SET_VALUE, .item = items[i]};
+            error = db_apply_change(&change) == -1;
+        }
+        pthread_mutex_unlock(&mutex_db);
+
+        more = reply.more;
+        cursor = (int32_t) reply.cursor;
+    }
+
+    free(items);
+    return error ? -1 : 0;
+}
+
+
+static int apply_changes(const int socket, const uint64_t start_seq) {
+    /* brings the local DB up to date with the primary and keeps it that way until the connection breaks
+     * or the replica falls too far behind; the watch is opened before copying the DB, so nothing is missed */
+    if (copy_items() == -1) {
+        close(socket); return -1;
+    }
+    set_status(TRUE, start_seq - 1, 0);
+    fprintf(stderr, "Replicating %s:%d from change %lu\n", primary_host, primary_port, (unsigned long) start_seq);
+
+    while (TRUE) {
+        change_t change;
+        /* recv_change closes the socket when it fails */
+        arena_reset(&arena);
+        if (recv_change(socket, &change, &arena) == -1) return -1;
+
+        if (change.op_code == WATCH_LAGGED) {
+            fprintf(stderr, "Replica missed %lu changes, copying DB again\n", (unsigned long) change.lag);
+            close(socket); return 0;
+        }
+
+        metrics_lock_db();
+        int error = db_apply_change(&change) == -1;
+        pthread_mutex_unlock(&mutex_db);
+
+        if (error) {
+            close(socket); return -1;
+        }
+        set_status(TRUE, change.seq, change.lag);
+    }
+}
+
+
+static int follow_primary(void) {
+    uint64_t start_seq;
+    int socket = open_watch(&start_seq);
+    if (socket == -1) return -1;
+
+    /* the copy stays open until following ends, even once recv_change has closed the socket */
+    pthread_mutex_lock(&mutex_status);
+    watch_socket = stopping ? -1 : dup(socket);
+    int error = watch_socket == -1;
+    pthread_mutex_unlock(&mutex_status);
+    if (error) {
+        close(socket); return -1;
+    }
+
+    int result = apply_changes(socket, start_seq);
+
+    pthread_mutex_lock(&mutex_status);
+    close(watch_socket);
+    watch_socket = -1;
+    pthread_mutex_unlock(&mutex_status);
+    return result;
+}
+
+
+static void *replica_thread(void *args) {
+    pthread_mutex_lock(&mutex_status);
+    while (!stopping) {
+        pthread_mutex_unlock(&mutex_status);
+        int error = follow_primary() == -1;
+
+        pthread_mutex_lock(&mutex_status);
+        status.connected = FALSE;
+        if (error && !stopping) {
+            fprintf(stderr, "Lost primary %s:%d, retrying\n", primary_host, primary_port);
+            struct timespec retry;
+            clock_gettime(CLOCK_REALTIME, &retry);
+            retry.tv_sec += REPLICA_RETRY_S;
+            while (!stopping && pthread_cond_timedwait(&cond_stop, &mutex_status, &retry) == 0);
+        }
+    }
+    pthread_mutex_unlock(&mutex_status);
+    return NULL;
+}
+
+
+int replica_start(const char *primary) {
+    /* starts following the primary given as host:port */
+    if (str_to_host_port(primary, strlen(primary), primary_host, &primary_port) == -1) return -1;
+    arena_init(&arena);
+    stopping = FALSE;
+
+    if (pthread_create(&thread, NULL, replica_thread, NULL) != 0) {
+        perror("Could not create replica thread"); return -1;
+    }
+
+    running = TRUE;
+    return 0;
+}
+
+
+void replica_stop(void) {
+    /* stops following the primary, once the change being applied is */
+    if (!running) return;
+
+    pthread_mutex_lock(&mutex_status);
+    stopping = TRUE;
+    if (watch_socket != -1) shutdown(watch_socket, SHUT_RDWR);
+    pthread_cond_signal(&cond_stop);
+    pthread_mutex_unlock(&mutex_status);
+
+    pthread_join(thread, NULL);
+    arena_free(&arena);
+    memset(&status, 0, sizeof(replica_status_t));
+    running = FALSE;
+}
+
+
+int replica_is_running(void) {
+    return running;
+}
+
+
+void replica_get_status(replica_status_t *replica) {
+    pthread_mutex_lock(&mutex_status);
+    *replica = status;
+    pthread_mutex_unlock(&mutex_status);
+}
@@ -0,0 +1,228 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "DS-MandatoryExercise/utils.h"
+#include "DS-MandatoryExercise/metrics.h"
+#include "DS-MandatoryExercise/trace.h"
+#include "DS-MandatoryExercise/dbms/dbms.h"
+
+typedef struct {
+    /* stages of a request, as clock_ns stamps; lock waits & storage I/O are added up over its execution */
+    uint32_t id;                            /* transaction ID sent by the client */
+    char op_code;
+    time_t time;                            /* wall clock time the reply was sent at */
+    uint64_t accepted_ns;                   /* connection accepted */
+    uint64_t started_ns;                    /* taken out of conn_q (or fully received, in the ring) */
+    uint64_t received_ns;                   /* rest of the request received */
+    uint64_t executed_ns;                   /* executed, reply not sent yet */
+    uint64_t replied_ns;                    /* reply sent */
+    uint64_t lock_wait_ns;                  /* waiting for mutex_db */
+    uint64_t io_ns;                         /* in storage engine reads & writes */
+} trace_t;
+
+typedef struct {
+    /* ring slot: seq tells producers & the flush thread whose turn it is to use it */
+    uint64_t seq;
+    trace_t trace;
+} ring_slot_t;
+
+/* bounded ring with a sequence number per slot: service threads claim slots by moving ring_head forward with
+ * a compare & swap, and the flush thread, the only consumer, frees them by moving ring_tail forward.
+ * slot i is free for the producer claiming position pos once its seq is pos, and holds a trace
+ * for the consumer at position pos once its seq is pos + 1 */
+static ring_slot_t ring[TRACE_RING_SIZE];
+static uint64_t ring_head;                  /* next position producers claim */
+static uint64_t ring_tail;                  /* next position the flush thread reads; only it writes it */
+static uint64_t dropped;                    /* slow requests that found the ring full */
+static uint64_t dropped_logged;             /* dropped, as of the last flush; only the flush thread writes it */
+
+static uint64_t slow_ns;                    /* requests taking longer are logged; 0 if tracing is off */
+static _Thread_local trace_t current;       /* request the calling thread is serving */
+static _Thread_local int tracing = FALSE;   /* TRUE while current is being stamped */
+static _Thread_local uint64_t io_start_ns;  /* storage I/O time of the calling thread before the request */
+
+static pthread_t flush_th;
+static int flushing = FALSE;                /* TRUE while flush_th runs */
+static pthread_mutex_t mutex_flush = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond_flush_stop = PTHREAD_COND_INITIALIZER;
+static int flush_stopping;                  /* guarded by mutex_flush */
+
+
+static void ring_put(const trace_t *trace) {
+    /* copies trace into a free slot; never blocks, so the trace is dropped if there's none */
+    uint64_t pos = __atomic_load_n(&ring_head, __ATOMIC_RELAXED);
+    ring_slot_t *slot;
+
+    while (TRUE) {
+        slot = &ring[pos & (TRACE_RING_SIZE - 1)];
+        int64_t diff = (int64_t) (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - pos);
+        if (diff == 0) {
+            /* the slot is free: claim it, unless another producer did first; pos is reloaded if so */
+            if (__atomic_compare_exchange_n(&ring_head, &pos, pos + 1, TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        } else if (diff < 0) {
+            /* the slot still holds a trace from the previous lap: the ring is full */
+            __atomic_add_fetch(&dropped, 1, __ATOMIC_RELAXED); return;
+        } else pos = __atomic_load_n(&ring_head, __ATOMIC_RELAXED);
+    }
+
+    slot->trace = *trace;
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+}
+
+
+static int ring_take(trace_t *trace) {
+    /* moves the oldest trace in the ring to trace; returns FALSE if there's none. called by the flush thread only */
+    ring_slot_t *slot = &ring[ring_tail & (TRACE_RING_SIZE - 1)];
+    if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != ring_tail + 1) return FALSE;
+
+    *trace = slot->trace;
+    __atomic_store_n(&slot->seq, ring_tail + TRACE_RING_SIZE, __ATOMIC_RELEASE);
+    ring_tail++;
+    return TRUE;
+}
+
+
+static double us(const uint64_t ns) {
+    return (double) ns / 1000;
+}
+
+
+static int flush_ring(void) {
+    /* appends the traces in the ring to SLOW_LOG_FILE_NAME, which is only opened if there are any */
+    uint64_t dropped_now = __atomic_load_n(&dropped, __ATOMIC_RELAXED);
+    trace_t trace;
+    int taken = ring_take(&trace);
+    if (!taken && dropped_now == dropped_logged) return 0;
+
+    FILE *file = fopen(SLOW_LOG_FILE_NAME, "a");
+    if (!file) return -1;
+    if (ftell(file) == 0) {
+        fprintf(file, "%-10s %10s %-14s %10s %10s %10s %10s %10s %10s %10s\n", "time", "id", "op", "total us",
+                "queue us", "recv us", "lock us", "io us", "exec us", "send us");
+    }
+
+    for (; taken; taken = ring_take(&trace)) {
+        fprintf(file, "%-10ld %10u %-14s %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n", (long) trace.time,
+                trace.id, metrics_op_name(trace.op_code), us(trace.replied_ns - trace.accepted_ns),
+                us(trace.started_ns - trace.accepted_ns), us(trace.received_ns - trace.started_ns),
+                us(trace.lock_wait_ns), us(trace.io_ns), us(trace.executed_ns - trace.received_ns),
+                us(trace.replied_ns - trace.executed_ns));
+    }
+    if (dropped_now != dropped_logged) {
+        fprintf(file, "# %lu slow requests dropped so far, the ring was full\n", (unsigned long) dropped_now);
+        dropped_logged = dropped_now;
+    }
+
+    return fclose(file) == EOF ? -1 : 0;
+}
+
+
+static int wait_flush(void) {
+    /* sleeps for SLOW_LOG_FLUSH_MS; returns FALSE if slow_log_stop was called meanwhile */
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += SLOW_LOG_FLUSH_MS / 1000;
+    deadline.tv_nsec += (SLOW_LOG_FLUSH_MS % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&mutex_flush);
+    while (!flush_stopping && pthread_cond_timedwait(&cond_flush_stop, &mutex_flush, &deadline) == 0);
+    int stop = flush_stopping;
+    pthread_mutex_unlock(&mutex_flush);
+    return !stop;
+}
+
+
+static void *flush_thread(void *args) {
+    /* the ring is flushed once more when stopped, so that the last slow requests are logged too */
+    int running;
+    do {
+        running = wait_flush();
+        if (flush_ring() == -1) perror("Could not write slow request log");
+    } while (running);
+    return NULL;
+}
+
+
+int slow_log_start(const uint64_t slow_us) {
+    /* requests taking longer than slow_us, from their connection being accepted to their reply being sent,
+     * are logged to SLOW_LOG_FILE_NAME from now on; must be called before any request is served */
+    for (uint64_t i = 0; i < TRACE_RING_SIZE; i++) ring[i].seq = i;
+    ring_head = ring_tail = 0;
+    dropped = dropped_logged = 0;
+    flush_stopping = FALSE;
+
+    if (pthread_create(&flush_th, NULL, flush_thread, NULL) != 0) {
+        fprintf(stderr, "Could not start slow request log\n"); return -1;
+    }
+    flushing = TRUE;
+    __atomic_store_n(&slow_ns, slow_us * 1000, __ATOMIC_RELAXED);
+    return 0;
+}
+
+
+void slow_log_stop(void) {
+    /* called once no more requests are served */
+    __atomic_store_n(&slow_ns, 0, __ATOMIC_RELAXED);
+    if (!flushing) return;
+
+    pthread_mutex_lock(&mutex_flush);
+    flush_stopping = TRUE;
+    pthread_cond_signal(&cond_flush_stop);
+    pthread_mutex_unlock(&mutex_flush);
+
+    pthread_join(flush_th, NULL);
+    flushing = FALSE;
+}
+
+
+void trace_request(const uint32_t id, const char op_code, const uint64_t accepted_ns, const uint64_t started_ns) {
+    /* starts tracing the request the calling thread just received the header of */
+    tracing = __atomic_load_n(&slow_ns, __ATOMIC_RELAXED) != 0;
+    if (!tracing) return;
+
+    memset(&current, 0, sizeof(trace_t));
+    current.id = id;
+    current.op_code = op_code;
+    current.accepted_ns = accepted_ns;
+    current.started_ns = started_ns;
+    io_start_ns = db_thread_io_ns();
+}
+
+
+void trace_received(void) {
+    if (tracing) current.received_ns = clock_ns();
+}
+
+
+void trace_lock_wait(const uint64_t wait_ns) {
+    if (tracing) current.lock_wait_ns += wait_ns;
+}
+
+
+void trace_executed(void) {
+    if (tracing) current.executed_ns = clock_ns();
+}
+
+
+void trace_replied(void) {
+    /* ends the trace of the request whose reply was just sent, and puts it in the ring if it was slow */
+    if (!tracing) return;
+    tracing = FALSE;
+
+    current.replied_ns = clock_ns();
+    uint64_t slow = __atomic_load_n(&slow_ns, __ATOMIC_RELAXED);
+    if (!slow || current.replied_ns - current.accepted_ns <= slow) return;
+
+    /* stages a request doesn't have take no time */
+    if (!current.received_ns) current.received_ns = current.started_ns;
+    if (!current.executed_ns) current.executed_ns = current.received_ns;
+    current.io_ns = db_thread_io_ns() - io_start_ns;
+    current.time = time(NULL);
+    ring_put(&current);
+}
@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "DS-MandatoryExercise/uring.h"
+
+
+int uring_init(uring_t *ring, const unsigned entries) {
+    /* sets up a ring with room for entries submissions; returns -1 with errno set if the kernel
+     * doesn't offer io_uring, or one too old to map both rings at once */
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(ring, 0, sizeof(*ring));
+
+    ring->fd = (int) syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd == -1) return -1;
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        close(ring->fd);
+        errno = ENOSYS; return -1;
+    }
+
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->rings_size = sq_size > cq_size ? sq_size : cq_size;
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->rings = mmap(NULL, ring->rings_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+                       IORING_OFF_SQ_RING);
+    if (ring->rings == MAP_FAILED) {
+        close(ring->fd); return -1;
+    }
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+                      IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        munmap(ring->rings, ring->rings_size);
+        close(ring->fd); return -1;
+    }
+
+    char *rings = ring->rings;
+    ring->sq_entries = params.sq_entries;
+    ring->sq_mask = *(unsigned *) (rings + params.sq_off.ring_mask);
+    ring->sq_head = (unsigned *) (rings + params.sq_off.head);
+    ring->sq_tail = (unsigned *) (rings + params.sq_off.tail);
+    ring->sq_array = (unsigned *) (rings + params.sq_off.array);
+    ring->cq_mask = *(unsigned *) (rings + params.cq_off.ring_mask);
+    ring->cq_head = (unsigned *) (rings + params.cq_off.head);
+    ring->cq_tail = (unsigned *) (rings + params.cq_off.tail);
+    ring->cqes = (struct io_uring_cqe *) (rings + params.cq_off.cqes);
+    ring->tail = *ring->sq_tail;
+    return 0;
+}
+
+
+void uring_free(uring_t *ring) {
+    /* operations still in flight are cancelled, and registered files closed, along with the ring */
+    munmap(ring->sqes, ring->sqes_size);
+    munmap(ring->rings, ring->rings_size);
+    close(ring->fd);
+}
+
+
+int uring_register(uring_t *ring, const unsigned opcode, void *arg, const unsigned nr_args) {
+    return (int) syscall(__NR_io_uring_register, ring->fd, opcode, arg, nr_args);
+}
+
+
+struct io_uring_sqe *uring_get_sqe(uring_t *ring) {
+    /* queues an empty entry, submitted by the next uring_submit; NULL if the submission queue is full */
+    unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if (ring->tail - head == ring->sq_entries) return NULL;
+
+    unsigned index = ring->tail & ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[index] = index;
+    ring->tail++;
+    return sqe;
+}
+
+
+int uring_submit(uring_t *ring, const unsigned wait_nr) {
+    /* submits the entries queued and waits until there are at least wait_nr completions to reap;
+     * returns the number of entries submitted, -1 with errno set on error (EINTR included) */
+    __atomic_store_n(ring->sq_tail, ring->tail, __ATOMIC_RELEASE);
+    unsigned to_submit = ring->tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+
+    return (int) syscall(__NR_io_uring_enter, ring->fd, to_submit, wait_nr, wait_nr ? IORING_ENTER_GETEVENTS : 0,
+                         NULL, 0);
+}
+
+
+struct io_uring_cqe *uring_peek_cqe(uring_t *ring) {
+    /* oldest completion not seen yet; NULL if there's none */
+    unsigned head = *ring->cq_head;
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) return NULL;
+    return &ring->cqes[head & ring->cq_mask];
+}
+
+
+void uring_cqe_seen(uring_t *ring) {
+    /* lets the kernel reuse the completion returned by uring_peek_cqe */
+    __atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
@@ -3,6 +3,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <time.h>
 #include "DS-MandatoryExercise/utils.h"
 
 
@@ -57,10 +58,74 @@ int str_to_num(const char *value_str, void *value, const char type) {
 }
 
 
+int str_to_host_port(const char *str, const size_t len, char *host, int *port) {
+    /* function that splits the first len chars of str, written as host:port, into host & port;
+     * host should be at least MAX_STR_SIZE bytes long */
+    char host_port[MAX_STR_SIZE];
+    if (len >= MAX_STR_SIZE) {
+        fprintf(stderr, "Address too long\n"); return -1;
+    }
+    memcpy(host_port, str, len);
+    host_port[len] = '\0';
+
+    char *colon = strrchr(host_port, ':');
+    if (!colon || colon == host_port) {
+        fprintf(stderr, "Invalid address: %s\n", host_port); return -1;
+    }
+    *colon = '\0';
+    if (str_to_num(colon + 1, (void *) port, INT) == -1) return -1;
+
+    strcpy(host, host_port);
+    return 0;
+}
+
+
 /* file & socket stuff */
 
+static _Thread_local mem_stream_t *mem_stream;     /* stream used by MEM_STREAM in the calling thread */
+
+
+void mem_stream_set(mem_stream_t *stream) {
+    mem_stream = stream;
+}
+
+
+static int mem_stream_write(const char *buffer, const size_t len) {
+    if (mem_stream->out_len + len > mem_stream->out_cap) {
+        size_t cap = mem_stream->out_cap ? mem_stream->out_cap : 256;
+        while (cap < mem_stream->out_len + len) cap *= 2;
+
+        char *out = realloc(mem_stream->out, cap);
+        if (!out) return -1;
+        mem_stream->out = out;
+        mem_stream->out_cap = cap;
+    }
+    memcpy(mem_stream->out + mem_stream->out_len, buffer, len);
+    mem_stream->out_len += len;
+    return 0;
+}
+
+
+static int mem_stream_read(char *buffer, const size_t len) {
+    if (mem_stream->in_len - mem_stream->in_pos < len) {
+        errno = ENODATA; return -1;
+    }
+    memcpy(buffer, mem_stream->in + mem_stream->in_pos, len);
+    mem_stream->in_pos += len;
+    return 0;
+}
+
+
+void close_stream(const int d) {
+    /* closes d on error; MEM_STREAM is left alone, as its caller owns the socket behind it */
+    if (d != MEM_STREAM) close(d);
+}
+
+
 int send_msg(const int d, char *buffer, const int len) {
     /* sends a message of len bytes to d (socket, file... descriptor) */
+    if (d == MEM_STREAM) return mem_stream_write(buffer, (size_t) len);
+
     ssize_t bytes_sent;         /* number of bytes written by last write() */
     ssize_t bytes_left = len;   /* number of bytes left to be received */
 
@@ -77,6 +142,8 @@ int send_msg(const int d, char *buffer, const int len) {
 
 int recv_msg(const int d, char *buffer, const int len) {
     /* receives a message of len bytes from d (socket, file... descriptor) */
+    if (d == MEM_STREAM) return mem_stream_read(buffer, (size_t) len);
+
     ssize_t bytes_received;     /* number of bytes fetched by last read() */
     ssize_t bytes_left = len;   /* number of bytes left to be received */
 
@@ -84,9 +151,10 @@ int recv_msg(const int d, char *buffer, const int len) {
         bytes_received = read(d, buffer, bytes_left);
         bytes_left -= bytes_received;
         buffer += bytes_received;
-    } while ((bytes_left > 0) && (bytes_received >= 0));
+    } while ((bytes_left > 0) && (bytes_received > 0));
 
     if (bytes_received < 0) return -1;  /* read() error */
+    if (bytes_left > 0) return -1;      /* EOF before the whole message arrived */
     return 0;	/* full length has been received */
 }
 
@@ -132,3 +200,37 @@ ssize_t read_line(const int d, char *buffer, const int buf_space) {
     *buffer = '\0';
     return bytes_read_total;
 }
+
+
+/* metrics stuff */
+
+uint64_t clock_ns(void) {
+    /* monotonic clock, in nanoseconds */
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+}
+
+
+void histogram_add(histogram_t *histogram, const uint64_t ns) {
+    /* records a latency; a histogram has a single writer, but may be read by histogram_merge meanwhile */
+    uint64_t us = ns / 1000;
+    int bucket = 0;
+    while (us && bucket < STATS_BUCKETS - 1) {
+        us >>= 1;
+        bucket++;
+    }
+
+    __atomic_store_n(&histogram->count, histogram->count + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&histogram->total_ns, histogram->total_ns + ns, __ATOMIC_RELAXED);
+    __atomic_store_n(&histogram->buckets[bucket], histogram->buckets[bucket] + 1, __ATOMIC_RELAXED);
+}
+
+
+void histogram_merge(histogram_t *total, const histogram_t *histogram) {
+    /* adds histogram to total */
+    total->count += __atomic_load_n(&histogram->count, __ATOMIC_RELAXED);
+    total->total_ns += __atomic_load_n(&histogram->total_ns, __ATOMIC_RELAXED);
+    for (int i = 0; i < STATS_BUCKETS; i++)
+        total->buckets[i] += __atomic_load_n(&histogram->buckets[i], __ATOMIC_RELAXED);
+}
@@ -1,6 +1,11 @@
 /* gtest.h declares the testing framework */
 #include "gtest/gtest.h"
 #include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <sys/wait.h>
 
 extern "C" {
 #include "DS-MandatoryExercise/utils.h"
@@ -50,23 +55,21 @@ TEST(keys_tests, test_set_value) {
 TEST(keys_tests, test_set_value_value1_too_long) {
     /* testing set_value service: checking that value1 never exceeds its max length */
 
-    /* initial setup: trying to insert a tuple with a value1 longer that it's supposed to be */
+    /* initial setup */
     init();
     int key_1 = 11;
-    /* 260 chars, longer than the 255 value1 allows */
-    char value1_1[] = "123456789012345678901234567890123456789012345678901234567890123456789012345678901234567890"
-                      "123456789012345678901234567890123456789012345678901234567890123456789012345678901234567890"
-                      "12345678901234567890123456789012345678901234567890123456789012345678901234567890\0";
     int value2_1 = 11;
     float value3_1 = 11.1f;
-    set_value(key_1, value1_1, value2_1, value3_1);
 
-    /* success: retrieve tuple & check value1: it should be shorter that the one we tried to write */
-    char value1_2[VALUE1_MAX_STR_SIZE]; int value2_2; float value3_2;
+    /* failure: value1 one char longer than the max is refused */
+    std::string value1_1(VALUE1_DEFAULT_MAX_LEN + 1, 'a');
+    ASSERT_EQ(set_value(key_1, &value1_1[0], value2_1, value3_1), ERROR);
+    ASSERT_EQ(exist(key_1), NOT_EXISTS);    /* sanity check: tuple wasn't created */
 
+    /* success: value1 as long as the max is stored */
+    value1_1.pop_back();
+    ASSERT_EQ(set_value(key_1, &value1_1[0], value2_1, value3_1), SUCCESS);
     ASSERT_EQ(exist(key_1), EXISTS);        /* sanity check: tuple exists */
-    get_value(key_1, value1_2, &value2_2, &value3_2);
-    ASSERT_EQ(strlen(value1_1) > strlen(value1_2), true);
 }
 
 
@@ -141,21 +144,60 @@ TEST(keys_tests, test_modify_value_value1_too_long) {
     float value3_1 = 11.1f;
     set_value(key_1, value1_1, value2_1, value3_1);
 
-    /* trying to modify a tuple with a value1 longer that it's supposed to be:
-     * 260 chars, longer than the 255 value1 allows */
-    char value1_2[] = "123456789012345678901234567890123456789012345678901234567890123456789012345678901234567890"
-                      "123456789012345678901234567890123456789012345678901234567890123456789012345678901234567890"
-                      "12345678901234567890123456789012345678901234567890123456789012345678901234567890\0";
+    /* failure: modifying a tuple with a value1 longer than the max */
+    std::string value1_2(VALUE1_DEFAULT_MAX_LEN + 1, 'a');
 
     ASSERT_EQ(exist(key_1), EXISTS);        /* sanity check: tuple exists */
-    modify_value(key_1, value1_2, value2_1, value3_1);
+    ASSERT_EQ(modify_value(key_1, &value1_2[0], value2_1, value3_1), ERROR);
     ASSERT_EQ(exist(key_1), EXISTS);        /* sanity check: tuple still exists */
 
-    /* success: retrieve tuple & check value1: it should be shorter that the one we tried to write */
+    /* success: retrieve tuple & check value1: it should be the one it had */
     char value1_3[VALUE1_MAX_STR_SIZE];
 
-    get_value(key_1, value1_3, &value2_1, &value3_1);
-    ASSERT_EQ(strlen(value1_2) > strlen(value1_3), true);
+    ASSERT_EQ(get_value(key_1, value1_3, &value2_1, &value3_1), SUCCESS);
+    ASSERT_STREQ(value1_3, value1_1);
+}
+
+
+TEST(keys_tests, test_large_value) {
+    /* testing value1 strings longer than a page & than the buffer get_value assumes */
+
+    /* initial setup: value1 made of a repeating pattern, so misplaced chunks are noticed */
+    init();
+    std::string value1_1(300000, ' '), value1_2(700000, ' ');
+    for (size_t i = 0; i < value1_1.size(); i++) value1_1[i] = (char) ('a' + i % 23);
+    for (size_t i = 0; i < value1_2.size(); i++) value1_2[i] = (char) ('A' + i % 19);
+    std::string value1_ret(VALUE1_DEFAULT_MAX_LEN + 1, ' ');
+    char value1_short[VALUE1_MAX_STR_SIZE]; int value2; float value3;
+
+    /* success: tuple with a long value1 is read back whole */
+    ASSERT_EQ(set_value(1, &value1_1[0], 1, 1.0f), SUCCESS);
+    ASSERT_EQ(get_value_sized(1, &value1_ret[0], value1_ret.size(), &value2, &value3), SUCCESS);
+    ASSERT_STREQ(value1_ret.c_str(), value1_1.c_str());
+    ASSERT_EQ(value2, 1);
+
+    /* error: value1 doesn't fit in the buffer get_value assumes */
+    ASSERT_EQ(get_value(1, value1_short, &value2, &value3), ERROR);
+
+    /* success: value1 grows, then shrinks back to a short one */
+    ASSERT_EQ(modify_value(1, &value1_2[0], 2, 2.0f), SUCCESS);
+    ASSERT_EQ(get_value_sized(1, &value1_ret[0], value1_ret.size(), &value2, &value3), SUCCESS);
+    ASSERT_STREQ(value1_ret.c_str(), value1_2.c_str());
+    char value1_3[] = "short again\0";
+    ASSERT_EQ(modify_value(1, value1_3, 3, 3.0f), SUCCESS);
+    ASSERT_EQ(get_value(1, value1_short, &value2, &value3), SUCCESS);
+    ASSERT_STREQ(value1_short, value1_3);
+
+    /* success: scans return long values through scan_next_item */
+    ASSERT_EQ(set_value(2, &value1_2[0], 4, 4.0f), SUCCESS);
+    scan_t scan;
+    const item_t *item;
+    ASSERT_EQ(scan_open(&scan, 2, 2), SUCCESS);
+    ASSERT_EQ(scan_next_item(&scan, &item), 1);
+    ASSERT_EQ(item->key, 2);
+    ASSERT_STREQ(item->value1, value1_2.c_str());
+    ASSERT_EQ(scan_next_item(&scan, &item), 0);
+    scan_close(&scan);
 }
 
 
@@ -229,3 +271,538 @@ TEST(keys_tests, test_num_items) {
     ASSERT_EQ(exist(key_3), EXISTS);        /* sanity check: tuple exists */
     ASSERT_EQ(num_items(), 3);
 }
+
+
+TEST(keys_tests, test_scan) {
+    /* testing scan iterator: going through a key range in order, across several pages;
+     * going through an empty range */
+
+    /* initial setup: inserting tuples in reverse key order, more than fit in a page */
+    init();
+    int num_tuples = 2 * SCAN_PAGE_ITEMS + 10;
+    for (int key = num_tuples - 1; key >= 0; key--) {
+        char value1[] = "hello\0";
+        set_value(key, value1, key * 10, (float) key);
+    }
+
+    /* success: every tuple in [5, num_tuples - 6] is read once, in key order */
+    scan_t scan;
+    int key; char value1[VALUE1_MAX_STR_SIZE]; int value2; float value3;
+    int expected_key = 5;
+
+    ASSERT_EQ(scan_open(&scan, 5, num_tuples - 6), SUCCESS);
+    while (scan_next(&scan, &key, value1, &value2, &value3) == 1) {
+        ASSERT_EQ(key, expected_key);
+        ASSERT_EQ(value2, key * 10);
+        expected_key++;
+    }
+    ASSERT_EQ(expected_key, num_tuples - 5);
+    scan_close(&scan);
+
+    /* success: no tuples in range */
+    ASSERT_EQ(scan_open(&scan, num_tuples, num_tuples + 100), SUCCESS);
+    ASSERT_EQ(scan_next(&scan, &key, value1, &value2, &value3), 0);
+    scan_close(&scan);
+}
+
+
+TEST(keys_tests, test_aggregate) {
+    /* testing aggregate service: computing every aggregate function over value2 & value3,
+     * over the whole DB and over a key range; aggregating an empty range */
+
+    /* initial setup: tuples with keys 1..100, value2 = key, value3 = key / 2 */
+    init();
+    for (int key = 1; key <= 100; key++) {
+        char value1[] = "hello\0";
+        set_value(key, value1, key, (float) key / 2);
+    }
+    delete_key(50);
+    double result;
+
+    /* success: whole DB; key 50 was deleted, so it mustn't be aggregated */
+    ASSERT_EQ(aggregate(AGG_COUNT, FIELD_VALUE2, INT32_MIN, INT32_MAX, &result), 99);
+    ASSERT_EQ(result, 99);
+    ASSERT_EQ(aggregate(AGG_SUM, FIELD_VALUE2, INT32_MIN, INT32_MAX, &result), 99);
+    ASSERT_EQ(result, 5050 - 50);
+    ASSERT_EQ(aggregate(AGG_MIN, FIELD_VALUE2, INT32_MIN, INT32_MAX, &result), 99);
+    ASSERT_EQ(result, 1);
+    ASSERT_EQ(aggregate(AGG_MAX, FIELD_VALUE3, INT32_MIN, INT32_MAX, &result), 99);
+    ASSERT_EQ(result, 50.0);
+
+    /* success: key range [11, 20] */
+    ASSERT_EQ(aggregate(AGG_AVG, FIELD_VALUE2, 11, 20, &result), 10);
+    ASSERT_EQ(result, 15.5);
+    ASSERT_EQ(aggregate(AGG_SUM, FIELD_VALUE3, 11, 20, &result), 10);
+    ASSERT_EQ(result, 155 / 2.0);
+
+    /* success: no tuples in range */
+    ASSERT_EQ(aggregate(AGG_SUM, FIELD_VALUE2, 200, 300, &result), 0);
+
+    /* failure: invalid aggregate function */
+    ASSERT_EQ(aggregate('?', FIELD_VALUE2, INT32_MIN, INT32_MAX, &result), ERROR);
+}
+
+
+TEST(keys_tests, test_query) {
+    /* testing query iterator: going through the tuples whose value2 is in a range,
+     * ordered by value2, across several pages; fetching keys only */
+
+    /* initial setup: value2 = key % 10, so every value2 is shared by many tuples */
+    init();
+    int num_tuples = 500;
+    for (int key = 0; key < num_tuples; key++) {
+        char value1[] = "hello\0";
+        set_value(key, value1, key % 10, (float) key);
+    }
+    /* moving a tuple out of the queried range and deleting another */
+    char value1_1[] = "moved\0";
+    modify_value(3, value1_1, 100, 3.0f);
+    delete_key(4);
+
+    /* success: value2 in [3, 4] */
+    query_t query;
+    int key; char value1[VALUE1_MAX_STR_SIZE]; int value2; float value3;
+    int num_read = 0; int last_value2 = 3;
+
+    ASSERT_EQ(query_open(&query, 3, 4, FALSE), SUCCESS);
+    while (query_next(&query, &key, value1, &value2, &value3) == 1) {
+        ASSERT_EQ(value2, key % 10);
+        ASSERT_GE(value2, last_value2);     /* ordered by value2 */
+        ASSERT_NE(key, 3);
+        ASSERT_NE(key, 4);
+        last_value2 = value2;
+        num_read++;
+    }
+    ASSERT_EQ(num_read, 2 * num_tuples / 10 - 2);
+    query_close(&query);
+
+    /* success: keys only, single value2 */
+    num_read = 0;
+    ASSERT_EQ(query_open(&query, 100, 100, TRUE), SUCCESS);
+    while (query_next(&query, &key, NULL, NULL, NULL) == 1) {
+        ASSERT_EQ(key, 3);
+        num_read++;
+    }
+    ASSERT_EQ(num_read, 1);
+    query_close(&query);
+}
+
+TEST(keys_tests, test_search) {
+    /* testing value1 search: exact, prefix & substring matches, and more matches than fit in one chunk */
+
+    /* initial setup: value1 = "item-<key>-end" */
+    init();
+    int num_tuples = 1500;
+    for (int key = 0; key < num_tuples; key++) {
+        char value1[VALUE1_MAX_STR_SIZE];
+        sprintf(value1, "item-%d-end", key);
+        set_value(key, value1, key, (float) key);
+    }
+    char value1_1[] = "a much longer value that no longer ends the same way\0";
+    modify_value(7, value1_1, 7, 7.0f);
+    delete_key(8);
+
+    int keys[2000];
+
+    /* success: exact match */
+    ASSERT_EQ(search(SEARCH_EXACT, (char *) "item-42-end", keys, 2000), 1);
+    ASSERT_EQ(keys[0], 42);
+    ASSERT_EQ(search(SEARCH_EXACT, (char *) "item-42", keys, 2000), 0);
+
+    /* success: prefix match (items 12 & 120-129, but not the deleted/modified ones) */
+    ASSERT_EQ(search(SEARCH_PREFIX, (char *) "item-12", keys, 2000), 1 + 10 + 100);
+
+    /* success: substring match, streamed in several chunks */
+    ASSERT_EQ(search(SEARCH_SUBSTRING, (char *) "-end", keys, 2000), num_tuples - 2);
+    ASSERT_EQ(search(SEARCH_SUBSTRING, (char *) "same way", keys, 2000), 1);
+    ASSERT_EQ(keys[0], 7);
+    ASSERT_EQ(search(SEARCH_SUBSTRING, (char *) "8-e", keys, 10), 150 - 1);   /* only 10 keys stored */
+
+    /* error: invalid mode */
+    ASSERT_EQ(search('z', (char *) "item", keys, 2000), ERROR);
+}
+
+TEST(keys_tests, test_incr_add) {
+    /* testing atomic increments of value2 & additions to value3, including concurrent ones */
+
+    /* initial setup */
+    init();
+    char value1[] = "counter\0";
+    set_value(1, value1, 10, 1.5f);
+    set_value(2, value1, INT32_MAX, 0.0f);
+
+    /* success */
+    int value2; float value3;
+    ASSERT_EQ(incr_value(1, 5, &value2), SUCCESS);
+    ASSERT_EQ(value2, 15);
+    ASSERT_EQ(incr_value(1, -20, &value2), SUCCESS);
+    ASSERT_EQ(value2, -5);
+    ASSERT_EQ(add_value(1, 0.25f, &value3), SUCCESS);
+    ASSERT_FLOAT_EQ(value3, 1.75f);
+
+    /* other values are left untouched */
+    char value1_1[VALUE1_MAX_STR_SIZE];
+    ASSERT_EQ(get_value(1, value1_1, &value2, &value3), SUCCESS);
+    ASSERT_STREQ(value1_1, value1);
+    ASSERT_EQ(value2, -5);
+    ASSERT_FLOAT_EQ(value3, 1.75f);
+
+    /* success: increments from concurrent clients aren't lost */
+    for (int i = 0; i < 4; i++) {
+        if (fork() == 0) {
+            int value;
+            for (int j = 0; j < 50; j++) incr_value(1, 1, &value);
+            _exit(0);
+        }
+    }
+    while (wait(NULL) > 0);
+    ASSERT_EQ(get_value(1, value1_1, &value2, &value3), SUCCESS);
+    ASSERT_EQ(value2, -5 + 4 * 50);
+
+    /* error: key doesn't exist */
+    ASSERT_EQ(incr_value(3, 1, &value2), ERROR);
+    ASSERT_EQ(add_value(3, 1.0f, &value3), ERROR);
+
+    /* error: value2 overflow */
+    ASSERT_EQ(incr_value(2, 1, &value2), ERROR);
+}
+
+TEST(keys_tests, test_upsert_cas) {
+    /* testing versions returned by get, upserts and compare-and-swap writes */
+
+    /* initial setup */
+    init();
+    char value1[] = "first\0";
+    char value1_1[] = "second\0";
+    char value1_2[VALUE1_MAX_STR_SIZE]; int value2; float value3;
+    uint32_t version, version_1;
+
+    /* success: upsert creates the tuple, then modifies it */
+    ASSERT_EQ(upsert_value(1, value1, 1, 1.0f, &version), SUCCESS);
+    ASSERT_EQ(version, 1u);
+    ASSERT_EQ(upsert_value(1, value1_1, 2, 2.0f, &version), SUCCESS);
+    ASSERT_EQ(version, 2u);
+
+    /* success: get returns the version, which any write bumps */
+    ASSERT_EQ(modify_value(1, value1, 3, 3.0f), SUCCESS);
+    ASSERT_EQ(get_value_version(1, value1_2, &value2, &value3, &version), SUCCESS);
+    ASSERT_STREQ(value1_2, value1);
+    ASSERT_EQ(value2, 3);
+    ASSERT_EQ(version, 3u);
+
+    /* success: CAS with the current version */
+    version_1 = version;
+    ASSERT_EQ(cas_value(1, &version, value1_1, 4, 4.0f), SUCCESS);
+    ASSERT_EQ(version, 4u);
+
+    /* conflict: CAS with a stale version leaves the tuple alone and returns the current version */
+    ASSERT_EQ(cas_value(1, &version_1, value1, 5, 5.0f), 1);
+    ASSERT_EQ(version_1, 4u);
+    ASSERT_EQ(get_value(1, value1_2, &value2, &value3), SUCCESS);
+    ASSERT_STREQ(value1_2, value1_1);
+    ASSERT_EQ(value2, 4);
+
+    /* success: versions start over when a tuple is deleted and created again */
+    ASSERT_EQ(delete_key(1), SUCCESS);
+    ASSERT_EQ(set_value(1, value1, 1, 1.0f), SUCCESS);
+    ASSERT_EQ(get_value_version(1, value1_2, &value2, &value3, &version), SUCCESS);
+    ASSERT_EQ(version, 1u);
+
+    /* error: CAS on a key that doesn't exist */
+    ASSERT_EQ(cas_value(2, &version, value1, 1, 1.0f), ERROR);
+}
+
+TEST(keys_tests, test_txn) {
+    /* testing transactions: moving a value between keys atomically, and rolling back failed ones */
+
+    /* initial setup */
+    init();
+    char value1[] = "account\0";
+    set_value(1, value1, 100, 0.0f);
+    set_value(2, value1, 50, 0.0f);
+    char value1_1[VALUE1_MAX_STR_SIZE]; int value2; float value3; uint32_t version;
+
+    /* success: read both keys, then move 30 from one to the other, guarded by their versions */
+    txn_op_t ops[4] = {};
+    ops[0].op_code = GET_VALUE; ops[0].item.key = 1;
+    ops[1].op_code = GET_VALUE; ops[1].item.key = 2;
+    ASSERT_EQ(txn(ops, 2), SUCCESS);
+    ASSERT_EQ(ops[0].result, SRV_SUCCESS);
+    ASSERT_EQ(ops[0].item.value2, 100);
+    ASSERT_EQ(ops[1].item.value2, 50);
+
+    ops[0].op_code = TXN_COMPARE;
+    ops[1].op_code = TXN_COMPARE;
+    ops[2].op_code = MODIFY_VALUE; ops[2].item.key = 1; ops[2].item.value1 = value1; ops[2].item.value2 = 70;
+    ops[3].op_code = MODIFY_VALUE; ops[3].item.key = 2; ops[3].item.value1 = value1; ops[3].item.value2 = 80;
+    ASSERT_EQ(txn(ops, 4), SUCCESS);
+    for (auto &op: ops) ASSERT_EQ(op.result, SRV_SUCCESS);
+    ASSERT_EQ(get_value(1, value1_1, &value2, &value3), SUCCESS);
+    ASSERT_EQ(value2, 70);
+    ASSERT_EQ(get_value(2, value1_1, &value2, &value3), SUCCESS);
+    ASSERT_EQ(value2, 80);
+
+    /* conflict: versions are stale now, so nothing is written */
+    ops[2].item.value2 = 0;
+    ASSERT_EQ(txn(ops, 4), 1);
+    ASSERT_EQ(ops[0].result, SRV_CONFLICT);
+    ASSERT_EQ(ops[3].result, SRV_ABORTED);
+    ASSERT_EQ(get_value(1, value1_1, &value2, &value3), SUCCESS);
+    ASSERT_EQ(value2, 70);
+
+    /* error: a failed sub-operation rolls back the previous ones, versions included */
+    ASSERT_EQ(get_value_version(1, value1_1, &value2, &value3, &version), SUCCESS);
+    ops[0].op_code = DELETE_KEY; ops[0].item.key = 1;
+    ops[1].op_code = SET_VALUE; ops[1].item.key = 3; ops[1].item.value1 = value1; ops[1].item.value2 = 3;
+    ops[2].op_code = MODIFY_VALUE; ops[2].item.key = 2; ops[2].item.value2 = 0;
+    ops[3].op_code = SET_VALUE; ops[3].item.key = 2;   /* already exists */
+    ASSERT_EQ(txn(ops, 4), ERROR);
+    ASSERT_EQ(ops[0].result, SRV_ABORTED);
+    ASSERT_EQ(ops[3].result, SRV_ERROR);
+    uint32_t version_1;
+    ASSERT_EQ(get_value_version(1, value1_1, &value2, &value3, &version_1), SUCCESS);
+    ASSERT_EQ(value2, 70);
+    ASSERT_EQ(version_1, version);
+    ASSERT_EQ(exist(3), NOT_EXISTS);
+    ASSERT_EQ(get_value(2, value1_1, &value2, &value3), SUCCESS);
+    ASSERT_EQ(value2, 80);
+    ASSERT_EQ(num_items(), 2);
+}
+
+TEST(keys_tests, test_batch) {
+    /* testing batches: independent operations, each with its own result */
+
+    /* initial setup */
+    init();
+    char value1[] = "batched\0";
+    set_value(1, value1, 10, 1.0f);
+
+    /* success & error: operations run on their own, so failing ones don't undo the others */
+    txn_op_t ops[4] = {};
+    ops[0].op_code = SET_VALUE; ops[0].item.key = 2; ops[0].item.value1 = value1; ops[0].item.value2 = 20;
+    ops[1].op_code = SET_VALUE; ops[1].item.key = 1; ops[1].item.value1 = value1;   /* already exists */
+    ops[2].op_code = GET_VALUE; ops[2].item.key = 1;
+    ops[3].op_code = DELETE_KEY; ops[3].item.key = 3;                                       /* doesn't exist */
+    ASSERT_EQ(batch(ops, 4), 2);
+    ASSERT_EQ(ops[0].result, SRV_SUCCESS);
+    ASSERT_EQ(ops[1].result, SRV_ERROR);
+    ASSERT_EQ(ops[2].result, SRV_SUCCESS);
+    ASSERT_EQ(ops[2].item.value2, 10);
+    ASSERT_EQ(ops[2].item.version, 1u);
+    ASSERT_EQ(ops[3].result, SRV_ERROR);
+    ASSERT_EQ(exist(2), EXISTS);
+
+    /* success: empty batch */
+    ASSERT_EQ(batch(ops, 0), 0);
+}
+
+
+TEST(keys_tests, test_watch) {
+    /* testing the change feed: changes pushed for a key range, and resuming after reconnecting */
+
+    /* initial setup */
+    init();
+    char value1[] = "watched\0";
+    watch_t watch;
+    change_t change;
+
+    /* success: only changes to keys in [10, 20] are pushed, in commit order */
+    ASSERT_EQ(watch_open(&watch, 10, 20, 0), SUCCESS);
+    uint64_t first_seq = watch.next_seq;
+    set_value(5, value1, 5, 5.0f);
+    set_value(10, value1, 10, 10.0f);
+    modify_value(10, value1, 11, 11.0f);
+    set_value(30, value1, 30, 30.0f);
+    delete_key(10);
+
+    ASSERT_EQ(watch_next(&watch, &change), SUCCESS);
+    ASSERT_EQ(change.op_code, SET_VALUE);
+    ASSERT_EQ(change.seq, first_seq + 1);   /* key 5 was skipped */
+    ASSERT_EQ(change.item.key, 10);
+    ASSERT_EQ(change.item.value2, 10);
+    ASSERT_STREQ(change.item.value1, value1);
+    ASSERT_EQ(change.item.version, 1u);
+
+    ASSERT_EQ(watch_next(&watch, &change), SUCCESS);
+    ASSERT_EQ(change.op_code, MODIFY_VALUE);
+    ASSERT_EQ(change.item.value2, 11);
+    ASSERT_EQ(change.item.version, 2u);
+
+    ASSERT_EQ(watch_next(&watch, &change), SUCCESS);
+    ASSERT_EQ(change.op_code, DELETE_KEY);
+    ASSERT_EQ(change.item.key, 10);
+    ASSERT_EQ(change.seq, first_seq + 4);
+    watch_close(&watch);
+
+    /* success: changes committed while disconnected are replayed when resuming */
+    set_value(15, value1, 15, 15.0f);
+    ASSERT_EQ(watch_open(&watch, 10, 20, watch.next_seq), SUCCESS);
+    ASSERT_EQ(watch_next(&watch, &change), SUCCESS);
+    ASSERT_EQ(change.op_code, SET_VALUE);
+    ASSERT_EQ(change.item.key, 15);
+    watch_close(&watch);
+}
+
+
+TEST(keys_tests, test_replication) {
+    /* testing reads served by a replica; needs a server started with -r <primary> listening at TEST_REPLICA */
+    const char *replica = getenv("TEST_REPLICA");
+    if (!replica) GTEST_SKIP() << "TEST_REPLICA not set";
+
+    /* initial setup: reads go to the replica from now on */
+    init();
+    char value1[] = "replicated\0";
+    char value1_ret[VALUE1_MAX_STR_SIZE];
+    int value2_ret;
+    float value3_ret;
+    uint32_t version;
+    uint64_t applied_seq, lag;
+
+    /* the replica may still be applying the changes of earlier tests: wait for it to catch up with this init */
+    watch_t watch;
+    ASSERT_EQ(watch_open(&watch, 0, 0, 0), SUCCESS);
+    uint64_t init_seq = watch.next_seq - 1;
+    watch_close(&watch);
+    setenv("REPLICAS_TUPLES", replica, 1);
+    for (int i = 0; i < 1000 && (replica_status(0, &applied_seq, &lag) != 0 || applied_seq < init_seq); i++)
+        usleep(10000);
+
+    /* success: writes made on the primary show up on the replica, versions included */
+    set_value(1, value1, 1, 1.0f);
+    modify_value(1, value1, 2, 2.0f);
+    set_value(2, value1, 3, 3.0f);
+    for (int i = 0; i < 500 && (replica_status(0, &applied_seq, &lag) != 0 || exist(2) != 1); i++) usleep(10000);
+    ASSERT_EQ(get_value_version(1, value1_ret, &value2_ret, &value3_ret, &version), SUCCESS);
+    ASSERT_STREQ(value1_ret, value1);
+    ASSERT_EQ(value2_ret, 2);
+    ASSERT_EQ(version, 2u);
+    ASSERT_EQ(num_items(), 2);
+
+    /* success: deletions are replicated too */
+    delete_key(1);
+    for (int i = 0; i < 500 && exist(1) != 0; i++) usleep(10000);
+    ASSERT_EQ(exist(1), 0);
+
+    /* success: the replica is caught up */
+    ASSERT_EQ(replica_status(0, &applied_seq, &lag), SUCCESS);
+    ASSERT_EQ(lag, 0u);
+    ASSERT_GT(applied_seq, 0u);
+
+    /* error: replicas don't accept writes */
+    const char *primary_ip = getenv("IP_TUPLES");
+    const char *primary_port = getenv("PORT_TUPLES");
+    std::string primary[2] = {primary_ip, primary_port};
+    std::string replica_str(replica);
+    size_t colon = replica_str.rfind(':');
+    setenv("IP_TUPLES", replica_str.substr(0, colon).c_str(), 1);
+    setenv("PORT_TUPLES", replica_str.substr(colon + 1).c_str(), 1);
+    ASSERT_EQ(set_value(3, value1, 3, 3.0f), ERROR);
+    setenv("IP_TUPLES", primary[0].c_str(), 1);
+    setenv("PORT_TUPLES", primary[1].c_str(), 1);
+
+    /* error: the primary has no replication status */
+    setenv("REPLICAS_TUPLES", (primary[0] + ":" + primary[1]).c_str(), 1);
+    ASSERT_EQ(replica_status(0, &applied_seq, &lag), ERROR);
+    unsetenv("REPLICAS_TUPLES");
+}
+
+
+TEST(keys_tests, test_sharding) {
+    /* testing a key space split across several servers; needs servers listening at TEST_SERVERS (host:port,...) */
+    const char *servers = getenv("TEST_SERVERS");
+    if (!servers) GTEST_SKIP() << "TEST_SERVERS not set";
+
+    /* initial setup: tuples go to every server from now on */
+    setenv("SERVERS_TUPLES", servers, 1);
+    ASSERT_EQ(init(), SUCCESS);
+    char value1[] = "sharded\0";
+    int num_tuples = 3 * SCAN_PAGE_ITEMS + 7;
+    txn_op_t ops[8] = {};
+    char values1[8][VALUE1_MAX_STR_SIZE];
+    for (int key = 0; key < num_tuples; key += 8) {
+        int num_ops = 0;
+        for (; num_ops < 8 && key + num_ops < num_tuples; num_ops++) {
+            ops[num_ops].op_code = SET_VALUE;
+            ops[num_ops].item.key = key + num_ops;
+            ops[num_ops].item.value1 = values1[num_ops];
+            sprintf(values1[num_ops], "%s%d", value1, key + num_ops);
+            ops[num_ops].item.value2 = -(key + num_ops);
+            ops[num_ops].item.value3 = 1.0f;
+        }
+        ASSERT_EQ(batch(ops, num_ops), 0);
+    }
+
+    /* success: every tuple is found on its server, and counted once */
+    ASSERT_EQ(num_items(), num_tuples);
+    char value1_ret[VALUE1_MAX_STR_SIZE]; int value2; float value3;
+    for (int key = 0; key < num_tuples; key++) {
+        ASSERT_EQ(get_value(key, value1_ret, &value2, &value3), SUCCESS);
+        ASSERT_EQ(value2, -key);
+    }
+
+    /* success: scans merge every server's tuples in key order */
+    scan_t scan;
+    int key, expected_key = 0;
+    ASSERT_EQ(scan_open(&scan, INT32_MIN, INT32_MAX), SUCCESS);
+    while (scan_next(&scan, &key, value1_ret, &value2, &value3) == 1) ASSERT_EQ(key, expected_key++);
+    ASSERT_EQ(expected_key, num_tuples);
+
+    /* success: value2 queries merge them in value2 order */
+    query_t query;
+    expected_key = num_tuples - 1;
+    ASSERT_EQ(query_open(&query, INT32_MIN, INT32_MAX, TRUE), SUCCESS);
+    while (query_next(&query, &key, value1_ret, &value2, &value3) == 1) ASSERT_EQ(key, expected_key--);
+    ASSERT_EQ(expected_key, -1);
+
+    /* success: aggregations & searches combine every server's results */
+    double result;
+    ASSERT_EQ(aggregate(AGG_SUM, FIELD_VALUE3, INT32_MIN, INT32_MAX, &result), num_tuples);
+    ASSERT_DOUBLE_EQ(result, num_tuples);
+    ASSERT_EQ(aggregate(AGG_MIN, FIELD_VALUE2, INT32_MIN, INT32_MAX, &result), num_tuples);
+    ASSERT_DOUBLE_EQ(result, -(num_tuples - 1));
+    ASSERT_EQ(aggregate(AGG_AVG, FIELD_VALUE3, 0, 9, &result), 10);
+    ASSERT_DOUBLE_EQ(result, 1.0);
+    int keys[2];
+    ASSERT_EQ(search(SEARCH_PREFIX, value1, keys, 2), num_tuples);
+
+    /* error: watches need a single server */
+    watch_t watch;
+    ASSERT_EQ(watch_open(&watch, 0, 10, 0), ERROR);
+    unsetenv("SERVERS_TUPLES");
+}
+
+
+TEST(keys_tests, test_server_stats) {
+    /* testing server metrics: requests served are counted per op_code, with their latencies */
+
+    /* initial setup */
+    init();
+    char value1[] = "counted\0";
+    char value1_ret[VALUE1_MAX_STR_SIZE];
+    int value2_ret;
+    float value3_ret;
+    server_stats_t before, after;
+    ASSERT_EQ(server_stats(0, &before), SUCCESS);
+
+    /* success: every request served shows up in the counters */
+    set_value(1, value1, 1, 1.0f);
+    for (int i = 0; i < 3; i++) get_value(1, value1_ret, &value2_ret, &value3_ret);
+    ASSERT_EQ(server_stats(0, &after), SUCCESS);
+
+    int set = SET_VALUE - INIT, get = GET_VALUE - INIT;
+    ASSERT_EQ(after.requests[set] - before.requests[set], 1u);
+    ASSERT_EQ(after.requests[get] - before.requests[get], 3u);
+    ASSERT_EQ(after.service[get].count - before.service[get].count, 3u);
+    ASSERT_EQ(after.end_to_end[get].count - before.end_to_end[get].count, 3u);
+    ASSERT_GE(after.end_to_end[get].total_ns, after.service[get].total_ns);
+    ASSERT_GT(after.requests[STATS - INIT], before.requests[STATS - INIT]);
+    ASSERT_GT(after.db_lock_wait.count, before.db_lock_wait.count);
+    ASSERT_GT(after.storage_io.count, before.storage_io.count);
+
+    uint64_t bucketed = 0;
+    for (int i = 0; i < STATS_BUCKETS; i++) bucketed += after.service[get].buckets[i];
+    ASSERT_EQ(bucketed, after.service[get].count);
+
+    /* error: there's no such server */
+    ASSERT_EQ(server_stats(1, &after), ERROR);
+}
@@ -0,0 +1,729 @@
+/* gtest.h declares the testing framework */
+#include "gtest/gtest.h"
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <ftw.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+extern "C" {
+#include "DS-MandatoryExercise/utils.h"
+#include "DS-MandatoryExercise/netUtils.h"
+#include "DS-MandatoryExercise/keys.h"
+#include "DS-MandatoryExercise/kvServer.h"
+#include "DS-MandatoryExercise/netRing.h"
+#include "DS-MandatoryExercise/metrics.h"
+#include "DS-MandatoryExercise/trace.h"
+#include "DS-MandatoryExercise/dbms/dbms.h"
+#include "DS-MandatoryExercise/dbms/ioRing.h"
+
+/* the server's watchers lock; tests hold it to keep a service thread starting a watch busy */
+extern pthread_mutex_t mutex_watchers;
+}
+
+/* test error codes */
+const int SUCCESS = 0;
+const int ERROR = -1;
+
+
+static void use_server(const int port) {
+    /* points the client API at the in-process server */
+    unsetenv("SERVERS_TUPLES");
+    unsetenv("REPLICAS_TUPLES");
+    setenv("IP_TUPLES", "localhost", 1);
+    setenv("PORT_TUPLES", std::to_string(port).c_str(), 1);
+}
+
+
+static int remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+    return remove(path);
+}
+
+
+class kv_server_tests : public ::testing::Test {
+protected:
+    /* every test gets its DB in a temp directory of its own, and sets config up before starting the server;
+     * the server is stopped & the directory removed after the test, even if it failed halfway */
+    char dir[sizeof("/tmp/kv_server_tests.XXXXXX")] = "/tmp/kv_server_tests.XXXXXX";
+    kv_server_config_t config;
+    int port = -1;
+
+    void SetUp() override {
+        ASSERT_NE(mkdtemp(dir), nullptr);
+        kv_server_default_config(&config);
+        config.port = 0;
+        config.storage_path = dir;
+    }
+
+    void TearDown() override {
+        kv_server_stop();
+        nftw(dir, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    }
+
+    int start() {
+        /* starts the server with config, on a free port, and points the client API at it; returns the port */
+        port = kv_server_start(&config);
+        if (port > 0) use_server(port);
+        return port;
+    }
+
+    std::string path(const char *name) const {
+        return std::string(dir) + "/" + name;
+    }
+
+    void test_start_stop(int net_ring);
+};
+
+
+static server_stats_t wait_for_conn_q(const uint64_t taken, const uint64_t depth) {
+    /* waits, for up to 2 s, until service threads took taken connections from conn_q and depth are left in it */
+    server_stats_t stats;
+    for (int i = 0; i < 200; i++) {
+        metrics_read(&stats);
+        if (stats.conn_q_wait.count >= taken && stats.conn_q_depth == depth) break;
+        usleep(10000);
+    }
+    return stats;
+}
+
+
+void kv_server_tests::test_start_stop(const int net_ring) {
+    /* initial setup: a server with 2 service threads, or the ring if net_ring is TRUE */
+    config.threads = 2;
+    config.net_ring = net_ring;
+
+    /* success: the server picks a port and serves requests on it */
+    ASSERT_GT(start(), 0);
+    char value1[] = "kept\0";
+    ASSERT_EQ(init(), SUCCESS);
+    ASSERT_EQ(set_value(1, value1, 1, 1.0f), SUCCESS);
+
+    /* failure: only one server runs at a time */
+    ASSERT_EQ(kv_server_start(&config), ERROR);
+
+    /* success: once stopped, nothing is served; the DB stays in the storage path */
+    ASSERT_EQ(kv_server_stop(), SUCCESS);
+    ASSERT_EQ(exist(1), ERROR);
+    ASSERT_EQ(access(path(DB_NAME "/1").c_str(), F_OK), 0);
+
+    /* success: a server started again finds the items stored before */
+    ASSERT_GT(start(), 0);
+    char value1_ret[VALUE1_MAX_STR_SIZE];
+    int value2_ret;
+    float value3_ret;
+    ASSERT_EQ(get_value(1, value1_ret, &value2_ret, &value3_ret), SUCCESS);
+    ASSERT_STREQ(value1_ret, value1);
+}
+
+
+TEST_F(kv_server_tests, test_start_stop) {
+    /* testing an in-process server: started, stopped & started again */
+    test_start_stop(FALSE);
+}
+
+
+TEST_F(kv_server_tests, test_start_stop_net_ring) {
+    /* same, serving connections through io_uring; servers fall back to threads if it isn't available */
+    test_start_stop(TRUE);
+}
+
+
+TEST_F(kv_server_tests, test_slow_log) {
+    /* initial setup: a server logging every request as slow */
+    config.slow_us = 1;
+    unlink(SLOW_LOG_FILE_NAME);
+
+    ASSERT_GT(start(), 0);
+    char value1[] = "slow\0";
+    ASSERT_EQ(init(), SUCCESS);
+    ASSERT_EQ(set_value(1, value1, 1, 1.0f), SUCCESS);
+    ASSERT_EQ(exist(1), 1);
+    ASSERT_EQ(init(), SUCCESS);
+
+    /* success: requests served before the server stopped are in the log, one line each */
+    ASSERT_EQ(kv_server_stop(), SUCCESS);
+    std::ifstream log(SLOW_LOG_FILE_NAME);
+    ASSERT_TRUE(log.is_open());
+    std::stringstream contents;
+    contents << log.rdbuf();
+    ASSERT_NE(contents.str().find(" set_value "), std::string::npos);
+    ASSERT_NE(contents.str().find(" exist "), std::string::npos);
+
+    /* clean up */
+    ASSERT_EQ(unlink(SLOW_LOG_FILE_NAME), 0);
+}
+
+
+static int idle_connection(const int port) {
+    /* connection to the server that never sends its request, keeping a service thread or conn_q busy */
+    int sd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(sd, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+        close(sd); return -1;
+    }
+    return sd;
+}
+
+
+TEST_F(kv_server_tests, test_admission_control) {
+    /* initial setup: a server with a single service thread and room for a single connection in conn_q */
+    config.threads = 1;
+    config.queue_limit = 1;
+
+    ASSERT_GT(start(), 0);
+    ASSERT_EQ(init(), SUCCESS);
+
+    /* error: with the service thread & conn_q taken, requests are rejected until the client gives up */
+    uint64_t taken = wait_for_conn_q(0, 0).conn_q_wait.count;
+    int serving = idle_connection(port);
+    ASSERT_NE(serving, -1);
+    ASSERT_EQ(wait_for_conn_q(taken + 1, 0).conn_q_wait.count, taken + 1);
+    int queued = idle_connection(port);
+    ASSERT_NE(queued, -1);
+    ASSERT_EQ(wait_for_conn_q(taken + 1, 1).conn_q_depth, 1u);
+    char value1[] = "busy\0";
+    ASSERT_EQ(set_value(1, value1, 1, 1.0f), ERROR);
+
+    /* success: requests are served again once there's room */
+    close(serving);
+    close(queued);
+    ASSERT_EQ(set_value(1, value1, 1, 1.0f), SUCCESS);
+    server_stats_t stats;
+    ASSERT_EQ(server_stats(0, &stats), SUCCESS);
+    ASSERT_GT(stats.conn_q_full, 0u);
+}
+
+
+static int raw_set(const int port, const int key, char *value1) {
+    /* sends a set request without waiting for its reply; returns the connection, -1 on error */
+    int sd = idle_connection(port);
+    if (sd == -1) return -1;
+    request_t request = {};
+    request.header.op_code = SET_VALUE;
+    request.item.key = key;
+    request.item.value1 = value1;
+    if (send_request_header(sd, &request.header) == -1 || send_key(sd, &request.item) == -1 ||
+        send_values(sd, &request.item) == -1) return -1;
+    return sd;
+}
+
+
+static int raw_watch(const int port, const int key) {
+    /* sends a watch request on key without waiting for its reply; returns the connection, -1 on error */
+    int sd = idle_connection(port);
+    if (sd == -1) return -1;
+    request_t request = {};
+    request.header.op_code = WATCH;
+    request.range.lo = request.range.hi = key;
+    if (send_request_header(sd, &request.header) == -1 || send_range(sd, &request.range) == -1 ||
+        send_watch(sd, &request) == -1) return -1;
+    return sd;
+}
+
+
+static int32_t raw_reply(const int sd) {
+    /* server error code of the reply to a request sent by raw_set or raw_watch */
+    reply_t reply;
+    int32_t result = recv_reply_header(sd, &reply) == -1 ? SRV_ERROR : reply.server_error_code;
+    close(sd);
+    return result;
+}
+
+
+TEST_F(kv_server_tests, test_net_ring_limits) {
+    /* initial setup: the ring with a single service thread, room for a single request waiting for it,
+     * and requests taking a single value1 of the longest length at most */
+    config.net_ring = TRUE;
+    config.threads = 1;
+    config.queue_limit = 1;
+    config.request_max_len = (int) get_value1_max_len() + 64;
+
+    ASSERT_GT(start(), 0);
+    if (!net_ring_in_use()) GTEST_SKIP() << "io_uring networking not available";
+    ASSERT_EQ(init(), SUCCESS);
+
+    /* error: with the service thread starting a watch & a request waiting for it, requests are rejected
+     * until the client gives up */
+    char value1[] = "busy\0";
+    uint64_t taken = wait_for_conn_q(0, 0).conn_q_wait.count;
+    pthread_mutex_lock(&mutex_watchers);
+    int serving = raw_watch(port, 1);
+    ASSERT_NE(serving, -1);
+    ASSERT_EQ(wait_for_conn_q(taken + 1, 0).conn_q_wait.count, taken + 1);
+    int queued = raw_set(port, 2, value1);
+    ASSERT_NE(queued, -1);
+    ASSERT_EQ(wait_for_conn_q(taken + 1, 1).conn_q_depth, 1u);
+    ASSERT_EQ(set_value(3, value1, 3, 1.0f), ERROR);
+
+    /* success: the requests taken are served once the watch starts, and the rest again */
+    pthread_mutex_unlock(&mutex_watchers);
+    ASSERT_EQ(raw_reply(serving), SRV_SUCCESS);
+    ASSERT_EQ(raw_reply(queued), SRV_SUCCESS);
+    ASSERT_EQ(set_value(3, value1, 3, 1.0f), SUCCESS);
+    server_stats_t stats;
+    ASSERT_EQ(server_stats(0, &stats), SUCCESS);
+    ASSERT_GT(stats.conn_q_full, 0u);
+
+    /* success: a set of the longest value1 fits */
+    std::string value1_long(get_value1_max_len(), 'r');
+    ASSERT_EQ(set_value(4, &value1_long[0], 4, 1.0f), SUCCESS);
+
+    /* error: a txn setting two of them doesn't, and is refused whole */
+    txn_op_t ops[2] = {};
+    for (int i = 0; i < 2; i++) {
+        ops[i].op_code = SET_VALUE;
+        ops[i].item.key = 5 + i;
+        ops[i].item.value1 = &value1_long[0];
+    }
+    ASSERT_EQ(txn(ops, 2), ERROR);
+    ASSERT_EQ(exist(5), 0);
+    ASSERT_EQ(exist(4), 1);
+}
+
+
+TEST_F(kv_server_tests, test_deadline) {
+    /* initial setup: a server with a single service thread, and clients giving up after 50 ms */
+    config.threads = 1;
+
+    ASSERT_GT(start(), 0);
+    ASSERT_EQ(init(), SUCCESS);
+    set_request_timeout(50);
+
+    /* error: with the service thread taken, the request is still queued when the client gives up */
+    uint64_t taken = wait_for_conn_q(0, 0).conn_q_wait.count;
+    int serving = idle_connection(port);
+    ASSERT_NE(serving, -1);
+    ASSERT_EQ(wait_for_conn_q(taken + 1, 0).conn_q_wait.count, taken + 1);
+    char value1[] = "late\0";
+    ASSERT_EQ(set_value(1, value1, 1, 1.0f), ERROR);
+
+    /* success: once dequeued, the request is dropped instead of executed */
+    close(serving);
+    set_request_timeout(0);
+    ASSERT_EQ(exist(1), 0);
+    server_stats_t stats;
+    ASSERT_EQ(server_stats(0, &stats), SUCCESS);
+    ASSERT_EQ(stats.expired[SET_VALUE - INIT], 1u);
+}
+
+
+static int raw_modify(const int port, const int key, char *value1) {
+    /* modifies a tuple without going through the client API, as another client process would */
+    int sd = idle_connection(port);
+    if (sd == -1) return -1;
+    request_t request = {};
+    request.header.op_code = MODIFY_VALUE;
+    request.item.key = key;
+    request.item.value1 = value1;
+    reply_t reply;
+    if (send_request_header(sd, &request.header) == -1 || send_key(sd, &request.item) == -1 ||
+        send_values(sd, &request.item) == -1 || recv_reply_header(sd, &reply) == -1) return -1;
+    close(sd);
+    return reply.server_error_code == SRV_SUCCESS ? 0 : -1;
+}
+
+
+static int read_until(const int key, const char *expected, cache_stats_t *stats) {
+    /* reads key until its value1 is expected & the cache has served it, for up to 2 s */
+    cache_stats(stats);
+    uint64_t hits = stats->hits;
+    char value1[VALUE1_MAX_STR_SIZE];
+    int value2;
+    float value3;
+    for (int i = 0; i < 200; i++) {
+        if (get_value(key, value1, &value2, &value3) == -1) return -1;
+        cache_stats(stats);
+        if (!strcmp(value1, expected) && stats->hits > hits) return 0;
+        usleep(10000);
+    }
+    return -1;
+}
+
+
+TEST_F(kv_server_tests, test_read_cache) {
+    /* initial setup: a server granting leases long enough that only invalidations keep cached tuples fresh */
+    config.lease_ms = 60000;
+
+    ASSERT_GT(start(), 0);
+    ASSERT_EQ(init(), SUCCESS);
+    char value1[] = "cached\0";
+    ASSERT_EQ(set_value(1, value1, 1, 1.0f), SUCCESS);
+
+    /* success: once the server's feed is up, reads are served from the cache */
+    ASSERT_EQ(cache_enable(1 << 20), SUCCESS);
+    cache_stats_t stats;
+    ASSERT_EQ(read_until(1, value1, &stats), SUCCESS);
+    ASSERT_GT(stats.misses, 0u);
+    ASSERT_EQ(stats.entries, 1u);
+
+    /* success: a tuple modified by another client is invalidated by the server, and read again */
+    char modified[] = "modified\0";
+    ASSERT_EQ(raw_modify(port, 1, modified), SUCCESS);
+    ASSERT_EQ(read_until(1, modified, &stats), SUCCESS);
+    ASSERT_GT(stats.invalidations, 0u);
+
+    /* success: the cache stays under its budget, evicting the least recently used tuples */
+    cache_disable();
+    ASSERT_EQ(cache_enable(256), SUCCESS);
+    ASSERT_EQ(read_until(1, modified, &stats), SUCCESS);
+    for (int key = 2; key < 10; key++) {
+        /* a read is only cached if the invalidation of the write before it didn't arrive meanwhile */
+        ASSERT_EQ(set_value(key, value1, key, 1.0f), SUCCESS);
+        ASSERT_EQ(read_until(key, value1, &stats), SUCCESS);
+    }
+    cache_stats(&stats);
+    ASSERT_LE(stats.bytes, 256u);
+    ASSERT_GT(stats.evictions, 0u);
+
+    /* clean up */
+    cache_disable();
+}
+
+
+TEST_F(kv_server_tests, test_hot_keys) {
+    /* initial setup: a server pinning the 4 most read keys, with tuples read more or less often */
+    config.hot_keys = 4;
+
+    ASSERT_GT(start(), 0);
+    ASSERT_EQ(init(), SUCCESS);
+    char value1[] = "hot\0";
+    char value1_ret[VALUE1_MAX_STR_SIZE];
+    int value2_ret;
+    float value3_ret;
+    for (int key = 1; key < 10; key++) ASSERT_EQ(set_value(key, value1, key, 1.0f), SUCCESS);
+    for (int i = 0; i < 20; i++) ASSERT_EQ(get_value(1, value1_ret, &value2_ret, &value3_ret), SUCCESS);
+    for (int i = 0; i < 10; i++) ASSERT_EQ(exist(2), 1);
+    for (int key = 3; key < 10; key++) ASSERT_EQ(get_value(key, value1_ret, &value2_ret, &value3_ret), SUCCESS);
+
+    /* success: the most read tuples are pinned, hottest first, and the GETs their copies served are counted */
+    server_stats_t stats;
+    ASSERT_EQ(server_stats(0, &stats), SUCCESS);
+    ASSERT_EQ(stats.hot_num_keys, 2u);
+    ASSERT_EQ(stats.hot_keys[0], 1u);
+    ASSERT_EQ(stats.hot_keys[1], 2u);
+    ASSERT_GT(stats.hot_counts[0], stats.hot_counts[1]);
+    ASSERT_GT(stats.hot_reads, 0u);
+    ASSERT_EQ(stats.hot_reads + stats.cold_reads, 27u);
+
+    /* success: pinned tuples are read from memory, without touching their key files */
+    ASSERT_EQ(unlink(path(DB_NAME "/1").c_str()), 0);
+    ASSERT_EQ(get_value(1, value1_ret, &value2_ret, &value3_ret), SUCCESS);
+    ASSERT_STREQ(value1_ret, value1);
+    ASSERT_EQ(exist(1), 1);
+
+    /* success: however long their value1 is, instead of it being sent from storage */
+    std::string long_value1(ZERO_COPY_MIN_LEN * 2, 'h');
+    std::string long_value1_ret(long_value1.size() + 1, '\0');
+    ASSERT_EQ(modify_value(2, (char *) long_value1.c_str(), 2, 1.0f), SUCCESS);
+    ASSERT_EQ(unlink(path(DB_NAME "/2").c_str()), 0);
+    ASSERT_EQ(get_value_sized(2, &long_value1_ret[0], long_value1_ret.size(), &value2_ret, &value3_ret), SUCCESS);
+    ASSERT_STREQ(long_value1_ret.c_str(), long_value1.c_str());
+
+    /* failure: every other tuple is read from its key file, which exist never needs */
+    ASSERT_EQ(unlink(path(DB_NAME "/3").c_str()), 0);
+    ASSERT_EQ(get_value(3, value1_ret, &value2_ret, &value3_ret), ERROR);
+    ASSERT_EQ(exist(3), 1);
+
+    /* success: INCR & ADD update the numbers in the key file header, without reading value1 or counting as reads */
+    ASSERT_EQ(server_stats(0, &stats), SUCCESS);
+    uint64_t reads = stats.hot_reads + stats.cold_reads;
+    ASSERT_EQ(incr_value(4, 10, &value2_ret), SUCCESS);
+    ASSERT_EQ(value2_ret, 14);
+    ASSERT_EQ(add_value(4, 0.5f, &value3_ret), SUCCESS);
+    ASSERT_FLOAT_EQ(value3_ret, 1.5f);
+    ASSERT_EQ(server_stats(0, &stats), SUCCESS);
+    ASSERT_EQ(stats.hot_reads + stats.cold_reads, reads);
+    ASSERT_EQ(get_value(4, value1_ret, &value2_ret, &value3_ret), SUCCESS);
+    ASSERT_STREQ(value1_ret, value1);
+    ASSERT_EQ(value2_ret, 14);
+    ASSERT_FLOAT_EQ(value3_ret, 1.5f);
+}
+
+
+TEST_F(kv_server_tests, test_compaction) {
+    /* initial setup: enough tuples that deleting most of them leaves the in-memory table to be compacted */
+
+    ASSERT_GT(start(), 0);
+    ASSERT_EQ(init(), SUCCESS);
+    for (int key = 0; key < 3000; key++) {
+        std::string value1 = "v" + std::to_string(key);
+        ASSERT_EQ(set_value(key, (char *) value1.c_str(), key, 1.0f), SUCCESS);
+    }
+
+    /* success: tuples modified while compactions run keep their latest values, whether they grew or not */
+    for (int key = 0; key < 2000; key++) {
+        ASSERT_EQ(delete_key(key), SUCCESS);
+        int modified = 2000 + key % 1000;
+        std::string value1 = (key < 1000 ? "modified v" : key % 2 ? "modified again v" : "mod v") +
+                             std::to_string(modified);
+        ASSERT_EQ(modify_value(modified, (char *) value1.c_str(), modified, 1.0f), SUCCESS);
+    }
+    ASSERT_EQ(num_items(), 1000);
+    double result;
+    ASSERT_EQ(aggregate(AGG_SUM, FIELD_VALUE2, INT32_MIN, INT32_MAX, &result), 1000);
+    ASSERT_EQ(result, 2499500.0);
+    for (int key = 2000; key < 3000; key++) {
+        char value1_ret[VALUE1_MAX_STR_SIZE];
+        int value2_ret;
+        float value3_ret;
+        ASSERT_EQ(get_value(key, value1_ret, &value2_ret, &value3_ret), SUCCESS);
+        ASSERT_STREQ(value1_ret, ((key % 2 ? "modified again v" : "mod v") + std::to_string(key)).c_str());
+    }
+    int keys[2];
+    char pattern[] = "modified again v2501";
+    ASSERT_EQ(search(SEARCH_EXACT, pattern, keys, 2), 1);
+    ASSERT_EQ(keys[0], 2501);
+}
+
+
+static off_t file_size(const std::string &path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == -1 ? -1 : st.st_size;
+}
+
+
+static int check_value1(const int key, const std::string &expected) {
+    /* reads key into a buffer big enough for value1 strings of any length; 0 if it holds expected */
+    std::string value1_ret(expected.size() + 1, '\0');
+    int value2_ret;
+    float value3_ret;
+    if (get_value_sized(key, &value1_ret[0], value1_ret.size(), &value2_ret, &value3_ret) == -1) return -1;
+    return strcmp(value1_ret.c_str(), expected.c_str()) == 0 && value2_ret == key ? 0 : -1;
+}
+
+
+TEST_F(kv_server_tests, test_page_engine) {
+    /* initial setup: a server storing tuples in the page file */
+    std::string pages = path(DB_PAGES_NAME);
+    config.engine = PAGE_ENGINE;
+
+    ASSERT_GT(start(), 0);
+    ASSERT_EQ(init(), SUCCESS);
+
+    /* success: slots freed by deletions are reused, so the page file doesn't grow with every round */
+    off_t size = -1;
+    for (int round = 0; round < 20; round++) {
+        for (int key = 0; key < 500; key++) {
+            std::string value1 = "round " + std::to_string(round) + " v" + std::to_string(key);
+            ASSERT_EQ(set_value(round * 500 + key, (char *) value1.c_str(), round * 500 + key, 1.0f), SUCCESS);
+        }
+        if (size == -1) size = file_size(pages);
+        for (int key = 0; key < 500; key++) ASSERT_EQ(delete_key(round * 500 + key), SUCCESS);
+    }
+    ASSERT_EQ(num_items(), 0);
+    ASSERT_EQ(file_size(pages), size);
+
+    /* success: a tuple that outgrows its record is moved, to another page once its own is full */
+    std::string small = "s";
+    ASSERT_EQ(set_value(1, (char *) small.c_str(), 1, 1.0f), SUCCESS);
+    for (int key = 2; key < 100; key++) {
+        std::string value1(40, 'f');
+        ASSERT_EQ(set_value(key, (char *) value1.c_str(), key, 1.0f), SUCCESS);
+    }
+    std::string grown(1000, 'g');
+    ASSERT_EQ(modify_value(1, (char *) grown.c_str(), 1, 2.0f), SUCCESS);
+    ASSERT_EQ(check_value1(1, grown), SUCCESS);
+    ASSERT_EQ(check_value1(2, std::string(40, 'f')), SUCCESS);
+
+    /* success: value1 strings over 1 KiB go to extents, including ones sent straight from the page file,
+     * and extents freed by later writes are reused */
+    std::string extent(3000, 'e');
+    std::string long_extent(200000, 'l');
+    ASSERT_EQ(modify_value(1, (char *) extent.c_str(), 1, 3.0f), SUCCESS);
+    ASSERT_EQ(check_value1(1, extent), SUCCESS);
+    ASSERT_EQ(set_value(100, (char *) long_extent.c_str(), 100, 1.0f), SUCCESS);
+    ASSERT_EQ(check_value1(100, long_extent), SUCCESS);
+    for (int i = 0; i < 20; i++) {
+        /* the new extent is written before the old one is freed, so the file holds two from the first write on */
+        if (i == 2) size = file_size(pages);
+        long_extent[0] = (char) ('a' + i);
+        ASSERT_EQ(modify_value(100, (char *) long_extent.c_str(), 100, 1.0f), SUCCESS);
+    }
+    ASSERT_EQ(check_value1(100, long_extent), SUCCESS);
+    ASSERT_EQ(file_size(pages), size);
+    ASSERT_EQ(modify_value(1, (char *) small.c_str(), 1, 4.0f), SUCCESS);
+    ASSERT_EQ(check_value1(1, small), SUCCESS);
+
+    /* success: INCR & ADD update the record header in place, leaving the extent where it is */
+    int value2_ret;
+    float value3_ret;
+    ASSERT_EQ(incr_value(100, 5, &value2_ret), SUCCESS);
+    ASSERT_EQ(value2_ret, 105);
+    ASSERT_EQ(add_value(100, 1.0f, &value3_ret), SUCCESS);
+    ASSERT_FLOAT_EQ(value3_ret, 2.0f);
+    ASSERT_EQ(file_size(pages), size);
+
+    /* success: a server started again finds the tuples stored before, long ones sent a chunk at a time */
+    ASSERT_EQ(kv_server_stop(), SUCCESS);
+    config.zero_copy = FALSE;
+    ASSERT_GT(start(), 0);
+    ASSERT_EQ(num_items(), 100);
+    ASSERT_EQ(check_value1(1, small), SUCCESS);
+    for (int key = 2; key < 100; key++) ASSERT_EQ(check_value1(key, std::string(40, 'f')), SUCCESS);
+    ASSERT_EQ(incr_value(100, -5, &value2_ret), SUCCESS);
+    ASSERT_EQ(value2_ret, 100);
+    ASSERT_EQ(check_value1(100, long_extent), SUCCESS);
+
+    /* success: searches match the part of value1 strings past the prefix kept in memory too */
+    std::string needle = std::string(100, 'f') + "needle";
+    ASSERT_EQ(set_value(101, (char *) needle.c_str(), 101, 1.0f), SUCCESS);
+    int keys[3];
+    char substring[] = "needle";
+    ASSERT_EQ(search(SEARCH_SUBSTRING, substring, keys, 3), 1);
+    ASSERT_EQ(keys[0], 101);
+    ASSERT_EQ(search(SEARCH_PREFIX, (char *) needle.substr(0, 103).c_str(), keys, 3), 1);
+    ASSERT_EQ(search(SEARCH_EXACT, (char *) needle.c_str(), keys, 3), 1);
+    ASSERT_EQ(search(SEARCH_EXACT, (char *) needle.substr(0, 105).c_str(), keys, 3), 0);
+    ASSERT_EQ(search(SEARCH_PREFIX, (char *) std::string(41, 'f').c_str(), keys, 3), 1);
+}
+
+
+TEST_F(kv_server_tests, test_search_len) {
+    /* initial setup: tuples whose value1 only matches past the prefix kept in memory by default */
+    ASSERT_GT(start(), 0);
+    ASSERT_EQ(init(), SUCCESS);
+    for (int key = 1; key <= 10; key++) {
+        std::string value1 = std::string(100, 'a') + (key % 2 ? "odd" : "even");
+        ASSERT_EQ(set_value(key, (char *) value1.c_str(), key, 1.0f), SUCCESS);
+    }
+    int keys[10];
+    char substring[] = "odd";
+    server_stats_t before, after;
+
+    /* success: the prefix doesn't settle them, so every one is read from storage */
+    metrics_read(&before);
+    ASSERT_EQ(search(SEARCH_SUBSTRING, substring, keys, 10), 5);
+    metrics_read(&after);
+    ASSERT_EQ(after.storage_io.count - before.storage_io.count, 10u);
+
+    /* success: a server keeping 128 bytes of every value1 settles them from memory */
+    ASSERT_EQ(kv_server_stop(), SUCCESS);
+    config.search_len = 128;
+    ASSERT_GT(start(), 0);
+    metrics_read(&before);
+    ASSERT_EQ(search(SEARCH_SUBSTRING, substring, keys, 10), 5);
+    for (int i = 0; i < 5; i++) ASSERT_EQ(keys[i] % 2, 1);
+    ASSERT_EQ(search(SEARCH_EXACT, (char *) (std::string(100, 'a') + "even").c_str(), keys, 10), 5);
+    metrics_read(&after);
+    ASSERT_EQ(after.storage_io.count, before.storage_io.count);
+
+    /* error: the server refuses a negative length */
+    ASSERT_EQ(kv_server_stop(), SUCCESS);
+    config.search_len = -1;
+    ASSERT_EQ(kv_server_start(&config), ERROR);
+}
+
+
+static int io_uring_fd() {
+    /* descriptor of the only io_uring instance of the process; -1 if there's none */
+    DIR *fds = opendir("/proc/self/fd");
+    if (!fds) return -1;
+    int fd = -1;
+    struct dirent *entry;
+    while (fd == -1 && (entry = readdir(fds)) != nullptr) {
+        char link[64] = "";
+        std::string path = std::string("/proc/self/fd/") + entry->d_name;
+        if (readlink(path.c_str(), link, sizeof(link) - 1) > 0 && !strcmp(link, "anon_inode:[io_uring]"))
+            fd = atoi(entry->d_name);
+    }
+    closedir(fds);
+    return fd;
+}
+
+
+TEST_F(kv_server_tests, test_io_ring) {
+    /* initial setup: a server doing its file I/O through io_uring, if the kernel offers it */
+    config.io_ring = TRUE;
+
+    ASSERT_GT(start(), 0);
+    if (!io_ring_in_use()) GTEST_SKIP() << "io_uring not available";
+    ASSERT_EQ(init(), SUCCESS);
+    char value1[] = "ring\0";
+    char value1_mod[] = "modified\0";
+    char value1_ret[VALUE1_MAX_STR_SIZE];
+    int value2_ret;
+    float value3_ret;
+
+    /* success: key files are written, rewritten & removed through the ring */
+    for (int key = 1; key <= 100; key++) ASSERT_EQ(set_value(key, value1, key, 1.0f), SUCCESS);
+    ASSERT_EQ(modify_value(2, value1_mod, 20, 2.0f), SUCCESS);
+    ASSERT_EQ(delete_key(3), SUCCESS);
+    ASSERT_EQ(set_value(1, value1, 1, 1.0f), ERROR);
+    ASSERT_EQ(modify_value(3, value1_mod, 30, 3.0f), ERROR);
+    ASSERT_TRUE(io_ring_in_use());
+
+    /* success: a server started again reads every key file back through the ring */
+    ASSERT_EQ(kv_server_stop(), SUCCESS);
+    port = kv_server_start(&config);
+    ASSERT_GT(port, 0);
+    ASSERT_TRUE(io_ring_in_use());
+    use_server(port);
+    ASSERT_EQ(num_items(), 99);
+    ASSERT_EQ(get_value(2, value1_ret, &value2_ret, &value3_ret), SUCCESS);
+    ASSERT_STREQ(value1_ret, value1_mod);
+    ASSERT_EQ(value2_ret, 20);
+    ASSERT_EQ(exist(3), 0);
+    ASSERT_EQ(get_value(100, value1_ret, &value2_ret, &value3_ret), SUCCESS);
+    ASSERT_STREQ(value1_ret, value1);
+
+    /* success: a transaction's key files are written together at the end, a key written twice before that */
+    txn_op_t ops[4] = {};
+    for (int i = 0; i < 3; i++) {
+        ops[i].op_code = SET_VALUE; ops[i].item.key = 200 + i; ops[i].item.value1 = value1; ops[i].item.value2 = i;
+    }
+    ops[3].op_code = MODIFY_VALUE; ops[3].item.key = 200; ops[3].item.value1 = value1_mod; ops[3].item.value2 = 7;
+    ASSERT_EQ(txn(ops, 4), SUCCESS);
+    ASSERT_EQ(get_value(200, value1_ret, &value2_ret, &value3_ret), SUCCESS);
+    ASSERT_STREQ(value1_ret, value1_mod);
+    ASSERT_EQ(value2_ret, 7);
+    ASSERT_EQ(get_value(202, value1_ret, &value2_ret, &value3_ret), SUCCESS);
+    ASSERT_EQ(value2_ret, 2);
+
+    /* error: a failed sub-operation rolls back the writes deferred before it */
+    ops[0].item.key = 203;
+    ops[1].item.key = 204;
+    ops[2].item.key = 201;      /* already exists */
+    ASSERT_EQ(txn(ops, 3), ERROR);
+    ASSERT_EQ(ops[2].result, SRV_ERROR);
+    ASSERT_EQ(exist(203), 0);
+    ASSERT_EQ(exist(204), 0);
+    ASSERT_EQ(access(path(DB_NAME "/203").c_str(), F_OK), -1);
+    ASSERT_TRUE(io_ring_in_use());
+
+    /* success: once the ring fails before taking a request, the write is done with plain syscalls instead,
+     * and so is every later one */
+    int ring_fd = io_uring_fd();
+    ASSERT_GE(ring_fd, 0);
+    int null_fd = open("/dev/null", O_RDWR | O_CLOEXEC);
+    ASSERT_GE(null_fd, 0);
+    ASSERT_EQ(dup2(null_fd, ring_fd), ring_fd);
+    close(null_fd);
+    ASSERT_EQ(set_value(101, value1, 101, 1.0f), SUCCESS);
+    ASSERT_FALSE(io_ring_in_use());
+    ASSERT_EQ(modify_value(101, value1_mod, 102, 2.0f), SUCCESS);
+    ASSERT_EQ(delete_key(100), SUCCESS);
+
+    /* success: what was written with plain syscalls is there after a restart, now without the ring */
+    config.io_ring = FALSE;
+    ASSERT_EQ(kv_server_stop(), SUCCESS);
+    ASSERT_GT(start(), 0);
+    ASSERT_EQ(num_items(), 102);
+    ASSERT_EQ(get_value(200, value1_ret, &value2_ret, &value3_ret), SUCCESS);
+    ASSERT_STREQ(value1_ret, value1_mod);
+    ASSERT_EQ(get_value(101, value1_ret, &value2_ret, &value3_ret), SUCCESS);
+    ASSERT_STREQ(value1_ret, value1_mod);
+    ASSERT_EQ(value2_ret, 102);
+    ASSERT_EQ(exist(100), 0);
+}